@@ -0,0 +1,204 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+/*
+   Runs the analysis pipeline of the analytics enclave natively on the host,
+   for profiling, see README.md.
+
+   analytics_host <work directory> <H files> <keys> <update|full>
+                  [<reference areas file> <census file> [calibration]]
+
+   Like the `file` and `period` arguments of the enclave, the H files of
+   consecutive periods are given as a comma separated list, and their keys in
+   the same order. Like with the `sorted` argument, a file can be declared
+   sorted by prefixing its path with `sorted:`.
+
+   The S state is kept in the work directory between runs, like the enclave
+   keeps it in its data directory. The outputs of a full analysis are appended
+   to files in `<work directory>/outputs`, and the application log is printed
+   to stdout.
+ */
+
+#include "Entities.h"
+#include "FullAnalysis.h"
+#include "IoProfile.h"
+#include "PipelineProfile.h"
+#include "SSegments.h"
+#include "SgxEncryptedFile.h"
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <sharemind-hi/enclave/common/File.h>
+#include <sharemind-hi/enclave/task/Task.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+using namespace eurostat::enclave;
+using sharemind_hi::enclave::File;
+
+namespace {
+
+bool exists(std::string const & path) {
+    struct stat status;
+    return ::stat(path.c_str(), &status) == 0;
+}
+
+template <typename T>
+std::vector<T> readArray(std::string const & path) {
+    File file{path, sharemind_hi::FileOpenMode::FILE_OPEN_READ_ONLY};
+    auto const size = file.size();
+    if (size % sizeof(T) != 0u) {
+        throw std::runtime_error("The size of <" + path + "> is not a multiple of the record size");
+    }
+    std::vector<T> result(size / sizeof(T));
+    file.read(result.data(), size);
+    return result;
+}
+
+std::vector<std::string> splitList(std::string const & list) {
+    std::vector<std::string> result;
+    std::string::size_type begin = 0;
+    for (auto end = list.find(','); end != std::string::npos; end = list.find(',', begin)) {
+        result.push_back(list.substr(begin, end - begin));
+        begin = end + 1u;
+    }
+    result.push_back(list.substr(begin));
+    return result;
+}
+
+void parseKey(std::string const & hex, std::uint8_t (&key)[PseudonymisationKeyLength]) {
+    if (hex.size() != 2u * PseudonymisationKeyLength) {
+        throw std::runtime_error("The key must be given as 32 hex digits");
+    }
+    for (std::size_t i = 0; i < PseudonymisationKeyLength; ++i) {
+        key[i] = static_cast<std::uint8_t>(std::stoul(hex.substr(2u * i, 2u), nullptr, 16));
+    }
+}
+
+} // anonymous namespace
+
+int main(int argc, char ** argv) try {
+    if (argc != 5 && argc != 7 && argc != 8) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <work directory> <H files> <keys> <update|full>"
+                     " [<reference areas file> <census file> [calibration]]\n";
+        return 2;
+    }
+    std::string const work_directory = std::string{argv[1]} + "/";
+    auto const h_file_paths = splitList(argv[2]);
+    auto const keys = splitList(argv[3]);
+    if (h_file_paths.size() != keys.size()) {
+        throw std::runtime_error("Each H file needs its own key");
+    }
+    std::string const mode = argv[4];
+    if (mode != "update" && mode != "full") {
+        throw std::runtime_error("The mode must be <update> or <full>");
+    }
+    auto const what_to_do = mode == "update" ? full_analysis::Perform::OnlyStateUpdate
+                                             : full_analysis::Perform::FullAnalysis;
+    bool const with_calibration = argc == 8 && std::string{argv[7]} == "calibration";
+
+    ReferenceAreas reference_areas;
+    CensusResidents residents;
+    if (argc >= 7) {
+        for (auto const & area : readArray<ReferenceArea>(argv[5])) {
+            reference_areas.add(area.id, area.tile_index);
+        }
+        for (auto const & resident : readArray<CensusResident>(argv[6])) {
+            residents.insert(resident.index, resident.value);
+        }
+    }
+
+    auto const s_state_path = work_directory + "s_segments";
+    auto const s_file_prefix = work_directory + "s_file";
+    auto const output_directory = work_directory + "outputs";
+    ::mkdir(output_directory.c_str(), 0700);
+
+    SShards s_segments = {};
+    if (exists(s_state_path)) {
+        File file{s_state_path, sharemind_hi::FileOpenMode::FILE_OPEN_READ_ONLY};
+        if (file.size() != sizeof(s_segments)) {
+            throw std::runtime_error("The S state <" + s_state_path + "> has the wrong size");
+        }
+        file.read(&s_segments, sizeof(s_segments));
+    }
+    auto const s_segments_in = s_segments;
+
+    Log application_log;
+    auto io_profile = loadIoProfile(work_directory + IoProfile::FILE_NAME, application_log);
+
+    PipelineProfile profile;
+    std::vector<full_analysis::HInput> h_files(h_file_paths.size());
+    std::string const sorted_prefix = "sorted:";
+    for (std::size_t i = 0; i < h_files.size(); ++i) {
+        auto & h_file = h_files[i];
+        h_file.is_sorted = h_file_paths[i].compare(0, sorted_prefix.size(), sorted_prefix) == 0;
+        h_file.path = h_file.is_sorted ? h_file_paths[i].substr(sorted_prefix.size())
+                                       : h_file_paths[i];
+        parseKey(keys[i], h_file.pseudonymisation_key);
+    }
+    if (io_profile.auto_tune) {
+        autoTune(io_profile,
+                 h_files.front().path,
+                 work_directory + IoProfile::TUNED_FILE_NAME,
+                 application_log);
+    }
+
+    sharemind_hi::enclave::TaskOutputs outputs{output_directory};
+    full_analysis::run(h_files,
+                       s_file_prefix,
+                       s_segments,
+                       work_directory,
+                       what_to_do,
+                       reference_areas,
+                       residents,
+                       with_calibration,
+                       io_profile,
+                       profile,
+                       outputs,
+                       application_log);
+    profile.appendTo(application_log);
+
+    // Like the enclave: The replaced segments are removed once the new state
+    // is stored, and a full analysis finishes the S state.
+    std::vector<std::string> old_s_files;
+    for (std::size_t shard = 0; shard < s_shards; ++shard) {
+        if (what_to_do == full_analysis::Perform::FullAnalysis
+            || s_segments[shard].base.id != s_segments_in[shard].base.id)
+        {
+            s_segments_in[shard].collectPaths(sShardPrefix(s_file_prefix, shard), old_s_files);
+        }
+    }
+    if (what_to_do == full_analysis::Perform::FullAnalysis) {
+        if (exists(s_state_path)) { File::remove(s_state_path); }
+    } else {
+        File file{s_state_path, sharemind_hi::FileOpenMode::FILE_OPEN_WRITE_ONLY};
+        file.write(&s_segments, sizeof(s_segments));
+    }
+    for (auto const & path : old_s_files) {
+        if (exists(path)) { SgxEncryptedFile::remove(path); }
+    }
+
+    std::cout << application_log << std::endl;
+    return 0;
+} catch (std::exception const & e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+}
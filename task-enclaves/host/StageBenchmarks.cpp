@@ -0,0 +1,712 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+/*
+   Microbenchmarks of the single stages of the analysis pipeline, over
+   synthetic data, see README.md.
+
+   analytics_host_bench [--users=<list>] [--tiles_per_user=<list>]
+                        [--duplicates=<list>] [--temporary_directory=<dir>]
+                        [<Google Benchmark options>]
+
+   Each list is comma separated, and every stage is measured for every
+   combination of the scales. `--duplicates` is the percentage of H records
+   which are sent twice. The results are written as JSON with the usual
+   `--benchmark_format=json` or `--benchmark_out=<file>` options.
+ */
+
+#include "AnalysisStages.h"
+#include "BackgroundJob.h"
+#include "Comparison.h"
+#include "Entities.h"
+#include "ExternalSort.h"
+#include "Indicators.h"
+#include "IoProfile.h"
+#include "Parameters.h"
+#include "Pseudonymisation.h"
+#include "ReferenceAreas.h"
+#include "StreamAdditions.h"
+#include "TileAggregation.h"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <random>
+#include <sharemind-hi/enclave/task/Task.h>
+#include <sharemind-hi/enclave/task/stream/Streams_detail.h>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace eurostat::enclave;
+using namespace eurostat::enclave::full_analysis;
+
+namespace {
+
+using SourceCategory = sharemind_hi::enclave::stream::detail::SourceCategory;
+using SinkCategory = sharemind_hi::enclave::stream::detail::SinkCategory;
+
+constexpr std::uint8_t benchmark_key[PseudonymisationKeyLength] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+
+/** Reference areas of the synthetic data, each a square of tiles. */
+constexpr std::size_t num_reference_areas = 64;
+constexpr std::uint16_t reference_area_side = 40;
+/** The users live on a square grid of tiles with this side. */
+constexpr std::uint16_t grid_side = 1000;
+/** The tiles of a user are at most this far from their home tile. */
+constexpr std::uint16_t roaming_distance = 8;
+
+struct Scale {
+    std::size_t users;
+    std::size_t tiles_per_user;
+    /** Percentage of the H records which are duplicated. */
+    std::size_t duplicates;
+
+    bool operator<(Scale const & other) const noexcept {
+        return std::tie(users, tiles_per_user, duplicates)
+               < std::tie(other.users, other.tiles_per_user, other.duplicates);
+    }
+
+    std::string name() const {
+        return "/users:" + std::to_string(users)
+               + "/tiles_per_user:" + std::to_string(tiles_per_user)
+               + "/duplicates:" + std::to_string(duplicates);
+    }
+};
+
+/**
+   The input of every stage, derived from a single synthetic H file and the S
+   state of the previous periods, by running the stages before it.
+ */
+struct SyntheticData {
+    /** The pseudonyms of the users, in user order. */
+    std::vector<PseudonymisedUserIdentifier> pseudonyms;
+    /** The H file, shuffled and with duplicates. */
+    std::vector<PseudonymisedUserFootprintUpdates> h_file;
+    /** The H file grouped by the pseudonyms, like a sorted H file. */
+    std::vector<PseudonymisedUserFootprintUpdates> grouped_h_file;
+    /** The decrypted H file. */
+    std::vector<H> h;
+    std::vector<H> sorted_h;
+    std::vector<H> deduped_h;
+    std::vector<S> old_s;
+    /** The element pairs of the outer join of `deduped_h` and `old_s`. */
+    std::vector<std::pair<H const *, S const *>> joined;
+    std::vector<S> new_s;
+    /** The offsets of the users in `new_s`, and its size in the end. */
+    std::vector<std::size_t> user_offsets;
+    /** The Y records without reference areas, as module C returns them. */
+    std::vector<Y> y_without_areas;
+    std::vector<Y> y;
+    ReferenceAreas reference_areas;
+};
+
+std::string temporary_directory;
+
+/** Creates a valid pseudonym of `id` under `key`, see `PseudonymDecryptor`. */
+PseudonymisedUserIdentifier pseudonymise(PseudonymisationKeyRef key, UserIdentifier const & id) {
+    PseudonymisedUserIdentifier plain;
+    std::memcpy(plain.data(), id.data(), hash_bytes);
+    std::uint8_t digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_size = 0;
+    if (!HMAC(EVP_sha256(), key, PseudonymisationKeyLength, id.data(), id.size(),
+              digest, &digest_size)) {
+        throw std::runtime_error("HMAC failed");
+    }
+    std::memcpy(plain.data() + hash_bytes, digest, hmac_bytes);
+
+    // CTR mode with a zero counter: XOR with the encrypted zero block.
+    std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> ctx{
+            EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free};
+    std::uint8_t const zeros[aes_block_size] = {};
+    std::uint8_t keystream[aes_block_size + EVP_MAX_BLOCK_LENGTH];
+    int size = 0;
+    if (!ctx
+        || !EVP_EncryptInit_ex(ctx.get(), EVP_aes_128_ecb(), nullptr, key, nullptr)
+        || !EVP_CIPHER_CTX_set_padding(ctx.get(), 0)
+        || !EVP_EncryptUpdate(ctx.get(), keystream, &size, zeros, sizeof(zeros))) {
+        throw std::runtime_error("AES failed");
+    }
+    PseudonymisedUserIdentifier result;
+    for (std::size_t i = 0; i < result.size(); ++i) { result[i] = plain[i] ^ keystream[i]; }
+    return result;
+}
+
+/** The tiles of one user around `home`, sorted and unique. */
+std::vector<TileIndex> userTiles(std::mt19937_64 & rng, TileIndex const home, std::size_t count) {
+    std::uniform_int_distribution<int> offset{-roaming_distance, roaming_distance};
+    std::vector<TileIndex> tiles;
+    for (std::size_t i = 0; i < count; ++i) {
+        auto const easting = std::min(std::max(home.easting + offset(rng), 0), grid_side - 1);
+        auto const northing = std::min(std::max(home.northing + offset(rng), 0), grid_side - 1);
+        tiles.push_back(TileIndex{static_cast<std::uint16_t>(easting),
+                                  static_cast<std::uint16_t>(northing)});
+    }
+    std::sort(tiles.begin(), tiles.end());
+    tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+    return tiles;
+}
+
+/** A day value and the sub-period values at most as high. About a quarter of
+ * the day values are below `day_quantisation_threshold`, and a few records are
+ * all zero, so they are filtered. */
+IColumn values(std::mt19937_64 & rng) {
+    std::uniform_real_distribution<float> day{0.0f, 40.0f};
+    std::uniform_real_distribution<float> fraction{0.0f, 1.0f};
+    IColumn result = {};
+    if (fraction(rng) < 0.005f) { return result; }
+    result[0] = day(rng);
+    for (std::size_t i = 1; i < result.size(); ++i) {
+        if (fraction(rng) < 0.5f) { result[i] = result[0] * fraction(rng); }
+    }
+    return result;
+}
+
+SyntheticData generate(Scale const & scale) {
+    SyntheticData data;
+    std::mt19937_64 rng{scale.users * 1000003u + scale.tiles_per_user * 101u + scale.duplicates};
+    std::uniform_int_distribution<std::uint16_t> coordinate{0, grid_side - 1};
+    std::uniform_int_distribution<std::size_t> tile_count{1, 2 * scale.tiles_per_user - 1};
+    std::uniform_int_distribution<unsigned> percent{0, 99};
+
+    for (std::size_t area = 0; area < num_reference_areas; ++area) {
+        auto const easting = coordinate(rng) % (grid_side - reference_area_side);
+        auto const northing = coordinate(rng) % (grid_side - reference_area_side);
+        for (std::uint16_t e = 0; e < reference_area_side; ++e) {
+            for (std::uint16_t n = 0; n < reference_area_side; ++n) {
+                data.reference_areas.add(
+                        static_cast<ReferenceAreaIndex>(area),
+                        TileIndex{static_cast<std::uint16_t>(easting + e),
+                                  static_cast<std::uint16_t>(northing + n)});
+            }
+        }
+    }
+
+    for (std::size_t user = 0; user < scale.users; ++user) {
+        UserIdentifier id;
+        for (auto & byte : id) { byte = static_cast<std::uint8_t>(rng()); }
+        data.pseudonyms.push_back(pseudonymise(benchmark_key, id));
+        TileIndex const home{coordinate(rng), coordinate(rng)};
+
+        // H holds the footprints of this period, S those of the previous
+        // periods, in about the same area.
+        for (auto const tile : userTiles(rng, home, tile_count(rng))) {
+            PseudonymisedUserFootprintUpdates const e{data.pseudonyms.back(), tile, values(rng)};
+            data.grouped_h_file.push_back(e);
+            if (percent(rng) < scale.duplicates) { data.grouped_h_file.push_back(e); }
+        }
+        for (auto const tile : userTiles(rng, home, tile_count(rng))) {
+            auto i_column = values(rng);
+            for (auto & value : i_column) { value *= 3.0f; }
+            data.old_s.push_back(S{{id, tile}, i_column});
+        }
+    }
+
+    data.h_file = data.grouped_h_file;
+    std::shuffle(data.h_file.begin(), data.h_file.end(), rng);
+
+    data.h.resize(data.h_file.size());
+    {
+        Log log;
+        PseudonymReversal reversal{benchmark_key, IoProfile{}.pseudonym_cache, log};
+        reversal(data.h_file.data(), data.h_file.size(), data.h.data());
+    }
+    data.sorted_h = data.h;
+    std::stable_sort(data.sorted_h.begin(), data.sorted_h.end(), CMP_LAMBDA(<, H, e.key));
+    std::sort(data.old_s.begin(), data.old_s.end(), CMP_LAMBDA(<, S, e.key));
+
+    for (auto const & e : data.sorted_h) {
+        if (!is_valid(e)) { continue; }
+        if (!data.deduped_h.empty() && data.deduped_h.back().key == e.key) {
+            merge_duplicate_values(data.deduped_h.back(), e);
+        } else {
+            data.deduped_h.push_back(e);
+        }
+    }
+
+    {
+        auto h = data.deduped_h.cbegin();
+        auto s = data.old_s.cbegin();
+        while (h != data.deduped_h.cend() || s != data.old_s.cend()) {
+            if (s == data.old_s.cend() || (h != data.deduped_h.cend() && h->key < s->key)) {
+                data.joined.emplace_back(&*h++, nullptr);
+            } else if (h == data.deduped_h.cend() || s->key < h->key) {
+                data.joined.emplace_back(nullptr, &*s++);
+            } else {
+                data.joined.emplace_back(&*h++, &*s++);
+            }
+        }
+    }
+    for (auto const & pair : data.joined) {
+        auto const e = accumulate_s(pair.first, pair.second);
+        if (data.new_s.empty() || data.new_s.back().key.id != e.key.id) {
+            data.user_offsets.push_back(data.new_s.size());
+        }
+        data.new_s.push_back(e);
+    }
+    data.user_offsets.push_back(data.new_s.size());
+
+    Statistics statistics = {};
+    module_c::SingleHumanAnalysis single_human_analysis{statistics};
+    std::vector<S> footprints;
+    std::vector<Y> result;
+    for (std::size_t user = 0; user + 1u < data.user_offsets.size(); ++user) {
+        footprints.assign(data.new_s.begin() + data.user_offsets[user],
+                          data.new_s.begin() + data.user_offsets[user + 1u]);
+        result.clear();
+        single_human_analysis(footprints, result);
+        for (auto & q : result) { q.calibration_weight = 1.0; }
+        data.y_without_areas.insert(data.y_without_areas.end(), result.begin(), result.end());
+        module_d::add_reference_areas(result, data.reference_areas);
+        data.y.insert(data.y.end(), result.begin(), result.end());
+    }
+    return data;
+}
+
+/** The synthetic data of each scale is generated once, when it is first
+ * used. */
+SyntheticData const & syntheticData(Scale const & scale) {
+    static std::map<Scale, std::unique_ptr<SyntheticData>> cache;
+    auto & data = cache[scale];
+    if (!data) { data.reset(new SyntheticData(generate(scale))); }
+    return *data;
+}
+
+/** A stream source over a vector. */
+template <typename T>
+struct VectorSource {
+    using Category = SourceCategory;
+    using Out = T;
+
+    explicit VectorSource(std::vector<T> const & data) : m_data(&data) {}
+
+    bool next(Out & result) {
+        if (m_index == m_data->size()) { return false; }
+        result = (*m_data)[m_index++];
+        return true;
+    }
+
+private: /* Fields: */
+    std::vector<T> const * m_data;
+    std::size_t m_index = 0;
+};
+
+/** A stream sink which only counts the elements. */
+struct CountingSinkBuilder {
+    using Category = SinkCategory;
+
+    template <typename T>
+    struct Impl {
+        using In = T;
+        using Res = std::size_t;
+
+        void sink(In const & e) {
+            benchmark::DoNotOptimize(&e);
+            ++m_count;
+        }
+
+        Res finalize() && { return m_count; }
+
+    private: /* Fields: */
+        std::size_t m_count = 0;
+    };
+
+    template <typename T>
+    Impl<T> build() && { return Impl<T>{}; }
+};
+
+/** Pushes `data` into the stream sink `sink`, and finalizes it. */
+template <typename Sink, typename T>
+typename Sink::Res drain(Sink sink, std::vector<T> const & data) {
+    for (auto const & e : data) { sink.sink(e); }
+    return std::move(sink).finalize();
+}
+
+void itemsProcessed(benchmark::State & state, std::size_t items) {
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * items));
+}
+
+/************
+ * Module B
+ ************/
+
+void decryptPseudonym(benchmark::State & state, SyntheticData const & data) {
+    for (auto _ : state) {
+        for (auto const & pseudonym : data.pseudonyms) {
+            benchmark::DoNotOptimize(decrypt_pseudonym(benchmark_key, pseudonym));
+        }
+    }
+    itemsProcessed(state, data.pseudonyms.size());
+}
+
+void pseudonymDecryptorBatch(benchmark::State & state, SyntheticData const & data) {
+    PseudonymDecryptor const decryptor{benchmark_key};
+    std::vector<UserIdentifier> ids(data.pseudonyms.size());
+    for (auto _ : state) {
+        decryptor.decrypt(data.pseudonyms.data(), data.pseudonyms.size(), ids.data());
+        benchmark::ClobberMemory();
+    }
+    itemsProcessed(state, data.pseudonyms.size());
+}
+
+template <std::vector<PseudonymisedUserFootprintUpdates> SyntheticData::* h_file>
+void pseudonymReversal(benchmark::State & state, SyntheticData const & data) {
+    auto const & in = data.*h_file;
+    std::vector<H> out(PseudonymReversal::chunk_size);
+    for (auto _ : state) {
+        Log log;
+        PseudonymReversal reversal{benchmark_key, IoProfile{}.pseudonym_cache, log};
+        for (std::size_t offset = 0; offset < in.size(); offset += PseudonymReversal::chunk_size) {
+            auto const count = std::min(PseudonymReversal::chunk_size, in.size() - offset);
+            reversal(in.data() + offset, count, out.data());
+            benchmark::ClobberMemory();
+        }
+    }
+    itemsProcessed(state, in.size());
+}
+
+/********
+ * H sort
+ ********/
+
+void hSortRadix(benchmark::State & state, SyntheticData const & data) {
+    std::vector<H> h;
+    for (auto _ : state) {
+        state.PauseTiming();
+        h = data.h;
+        state.ResumeTiming();
+        FootprintKeyRadixSort{IoProfile{}.threads}(h.data(), h.data() + h.size());
+        benchmark::ClobberMemory();
+    }
+    itemsProcessed(state, data.h.size());
+}
+
+/** Like the pipeline, with the run size of the default `IoProfile`, so the
+ * runs are spilled for the bigger scales. */
+void hSortExternal(benchmark::State & state, SyntheticData const & data) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(drain(
+                externalSort(CMP_LAMBDA(<, H, e.key),
+                             FootprintKeyRadixSort{IoProfile{}.threads},
+                             IoProfile{}.sort_run,
+                             temporary_directory + "/h_sort_run")
+                        .build(CountingSinkBuilder{})
+                        .template build<H>(),
+                data.h));
+    }
+    itemsProcessed(state, data.h.size());
+}
+
+/*******************
+ * Filter and dedup
+ *******************/
+
+void filterDedup(benchmark::State & state, SyntheticData const & data) {
+    for (auto _ : state) {
+        auto sink = mergeDuplicates(CMP_LAMBDA(==, H, e.key),
+                                    [](H & result, H const & duplicate) noexcept {
+                                        merge_duplicate_values(result, duplicate);
+                                    })
+                            .build(CountingSinkBuilder{})
+                            .template build<H>();
+        for (auto const & e : data.sorted_h) {
+            if (is_valid(e)) { sink.sink(e); }
+        }
+        benchmark::DoNotOptimize(std::move(sink).finalize());
+    }
+    itemsProcessed(state, data.sorted_h.size());
+}
+
+/************
+ * H ⋈ S
+ ************/
+
+void outerJoin(benchmark::State & state, SyntheticData const & data) {
+    for (auto _ : state) {
+        auto joined = uniqueOuterJoin(VectorSource<H>{data.deduped_h},
+                                      VectorSource<S>{data.old_s},
+                                      [](H const & e) { return e.key; },
+                                      [](S const & e) { return e.key; },
+                                      [](H const * h, S const * s) noexcept {
+                                          return accumulate_s(h, s);
+                                      });
+        S e;
+        while (joined.next(e)) { benchmark::DoNotOptimize(e); }
+    }
+    itemsProcessed(state, data.deduped_h.size() + data.old_s.size());
+}
+
+/************
+ * Module C
+ ************/
+
+void singleHumanAnalysis(benchmark::State & state, SyntheticData const & data) {
+    std::vector<S> footprints;
+    std::vector<Y> result;
+    for (auto _ : state) {
+        Statistics statistics = {};
+        module_c::SingleHumanAnalysis single_human_analysis{statistics};
+        for (std::size_t user = 0; user + 1u < data.user_offsets.size(); ++user) {
+            footprints.assign(data.new_s.begin() + data.user_offsets[user],
+                              data.new_s.begin() + data.user_offsets[user + 1u]);
+            result.clear();
+            single_human_analysis(footprints, result);
+            benchmark::ClobberMemory();
+        }
+    }
+    itemsProcessed(state, data.new_s.size());
+}
+
+/************
+ * Module D
+ ************/
+
+void addReferenceAreas(benchmark::State & state, SyntheticData const & data) {
+    std::vector<Y> result;
+    for (auto _ : state) {
+        auto begin = data.y_without_areas.cbegin();
+        while (begin != data.y_without_areas.cend()) {
+            auto const end = std::find_if(begin, data.y_without_areas.cend(), [&](Y const & e) {
+                return e.key.id != begin->key.id;
+            });
+            result.assign(begin, end);
+            module_d::add_reference_areas(result, data.reference_areas);
+            benchmark::ClobberMemory();
+            begin = end;
+        }
+    }
+    itemsProcessed(state, data.y_without_areas.size());
+}
+
+/** Includes the report, which is put into a file in the temporary
+ * directory. */
+void connectionStrengths(benchmark::State & state, SyntheticData const & data) {
+    sharemind_hi::enclave::TaskOutputs outputs{temporary_directory};
+    for (auto _ : state) {
+        module_d::ConnectionStrengths connection_strengths{outputs, data.reference_areas};
+        for (auto const & e : data.y) { connection_strengths(e); }
+    }
+    std::remove((temporary_directory + "/" + output_names::functional_urban_fingerprint_report).c_str());
+    itemsProcessed(state, data.y.size());
+}
+
+/** Like `report_footprints` of the pipeline. */
+void tileAggregation(benchmark::State & state, SyntheticData const & data) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(drain(
+                aggregateByTile(
+                        [](Y const & e) noexcept { return e.key.tile; },
+                        [](Y const & e) {
+                            TotalFootprint result{};
+                            result.tile_index = e.key.tile;
+                            return result;
+                        },
+                        [](TotalFootprint & result, Y const & e) {
+                            for (std::size_t i = 0; i < result.values.size(); ++i) {
+                                result.values[i] += e.calibration_weight
+                                                    * static_cast<double>(e.values[i]);
+                            }
+                        },
+                        tile_aggregation_bytes,
+                        temporary_directory + "/y_aggregation_partition")
+                        .build(CountingSinkBuilder{})
+                        .template build<Y>(),
+                data.y));
+    }
+    itemsProcessed(state, data.y.size());
+}
+
+/************
+ * Indicators
+ ************/
+
+void countIndicator(benchmark::State & state, SyntheticData const & data) {
+    for (auto _ : state) {
+        indicators::Count count;
+        for (auto const & e : data.deduped_h) { count(e.key.id); }
+        benchmark::DoNotOptimize(count.finish());
+    }
+    itemsProcessed(state, data.deduped_h.size());
+}
+
+void spatiotemporalDistribution(benchmark::State & state, SyntheticData const & data) {
+    for (auto _ : state) {
+        indicators::SpatiotemporalDistribution distribution;
+        for (auto const & e : data.deduped_h) { distribution(e.i_column); }
+        benchmark::DoNotOptimize(distribution.result);
+    }
+    itemsProcessed(state, data.deduped_h.size());
+}
+
+void uniqueTilesPerUser(benchmark::State & state, SyntheticData const & data) {
+    for (auto _ : state) {
+        indicators::spatial_distribution::HHistogramCountOfUniqueTilesPerUserWithPresence histogram;
+        for (auto const & e : data.deduped_h) { histogram(e); }
+        benchmark::DoNotOptimize(histogram.finish());
+    }
+    itemsProcessed(state, data.deduped_h.size());
+}
+
+void weightValues(benchmark::State & state, SyntheticData const & data) {
+    for (auto _ : state) {
+        indicators::spatial_distribution::HistogramOfWeightValues histogram;
+        for (auto const & e : data.deduped_h) { histogram(e.i_column); }
+        benchmark::DoNotOptimize(histogram.finish());
+    }
+    itemsProcessed(state, data.deduped_h.size());
+}
+
+void averageDistances(benchmark::State & state, SyntheticData const & data) {
+    for (auto _ : state) {
+        indicators::spatial_distribution::HistogramOfAverageDistances histogram;
+        for (auto const & pair : data.joined) {
+            if (pair.first) { histogram(*pair.first); }
+            if (pair.second) { histogram(*pair.second); }
+        }
+        benchmark::DoNotOptimize(histogram.finish());
+    }
+    itemsProcessed(state, data.joined.size());
+}
+
+void boundingBoxMeasure(benchmark::State & state, SyntheticData const & data) {
+    for (auto _ : state) {
+        indicators::spatial_distribution::BoundingBoxMeasure measure;
+        for (std::size_t i = 0; i < data.joined.size(); ++i) {
+            if (data.joined[i].first) { measure.h(*data.joined[i].first); }
+            if (data.joined[i].second) { measure.old_s(*data.joined[i].second); }
+            measure.new_s(data.new_s[i]);
+        }
+        benchmark::DoNotOptimize(measure.finish());
+    }
+    itemsProcessed(state, data.joined.size());
+}
+
+using Stage = void (*)(benchmark::State &, SyntheticData const &);
+
+struct NamedStage {
+    char const * name;
+    Stage stage;
+};
+
+NamedStage const stages[] = {
+        {"decrypt_pseudonym", &decryptPseudonym},
+        {"PseudonymDecryptor/batch", &pseudonymDecryptorBatch},
+        {"PseudonymReversal/shuffled", &pseudonymReversal<&SyntheticData::h_file>},
+        {"PseudonymReversal/grouped", &pseudonymReversal<&SyntheticData::grouped_h_file>},
+        {"HSort/radix", &hSortRadix},
+        {"HSort/external", &hSortExternal},
+        {"FilterDedup", &filterDedup},
+        {"OuterJoin", &outerJoin},
+        {"SingleHumanAnalysis", &singleHumanAnalysis},
+        {"AddReferenceAreas", &addReferenceAreas},
+        {"ConnectionStrengths", &connectionStrengths},
+        {"TileAggregation", &tileAggregation},
+        {"indicators::Count", &countIndicator},
+        {"indicators::SpatiotemporalDistribution", &spatiotemporalDistribution},
+        {"indicators::HHistogramCountOfUniqueTilesPerUserWithPresence", &uniqueTilesPerUser},
+        {"indicators::HistogramOfWeightValues", &weightValues},
+        {"indicators::HistogramOfAverageDistances", &averageDistances},
+        {"indicators::BoundingBoxMeasure", &boundingBoxMeasure},
+};
+
+std::vector<std::size_t> parseList(std::string const & list) {
+    std::vector<std::size_t> result;
+    std::size_t begin = 0;
+    while (begin <= list.size()) {
+        auto end = list.find(',', begin);
+        if (end == std::string::npos) { end = list.size(); }
+        result.push_back(std::stoul(list.substr(begin, end - begin)));
+        begin = end + 1u;
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+int main(int argc, char ** argv) try {
+    benchmark::Initialize(&argc, argv);
+
+    std::vector<std::size_t> users{10000, 100000};
+    std::vector<std::size_t> tiles_per_user{20};
+    std::vector<std::size_t> duplicates{1};
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+        auto const value = arg.substr(arg.find('=') + 1u);
+        if (arg.compare(0, 8, "--users=") == 0) {
+            users = parseList(value);
+        } else if (arg.compare(0, 17, "--tiles_per_user=") == 0) {
+            tiles_per_user = parseList(value);
+        } else if (arg.compare(0, 13, "--duplicates=") == 0) {
+            duplicates = parseList(value);
+        } else if (arg.compare(0, 22, "--temporary_directory=") == 0) {
+            temporary_directory = value;
+        } else {
+            std::cerr << "Unknown argument <" << arg << ">\n";
+            return 2;
+        }
+    }
+
+    bool const own_temporary_directory = temporary_directory.empty();
+    if (own_temporary_directory) {
+        char path[] = "/tmp/analytics_host_bench.XXXXXX";
+        if (!::mkdtemp(path)) { throw std::runtime_error("Failed to create a temporary directory"); }
+        temporary_directory = path;
+    }
+
+    for (auto const u : users) {
+        for (auto const t : tiles_per_user) {
+            for (auto const d : duplicates) {
+                Scale const scale{u, std::max<std::size_t>(t, 1u), std::min<std::size_t>(d, 100u)};
+                for (auto const & named : stages) {
+                    auto const stage = named.stage;
+                    benchmark::RegisterBenchmark(
+                            (named.name + scale.name()).c_str(),
+                            [stage, scale](benchmark::State & state) {
+                                stage(state, syntheticData(scale));
+                            })
+                            ->Unit(benchmark::kMillisecond);
+                }
+            }
+        }
+    }
+
+    // Like `full_analysis::run` with the default `IoProfile`.
+    BackgroundJob::setMaxThreads(IoProfile{}.threads - 1u);
+    benchmark::AddCustomContext("threads", std::to_string(IoProfile{}.threads));
+    benchmark::AddCustomContext("s_shards", std::to_string(s_shards));
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    if (own_temporary_directory) { ::rmdir(temporary_directory.c_str()); }
+    return 0;
+} catch (std::exception const & e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+}
@@ -0,0 +1,324 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+/*
+   The implementation of the host shim, see README.md: The SGX SDK and
+   sharemind-hi enclave APIs used by the analysis pipeline, backed by POSIX
+   files and OpenSSL.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <sgx_tcrypto.h>
+#include <sgx_tprotected_fs.h>
+#include <sgx_trts.h>
+#include <sharemind-hi/enclave/common/EnclaveException.h>
+#include <sharemind-hi/enclave/common/File.h>
+#include <sharemind-hi/enclave/common/Log.h>
+#include <sharemind-hi/enclave/task/Task.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t aes_block_size = 16;
+
+/** Initializes `ctx` for AES-128-CTR at the byte `position` of the stream. */
+bool initCtr(EVP_CIPHER_CTX * const ctx,
+             std::uint8_t const (&key)[16],
+             std::uint64_t const position)
+{
+    std::uint8_t counter[aes_block_size] = {};
+    auto block = position / aes_block_size;
+    for (std::size_t i = 0; i < 8u; ++i) {
+        counter[aes_block_size - 1u - i] = static_cast<std::uint8_t>(block);
+        block >>= 8u;
+    }
+    if (EVP_EncryptInit_ex(ctx, EVP_aes_128_ctr(), nullptr, key, counter) != 1) { return false; }
+    // Discard the keystream up to the position within the block.
+    std::uint8_t skip[aes_block_size] = {};
+    int length = 0;
+    return EVP_EncryptUpdate(ctx,
+                             skip,
+                             &length,
+                             skip,
+                             static_cast<int>(position % aes_block_size))
+           == 1;
+}
+
+} // anonymous namespace
+
+struct _sgx_file {
+    std::FILE * file = nullptr;
+    EVP_CIPHER_CTX * ctx = nullptr;
+    std::uint8_t key[16] = {};
+    /** The position the cipher context is at, if `ctx_valid`. */
+    std::uint64_t position = 0;
+    bool ctx_valid = false;
+    bool error = false;
+    std::vector<std::uint8_t> scratch;
+
+    /** En- or decrypts `size` bytes at the current position in place. */
+    bool crypt(std::uint8_t * const data, std::size_t size) {
+        if (!ctx_valid) {
+            if (!initCtr(ctx, key, position)) { return false; }
+            ctx_valid = true;
+        }
+        while (size != 0u) {
+            auto const chunk = static_cast<int>(std::min<std::size_t>(size, 1u << 30u));
+            int length = 0;
+            if (EVP_EncryptUpdate(ctx, data, &length, data, chunk) != 1) { return false; }
+            size -= static_cast<std::size_t>(chunk);
+        }
+        return true;
+    }
+};
+
+extern "C" {
+
+SGX_FILE * sgx_fopen(char const * const filename,
+                     char const * const mode,
+                     sgx_key_128bit_t const * const key)
+{
+    auto * const file = std::fopen(filename, mode);
+    if (!file) { return nullptr; }
+    auto * const result = new _sgx_file;
+    result->file = file;
+    result->ctx = EVP_CIPHER_CTX_new();
+    std::memcpy(result->key, *key, sizeof(result->key));
+    if (!result->ctx) {
+        sgx_fclose(result);
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return result;
+}
+
+size_t sgx_fwrite(void const * const ptr, size_t const size, size_t const count, SGX_FILE * const stream) {
+    auto const bytes = size * count;
+    stream->scratch.assign(static_cast<std::uint8_t const *>(ptr),
+                           static_cast<std::uint8_t const *>(ptr) + bytes);
+    if (!stream->crypt(stream->scratch.data(), bytes)) {
+        stream->error = true;
+        return 0;
+    }
+    auto const written = std::fwrite(stream->scratch.data(), 1u, bytes, stream->file);
+    stream->position += written;
+    if (written != bytes) {
+        // The keystream went ahead of the file.
+        stream->ctx_valid = false;
+        stream->error = true;
+    }
+    return size == 0u ? 0u : written / size;
+}
+
+size_t sgx_fread(void * const ptr, size_t const size, size_t const count, SGX_FILE * const stream) {
+    auto * const data = static_cast<std::uint8_t *>(ptr);
+    auto const read = std::fread(data, 1u, size * count, stream->file);
+    if (!stream->crypt(data, read)) {
+        stream->error = true;
+        return 0;
+    }
+    stream->position += read;
+    return size == 0u ? 0u : read / size;
+}
+
+int64_t sgx_ftell(SGX_FILE * const stream) {
+    return static_cast<int64_t>(ftello(stream->file));
+}
+
+int32_t sgx_fseek(SGX_FILE * const stream, int64_t const offset, int const origin) {
+    if (fseeko(stream->file, static_cast<off_t>(offset), origin) != 0) { return -1; }
+    stream->position = static_cast<std::uint64_t>(ftello(stream->file));
+    stream->ctx_valid = false;
+    return 0;
+}
+
+int32_t sgx_fflush(SGX_FILE * const stream) {
+    return std::fflush(stream->file);
+}
+
+int32_t sgx_ferror(SGX_FILE * const stream) {
+    return stream->error || std::ferror(stream->file) ? 1 : 0;
+}
+
+int32_t sgx_feof(SGX_FILE * const stream) {
+    return std::feof(stream->file) ? 1 : 0;
+}
+
+void sgx_clearerr(SGX_FILE * const stream) {
+    stream->error = false;
+    std::clearerr(stream->file);
+}
+
+int32_t sgx_fclose(SGX_FILE * const stream) {
+    auto const result = std::fclose(stream->file);
+    EVP_CIPHER_CTX_free(stream->ctx);
+    delete stream;
+    return result == 0 ? 0 : 1;
+}
+
+int32_t sgx_remove(char const * const filename) {
+    return std::remove(filename) == 0 ? 0 : 1;
+}
+
+int32_t sgx_fclear_cache(SGX_FILE *) {
+    return 0;
+}
+
+sgx_status_t sgx_read_rand(unsigned char * const rand, size_t const length_in_bytes) {
+    return RAND_bytes(rand, static_cast<int>(length_in_bytes)) == 1
+                   ? SGX_SUCCESS
+                   : SGX_ERROR_UNEXPECTED;
+}
+
+sgx_status_t sgx_aes_ctr_encrypt(sgx_aes_ctr_128bit_key_t const * const p_key,
+                                 uint8_t const * const p_src,
+                                 uint32_t const src_len,
+                                 uint8_t * const p_ctr,
+                                 uint32_t const ctr_inc_bits,
+                                 uint8_t * const p_dst)
+{
+    // OpenSSL increments the full 128 bit counter, which only makes a
+    // difference if the low `ctr_inc_bits` overflow.
+    (void) ctr_inc_bits;
+    auto * const ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) { return SGX_ERROR_UNEXPECTED; }
+    int length = 0;
+    bool const ok = EVP_EncryptInit_ex(ctx, EVP_aes_128_ctr(), nullptr, *p_key, p_ctr) == 1
+                    && EVP_EncryptUpdate(ctx, p_dst, &length, p_src, static_cast<int>(src_len)) == 1;
+    EVP_CIPHER_CTX_free(ctx);
+    return ok ? SGX_SUCCESS : SGX_ERROR_UNEXPECTED;
+}
+
+void enclave_printf_log(char const * const format, ...) {
+    std::va_list args;
+    va_start(args, format);
+    std::vfprintf(stderr, format, args);
+    va_end(args);
+    std::fputc('\n', stderr);
+}
+
+uint64_t enclave_untrusted_steady_clock_millis() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                         std::chrono::steady_clock::now().time_since_epoch())
+                                         .count());
+}
+
+} // extern "C"
+
+namespace sharemind_hi {
+namespace enclave {
+
+File::File(std::string const & path, FileOpenMode const mode)
+    : m_fd{::open(path.c_str(),
+                  (mode & FILE_OPEN_WRITE_ONLY) ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY,
+                  0600)}
+    , m_path{path}
+{
+    if (m_fd < 0) {
+        throw EnclaveException("Failed to open <" + path + ">: " + std::strerror(errno));
+    }
+}
+
+File::File(File && other) noexcept
+    : m_fd{other.m_fd}
+    , m_path{std::move(other.m_path)}
+{
+    other.m_fd = -1;
+}
+
+File & File::operator=(File && other) noexcept {
+    if (this != &other) {
+        if (m_fd >= 0) { ::close(m_fd); }
+        m_fd = other.m_fd;
+        m_path = std::move(other.m_path);
+        other.m_fd = -1;
+    }
+    return *this;
+}
+
+File::~File() {
+    if (m_fd >= 0) { ::close(m_fd); }
+}
+
+std::size_t File::size() const {
+    struct stat status;
+    if (::fstat(m_fd, &status) != 0) {
+        throw EnclaveException("Failed to stat <" + m_path + ">: " + std::strerror(errno));
+    }
+    return static_cast<std::size_t>(status.st_size);
+}
+
+void File::read(void * const buffer, std::size_t size) {
+    auto * data = static_cast<char *>(buffer);
+    while (size != 0u) {
+        auto const result = ::read(m_fd, data, size);
+        if (result < 0 && errno == EINTR) { continue; }
+        if (result <= 0) {
+            throw EnclaveException("Failed to read <" + m_path + ">");
+        }
+        data += result;
+        size -= static_cast<std::size_t>(result);
+    }
+}
+
+void File::write(void const * const buffer, std::size_t size) {
+    auto const * data = static_cast<char const *>(buffer);
+    while (size != 0u) {
+        auto const result = ::write(m_fd, data, size);
+        if (result < 0 && errno == EINTR) { continue; }
+        if (result <= 0) {
+            throw EnclaveException("Failed to write <" + m_path + ">");
+        }
+        data += result;
+        size -= static_cast<std::size_t>(result);
+    }
+}
+
+void File::remove(std::string const & path) {
+    if (std::remove(path.c_str()) != 0) {
+        throw EnclaveException("Failed to remove <" + path + ">");
+    }
+}
+
+TaskOutputs::TaskOutputs(std::string directory)
+    : m_directory{std::move(directory)}
+{}
+
+void TaskOutputs::put(char const * const topic, void const * const data, std::size_t const size) {
+    auto const path = m_directory + "/" + topic;
+    auto * const file = std::fopen(path.c_str(), "ab");
+    if (!file) { throw EnclaveException("Failed to open output <" + path + ">"); }
+    auto const written = std::fwrite(data, 1u, size, file);
+    std::fclose(file);
+    if (written != size) { throw EnclaveException("Failed to write output <" + path + ">"); }
+}
+
+} // namespace enclave
+} // namespace sharemind_hi
@@ -0,0 +1,37 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+#pragma once
+
+/*
+   Included before every source of the host build, see README.md. Adapts the
+   host C library to what the enclave sources expect from the SGX SDK.
+ */
+
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/** The XSI variant, which the SGX SDK provides as `strerror_r`. */
+int __xpg_strerror_r(int errnum, char * buf, size_t buflen);
+#ifdef __cplusplus
+}
+#endif
+
+#define strerror_r __xpg_strerror_r
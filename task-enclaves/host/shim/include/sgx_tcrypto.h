@@ -0,0 +1,42 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+#pragma once
+
+/* Host shim of the SGX SDK crypto library, see ../README.md. */
+
+#include "sgx_error.h"
+#include <stdint.h>
+
+typedef uint8_t sgx_aes_ctr_128bit_key_t[16];
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Backed by OpenSSL's AES-128-CTR, with a 128 bit counter. */
+sgx_status_t sgx_aes_ctr_encrypt(const sgx_aes_ctr_128bit_key_t * p_key,
+                                 const uint8_t * p_src,
+                                 const uint32_t src_len,
+                                 uint8_t * p_ctr,
+                                 const uint32_t ctr_inc_bits,
+                                 uint8_t * p_dst);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,53 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+#pragma once
+
+/*
+   Host shim of the SGX protected file system, see ../README.md. The files are
+   POSIX files encrypted with AES-128-CTR under the given key, so reading and
+   writing them costs a comparable amount of crypto work. There is no
+   integrity protection.
+ */
+
+#include "sgx_key.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _sgx_file SGX_FILE;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+SGX_FILE * sgx_fopen(const char * filename, const char * mode, const sgx_key_128bit_t * key);
+size_t sgx_fwrite(const void * ptr, size_t size, size_t count, SGX_FILE * stream);
+size_t sgx_fread(void * ptr, size_t size, size_t count, SGX_FILE * stream);
+int64_t sgx_ftell(SGX_FILE * stream);
+int32_t sgx_fseek(SGX_FILE * stream, int64_t offset, int origin);
+int32_t sgx_fflush(SGX_FILE * stream);
+int32_t sgx_ferror(SGX_FILE * stream);
+int32_t sgx_feof(SGX_FILE * stream);
+void sgx_clearerr(SGX_FILE * stream);
+int32_t sgx_fclose(SGX_FILE * stream);
+int32_t sgx_remove(const char * filename);
+int32_t sgx_fclear_cache(SGX_FILE * stream);
+
+#ifdef __cplusplus
+}
+#endif
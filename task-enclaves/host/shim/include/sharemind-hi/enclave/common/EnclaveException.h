@@ -0,0 +1,44 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+#pragma once
+
+/* Host shim of the sharemind-hi enclave exceptions, see ../../../../README.md. */
+
+#include <stdexcept>
+#include <string>
+
+namespace sharemind_hi {
+namespace enclave {
+
+class EnclaveException : public std::runtime_error {
+public:
+    explicit EnclaveException(std::string const & what)
+        : std::runtime_error(what)
+    {}
+};
+
+} // namespace enclave
+} // namespace sharemind_hi
+
+#define ENCLAVE_EXPECT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            throw ::sharemind_hi::enclave::EnclaveException(message); \
+        } \
+    } while (false)
@@ -0,0 +1,55 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+#pragma once
+
+/*
+   Host shim of the untrusted files of sharemind-hi, see ../../../../README.md.
+   A plain POSIX file.
+ */
+
+#include <cstddef>
+#include <sharemind-hi/filesystem/FileOpenMode.h>
+#include <string>
+
+namespace sharemind_hi {
+namespace enclave {
+
+class File {
+public: /* Methods: */
+    File(std::string const & path, FileOpenMode mode);
+    File(File && other) noexcept;
+    File(File const &) = delete;
+    File & operator=(File && other) noexcept;
+    File & operator=(File const &) = delete;
+    ~File();
+
+    std::size_t size() const;
+    /** Reads exactly `size` bytes, or throws. */
+    void read(void * buffer, std::size_t size);
+    void write(void const * buffer, std::size_t size);
+
+    static void remove(std::string const & path);
+
+private: /* Fields: */
+    int m_fd = -1;
+    std::string m_path;
+};
+
+} // namespace enclave
+} // namespace sharemind_hi
@@ -0,0 +1,42 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+#pragma once
+
+/* Host shim of the sharemind-hi SGX exceptions, see ../../../../README.md. */
+
+#include "EnclaveException.h"
+#include <sgx_error.h>
+#include <string>
+
+namespace sharemind_hi {
+namespace enclave {
+
+class SgxException : public EnclaveException {
+public:
+    SgxException(sgx_status_t const status, std::string const & what)
+        : EnclaveException(what + " (SGX status " + std::to_string(status) + ")")
+    {}
+
+    static void throwOnError(sgx_status_t const status, char const * const what) {
+        if (status != SGX_SUCCESS) { throw SgxException(status, what); }
+    }
+};
+
+} // namespace enclave
+} // namespace sharemind_hi
@@ -0,0 +1,50 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+#pragma once
+
+/*
+   Host shim of the task outputs of sharemind-hi, see ../../../../README.md.
+   Each output topic is appended, unencrypted, to a file of the same name in
+   the output directory.
+ */
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace sharemind_hi {
+namespace enclave {
+
+class TaskOutputs {
+public: /* Methods: */
+    explicit TaskOutputs(std::string directory);
+
+    void put(char const * topic, void const * data, std::size_t size);
+
+    template <typename T>
+    void put(char const * topic, std::vector<T> const & data) {
+        put(topic, data.data(), data.size() * sizeof(T));
+    }
+
+private: /* Fields: */
+    std::string m_directory;
+};
+
+} // namespace enclave
+} // namespace sharemind_hi
@@ -0,0 +1,97 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+#pragma once
+
+/*
+   Host shim of the task output streams of sharemind-hi, see
+   ../../../../../README.md. The elements are buffered and put into the
+   `TaskOutputs` in chunks.
+ */
+
+#include <cstddef>
+#include <sharemind-hi/enclave/task/Task.h>
+#include <sharemind-hi/enclave/task/stream/Streams_detail.h>
+#include <utility>
+#include <vector>
+
+namespace sharemind_hi {
+namespace enclave {
+namespace stream {
+
+struct EncryptedOutputBuilder {
+    using Category = detail::SinkCategory;
+
+    static constexpr std::size_t CHUNK_BYTES = std::size_t{1} * 1024u * 1024u;
+
+    EncryptedOutputBuilder(EncryptedOutputBuilder &&) noexcept = default;
+
+    EncryptedOutputBuilder(TaskOutputs & outputs, char const * topic)
+        : m_outputs{&outputs}
+        , m_topic{topic}
+    {}
+
+    template <typename T>
+    struct Impl {
+        using In = T;
+        using Res = void;
+
+        Impl(Impl &&) noexcept = default;
+
+        Impl(TaskOutputs & outputs, char const * topic)
+            : m_outputs{&outputs}
+            , m_topic{topic}
+        {
+            m_buffer.reserve(CHUNK_BYTES / sizeof(T) + 1u);
+        }
+
+        void sink(In const & argument) {
+            m_buffer.push_back(argument);
+            if (m_buffer.size() * sizeof(T) >= CHUNK_BYTES) { flush(); }
+        }
+
+        void finalize() && { flush(); }
+
+    private: /* Methods: */
+        void flush() {
+            if (m_buffer.empty()) { return; }
+            m_outputs->put(m_topic, m_buffer);
+            m_buffer.clear();
+        }
+
+    private: /* Fields: */
+        TaskOutputs * m_outputs;
+        char const * m_topic;
+        std::vector<T> m_buffer;
+    };
+
+    template <typename T>
+    Impl<T> build() && { return Impl<T>{*m_outputs, m_topic}; }
+
+private: /* Fields: */
+    TaskOutputs * m_outputs;
+    char const * m_topic;
+};
+
+inline EncryptedOutputBuilder encryptedOutput(TaskOutputs & outputs, char const * topic) {
+    return EncryptedOutputBuilder{outputs, topic};
+}
+
+} // namespace stream
+} // namespace enclave
+} // namespace sharemind_hi
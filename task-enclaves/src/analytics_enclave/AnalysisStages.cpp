@@ -0,0 +1,283 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#include "AnalysisStages.h"
+#include "Comparison.h"
+#include "Parameters.h"
+#include "RadixSort.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <string>
+
+#define RANGE(...) std::begin(__VA_ARGS__), std::end(__VA_ARGS__)
+
+namespace eurostat {
+namespace enclave {
+namespace full_analysis {
+
+bool is_valid(H const & e) noexcept {
+    bool positive_found = false;
+    for (auto const value : e.i_column) {
+        if (!std::isfinite(value)) { return false; }
+        if (value < 0) { return false; }
+        if (value > 0) { positive_found = true; }
+    }
+    return positive_found;
+}
+
+void merge_duplicate_values(H & result, H const & duplicate) noexcept {
+    for (std::size_t i = 0; i < result.i_column.size(); ++i) {
+        result.i_column[i] = std::max(result.i_column[i], duplicate.i_column[i]);
+    }
+}
+
+S accumulate_s(H const * const h, S const * const s) noexcept {
+    if (!h) { return *s; }
+    if (!s) { return S{h->key, h->i_column}; }
+    S result = *s;
+    for (std::size_t i = 0; i < result.i_column.size(); ++i) {
+        result.i_column[i] += h->i_column[i];
+    }
+    return result;
+}
+
+void add_period_values(H & result, H const & other) noexcept {
+    for (std::size_t i = 0; i < result.i_column.size(); ++i) {
+        result.i_column[i] += other.i_column[i];
+    }
+}
+
+void FootprintKeyRadixSort::operator()(H * const begin, H * const end) const {
+    parallelRadixSortByKey<sizeof(FootprintKey)>(
+            begin,
+            end,
+            [](H const & e) noexcept {
+                return reinterpret_cast<std::uint8_t const *>(&e.key);
+            },
+            threads);
+}
+
+constexpr std::size_t PseudonymReversal::chunk_size;
+
+PseudonymReversal::PseudonymReversal(PseudonymisationKeyRef pseudonymisation_key,
+                                     std::size_t const cache_bytes,
+                                     Log & application_log)
+    : m_decryptor{pseudonymisation_key}
+    , m_cache{cache_bytes}
+    , m_application_log(application_log)
+{
+    m_ids.reserve(chunk_size);
+    m_run_index.reserve(chunk_size);
+    m_misses.reserve(chunk_size);
+    m_miss_index.reserve(chunk_size);
+    m_miss_ids.reserve(chunk_size);
+}
+
+PseudonymReversal::~PseudonymReversal() {
+    m_application_log.append("Pseudonym cache (");
+    m_application_log.append(std::to_string(m_cache.capacity()));
+    m_application_log.append(" entries): ");
+    m_application_log.append(std::to_string(m_cache.hits()));
+    m_application_log.append(" hits, ");
+    m_application_log.append(std::to_string(m_cache.misses()));
+    m_application_log.append(" misses\n");
+}
+
+void PseudonymReversal::operator()(PseudonymisedUserFootprintUpdates const * const in,
+                                   std::size_t const count,
+                                   H * const out)
+{
+    // Resolve the start of each run of equal pseudonyms, a run may continue
+    // from the previous chunk. Index 0 refers to that run.
+    PseudonymisedUserIdentifier const * current = m_has_last ? &m_last_pseudonym : nullptr;
+    m_ids.assign(1u, m_last_id);
+    m_run_index.clear();
+    m_misses.clear();
+    m_miss_index.clear();
+    for (std::size_t i = 0; i < count; ++i) {
+        if (!current || in[i].id != *current) {
+            current = &in[i].id;
+            if (auto const cached = m_cache.find(in[i].id)) {
+                m_ids.push_back(*cached);
+            } else {
+                m_misses.push_back(in[i].id);
+                m_miss_index.push_back(m_ids.size());
+                m_ids.emplace_back();
+            }
+        }
+        m_run_index.push_back(m_ids.size() - 1u);
+    }
+
+    m_miss_ids.resize(m_misses.size());
+    m_decryptor.decrypt(m_misses.data(), m_misses.size(), m_miss_ids.data());
+    for (std::size_t i = 0; i < m_misses.size(); ++i) {
+        m_ids[m_miss_index[i]] = m_miss_ids[i];
+        m_cache.insert(m_misses[i], m_miss_ids[i]);
+    }
+
+    for (std::size_t i = 0; i < count; ++i) {
+        out[i] = H{{m_ids[m_run_index[i]], in[i].tile}, in[i].i_column};
+    }
+
+    if (count > 0) {
+        m_has_last = true;
+        m_last_pseudonym = in[count - 1].id;
+        m_last_id = m_ids[m_run_index[count - 1]];
+    }
+}
+
+namespace module_c {
+
+void SingleHumanAnalysis::operator()(std::vector<S> & footprints, std::vector<Y> & result)
+{
+    footprints.erase(std::remove_if(RANGE(footprints),
+                                    [](S const & e) {
+                                        return e.i_column[0]
+                                               < day_quantisation_threshold;
+                                    }),
+                     footprints.end());
+
+    if (footprints.empty()) {
+        m_statistics.highly_nomadic_users += 1;
+        return;
+    }
+
+    // Now, we want to use random data to sort, but we need to store it
+    // somewhere. The python implementation uses `random()` the lambda
+    // supplied to the `key` argument which is cached, but in C++ we don't
+    // have such a thing. So instead, we overwrite the user id data in the
+    // original S structs to contain random data, which is used as a tie
+    // braker and to introduce non-determinism.
+    auto const id_backup = footprints.front().key.id;
+    for (auto & footprint : footprints) {
+        std::array<uint64_t, 2> tmp_random{m_rng(), m_rng()};
+        static_assert(sizeof(tmp_random) >= sizeof(footprint.key.id), "");
+        memcpy(footprint.key.id.data(),
+               tmp_random.data(),
+               sizeof(footprint.key.id));
+    }
+
+    // Sort Y_m according to the L_m rules, so we get the ranks and store
+    // them inline in Y_m.
+    std::sort(RANGE(footprints),
+              CMP_LAMBDA(>, S,
+                         e.i_column[0],
+                         // XXX Use nested std::max(.,.) to preserve the
+                         // lvalue references, instead of std::max({...})
+                         // which creates new values.
+                         std::max(std::max(e.i_column[1], e.i_column[2]),
+                                  e.i_column[3]),
+                         e.i_column[1],
+                         // XXX This was replaced with random bits, see note above.
+                         e.key.id));
+
+    result.reserve(footprints.size());
+    for (std::size_t i = 0; i < footprints.size(); ++i) {
+        result.emplace_back();
+        auto & q = result.back();
+        q.key.id = id_backup;
+        q.key.tile = footprints[i].key.tile;
+        q.rank = i + QuantisedFootprint::FirstRank;
+
+        auto const fvalues = footprints[i].i_column;
+        q.values[0] = true;
+        for (std::size_t j = 1; j < 4; ++j) {
+            q.values[j] = (fvalues[j] / fvalues[0])
+                          >= sub_period_quantisation_threshold;
+        }
+    }
+}
+
+} // namespace module_c
+
+namespace module_d {
+
+void add_reference_areas(std::vector<Y> & result, ReferenceAreas const & reference_areas) {
+    // Intermediate storage for the reference area indices for this user.
+    decltype(Y::reference_area_indices) group_ra_indices{};
+    for (auto const & q : result) {
+        group_ra_indices |= reference_areas.areasOf(q.key.tile);
+    }
+
+    // The result needs to be written to all elements in the group.
+    for (auto & q : result) {
+        q.reference_area_indices = group_ra_indices;
+    }
+}
+
+bool operator==(CalibrationKey const & a, CalibrationKey const & b) noexcept {
+    return a.tile == b.tile && a.anchor == b.anchor && a.areas == b.areas;
+}
+
+bool operator<(CalibrationKey const & a, CalibrationKey const & b) noexcept {
+    if (a.tile != b.tile) { return a.tile < b.tile; }
+    if (a.anchor != b.anchor) { return a.anchor < b.anchor; }
+    // Any strict order of the areas will do.
+    return std::memcmp(&a.areas, &b.areas, sizeof(a.areas)) < 0;
+}
+
+std::uint32_t denseIdHash(CalibrationKey const & key) noexcept {
+    std::uint64_t bits = (std::uint64_t{enclave::denseIdHash(key.tile)} << 32u)
+                         | enclave::denseIdHash(key.anchor);
+    bits ^= std::hash<ReferenceAreas::Set>{}(key.areas);
+    // Fibonacci hashing again, so the upper bits depend on all parts.
+    return static_cast<std::uint32_t>((bits * 0x9e3779b97f4a7c15ull) >> 32u);
+}
+
+AnchoredY AddAnchorTile::operator()(Y const & e) noexcept {
+    if (e.rank == Y::FirstRank) { m_anchor = e.key.tile; }
+    return AnchoredY{CalibrationKey{e.key.tile, m_anchor, e.reference_area_indices}, e.values};
+}
+
+void add_calibration_sums(CalibrationSums & result, AnchoredY const & e) noexcept {
+    ++result.records;
+    for (std::size_t i = 0; i < result.values.size(); ++i) {
+        result.values[i] += e.values[i] ? 1u : 0u;
+    }
+}
+
+CalibratedSums calibrate(CalibrationSums const & e, double const weight) noexcept {
+    CalibratedSums result;
+    result.tile = e.key.tile;
+    result.areas = e.key.areas;
+    result.users = weight * static_cast<double>(e.records);
+    for (std::size_t i = 0; i < result.values.size(); ++i) {
+        result.values[i] = weight * static_cast<double>(e.values[i]);
+    }
+    return result;
+}
+
+ConnectionStrengths::~ConnectionStrengths()
+{
+    if (m_sums.empty()) {
+        // This is the moved-from instance. We can be rather sure that there
+        // is always input data, and hence there is always some data in
+        // this map.
+        return;
+    }
+    m_outputs.put(output_names::functional_urban_fingerprint_report, m_sums.report());
+}
+
+} // namespace module_d
+
+} // namespace full_analysis
+} // namespace enclave
+} // namespace eurostat
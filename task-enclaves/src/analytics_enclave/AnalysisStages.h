@@ -0,0 +1,235 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include "ConnectionStrengthSums.h"
+#include "DenseTileIds.h"
+#include "Entities.h"
+#include "Pseudonymisation.h"
+#include "ReferenceAreas.h"
+#include "Xoroshiro.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <sharemind-hi/enclave/task/Task.h>
+#include <vector>
+
+/*
+   The record level logic of the stages of `full_analysis::run`. It is kept
+   apart from the stream pipeline, so each stage can also be measured on its
+   own, see the benchmarks of the host build.
+ */
+
+namespace eurostat {
+namespace enclave {
+namespace full_analysis {
+
+// One char names, here we go ...
+using H = UserFootprintUpdates;
+using S = AccumulatedUserFootprint;
+using Y = QuantisedFootprint;
+
+/** Whether an H record is kept: All values are finite and not negative, and
+ * at least one is positive. */
+bool is_valid(H const & e) noexcept;
+
+/** Merges the values of a `duplicate` of the key of `result` into `result`. */
+void merge_duplicate_values(H & result, H const & duplicate) noexcept;
+
+/** The new S record of a key, out of its H and old S records (at most one is
+ * null). */
+S accumulate_s(H const * h, S const * s) noexcept;
+
+/** Adds the values of `other`, the H record of the key of `result` from a
+ * later period, to `result`. */
+void add_period_values(H & result, H const & other) noexcept;
+
+/**
+   Sorts H records in memory by their key. `FootprintKey::operator<` compares
+   the raw bytes, so a radix sort over these bytes yields the same order.
+ */
+struct FootprintKeyRadixSort {
+    /** Jobs which sort in parallel, see `parallelRadixSortByKey`. */
+    std::size_t threads;
+
+    void operator()(H * begin, H * end) const;
+};
+
+/**
+   Reverses the pseudonymisation of the H records chunk-wise. In an ideal
+   situation, pseudonyms are sorted, so only the first record of each run of
+   equal pseudonyms needs to be decrypted. Otherwise, the `PseudonymCache`
+   catches pseudonyms which were seen recently. The remaining pseudonyms of a
+   chunk are decrypted in one batch.
+
+   Writes the cache statistics to the application log in the dtor.
+ */
+class PseudonymReversal {
+public: /* Constants: */
+    static constexpr std::size_t chunk_size = 4096;
+
+public: /* Methods: */
+    /** The cache uses at most `cache_bytes`, see `PseudonymCache`. */
+    explicit PseudonymReversal(PseudonymisationKeyRef pseudonymisation_key,
+                               std::size_t cache_bytes,
+                               Log & application_log);
+
+    PseudonymReversal(PseudonymReversal const &) = delete;
+    PseudonymReversal & operator=(PseudonymReversal const &) = delete;
+
+    ~PseudonymReversal();
+
+    void operator()(PseudonymisedUserFootprintUpdates const * in,
+                    std::size_t count,
+                    H * out);
+
+private: /* Fields: */
+    PseudonymDecryptor m_decryptor;
+    PseudonymCache m_cache;
+    Log & m_application_log;
+    bool m_has_last = false;
+    PseudonymisedUserIdentifier m_last_pseudonym = {};
+    UserIdentifier m_last_id = {};
+    /** The identifiers of the runs in the current chunk. */
+    std::vector<UserIdentifier> m_ids;
+    /** For each record of the chunk, its index into `m_ids`. */
+    std::vector<std::size_t> m_run_index;
+    /** The pseudonyms which need to be decrypted, and where they belong. */
+    std::vector<PseudonymisedUserIdentifier> m_misses;
+    std::vector<std::size_t> m_miss_index;
+    std::vector<UserIdentifier> m_miss_ids;
+};
+
+namespace module_c {
+class SingleHumanAnalysis {
+public: /* Methods: */
+    SingleHumanAnalysis(Statistics & statistics) noexcept
+        : m_statistics(statistics)
+    {}
+
+    /** `footprints` (the S records of one user) is used as scratch space and
+     * is modified. */
+    void operator()(std::vector<S> & footprints, std::vector<Y> & result);
+
+private: /* Fields: */
+    Statistics & m_statistics;
+    /** A weak RNG just used for tie breaking */
+    Xoshiro256Plus m_rng;
+};
+} // namespace module_c
+
+namespace module_d {
+
+/**
+   Sets the reference areas of the Y records of one user: All reference areas
+   containing any of the user's tiles.
+ */
+void add_reference_areas(std::vector<Y> & result, ReferenceAreas const & reference_areas);
+
+/**
+   The calibration weight of a user only depends on the top anchor tile of the
+   user, and it is only known once all Y records were seen. So with
+   calibration, the Y records are summed up by this key instead, and the
+   weights are applied to the sums in the end.
+ */
+struct CalibrationKey {
+    TileIndex tile;
+    /** The tile of the user's Y record with the `FirstRank`. */
+    TileIndex anchor;
+    /** The reference areas of the user. */
+    ReferenceAreas::Set areas;
+};
+
+bool operator==(CalibrationKey const & a, CalibrationKey const & b) noexcept;
+/** By the tile first, as `aggregateByTile` requires. */
+bool operator<(CalibrationKey const & a, CalibrationKey const & b) noexcept;
+std::uint32_t denseIdHash(CalibrationKey const & key) noexcept;
+inline TileIndex aggregationTile(CalibrationKey const & key) noexcept { return key.tile; }
+
+/** A Y record with the top anchor tile of its user. */
+struct AnchoredY {
+    CalibrationKey key;
+    std::array<bool, num_subperiods> values;
+};
+
+/**
+   Adds the top anchor tile to the Y records. The records of a user are
+   consecutive, and the first one has the `FirstRank`.
+ */
+class AddAnchorTile {
+public: /* Methods: */
+    AnchoredY operator()(Y const & e) noexcept;
+
+private: /* Fields: */
+    TileIndex m_anchor = {};
+};
+
+/** The sums of the Y records with the same `CalibrationKey`. */
+struct CalibrationSums {
+    CalibrationKey key;
+    /** The number of records, i.e. of users. */
+    std::uint64_t records;
+    std::array<std::uint64_t, num_subperiods> values;
+};
+
+void add_calibration_sums(CalibrationSums & result, AnchoredY const & e) noexcept;
+
+/** The `CalibrationSums` of a key, weighted by the calibration weight of its
+ * top anchor tile. */
+struct CalibratedSums {
+    TileIndex tile;
+    ReferenceAreas::Set areas;
+    /** The weighted number of users. */
+    double users;
+    std::array<double, num_subperiods> values;
+};
+
+CalibratedSums calibrate(CalibrationSums const & e, double weight) noexcept;
+
+/**
+   Accumulates the connection strength operands of the Y records, or of their
+   `CalibratedSums`, see `ConnectionStrengthSums`.
+
+   Puts the `FunctionalUrbanFingerprintReport` into the outputs in the dtor.
+ */
+struct ConnectionStrengths {
+public: /* Methods: */
+    void operator()(Y const & e) { m_sums.add(e); }
+    void operator()(CalibratedSums const & e) { m_sums.add(e.tile, e.areas, e.users); }
+
+    ConnectionStrengths(sharemind_hi::enclave::TaskOutputs & outputs,
+                        ReferenceAreas const & reference_areas) noexcept
+        : m_outputs(outputs), m_sums(reference_areas)
+    {}
+
+    ConnectionStrengths(ConnectionStrengths &&) noexcept = default;
+
+    ~ConnectionStrengths();
+
+public: /* Fields: */
+    sharemind_hi::enclave::TaskOutputs & m_outputs;
+
+private: /* Fields: */
+    ConnectionStrengthSums m_sums;
+};
+
+} // namespace module_d
+
+} // namespace full_analysis
+} // namespace enclave
+} // namespace eurostat
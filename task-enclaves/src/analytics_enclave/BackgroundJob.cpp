@@ -0,0 +1,189 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#include "BackgroundJob.h"
+#include "Parameters.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <sharemind-hi/enclave/common/Log.h>
+#include <utility>
+
+namespace eurostat {
+namespace enclave {
+namespace {
+
+std::atomic<std::uint64_t> threaded_jobs{0u};
+std::atomic<std::uint64_t> synchronous_jobs{0u};
+std::atomic<std::uint64_t> failed_jobs{0u};
+
+#ifdef EUROSTAT_ENCLAVE_THREADS
+/** The calling thread needs a TCS itself. */
+constexpr std::size_t tcs_threads = enclave_tcs - 1u;
+std::atomic<std::size_t> max_threads{tcs_threads};
+std::atomic<std::size_t> running_threads{0u};
+
+/** Reserves one of the `max_threads`, if one is left. */
+bool reserveThread() noexcept {
+    auto const max = max_threads.load(std::memory_order_relaxed);
+    auto running = running_threads.load(std::memory_order_relaxed);
+    do {
+        if (running >= max) { return false; }
+    } while (!running_threads.compare_exchange_weak(running,
+                                                    running + 1u,
+                                                    std::memory_order_relaxed));
+    return true;
+}
+
+void releaseThread() noexcept {
+    running_threads.fetch_sub(1u, std::memory_order_relaxed);
+}
+#endif
+
+} // anonymous namespace
+
+BackgroundJob::~BackgroundJob() {
+    try {
+        wait();
+    } catch (...) {
+        // The owner is destroyed, most likely due to another exception. Nobody
+        // is interested in the result of the job anymore.
+    }
+}
+
+void BackgroundJob::start(std::function<void()> job) {
+    assert(!m_started);
+    m_job = std::move(job);
+    m_exception = nullptr;
+    m_io_account = IoAccount::current();
+    m_started = true;
+    // E.g. a merge of many sorted runs which all read ahead would otherwise
+    // request a thread per run. The jobs over the limit just run in `wait()`.
+    if (!startThread()) { synchronous_jobs.fetch_add(1u, std::memory_order_relaxed); }
+}
+
+bool BackgroundJob::tryStart(std::function<void()> job) {
+    assert(!m_started);
+    m_job = std::move(job);
+    m_exception = nullptr;
+    m_io_account = IoAccount::current();
+    m_started = startThread();
+    if (!m_started) { m_job = nullptr; }
+    return m_started;
+}
+
+void BackgroundJob::wait() {
+    if (!m_started) { return; }
+    m_started = false;
+#ifdef EUROSTAT_ENCLAVE_THREADS
+    if (m_threaded) {
+        auto const status = pthread_join(m_thread, nullptr);
+        if (status != 0) {
+            // The thread is in an unknown state and might still access memory
+            // we are about to release. There is no sane way to continue.
+            enclave_printf_log("BackgroundJob: Failed to join an enclave thread (status: %d). Aborting.", status);
+            std::abort();
+        }
+        releaseThread();
+        IoCounters::addToThread(m_io);
+    } else {
+        execute(this);
+    }
+#else
+    execute(this);
+#endif
+    m_job = nullptr;
+    if (m_exception) { std::rethrow_exception(m_exception); }
+}
+
+bool BackgroundJob::startThread() {
+#ifdef EUROSTAT_ENCLAVE_THREADS
+    m_threaded = false;
+    if (!reserveThread()) { return false; }
+    // Set before the thread reads it.
+    m_threaded = true;
+    auto const status = pthread_create(&m_thread, nullptr, &BackgroundJob::execute, this);
+    if (status != 0) {
+        m_threaded = false;
+        releaseThread();
+        failed_jobs.fetch_add(1u, std::memory_order_relaxed);
+#ifndef NDEBUG
+        enclave_printf_log("BackgroundJob: Failed to create an enclave thread (status: %d), running synchronously.", status);
+#endif
+        return false;
+    }
+    threaded_jobs.fetch_add(1u, std::memory_order_relaxed);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void BackgroundJob::setMaxThreads(std::size_t const threads) noexcept {
+#ifdef EUROSTAT_ENCLAVE_THREADS
+    max_threads.store(std::min(threads, tcs_threads), std::memory_order_relaxed);
+#else
+    (void) threads;
+#endif
+}
+
+std::size_t BackgroundJob::maxThreads() noexcept {
+#ifdef EUROSTAT_ENCLAVE_THREADS
+    return max_threads.load(std::memory_order_relaxed);
+#else
+    return 0u;
+#endif
+}
+
+BackgroundJob::Statistics BackgroundJob::statistics() noexcept {
+    Statistics result;
+    result.threaded = threaded_jobs.load(std::memory_order_relaxed);
+    result.synchronous = synchronous_jobs.load(std::memory_order_relaxed);
+    result.failed = failed_jobs.load(std::memory_order_relaxed);
+    return result;
+}
+
+void * BackgroundJob::execute(void * const self) noexcept {
+    auto & job = *static_cast<BackgroundJob *>(self);
+#ifdef EUROSTAT_ENCLAVE_THREADS
+    // The thread local storage of a TCS might outlive its threads.
+    auto const io_before = IoCounters::ofThread();
+#endif
+    {
+        IoAccount const account{job.m_io_account};
+        try {
+            job.m_job();
+        } catch (...) {
+            job.m_exception = std::current_exception();
+        }
+    }
+#ifdef EUROSTAT_ENCLAVE_THREADS
+    if (job.m_threaded) {
+        auto const & io_after = IoCounters::ofThread();
+        for (std::size_t i = 0; i < IoCounters::ACCOUNTS; ++i) {
+            job.m_io[i].bytes_written = io_after[i].bytes_written - io_before[i].bytes_written;
+            job.m_io[i].ocalls = io_after[i].ocalls - io_before[i].ocalls;
+        }
+    }
+#endif
+    return nullptr;
+}
+
+} // namespace enclave
+} // namespace eurostat
@@ -0,0 +1,116 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include "IoCounters.h"
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#ifdef EUROSTAT_ENCLAVE_THREADS
+#include <pthread.h>
+#endif
+
+namespace eurostat {
+namespace enclave {
+
+/**
+   Runs a single job on a separate enclave thread, so that e.g. file I/O can
+   overlap with the processing done in the calling thread.
+
+   Additional enclave threads are only available if the enclave is built with
+   the `ENCLAVE_THREADS` CMake option (the default, if sharemind-hi supports
+   it), as they need the `sgx_pthread` library and a spare TCS per
+   concurrently running job (`enclave_tcs`, set with the `ENCLAVE_TCS_NUM`
+   option). Without it, the job is run lazily in the calling thread as part
+   of `wait()`, which behaves exactly as if no `BackgroundJob` was used in
+   the first place. The same happens if no thread could be created, e.g. as
+   the enclave got fewer TCS than configured, and if already `maxThreads()`
+   jobs run on their own threads, so jobs do not compete for the TCS. How
+   many jobs ran in which way is reported by `statistics()`. Either way, the
+   job counts its I/O into the `IoAccount` of the thread which started it,
+   and the counts are added to the thread which waits for it.
+
+   The object is neither copyable nor movable, as the running job may refer to
+   it. Keep it on the heap if the owner needs to be movable.
+ */
+class BackgroundJob {
+public: /* Types: */
+    /** The number of started jobs, since the enclave was loaded. */
+    struct Statistics {
+        std::uint64_t threaded;
+        /** Includes the `failed` ones. */
+        std::uint64_t synchronous;
+        /** The jobs which ran synchronously as no thread could be created. */
+        std::uint64_t failed;
+    };
+
+public: /* Methods: */
+    BackgroundJob() noexcept = default;
+    BackgroundJob(BackgroundJob const &) = delete;
+    BackgroundJob & operator=(BackgroundJob const &) = delete;
+
+    /** Waits for a still running job, its exception is swallowed. */
+    ~BackgroundJob();
+
+    /** Precondition: No job was started, or it was `wait`ed for. */
+    void start(std::function<void()> job);
+
+    /**
+       Like `start`, but only starts the job if it gets its own thread, e.g.
+       if it waits for the calling thread itself. Otherwise `job` is dropped,
+       and false is returned.
+     */
+    bool tryStart(std::function<void()> job);
+
+    /**
+       Blocks until the started job has finished and rethrows the exception
+       thrown by the job, if any. Does nothing if no job was started.
+     */
+    void wait();
+
+    /**
+       Limits the jobs which run on their own threads at the same time, at
+       most (and by default) `enclave_tcs - 1`, as the task runs on a TCS
+       itself. Always 0 without enclave threads.
+     */
+    static void setMaxThreads(std::size_t threads) noexcept;
+    static std::size_t maxThreads() noexcept;
+
+    static Statistics statistics() noexcept;
+
+private: /* Methods: */
+    /** Starts the job on its own thread, if there is one. */
+    bool startThread();
+    static void * execute(void * self) noexcept;
+
+private: /* Fields: */
+    std::function<void()> m_job;
+    std::exception_ptr m_exception;
+    bool m_started = false;
+    std::size_t m_io_account = 0u;
+#ifdef EUROSTAT_ENCLAVE_THREADS
+    pthread_t m_thread = {};
+    bool m_threaded = false;
+    /** The I/O of the thread of the job. */
+    IoCounters::Accounts m_io = {};
+#endif
+};
+
+} // namespace enclave
+} // namespace eurostat
@@ -0,0 +1,60 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#include "BlockQueue.h"
+#include <cstdlib>
+
+namespace eurostat {
+namespace enclave {
+
+#ifdef EUROSTAT_ENCLAVE_THREADS
+QueueMonitor::QueueMonitor() noexcept {
+    pthread_mutex_init(&m_mutex, nullptr);
+    pthread_cond_init(&m_condition, nullptr);
+}
+
+QueueMonitor::~QueueMonitor() {
+    pthread_cond_destroy(&m_condition);
+    pthread_mutex_destroy(&m_mutex);
+}
+
+void QueueMonitor::lock() noexcept { pthread_mutex_lock(&m_mutex); }
+
+void QueueMonitor::unlock() noexcept { pthread_mutex_unlock(&m_mutex); }
+
+void QueueMonitor::wait() noexcept { pthread_cond_wait(&m_condition, &m_mutex); }
+
+void QueueMonitor::notifyAll() noexcept { pthread_cond_broadcast(&m_condition); }
+#else
+QueueMonitor::QueueMonitor() noexcept = default;
+
+QueueMonitor::~QueueMonitor() = default;
+
+void QueueMonitor::lock() noexcept {}
+
+void QueueMonitor::unlock() noexcept {}
+
+void QueueMonitor::wait() noexcept {
+    // Nobody else could ever change the state which is waited for.
+    std::abort();
+}
+
+void QueueMonitor::notifyAll() noexcept {}
+#endif
+
+} // namespace enclave
+} // namespace eurostat
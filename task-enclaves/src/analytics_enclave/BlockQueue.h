@@ -0,0 +1,142 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <sharemind-hi/enclave/common/EnclaveException.h>
+#include <utility>
+#include <vector>
+#ifdef EUROSTAT_ENCLAVE_THREADS
+#include <pthread.h>
+#endif
+
+namespace eurostat {
+namespace enclave {
+
+/**
+   A mutex with a condition variable, which guards a `BlockQueue`. Without
+   enclave threads no `BackgroundJob` runs concurrently, hence no queue is
+   shared by two threads, and this does nothing.
+ */
+class QueueMonitor {
+public: /* Types: */
+    class Lock {
+    public: /* Methods: */
+        explicit Lock(QueueMonitor & monitor) noexcept : m_monitor(monitor) { m_monitor.lock(); }
+        Lock(Lock const &) = delete;
+        Lock & operator=(Lock const &) = delete;
+        ~Lock() { m_monitor.unlock(); }
+
+    private: /* Fields: */
+        QueueMonitor & m_monitor;
+    };
+
+public: /* Methods: */
+    QueueMonitor() noexcept;
+    QueueMonitor(QueueMonitor const &) = delete;
+    QueueMonitor & operator=(QueueMonitor const &) = delete;
+    ~QueueMonitor();
+
+    void lock() noexcept;
+    void unlock() noexcept;
+    /** Precondition: Locked. Unlocks until `notifyAll` is called. */
+    void wait() noexcept;
+    void notifyAll() noexcept;
+
+private: /* Fields: */
+#ifdef EUROSTAT_ENCLAVE_THREADS
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_condition;
+#endif
+};
+
+/**
+   Hands blocks of elements from a producer to a consumer running on another
+   thread. At most `capacity` blocks are queued, so a slow consumer blocks
+   the producer instead of letting the queue grow.
+
+   The producer `close`s the queue when it is done. Either side `abort`s it
+   when it gives up, e.g. after a failure, which unblocks the other side: A
+   waiting producer stops pushing, and a waiting consumer gets an exception
+   instead of a truncated stream.
+ */
+template <typename T>
+class BlockQueue {
+public: /* Methods: */
+    explicit BlockQueue(std::size_t const capacity) noexcept
+        : m_capacity{capacity}
+    {}
+
+    /**
+       Moves `block` into the queue, and waits while the queue is full.
+       Returns false if the consumer aborted, then the block is dropped.
+     */
+    bool push(std::vector<T> & block) {
+        QueueMonitor::Lock lock{m_monitor};
+        while (m_blocks.size() >= m_capacity && !m_aborted) { m_monitor.wait(); }
+        if (m_aborted) { return false; }
+        m_blocks.push_back(std::move(block));
+        block.clear();
+        m_monitor.notifyAll();
+        return true;
+    }
+
+    /** No more blocks will be pushed. */
+    void close() noexcept {
+        QueueMonitor::Lock lock{m_monitor};
+        m_closed = true;
+        m_monitor.notifyAll();
+    }
+
+    /**
+       Moves the next block into `block`, and waits while the queue is empty.
+       Returns false if the queue is empty and closed. Throws if it was
+       aborted.
+     */
+    bool pop(std::vector<T> & block) {
+        QueueMonitor::Lock lock{m_monitor};
+        while (m_blocks.empty() && !m_closed && !m_aborted) { m_monitor.wait(); }
+        if (m_aborted) {
+            throw sharemind_hi::enclave::EnclaveException("BlockQueue: The producer gave up.");
+        }
+        if (m_blocks.empty()) { return false; }
+        block = std::move(m_blocks.front());
+        m_blocks.pop_front();
+        m_monitor.notifyAll();
+        return true;
+    }
+
+    /** No more blocks will be pushed or popped. */
+    void abort() noexcept {
+        QueueMonitor::Lock lock{m_monitor};
+        m_aborted = true;
+        m_blocks.clear();
+        m_monitor.notifyAll();
+    }
+
+private: /* Fields: */
+    QueueMonitor m_monitor;
+    std::size_t m_capacity;
+    std::deque<std::vector<T>> m_blocks = {};
+    bool m_closed = false;
+    bool m_aborted = false;
+};
+
+} // namespace enclave
+} // namespace eurostat
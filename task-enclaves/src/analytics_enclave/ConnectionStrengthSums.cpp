@@ -0,0 +1,81 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#include "ConnectionStrengthSums.h"
+#include "Parameters.h"
+#include <cstddef>
+
+namespace eurostat {
+namespace enclave {
+
+ReferenceAreas::Set const ConnectionStrengthSums::low_word_mask{~0ull};
+
+void ConnectionStrengthSums::add(TileIndex const tile,
+                                 ReferenceAreas::Set const & areas,
+                                 double const weight)
+{
+    auto const tile_id = m_tile_ids.insert(tile);
+    if (tile_id == m_denominators.size()) {
+        m_denominators.push_back(0.0);
+        m_numerators.resize(m_numerators.size() + m_reference_areas.size(), 0.0);
+    }
+
+    // The weight is 1.0 per user if calibration is disabled.
+    // The denominator is the same for all reference areas which do not
+    // contain the tile, the others are skipped when reporting.
+    m_denominators[tile_id] += weight;
+
+    // Only the reference areas of the user which do not contain the tile
+    // (yes, only look at elements outside) contribute to a numerator, so
+    // only their bits are visited.
+    auto const outside = areas & ~m_reference_areas.areasOf(tile);
+    if (outside.none()) { return; }
+    auto const numerators = &m_numerators[tile_id * m_reference_areas.size()];
+    static_assert(ReferenceArea::MAX_REFERENCE_AREAS % 64u == 0u, "");
+    for (std::size_t word = 0; word < m_reference_areas.size(); word += 64u) {
+        auto bits = ((outside >> word) & low_word_mask).to_ullong();
+        while (bits != 0u) {
+            auto const ra_index = word + static_cast<std::size_t>(__builtin_ctzll(bits));
+            numerators[ra_index] += weight;
+            bits &= bits - 1u;
+        }
+    }
+}
+
+std::vector<FunctionalUrbanFingerprintReport> ConnectionStrengthSums::report() const
+{
+    std::vector<FunctionalUrbanFingerprintReport> result;
+
+    for (ReferenceAreaIndex ra_index = 0; ra_index < m_reference_areas.size();
+         ++ra_index) {
+        for (std::size_t tile_id = 0; tile_id < m_denominators.size(); ++tile_id) {
+            auto const tile = m_tile_ids.key(static_cast<DenseTileIds::Id>(tile_id));
+            if (m_reference_areas.areasOf(tile).test(ra_index)) { continue; }
+
+            auto const numerator = m_numerators[tile_id * m_reference_areas.size() + ra_index];
+            auto const strength = numerator / m_denominators[tile_id];
+            // Applying SDC. Don't add 0 connection strengths to the result.
+            if (numerator >= sdc_threshold && strength > 1e-20) {
+                result.push_back({{ra_index, tile}, strength});
+            }
+        }
+    }
+    return result;
+}
+
+} // namespace enclave
+} // namespace eurostat
@@ -0,0 +1,76 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include "DenseTileIds.h"
+#include "Entities.h"
+#include "ReferenceAreas.h"
+#include <vector>
+
+namespace eurostat {
+namespace enclave {
+
+/**
+   The connection strength operands for each pair of a reference area r and a
+   tile j outside of r. The tiles are numbered densely in the order they are
+   seen, and the operands are kept in arrays indexed by the tile id (and the
+   reference area index for the numerators), so no hash lookup per reference
+   area is needed.
+ */
+class ConnectionStrengthSums {
+public: /* Methods: */
+    explicit ConnectionStrengthSums(ReferenceAreas const & reference_areas) noexcept
+        : m_reference_areas(reference_areas)
+    {}
+
+    /** Adds a Y record with its reference areas and calibration weight. */
+    void add(QuantisedFootprint const & e) {
+        add(e.key.tile, e.reference_area_indices, e.calibration_weight);
+    }
+
+    /** Adds users with the same `tile` and reference `areas`, whose
+     * calibration weights sum up to `weight`. */
+    void add(TileIndex tile, ReferenceAreas::Set const & areas, double weight);
+
+    /** Whether no record was added. */
+    bool empty() const noexcept { return m_denominators.empty(); }
+
+    /** The connection strengths which pass the SDC, ordered by the reference
+     * area, and then by the tile in the order the tiles were first added. */
+    std::vector<FunctionalUrbanFingerprintReport> report() const;
+
+private: /* Fields: */
+    static ReferenceAreas::Set const low_word_mask;
+
+    ReferenceAreas const & m_reference_areas;
+    DenseTileIds m_tile_ids;
+    /**
+       Per tile: The number of users that have tile j in their usual
+       environment.
+     */
+    std::vector<double> m_denominators;
+    /**
+       Per tile and reference area (the latter being the minor index): The
+       number of users that have both tile j and RA r in their usual
+       environment.
+     */
+    std::vector<double> m_numerators;
+};
+
+} // namespace enclave
+} // namespace eurostat
@@ -0,0 +1,31 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#include "DenseTileIds.h"
+
+namespace eurostat {
+namespace enclave {
+
+std::uint32_t denseIdHash(TileIndex const tile) noexcept {
+    // Fibonacci hashing, the upper bits are used to select the slot.
+    return ((std::uint32_t{tile.easting} << 16u) | tile.northing) * 0x9e3779b1u;
+}
+
+template class DenseIds<TileIndex>;
+
+} // namespace enclave
+} // namespace eurostat
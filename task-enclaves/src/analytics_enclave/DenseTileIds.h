@@ -0,0 +1,111 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include "Entities.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace eurostat {
+namespace enclave {
+
+/** The hash of a tile for `DenseIds`. */
+std::uint32_t denseIdHash(TileIndex tile) noexcept;
+
+/**
+   Numbers the distinct keys in the order they are first inserted, so data
+   per key can be kept in dense arrays indexed by the key id.
+
+   The keys are kept in an open addressing hash table with linear probing,
+   whose slots hold the key ids. A key needs an `operator==` and a 32 bit
+   hash `denseIdHash(Key)`, whose upper bits select the slot.
+ */
+template <typename Key>
+class DenseIds {
+public: /* Types: */
+    using Id = std::uint32_t;
+
+    static constexpr Id none = static_cast<Id>(-1);
+
+public: /* Methods: */
+    /** Returns the id of `key`, a new key gets the next free id. */
+    Id insert(Key const & key) {
+        // Keep the load factor at or below 1/2.
+        if (2u * (m_keys.size() + 1u) > m_slots.size()) {
+            rehash(m_slots.empty() ? 1024u : 2u * m_slots.size());
+        }
+
+        auto const slot = findSlot(key);
+        if (m_slots[slot] == 0u) {
+            m_keys.push_back(key);
+            m_slots[slot] = static_cast<Id>(m_keys.size());
+        }
+        return m_slots[slot] - 1u;
+    }
+
+    /** Returns the id of `key`, or `none` if it was not inserted. */
+    Id find(Key const & key) const noexcept {
+        if (m_slots.empty()) { return none; }
+        return m_slots[findSlot(key)] - 1u;
+    }
+
+    /** The number of distinct keys, ids are below this. */
+    std::size_t size() const noexcept { return m_keys.size(); }
+
+    Key const & key(Id id) const noexcept { return m_keys[id]; }
+
+private: /* Methods: */
+    /** The slot holding `key`, or the empty slot where it would be put. */
+    std::size_t findSlot(Key const & key) const noexcept {
+        auto const mask = m_slots.size() - 1u;
+        std::size_t slot = denseIdHash(key) >> m_shift;
+        while (m_slots[slot] != 0u && !(m_keys[m_slots[slot] - 1u] == key)) {
+            slot = (slot + 1u) & mask;
+        }
+        return slot;
+    }
+
+    void rehash(std::size_t const slot_count) {
+        m_slots.assign(slot_count, 0u);
+        m_shift = 32u;
+        for (std::size_t s = slot_count; s > 1u; s /= 2u) { --m_shift; }
+        for (std::size_t i = 0; i < m_keys.size(); ++i) {
+            m_slots[findSlot(m_keys[i])] = static_cast<Id>(i + 1u);
+        }
+    }
+
+private: /* Fields: */
+    std::vector<Key> m_keys;
+    /** Key id plus one, zero marks an empty slot. The number of slots is a
+     * power of two. */
+    std::vector<Id> m_slots;
+    /** Right shift applied to the 32 bit key hash to get a slot. */
+    unsigned m_shift = 32;
+};
+
+template <typename Key>
+constexpr typename DenseIds<Key>::Id DenseIds<Key>::none;
+
+extern template class DenseIds<TileIndex>;
+
+/** Numbers the distinct tiles, see `DenseIds`. */
+using DenseTileIds = DenseIds<TileIndex>;
+
+} // namespace enclave
+} // namespace eurostat
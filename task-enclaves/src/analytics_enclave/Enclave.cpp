@@ -48,7 +48,10 @@
 #include "Entities.h"
 #include "FullAnalysis.h"
 #include "HiInternalApiDuplication.h"
+#include "IoProfile.h"
 #include "Parameters.h"
+#include "PipelineProfile.h"
+#include "SSegments.h"
 #include "Seal.h"
 #include "SgxEncryptedFile.h"
 
@@ -78,6 +81,8 @@ public:
 std::string persistent_path;
 /** Where to store the state file. Set in the `init()` function. */
 std::string state_file_path;
+/** Where to store the report request file. Set in the `init()` function. */
+std::string report_request_file_path;
 
 void init() {
     static constexpr std::size_t const maxPathSize = 256u;
@@ -97,15 +102,24 @@ void init() {
     }
     persistent_path.erase(pos + 1);
     state_file_path = persistent_path + "state_file";
+    report_request_file_path = persistent_path + "report_request_file";
     enclave_printf_log("persistent path: %s, state file path: %s",
                        persistent_path.c_str(),
                        state_file_path.c_str());
 }
 
-std::string s_file_path(bool const index) {
-    return persistent_path + "s_file" + (index ? "1" : "0");
+/** Prefix of the files of the S segments. */
+std::string s_file_prefix() {
+    return persistent_path + "s_file";
 };
 
+/** Appends the paths of the S files of all shards. */
+void collect_s_file_paths(SShards const & shards, std::vector<std::string> & paths) {
+    for (std::size_t shard = 0; shard < shards.size(); ++shard) {
+        shards[shard].collectPaths(sShardPrefix(s_file_prefix(), shard), paths);
+    }
+}
+
 std::list<EnclaveDataInfo> const & find_topic(TaskInputs const & inputs,
                                               char const * const name)
 {
@@ -155,8 +169,20 @@ static_assert(sizeof(ReportRequest)
 /**
   This state is persistent, read in the start and written at the end of a
   successfull run.
+
+  The `ReportRequest` is not part of it: It is large, and it does not change
+  while the H files are processed. It is sealed into its own file once, when
+  the request is accepted, so the state stays small.
 */
 struct State {
+    /**
+       The layout of the sealed state. Increment it whenever the layout of
+       the state (including `SSegments`) changes, so a state which was
+       written by another enclave version is rejected with a clear error.
+       Only the `LegacyState`, which has no version, is converted.
+     */
+    static constexpr std::uint32_t VERSION = 1;
+
     // It's a simple state machine
     enum STATE_MACHINE {
         AWAITING_NEW_NSI_REPORT_REQUESTS,
@@ -167,10 +193,21 @@ struct State {
         // Should be empty.
     };
     struct AwaitingNewHFiles {
-        ReportRequest report_request;
+        // The scalar arguments of the report request, so they are available
+        // without loading the report request file.
+        Period first_period;
+        Period last_period;
+        std::uint64_t with_calibration;
+
         Period next_expected_period;
+
+        // The data id of the NSI input of the report request. It is part of
+        // the AAD of the report request file, so only the file of this
+        // request is accepted.
+        std::size_t report_request_id;
     };
 
+    std::uint32_t version = VERSION;
     STATE_MACHINE state = AWAITING_NEW_NSI_REPORT_REQUESTS;
     union {
         AwaitingNewRequests awaiting_new_requests;
@@ -187,40 +224,64 @@ struct State {
     std::size_t last_seen_nsi_inputs_topic_size = 0;
 
     /**
-     * The crypto key to use with the `sgx_fopen` API. The `sgx_fopen_auto_key`
-     * API is not used, as then S files from older report requests could be
-     * "imported" into this report request. This is changed on each update.
+     * The S shards, each S file with its own crypto key for the `sgx_fopen` API. The
+     * `sgx_fopen_auto_key` API is not used, as then S files from older report
+     * requests could be "imported" into this report request. An update only
+     * adds a new file, so the files this state refers to stay intact until
+     * the new state is stored.
      */
-    SgxFileKey s_file_key = {};
-
-    /**
-     * Valid values: 0, 1.
-     * We read from the S file and write to the S file in the same pipe
-     * command. Hence, we need to use different S files. In this case, using a
-     * double buffer, switching back and forth. */
-    bool s_file_name_index = 0;
+    SShards s_segments = {};
 
     void go_into_request_await_state() noexcept
     {
         state = State::AWAITING_NEW_NSI_REPORT_REQUESTS;
         awaiting_new_requests = {};
-        s_file_name_index = 0;
+        s_segments = {};
     }
 
-    void go_into_h_processing_state(ReportRequest const & report_request) noexcept
+    void go_into_h_processing_state(ReportRequest const & report_request,
+                                    std::size_t const report_request_id) noexcept
     {
         state = State::AWAITING_NEW_H_FILES;
+        awaiting_new_h_files.first_period = report_request.first_period;
+        awaiting_new_h_files.last_period = report_request.last_period;
+        awaiting_new_h_files.with_calibration = report_request.with_calibration;
         awaiting_new_h_files.next_expected_period = report_request.first_period;
-        awaiting_new_h_files.report_request = report_request;
-        s_file_name_index = 0;
+        awaiting_new_h_files.report_request_id = report_request_id;
+        s_segments = {};
     }
 };
 // Make sure that we can really memcpy it into a file, and back from the file
 // into the object.
 static_assert(std::is_trivially_copyable<State>::value, "");
 
-std::unique_ptr<State> load_state();
+/**
+   The layout of the state before `State::VERSION` was added: The report
+   request was part of the state, and S was a single file of raw records,
+   `s_file0` or `s_file1`. Such a state is converted by `load_state`.
+ */
+struct LegacyState {
+    struct AwaitingNewHFiles {
+        ReportRequest report_request;
+        Period next_expected_period;
+    };
+
+    State::STATE_MACHINE state;
+    union {
+        State::AwaitingNewRequests awaiting_new_requests;
+        AwaitingNewHFiles awaiting_new_h_files;
+    };
+    std::size_t last_seen_nsi_inputs_topic_size;
+    SgxFileKey s_file_key;
+    bool s_file_name_index;
+};
+static_assert(std::is_trivially_copyable<LegacyState>::value, "");
+static_assert(sizeof(LegacyState) != sizeof(State), "");
+
+std::unique_ptr<State> load_state(std::vector<std::string> & old_s_files_to_delete);
 void store_state(State const &);
+std::unique_ptr<ReportRequest> load_report_request(State const &);
+void store_report_request(ReportRequest const &, std::size_t report_request_id);
 /**
    `process_state` matches the state against the parameters and calls one of
    the other `process_*` functions.
@@ -231,16 +292,22 @@ State & process_state(State &,
                       std::vector<std::string> & old_s_files_to_delete,
                       Log &);
 State & process_nsi_report_request_digestion(State &, TaskInputs const &, Log &);
-State & process_h_file(State &,
-                       TaskInputs const &,
-                       TaskOutputs &,
-                       std::vector<std::string> & old_s_files_to_delete,
-                       Log &,
-                       std::string const & h_file,
-                       Period const period);
+State & process_h_files(State &,
+                        TaskInputs const &,
+                        TaskOutputs &,
+                        std::vector<std::string> & old_s_files_to_delete,
+                        Log &,
+                        std::vector<std::string> const & h_files,
+                        std::vector<bool> const & h_files_sorted,
+                        Period const first_period);
 State & process_cancel(State &,
                        std::vector<std::string> & old_s_files_to_delete,
                        Log & application_log);
+/** Cancels the report request of a state which could not be loaded. */
+State & process_cancel_without_state(State &,
+                                     TaskInputs const &,
+                                     char const * load_error,
+                                     Log & application_log);
 State &
 process_manually_finish_report(State &,
                                TaskOutputs &,
@@ -266,11 +333,27 @@ void run(TaskInputs const & inputs, TaskOutputs & outputs) {
 
     std::vector<std::string> old_s_files_to_delete;
 
-    store_state(process_state(*load_state().get(),
-                              inputs,
-                              outputs,
-                              old_s_files_to_delete,
-                              application_log));
+    std::unique_ptr<State> state;
+    bool state_lost = false;
+    try {
+        state = load_state(old_s_files_to_delete);
+    } catch (std::exception const & e) {
+        // A state which cannot be loaded can still be canceled, otherwise
+        // the enclave would never accept a new report request again.
+        if (!inputs.argument(arguments::cancel) || inputs.arguments().size() != 1) { throw; }
+        state.reset(new State{});
+        process_cancel_without_state(*state, inputs, e.what(), application_log);
+        state_lost = true;
+    }
+    bool const had_report_request =
+            state_lost || state->state == State::AWAITING_NEW_H_FILES;
+
+    store_state(state_lost ? *state
+                           : process_state(*state,
+                                           inputs,
+                                           outputs,
+                                           old_s_files_to_delete,
+                                           application_log));
 
     // The state has been overwritten, so the old S files can be delete, too.
     for (auto const & old_s_file_to_delete : old_s_files_to_delete) {
@@ -281,6 +364,18 @@ void run(TaskInputs const & inputs, TaskOutputs & outputs) {
         }
     }
 
+    // Likewise the report request file, if the report was finished or
+    // canceled.
+    if (had_report_request
+        && state->state == State::AWAITING_NEW_NSI_REPORT_REQUESTS)
+    {
+        try {
+            File::remove(report_request_file_path);
+        } catch (...) {
+            /* ignore */
+        }
+    }
+
     outputs.put(output_names::application_log,
                 application_log.c_str(),
                 application_log.size());
@@ -297,7 +392,7 @@ CensusResidents deserialize(CensusResident const * cur,
 {
     CensusResidents result;
     for (; cur != end; ++cur) {
-        result.emplace(std::make_pair(cur->index, cur->value));
+        result.insert(cur->index, cur->value);
     }
     return result;
 }
@@ -315,12 +410,8 @@ ReferenceAreas deserialize(ReferenceArea const * cur,
         // incrementing without gaps.
         if (cur->id > result.size() || result.size() - cur->id > 1) {
             throw EnclaveException("The reference area indices are invalid.");
-        } else if (cur->id == result.size()) {
-            result.push_back({cur->tile_index});
-        } else {
-            assert(cur->id + 1u == result.size()); // ensured by the top condition.
-            result.back().emplace(cur->tile_index);
         }
+        result.add(cur->id, cur->tile_index);
     }
     return result;
 }
@@ -341,8 +432,20 @@ void read_h_metadata_file(std::string const & h_file_path, Log & application_log
     application_log.append("\n");
 }
 
+/** Splits the comma separated values of the `file` and `period` arguments. */
+std::vector<std::string> split_list(std::string const & list) {
+    std::vector<std::string> result;
+    std::string::size_type begin = 0;
+    for (auto end = list.find(','); end != std::string::npos; end = list.find(',', begin)) {
+        result.push_back(list.substr(begin, end - begin));
+        begin = end + 1u;
+    }
+    result.push_back(list.substr(begin));
+    return result;
+}
+
 // Have a single function so it is consistent:
-void log_request_arguments(ReportRequest const & report_request,
+void log_request_arguments(State::AwaitingNewHFiles const & report_request,
                            Log & application_log)
 {
     application_log.append("With calibration: ");
@@ -378,20 +481,75 @@ void log_skipped_periods(uint64_t const first_skipped_inclusive,
     Actually, in the TE the Dirty automatically becomes "Committing" when the enclave finishes.
 
     Wellp, to get something started, let's just ignore server crashes and write errors.
-    We always commit the state file to the same file in the end. The S file will
-    be written to the toggled place. The S file is only updated once per task run.
+    We always commit the state file to the same file in the end. An S update
+    writes a new S segment file, and only after the state is committed the S
+    files which it replaced are removed, as is the report request file once
+    its report is finished or canceled.
 
  */
 
 
-// Only a single thing is sealed. Hence a single AAD is sufficient.
+// The state and the report request are sealed with different AADs, so one
+// cannot be passed off as the other.
 char const * const sealing_aad = "analysis_enclave_state_file";
 
-/** Return the state as a `std::unique_ptr`, as it is actually rather large. */
-std::unique_ptr<State> load_state()
+std::string report_request_sealing_aad(std::size_t const report_request_id) {
+    return "analysis_enclave_report_request_file_" + std::to_string(report_request_id);
+}
+
+/**
+   Converts a state with the layout before `State::VERSION`: Its report
+   request is sealed into the report request file, and its S file is split
+   into a base segment per shard. The S file is removed once the converted
+   state is stored, so a failed run converts the state again.
+ */
+void convert_legacy_state(LegacyState const & legacy,
+                          State & result,
+                          std::vector<std::string> & old_s_files_to_delete)
+{
+    result.last_seen_nsi_inputs_topic_size = legacy.last_seen_nsi_inputs_topic_size;
+    if (legacy.state != State::AWAITING_NEW_H_FILES) { return; }
+
+    // The report request was accepted as the last one seen.
+    auto const report_request_id = legacy.last_seen_nsi_inputs_topic_size - 1u;
+    store_report_request(legacy.awaiting_new_h_files.report_request, report_request_id);
+    result.go_into_h_processing_state(legacy.awaiting_new_h_files.report_request,
+                                      report_request_id);
+    result.awaiting_new_h_files.next_expected_period =
+            legacy.awaiting_new_h_files.next_expected_period;
+
+    // The S file is ordered by the `FootprintKey`, so is each shard of it.
+    auto const s_file_path =
+            persistent_path + "s_file" + (legacy.s_file_name_index ? "1" : "0");
+    SgxEncryptedFile::create_empty_if_not_exists(s_file_path, legacy.s_file_key);
+    IoProfile const io_profile;
+    std::vector<SSegmentsOutputBuilder::Impl<SUpdate>> shards;
+    for (std::size_t shard = 0; shard < s_shards; ++shard) {
+        // Empty S segments are always compacted, i.e. written as a base.
+        shards.push_back(sSegmentsOutput(sShardPrefix(s_file_prefix(), shard),
+                                         io_profile.s_sink,
+                                         result.s_segments[shard],
+                                         false)
+                                 .build<SUpdate>());
+    }
+    PersistentDataSource<AccumulatedUserFootprint, SgxEncryptedFile> s{
+            s_file_path.c_str(), io_profile.s_source, legacy.s_file_key};
+    SUpdate update;
+    update.changed = true;
+    while (s.next(update.record)) { shards[sShard(update.record.key.id)].sink(update); }
+    for (auto & shard : shards) { std::move(shard).finalize(); }
+    old_s_files_to_delete.push_back(s_file_path);
+}
+
+/**
+   Return the state as a `std::unique_ptr`. A state with the legacy layout is
+   converted, and the files it replaces are added to `old_s_files_to_delete`.
+ */
+std::unique_ptr<State> load_state(std::vector<std::string> & old_s_files_to_delete)
 {
     // Value-initialize (zero initialized).
     auto result = std::unique_ptr<State>{new State{}};
+    std::unique_ptr<LegacyState> legacy;
 
     // We assume that file loading only fails if it does not exist yet. In
     // that case the result is the zeroed state.
@@ -408,12 +566,35 @@ std::unique_ptr<State> load_state()
     unsealData(file,
                sealing_aad,
                strlen(sealing_aad),
-               [&result](std::size_t size) -> void * {
+               [&result, &legacy](std::size_t size) -> void * {
+                   // States which were written before the version was added
+                   // are told apart by their size.
+                   if (size == sizeof(LegacyState)) {
+                       legacy.reset(new LegacyState);
+                       return legacy.get();
+                   }
                    if (size != sizeof(State)) {
-                       throw EnclaveException("Unseal");
+                       throw EnclaveException(
+                               "The state file has an unsupported layout ("
+                               + std::to_string(size) + " instead of "
+                               + std::to_string(sizeof(State))
+                               + " bytes), it was written by another version "
+                                 "of the analysis enclave");
                    }
                    return result.get();
                });
+    if (legacy) {
+        enclave_printf_log("Converting the state file from the legacy layout.");
+        convert_legacy_state(*legacy, *result, old_s_files_to_delete);
+        return result;
+    }
+    if (result->version != State::VERSION) {
+        throw EnclaveException("The state file has the unsupported version "
+                               + std::to_string(result->version) + " (expected "
+                               + std::to_string(State::VERSION)
+                               + "), it was written by another version of the "
+                                 "analysis enclave");
+    }
     return result;
 }
 
@@ -422,6 +603,41 @@ void store_state(State const & state) {
     sealData(file, &state, sizeof(state), sealing_aad, strlen(sealing_aad));
 }
 
+/**
+   Return the report request of the state, which must await new H files, as a
+   `std::unique_ptr`, as it is actually rather large. Unlike the state file,
+   the report request file must exist.
+ */
+std::unique_ptr<ReportRequest> load_report_request(State const & state)
+{
+    auto result = std::unique_ptr<ReportRequest>{new ReportRequest};
+    auto const aad = report_request_sealing_aad(state.awaiting_new_h_files.report_request_id);
+    auto file = File(report_request_file_path, FileOpenMode::FILE_OPEN_READ_ONLY);
+    unsealData(file,
+               aad.c_str(),
+               aad.size(),
+               [&result](std::size_t size) -> void * {
+                   if (size != sizeof(ReportRequest)) {
+                       throw EnclaveException("Unseal");
+                   }
+                   return result.get();
+               });
+    return result;
+}
+
+/**
+   Written once, when the report request is accepted. The state which refers
+   to it is stored afterwards, so a failed run leaves no state behind which
+   refers to a partially written file.
+ */
+void store_report_request(ReportRequest const & report_request,
+                          std::size_t const report_request_id)
+{
+    auto const aad = report_request_sealing_aad(report_request_id);
+    auto file = File(report_request_file_path, FileOpenMode::FILE_OPEN_WRITE_ONLY);
+    sealData(file, &report_request, sizeof(report_request), aad.c_str(), aad.size());
+}
+
 /** Using out parameters, as `sizeof(T)` might be a bit large. */
 template <typename T>
 void read_scalar_from_input(EncryptedDataReader encData,
@@ -506,24 +722,69 @@ State & process_state(State & state,
                                  + arguments::period + ">, but it is missing");
         }
 
-        if (inputs.arguments().size() != 2) {
+        auto const has_sorted = static_cast<bool>(inputs.argument(arguments::sorted));
+        if (inputs.arguments().size() != (has_sorted ? 3u : 2u)) {
             throw InvalidRequest(
                     "Found the <" + std::string(arguments::file) + "> and <" +
                     std::string(arguments::period) + "> arguments - when these"
-                    " arguments are supplied, no other arguments shall be supplied,"
+                    " arguments are supplied, no other arguments than <" +
+                    std::string(arguments::sorted) + "> shall be supplied,"
                     " yet other arguments were found");
         }
 
-        auto const h_file = (*inputs.argument(arguments::file)).toString();
-        auto const period_string =
-                (*inputs.argument(arguments::period)).toString();
-        auto const period_ulong = std::stoul(period_string);
-        if (period_ulong > std::numeric_limits<Period>::max()) {
-            throw std::out_of_range{"period number too large"};
+        auto const h_files = split_list((*inputs.argument(arguments::file)).toString());
+        auto const period_strings =
+                split_list((*inputs.argument(arguments::period)).toString());
+        if (h_files.size() != period_strings.size()) {
+            throw InvalidRequest(
+                    "The <" + std::string(arguments::file) + "> and <"
+                    + std::string(arguments::period) + "> arguments list "
+                    + std::to_string(h_files.size()) + " files and "
+                    + std::to_string(period_strings.size()) + " periods");
+        }
+        std::vector<bool> h_files_sorted(h_files.size(), false);
+        if (has_sorted) {
+            auto const sorted_strings =
+                    split_list((*inputs.argument(arguments::sorted)).toString());
+            if (sorted_strings.size() != h_files.size()) {
+                throw InvalidRequest(
+                        "The <" + std::string(arguments::file) + "> and <"
+                        + std::string(arguments::sorted) + "> arguments list "
+                        + std::to_string(h_files.size()) + " files and "
+                        + std::to_string(sorted_strings.size()) + " values");
+            }
+            for (std::size_t i = 0; i < h_files.size(); ++i) {
+                if (sorted_strings[i] != "0" && sorted_strings[i] != "1") {
+                    throw InvalidRequest("The values of the <" + std::string(arguments::sorted)
+                                         + "> argument must be <0> or <1>");
+                }
+                h_files_sorted[i] = sorted_strings[i] == "1";
+            }
+        }
+        std::vector<Period> given_periods;
+        for (auto const & period_string : period_strings) {
+            auto const period_ulong = std::stoul(period_string);
+            if (period_ulong > std::numeric_limits<Period>::max()) {
+                throw std::out_of_range{"period number too large"};
+            }
+            given_periods.push_back(static_cast<Period>(period_ulong));
         }
-        auto const given_period = static_cast<Period>(period_ulong);
-        return process_h_file(
-                state, inputs, outputs, old_s_files_to_delete, application_log, h_file, given_period);
+        for (std::size_t i = 1; i < given_periods.size(); ++i) {
+            // The second condition catches the wrap around.
+            if (given_periods[i] != given_periods[i - 1u] + 1u
+                || given_periods[i] < given_periods[i - 1u])
+            {
+                throw InvalidRequest("The received periods are not consecutive");
+            }
+        }
+        return process_h_files(state,
+                               inputs,
+                               outputs,
+                               old_s_files_to_delete,
+                               application_log,
+                               h_files,
+                               h_files_sorted,
+                               given_periods.front());
     }     // switch
     assert(false); //
 }
@@ -602,7 +863,7 @@ State & process_nsi_report_request_digestion(State & state,
                                      report_request.num_of_reference_areas));
 
             // Commit: We found a valid NSI report request.
-            state.go_into_h_processing_state(report_request);
+            state.go_into_h_processing_state(report_request, id);
             break;
 
         } catch (std::exception const & e) {
@@ -634,7 +895,9 @@ State & process_nsi_report_request_digestion(State & state,
         state.last_seen_nsi_inputs_topic_size = id + 1;
     }
 
-    auto & report_request = state.awaiting_new_h_files.report_request;
+    store_report_request(*tmp_report_request, id);
+
+    auto const & report_request = state.awaiting_new_h_files;
     application_log.append("New NSI request arrived.\n");
     log_request_arguments(report_request, application_log);
 
@@ -646,31 +909,37 @@ State & process_nsi_report_request_digestion(State & state,
     return state;
 }
 
-State & process_h_file(State & state,
-                       TaskInputs const & inputs,
-                       TaskOutputs & outputs,
-                       std::vector<std::string> & old_s_files_to_delete,
-                       Log & application_log,
-                       std::string const & h_file,
-                       Period const given_period)
+State & process_h_files(State & state,
+                        TaskInputs const & inputs,
+                        TaskOutputs & outputs,
+                        std::vector<std::string> & old_s_files_to_delete,
+                        Log & application_log,
+                        std::vector<std::string> const & h_files,
+                        std::vector<bool> const & h_files_sorted,
+                        Period const first_period)
 {
-    auto & report_request = state.awaiting_new_h_files.report_request;
+    auto const & report_request = state.awaiting_new_h_files;
 
     auto const next_expected_period = state.awaiting_new_h_files.next_expected_period;
     auto const max_expected_period = report_request.last_period;
+    // The periods are consecutive, this does not wrap.
+    auto const last_period = static_cast<Period>(first_period + (h_files.size() - 1u));
 
-    read_h_metadata_file(h_file, application_log);
+    for (auto const & h_file : h_files) {
+        read_h_metadata_file(h_file, application_log);
+    }
 
-    if (given_period < next_expected_period
-        || given_period > max_expected_period) {
-        // This exception prints the parsed `given_period` number, instead
-        // of using the actually received argument value. I think this is
-        // better because if parsing did something strange, the parsed
-        // value can be compared to the original argument which is still
-        // accessible through the `displayDfc` action.
+    if (first_period < next_expected_period
+        || last_period > max_expected_period) {
+        // This exception prints the parsed period numbers, instead of using
+        // the actually received argument value. I think this is better
+        // because if parsing did something strange, the parsed value can be
+        // compared to the original argument which is still accessible
+        // through the `displayDfc` action.
         throw InvalidRequest(
-                "The received period (" + std::to_string(given_period)
-                + ") is not within the range of expected periods ( ["
+                "The received periods ( [" + std::to_string(first_period) + " - "
+                + std::to_string(last_period)
+                + "] ) are not within the range of expected periods ( ["
                 + std::to_string(next_expected_period) + " - "
                 + std::to_string(max_expected_period) + "] )");
     }
@@ -679,21 +948,28 @@ State & process_h_file(State & state,
     application_log.append("Expected next period: ");
     application_log.append(std::to_string(next_expected_period));
     application_log.append("\n");
+    if (h_files.size() > 1u) {
+        application_log.append("Processing the periods ");
+        application_log.append(std::to_string(first_period));
+        application_log.append(" to ");
+        application_log.append(std::to_string(last_period));
+        application_log.append(" together\n");
+    }
 
     // Log any skipped periods (6.2.1).
-    log_skipped_periods(next_expected_period, given_period, application_log);
+    log_skipped_periods(next_expected_period, first_period, application_log);
 
     // No problem if this wraps, as it is an unsigned int. In that case,
     // last_period is also uint32_t::max(), hence the analysis will run
     // and the state reset to wait for a report request.
-    ++state.awaiting_new_h_files.next_expected_period;
+    state.awaiting_new_h_files.next_expected_period = last_period + 1u;
 
-    // Need to use a C-style array here due to the use of SGX SDK APIs.
-    uint8_t pseudonymisation_key[PseudonymisationKeyLength];
+    using namespace full_analysis;
+    std::vector<HInput> h_inputs(h_files.size());
     {
         auto const & topic = find_topic(inputs, input_names::periodic_pseudonymisation_key);
         PeriodicPseudonymisationKey ppk;
-        bool found = false;
+        std::vector<bool> found(h_files.size(), false);
         for (auto const & data : topic) {
             // This should not fail, as the only producer is the trusted
             // pseudonymisation enclave, i.e. the size is trusted.
@@ -701,65 +977,80 @@ State & process_h_file(State & state,
                     EncryptedDataReader{data},
                     input_names::periodic_pseudonymisation_key,
                     ppk);
-            if (ppk.period == given_period) {
-                std::copy(std::begin(ppk.pseudonymisation_key),
-                          std::end(ppk.pseudonymisation_key),
-                          std::begin(pseudonymisation_key));
-                found = true;
-                break;
-            }
+            if (ppk.period < first_period || ppk.period > last_period) { continue; }
+            auto const i = ppk.period - first_period;
+            if (found[i]) { continue; }
+            std::copy(std::begin(ppk.pseudonymisation_key),
+                      std::end(ppk.pseudonymisation_key),
+                      std::begin(h_inputs[i].pseudonymisation_key));
+            found[i] = true;
         }
-        if (!found) {
-            throw EnclaveException(
-                    "Could not find pseudonymisation key for requested period <"
-                    + std::to_string(given_period) + ">");
+        for (std::size_t i = 0; i < h_files.size(); ++i) {
+            if (!found[i]) {
+                throw EnclaveException(
+                        "Could not find pseudonymisation key for requested period <"
+                        + std::to_string(first_period + i) + ">");
+            }
         }
     }
 
-    auto s_file_in_path = s_file_path(state.s_file_name_index);
-    auto s_file_out_path = s_file_path(!state.s_file_name_index);
-    // The S file will been written to the other index, so swap it in the state.
-    state.s_file_name_index = !state.s_file_name_index;
-    // The file we process right now is no longer required when this enclave
-    // finishes successfully. (s_file_out_path does not need to be cleaned:
-    // in the full analysis it won't be created, and in the state update it is
-    // the new state to be consumed in future invocations.)
-    old_s_files_to_delete.push_back(s_file_in_path);
-
-    // Make sure the input S file exists, otherwise reading from it later
-    // will fail.
-    SgxEncryptedFile::create_empty_if_not_exists(s_file_in_path, state.s_file_key);
+    // The update adds segments to `state.s_segments`.
+    auto const s_segments_in = state.s_segments;
 
-    SgxFileKey new_s_file_key = {};
-    SgxException::throwOnError(
-            sgx_read_rand(new_s_file_key.key, sizeof(new_s_file_key.key)),
-            "Failed to create a new random S file key");
+    // Only loaded now that the request is known to be valid.
+    auto const areas_and_residents = load_report_request(state);
 
-    constexpr auto one_MiB_buffer = sharemind_hi::enclave::stream::mebibytes(1);
+    auto io_profile = loadIoProfile(persistent_path + IoProfile::FILE_NAME, application_log);
+    if (io_profile.auto_tune) {
+        autoTune(io_profile, h_files.front(), persistent_path + IoProfile::TUNED_FILE_NAME, application_log);
+    }
 
-    using namespace full_analysis;
-    auto what_to_do = given_period < max_expected_period
+    auto what_to_do = last_period < max_expected_period
                               ? Perform::OnlyStateUpdate
                               : Perform::FullAnalysis;
     uint64_t const start_time = enclave_untrusted_steady_clock_millis();
+    PipelineProfile profile;
+    // Operators may provide presorted H files, then sorting them is skipped
+    // if their first sort run turns out to be sorted.
+    for (std::size_t i = 0; i < h_files.size(); ++i) {
+        auto & h_input = h_inputs[i];
+        h_input.path = h_files[i];
+        h_input.is_sorted = h_files_sorted[i];
+        application_log.append("H file of period ");
+        application_log.append(std::to_string(first_period + i));
+        application_log.append(" is declared sorted: ");
+        application_log.append(h_input.is_sorted ? "true\n" : "false\n");
+    }
     full_analysis::run(
-            HFileSource(h_file.c_str(),
-                        one_MiB_buffer),
-            SFileSource(s_file_in_path.c_str(), one_MiB_buffer, state.s_file_key),
-            SFileSink(s_file_out_path.c_str(), one_MiB_buffer, new_s_file_key),
-            pseudonymisation_key,
+            h_inputs,
+            s_file_prefix(),
+            state.s_segments,
+            persistent_path,
             what_to_do,
             // Deserialization might not be required, but this way the code
             // is streamlined and it probably is sub-second effort anyway.
-            deserialize(PRANGE(report_request.reference_areas.begin(),
-                               report_request.num_of_reference_areas)),
-            deserialize(PRANGE(report_request.census_residents.begin(),
-                               report_request.num_of_census_residents)),
+            deserialize(PRANGE(areas_and_residents->reference_areas.begin(),
+                               areas_and_residents->num_of_reference_areas)),
+            deserialize(PRANGE(areas_and_residents->census_residents.begin(),
+                               areas_and_residents->num_of_census_residents)),
             report_request.with_calibration,
+            io_profile,
+            profile,
             outputs,
             application_log);
     uint64_t const end_time = enclave_untrusted_steady_clock_millis();
-    state.s_file_key = new_s_file_key;
+
+    // The S files are no longer required when this enclave finishes
+    // successfully, if the update compacted them into a new base segment, or
+    // if the report is finished.
+    for (std::size_t shard = 0; shard < s_shards; ++shard) {
+        if (what_to_do == Perform::FullAnalysis
+            || state.s_segments[shard].base.id != s_segments_in[shard].base.id)
+        {
+            s_segments_in[shard].collectPaths(sShardPrefix(s_file_prefix(), shard),
+                                              old_s_files_to_delete);
+        }
+    }
 
     // Log how much time the analysis took to run.
     application_log.append("\nRuntime of enclave (not trustworthy): ");
@@ -771,6 +1062,7 @@ State & process_h_file(State & state,
         application_log.append(std::to_string((end_time - start_time) / 1000));
     }
     application_log.append("s\n");
+    profile.appendTo(application_log);
 
     if (what_to_do == Perform::FullAnalysis) {
         state.go_into_request_await_state();
@@ -785,10 +1077,34 @@ State & process_cancel(State & state,
 {
     application_log.append("The report generation process was canceled manually.");
 
-    log_request_arguments(state.awaiting_new_h_files.report_request, application_log);
+    log_request_arguments(state.awaiting_new_h_files, application_log);
+
+    collect_s_file_paths(state.s_segments, old_s_files_to_delete);
+
+    state.go_into_request_await_state();
+
+    return state;
+}
 
-    old_s_files_to_delete.push_back(s_file_path(state.s_file_name_index));
-    old_s_files_to_delete.push_back(s_file_path(!state.s_file_name_index));
+State & process_cancel_without_state(State & state,
+                                     TaskInputs const & inputs,
+                                     char const * const load_error,
+                                     Log & application_log)
+{
+    application_log.append("The report generation process was canceled manually. "
+                           "The state file could not be loaded, its S files "
+                           "are not removed.\n\tError message: ");
+    application_log.append(load_error);
+    application_log.append("\n");
+
+    // The request of the lost state is not known, so all NSI report requests
+    // which arrived so far are skipped, instead of accepting the first one
+    // again.
+    try {
+        state.last_seen_nsi_inputs_topic_size = find_topic(inputs, input_names::nsi_input).size();
+    } catch (...) {
+        /* No NSI report request arrived yet. */
+    }
 
     state.go_into_request_await_state();
 
@@ -800,7 +1116,7 @@ State & process_manually_finish_report(State & state,
                                        std::vector<std::string> & old_s_files_to_delete,
                                        Log & application_log)
 {
-    auto & report_request = state.awaiting_new_h_files.report_request;
+    auto const & report_request = state.awaiting_new_h_files;
 
     auto const next_expected_period = state.awaiting_new_h_files.next_expected_period;
     auto const max_expected_period = report_request.last_period;
@@ -817,9 +1133,6 @@ State & process_manually_finish_report(State & state,
                         static_cast<uint64_t>(max_expected_period) + 1,
                         application_log);
 
-    // There are no pseudonyms to decrypt, hence we can use a zero key.
-    const uint8_t pseudonymisation_key[PseudonymisationKeyLength] = {};
-
     // Create a dummy H file.
     auto const h_file = persistent_path + "dummy_h_file";
     try {
@@ -828,60 +1141,52 @@ State & process_manually_finish_report(State & state,
         throw EnclaveException("Failed to create a dummy H file, errno: " + std::to_string(errno));
     }
 
-    auto s_file_in_path = s_file_path(state.s_file_name_index);
-    auto s_file_out_path = s_file_path(!state.s_file_name_index);
-    // The S file will been written to the other index, so swap it in the state.
-    state.s_file_name_index = !state.s_file_name_index;
-    // The file we process right now is no longer required when this enclave
-    // finishes successfully. (s_file_out_path does not need to be cleaned,
-    // as it won't be created in the full analysis.)
-    old_s_files_to_delete.push_back(s_file_in_path);
-
-    // Make sure the input S file exists, otherwise reading from it later will
-    // fail. We do expect that the file exists already, but creating an empty
-    // file makes the error handling more consistent.
-    SgxEncryptedFile::create_empty_if_not_exists(s_file_in_path, state.s_file_key);
+    // The S files are no longer required when this enclave finishes
+    // successfully. (No new S file is written in the full analysis.)
+    collect_s_file_paths(state.s_segments, old_s_files_to_delete);
 
     using namespace full_analysis;
-    SgxFileKey new_s_file_key = {};
-    // Although not really required to create a new key here, as the file is
-    // never written, it does not hurt to still initialize it with randomness.
-    SgxException::throwOnError(
-            sgx_read_rand(new_s_file_key.key, sizeof(new_s_file_key.key)),
-            "Failed to create a new random S file key");
-
-    constexpr auto one_MiB_buffer = sharemind_hi::enclave::stream::mebibytes(1);
-
-    auto h_file_source = HFileSource(h_file.c_str(), one_MiB_buffer);
-    auto s_file_source = SFileSource(s_file_in_path.c_str(), one_MiB_buffer, state.s_file_key);
+    // The dummy H file is empty, so there is nothing to auto-tune with.
+    auto const io_profile = loadIoProfile(persistent_path + IoProfile::FILE_NAME, application_log);
 
     // The H file must be empty ..
-    if (not h_file_source.file_is_exhausted()) {
+    if (not HFileSource(h_file.c_str(), io_profile.h_source).file_is_exhausted()) {
         throw EnclaveException("Data was found in the empty H dummy file");
     }
 
-    // .. but the S file needs to hold data.
-    if (s_file_source.file_is_exhausted()) {
+    // .. but S needs to hold data.
+    if (std::all_of(state.s_segments.begin(),
+                    state.s_segments.end(),
+                    [](SSegments const & shard) { return shard.empty(); }))
+    {
         throw EnclaveException(
                 "No data was found in the S file (if you want to cancel the "
                 "processing, use the <"
                 + std::string(arguments::cancel) + "> argument)");
     }
 
+    auto const areas_and_residents = load_report_request(state);
+
     uint64_t const start_time = enclave_untrusted_steady_clock_millis();
+    PipelineProfile profile;
+    // The dummy H file is empty, i.e. sorted, and there are no pseudonyms to
+    // decrypt, hence we can use a zero key.
+    HInput dummy_h_input = {h_file, true, {}};
     full_analysis::run(
-            std::move(h_file_source),
-            std::move(s_file_source),
-            SFileSink(s_file_out_path.c_str(), one_MiB_buffer, new_s_file_key),
-            pseudonymisation_key,
+            {dummy_h_input},
+            s_file_prefix(),
+            state.s_segments,
+            persistent_path,
             Perform::FullAnalysis,
             deserialize(PRANGE(
-                    report_request.reference_areas.begin(),
-                    report_request.num_of_reference_areas)),
+                    areas_and_residents->reference_areas.begin(),
+                    areas_and_residents->num_of_reference_areas)),
             deserialize(PRANGE(
-                    report_request.census_residents.begin(),
-                    report_request.num_of_census_residents)),
+                    areas_and_residents->census_residents.begin(),
+                    areas_and_residents->num_of_census_residents)),
             report_request.with_calibration,
+            io_profile,
+            profile,
             outputs,
             application_log);
     uint64_t const end_time = enclave_untrusted_steady_clock_millis();
@@ -903,6 +1208,7 @@ State & process_manually_finish_report(State & state,
         application_log.append(std::to_string((end_time - start_time) / 1000));
     }
     application_log.append("s\n");
+    profile.appendTo(application_log);
 
     state.go_into_request_await_state();
 
@@ -266,16 +266,6 @@ struct TileIndexHasher {
     }
 };
 
-/** Not SDC filtered. */
-using TopAnchorDistribution = std::unordered_map<TileIndex, uint32_t, TileIndexHasher>;
-
-// Needs to be built up from the `CensusResident` input.
-using CensusResidents =
-        std::unordered_map<TileIndex, double, TileIndexHasher>;
-
-// Needs to be built up from the `ReferenceArea` input.
-using ReferenceAreas = std::vector<std::unordered_set<TileIndex, TileIndexHasher>>;
-
 // Need to use a C-style array here due to the use of SGX SDK APIs.
 using PseudonymisationKeyRef = const uint8_t (&)[PseudonymisationKeyLength];
 
@@ -0,0 +1,700 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include "BackgroundJob.h"
+#include "IoCounters.h"
+#include "PipelineProfile.h"
+#include "SgxEncryptedFile.h"
+#include "StreamAdditions.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <sharemind-hi/enclave/common/EnclaveException.h>
+#include <sharemind-hi/enclave/common/Log.h>
+#include <sharemind-hi/enclave/task/stream/Streams_detail.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace eurostat {
+namespace enclave {
+
+template <typename Less, typename RunSorter, typename Builder>
+struct ExternalSortBuilder {
+    using Category = sharemind_hi::enclave::stream::detail::SinkCategory;
+
+    ExternalSortBuilder(ExternalSortBuilder &&) noexcept = default;
+
+    explicit ExternalSortBuilder(Less less,
+                                 RunSorter sort_run,
+                                 std::size_t memory_bytes,
+                                 std::string temporary_path_prefix,
+                                 bool * input_is_sorted,
+                                 Builder sb2)
+        : m_less{std::move(less)}
+        , m_sort_run{std::move(sort_run)}
+        , m_memory_bytes{memory_bytes}
+        , m_temporary_path_prefix{std::move(temporary_path_prefix)}
+        , m_input_is_sorted{input_is_sorted}
+        , m_builder{std::move(sb2)}
+    { }
+
+    template <typename T>
+    struct Impl {
+        using In = T;
+        using Sink = typename Builder::template Impl<T>;
+        using Res = typename Sink::Res;
+
+        static constexpr std::size_t ITEM_SIZE = sizeof(T);
+
+        Impl(Impl &&) noexcept = default;
+
+        explicit Impl(Less less,
+                      RunSorter sort_run,
+                      std::size_t memory_bytes,
+                      std::string temporary_path_prefix,
+                      bool * input_is_sorted,
+                      Sink sink)
+            : m_less{less}
+            , m_memory_bytes{memory_bytes}
+            , m_run_size{std::max<std::size_t>(memory_bytes / ITEM_SIZE, 1u)}
+            , m_temporary_path_prefix{std::move(temporary_path_prefix)}
+            , m_input_is_sorted{input_is_sorted}
+            , m_sink{std::move(sink)}
+            , m_spill{new Spill{std::move(less), std::move(sort_run)}}
+        {
+            m_buffer.reserve(m_run_size);
+        }
+
+        void sink(In const & argument) {
+            if (!m_pass_through && m_buffer.size() >= m_run_size) {
+                if (m_runs.empty() && checkFirstRun()) {
+                    passOnFirstRun();
+                } else {
+                    spillRun();
+                }
+            }
+            if (m_pass_through) {
+                // The rest of the input is not buffered, so a claim which
+                // turns out wrong cannot be corrected anymore.
+                if (m_less(argument, m_buffer.back())) {
+                    throw sharemind_hi::enclave::EnclaveException(
+                            "ExternalSort: The input was expected to be sorted, but is not.");
+                }
+                m_buffer.back() = argument;
+                m_sink.sink(argument);
+                return;
+            }
+
+            if (m_sorted_prefix == m_buffer.size()
+                && (m_buffer.empty() || !m_less(argument, m_buffer.back())))
+            {
+                ++m_sorted_prefix;
+            }
+            m_buffer.push_back(argument);
+        }
+
+        Res finalize() && {
+            if (m_pass_through) {
+                // Nothing to do.
+            } else if (m_runs.empty()) {
+                // Everything fit into memory.
+                checkFirstRun();
+                m_spill->sortRun(m_buffer, m_sorted_prefix);
+                for (auto const & e : m_buffer) { m_sink.sink(e); }
+            } else {
+                if (!m_buffer.empty()) { spillRun(); }
+                m_spill->job.wait();
+                std::vector<T>().swap(m_spill->buffer);
+            }
+            std::vector<T>().swap(m_buffer);
+            if (!m_runs.empty()) { mergeRuns(); }
+            return std::move(m_sink).finalize();
+        }
+
+    private: /* Types: */
+        /**
+           A full buffer is sorted and written to its run file by `job`, while
+           the pipeline already fills the other buffer. Kept on the heap, so
+           `Impl` stays movable.
+         */
+        struct Spill {
+            Less less;
+            RunSorter sort_run;
+            std::vector<T> buffer = {};
+            std::size_t sorted_prefix = 0;
+            std::unique_ptr<SgxEncryptedFile> file = {};
+            /** Declared last, so it is destroyed (i.e. waited for) first. */
+            BackgroundJob job = {};
+
+            explicit Spill(Less l, RunSorter s)
+                : less(std::move(l)), sort_run(std::move(s)) {}
+
+            /**
+               The first `sorted_prefix` elements of `run` are known to be in
+               order. If only a short tail is out of order, only the tail is
+               sorted and merged with the prefix.
+             */
+            void sortRun(std::vector<T> & run, std::size_t const sorted_prefix) {
+                auto const begin = run.data();
+                auto const end = run.data() + run.size();
+                if (sorted_prefix == run.size()) {
+                    return;
+                } else if (sorted_prefix > 0u && run.size() - sorted_prefix <= run.size() / 8u) {
+                    sort_run(begin + sorted_prefix, end);
+                    std::inplace_merge(begin, begin + sorted_prefix, end, less);
+                } else {
+                    sort_run(begin, end);
+                }
+            }
+        };
+
+    private: /* Methods: */
+        /**
+           Whether the input is expected to be sorted and the first run, which
+           is in `m_buffer`, is in order. Clears `*m_input_is_sorted` if the
+           run is not in order after all.
+         */
+        bool checkFirstRun() noexcept {
+            if (!m_input_is_sorted || !*m_input_is_sorted) { return false; }
+            if (m_sorted_prefix == m_buffer.size()) { return true; }
+            *m_input_is_sorted = false;
+            return false;
+        }
+
+        /** Passes the sorted first run on, and the rest of the input directly
+         * after it. Keeps the last element, to verify the order. */
+        void passOnFirstRun() {
+            for (auto const & e : m_buffer) { m_sink.sink(e); }
+            std::vector<T>(1u, m_buffer.back()).swap(m_buffer);
+            m_pass_through = true;
+        }
+
+        void spillRun() {
+            auto & spill = *m_spill;
+            // Rethrows the exception if the previous spill failed.
+            spill.job.wait();
+            std::swap(m_buffer, spill.buffer);
+            spill.sorted_prefix = m_sorted_prefix;
+            m_sorted_prefix = 0;
+            m_buffer.reserve(m_run_size);
+
+            m_runs.emplace_back(m_temporary_path_prefix + std::to_string(m_runs.size()));
+            spill.file.reset(new SgxEncryptedFile{m_runs.back().openForWriting()});
+            spill.job.start([&spill] {
+                IoAccount const account{PipelineProfile::ioAccount(PipelineProfile::Stage::HSpill)};
+                spill.sortRun(spill.buffer, spill.sorted_prefix);
+                spill.file->write(spill.buffer.data(), spill.buffer.size() * ITEM_SIZE);
+                spill.file.reset();
+                spill.buffer.clear();
+            });
+        }
+
+        void mergeRuns() {
+#ifndef NDEBUG
+            enclave_printf_log("ExternalSort: Merging %zu runs", m_runs.size());
+#endif
+            // With many runs, groups of runs are merged in parallel by
+            // background jobs, and only the groups are merged here. A group
+            // hands its elements over in blocks of about `block_bytes`.
+            constexpr std::size_t min_runs_per_group = 2u;
+            constexpr std::size_t block_bytes = std::size_t{256} * 1024u;
+            auto const groups = std::min(BackgroundJob::maxThreads(),
+                                         m_runs.size() / min_runs_per_group);
+            if (groups < 2u) {
+                drain(RunGroup{this, 0u, m_runs.size()}());
+                return;
+            }
+
+            std::vector<BackgroundSource<RunGroup>> group_sources;
+            group_sources.reserve(groups);
+            for (std::size_t g = 0; g < groups; ++g) {
+                group_sources.push_back(
+                        inBackground(RunGroup{this,
+                                              m_runs.size() * g / groups,
+                                              m_runs.size() * (g + 1u) / groups},
+                                     block_bytes / ITEM_SIZE));
+            }
+            drain(mergeSorted(std::move(group_sources), m_less));
+        }
+
+        template <typename Source>
+        void drain(Source source) {
+            T e;
+            while (source.next(e)) { m_sink.sink(e); }
+        }
+
+    private: /* Types: */
+        /** Merges the runs `[first, last)`. */
+        struct RunGroup {
+            Impl const * impl;
+            std::size_t first;
+            std::size_t last;
+
+            MergeSource<PersistentDataSource<T, SgxEncryptedFile>, Less> operator()() const {
+                auto const & runs = impl->m_runs;
+                // Each source holds two buffers.
+                auto const buffer_bytes = std::max(impl->m_memory_bytes / (2u * runs.size()), ITEM_SIZE);
+                std::vector<PersistentDataSource<T, SgxEncryptedFile>> sources;
+                sources.reserve(last - first);
+                for (auto i = first; i < last; ++i) {
+                    sources.emplace_back(runs[i].path().c_str(), buffer_bytes, runs[i].key());
+                }
+                return mergeSorted(std::move(sources), impl->m_less);
+            }
+        };
+
+    private: /* Fields: */
+        Less m_less;
+        std::size_t m_memory_bytes;
+        /** Number of elements per run. */
+        std::size_t m_run_size;
+        std::string m_temporary_path_prefix;
+        /** Whether the input is expected to be sorted, may be null. */
+        bool * m_input_is_sorted;
+        /** Only verify the order, and pass all elements on directly. */
+        bool m_pass_through = false;
+        /** In pass through mode, holds the previous element only. */
+        std::vector<T> m_buffer = {};
+        /** Number of elements at the front of `m_buffer` which are in order. */
+        std::size_t m_sorted_prefix = 0;
+        /** Removed in their dtor. */
+        std::vector<TemporaryEncryptedFile> m_runs = {};
+        Sink m_sink;
+        /** Declared after `m_runs`, so a running spill ends before the files
+         * are removed. */
+        std::unique_ptr<Spill> m_spill;
+    };
+
+    template <typename T>
+    Impl<T> build() && {
+        return Impl<T>{std::move(m_less),
+                       std::move(m_sort_run),
+                       m_memory_bytes,
+                       std::move(m_temporary_path_prefix),
+                       m_input_is_sorted,
+                       std::move(m_builder).template build<T>()};
+    }
+
+private: /* Fields: */
+    Less m_less;
+    RunSorter m_sort_run;
+    std::size_t m_memory_bytes;
+    std::string m_temporary_path_prefix;
+    bool * m_input_is_sorted;
+    Builder m_builder;
+};
+
+template <typename Less, typename RunSorter>
+struct ExternalSortPipe {
+    using Category = sharemind_hi::enclave::stream::detail::PipeCategory;
+
+    template <typename In>
+    using Out = In;
+
+    ExternalSortPipe(ExternalSortPipe &&) noexcept = default;
+
+    explicit ExternalSortPipe(Less less,
+                              RunSorter sort_run,
+                              std::size_t memory_bytes,
+                              std::string temporary_path_prefix,
+                              bool * input_is_sorted)
+        : m_less{std::move(less)}
+        , m_sort_run{std::move(sort_run)}
+        , m_memory_bytes{memory_bytes}
+        , m_temporary_path_prefix{std::move(temporary_path_prefix)}
+        , m_input_is_sorted{input_is_sorted}
+    {}
+
+    template <typename Builder>
+    using InBuilder = ExternalSortBuilder<Less, RunSorter, Builder>;
+
+    template <typename Builder>
+    InBuilder<Builder> build(Builder down) && {
+        return InBuilder<Builder>{std::move(m_less),
+                                  std::move(m_sort_run),
+                                  m_memory_bytes,
+                                  std::move(m_temporary_path_prefix),
+                                  m_input_is_sorted,
+                                  std::move(down)};
+    }
+
+private: /* Fields: */
+    Less m_less;
+    RunSorter m_sort_run;
+    std::size_t m_memory_bytes;
+    std::string m_temporary_path_prefix;
+    bool * m_input_is_sorted;
+};
+
+/**
+   Sorts the stream like `sort`, but with a custom in-memory sort for the runs.
+
+   Up to `memory_bytes` of elements are collected and sorted with `sort_run`
+   into a run. If the input does not fit into a single run, the runs are
+   spilled into temporary files (`temporary_path_prefix` followed by the run
+   number) and merged with `less` in the end. The temporary files are removed
+   when the pipeline is destroyed.
+
+   A full run is sorted and spilled by a `BackgroundJob` while the next run is
+   collected, so up to twice `memory_bytes` are in use. `sort_run` may start
+   jobs on its own, e.g. with `parallelRadixSortByKey`. Many runs are merged
+   in groups by parallel jobs, as far as `BackgroundJob::maxThreads()` allows,
+   and then the groups are merged in the calling thread.
+
+   Sorting adapts to presorted input: A run which arrived in order is not
+   sorted at all, and a run with a short unordered tail only gets its tail
+   sorted. If the caller expects the whole input to be sorted
+   (`*input_is_sorted`), the first run is collected as usual. If it arrived in
+   order, it is passed on, and the rest of the input is passed on directly
+   without being buffered. Its order is still verified, and an exception is
+   thrown if it does not hold. Otherwise, `*input_is_sorted` is set to false
+   and the input is sorted like any other, so nothing is read twice.
+ */
+template <
+        /** bool(T const &, T const &), the order `sort_run` sorts in. */
+        typename Less,
+        /** void(T * begin, T * end), sorts the range in place. */
+        typename RunSorter>
+inline ExternalSortPipe<Less, RunSorter> externalSort(Less less,
+                                                      RunSorter sort_run,
+                                                      std::size_t memory_bytes,
+                                                      std::string temporary_path_prefix,
+                                                      bool * input_is_sorted = nullptr)
+{
+    return ExternalSortPipe<Less, RunSorter>{std::move(less),
+                                             std::move(sort_run),
+                                             memory_bytes,
+                                             std::move(temporary_path_prefix),
+                                             input_is_sorted};
+}
+
+/**
+   The result of `partitionedSort`: The elements of each partition, sorted.
+   They stay in memory if they fit into a single run, otherwise they are read
+   from the sorted runs of the partition, which are merged on the fly. The
+   temporary run files are removed with this object.
+ */
+template <typename T, typename Less>
+class SortedPartitions {
+public: /* Types: */
+    using RunSource = PersistentDataSource<T, SgxEncryptedFile>;
+
+    /** Iterates over the elements of one partition in order. */
+    class Source {
+    public: /* Types: */
+        using Category = sharemind_hi::enclave::stream::detail::SourceCategory;
+        using Out = T;
+
+    public: /* Methods: */
+        Source(Source &&) noexcept = default;
+
+        explicit Source(T const * begin, T const * end) noexcept
+            : m_next{begin}
+            , m_end{end}
+        {}
+
+        explicit Source(MergeSource<RunSource, Less> merge)
+            : m_merge{new MergeSource<RunSource, Less>{std::move(merge)}}
+        {}
+
+        bool next(Out & result) {
+            if (m_merge) { return m_merge->next(result); }
+            if (m_next == m_end) { return false; }
+            result = *m_next++;
+            return true;
+        }
+
+    private: /* Fields: */
+        T const * m_next = nullptr;
+        T const * m_end = nullptr;
+        std::unique_ptr<MergeSource<RunSource, Less>> m_merge = {};
+    };
+
+public: /* Methods: */
+    SortedPartitions(SortedPartitions &&) noexcept = default;
+
+    explicit SortedPartitions(Less less,
+                              std::size_t const memory_bytes,
+                              std::vector<std::vector<T>> in_memory,
+                              std::vector<std::vector<TemporaryEncryptedFile>> runs)
+        : m_less{std::move(less)}
+        , m_memory_bytes{memory_bytes}
+        , m_in_memory{std::move(in_memory)}
+        , m_runs{std::move(runs)}
+    {}
+
+    /**
+       The sources of several partitions may be used at the same time, also
+       by different threads, they share the memory of the sort.
+     */
+    Source source(std::size_t const partition) const {
+        if (!m_in_memory.empty()) {
+            auto const & elements = m_in_memory[partition];
+            return Source{elements.data(), elements.data() + elements.size()};
+        }
+
+        std::size_t all_runs = 0;
+        for (auto const & runs : m_runs) { all_runs += runs.size(); }
+        // Each source holds two buffers.
+        auto const buffer_bytes = std::max(m_memory_bytes / (2u * all_runs), sizeof(T));
+        std::vector<RunSource> sources;
+        sources.reserve(m_runs[partition].size());
+        for (auto const & run : m_runs[partition]) {
+            sources.emplace_back(run.path().c_str(), buffer_bytes, run.key());
+        }
+        return Source{mergeSorted(std::move(sources), m_less)};
+    }
+
+private: /* Fields: */
+    Less m_less;
+    std::size_t m_memory_bytes;
+    /** Either the elements of each partition, or empty. */
+    std::vector<std::vector<T>> m_in_memory;
+    /** The runs of each partition, if they did not fit into memory. */
+    std::vector<std::vector<TemporaryEncryptedFile>> m_runs;
+};
+
+template <typename Less, typename RunSorter, typename PartitionOf>
+struct PartitionedSortBuilder {
+    using Category = sharemind_hi::enclave::stream::detail::SinkCategory;
+
+    PartitionedSortBuilder(PartitionedSortBuilder &&) noexcept = default;
+
+    explicit PartitionedSortBuilder(Less less,
+                                    RunSorter sort_run,
+                                    std::size_t memory_bytes,
+                                    std::string temporary_path_prefix,
+                                    PartitionOf partition_of,
+                                    std::size_t partitions)
+        : m_less{std::move(less)}
+        , m_sort_run{std::move(sort_run)}
+        , m_memory_bytes{memory_bytes}
+        , m_temporary_path_prefix{std::move(temporary_path_prefix)}
+        , m_partition_of{std::move(partition_of)}
+        , m_partitions{partitions}
+    { }
+
+    template <typename T>
+    struct Impl {
+        using In = T;
+        using Res = SortedPartitions<T, Less>;
+
+        static constexpr std::size_t ITEM_SIZE = sizeof(T);
+
+        Impl(Impl &&) noexcept = default;
+
+        explicit Impl(Less less,
+                      RunSorter sort_run,
+                      std::size_t memory_bytes,
+                      std::string temporary_path_prefix,
+                      PartitionOf partition_of,
+                      std::size_t const partitions)
+            : m_less{less}
+            , m_memory_bytes{memory_bytes}
+            , m_run_size{std::max<std::size_t>(memory_bytes / ITEM_SIZE, 1u)}
+            , m_temporary_path_prefix{std::move(temporary_path_prefix)}
+            , m_partition_of{std::move(partition_of)}
+            , m_buckets(partitions)
+            , m_runs(partitions)
+            , m_spill{new Spill{std::move(less), std::move(sort_run), partitions}}
+        {
+            assert(partitions > 0u);
+            for (auto & bucket : m_buckets) { bucket.reserve(m_run_size / partitions); }
+        }
+
+        void sink(In const & argument) {
+            if (m_size >= m_run_size) { spillRun(); }
+            auto const p = m_partition_of(argument);
+            assert(p < m_buckets.size());
+            auto & bucket = m_buckets[p];
+            if (bucket.sorted_prefix == bucket.elements.size()
+                && (bucket.elements.empty() || !m_less(argument, bucket.elements.back())))
+            {
+                ++bucket.sorted_prefix;
+            }
+            bucket.elements.push_back(argument);
+            ++m_size;
+        }
+
+        Res finalize() && {
+            if (!m_spilled) {
+                // Everything fit into memory.
+                std::vector<std::vector<T>> in_memory;
+                in_memory.reserve(m_buckets.size());
+                for (auto & bucket : m_buckets) {
+                    m_spill->sortRun(bucket);
+                    in_memory.push_back(std::move(bucket.elements));
+                }
+                return Res{std::move(m_less), m_memory_bytes, std::move(in_memory), {}};
+            }
+
+            if (m_size > 0u) { spillRun(); }
+            m_spill->job.wait();
+            m_spill.reset();
+            m_buckets.clear();
+            return Res{std::move(m_less), m_memory_bytes, {}, std::move(m_runs)};
+        }
+
+    private: /* Types: */
+        struct Bucket {
+            std::vector<T> elements;
+            /** The first elements are known to be in order. */
+            std::size_t sorted_prefix = 0;
+
+            void reserve(std::size_t const size) { elements.reserve(size); }
+        };
+
+        /**
+           Full buckets are sorted and written to the run files of their
+           partitions by `job`, while the pipeline already fills the other
+           buckets. Kept on the heap, so `Impl` stays movable.
+         */
+        struct Spill {
+            Less less;
+            RunSorter sort_run;
+            std::vector<Bucket> buckets;
+            std::vector<std::unique_ptr<SgxEncryptedFile>> files;
+            /** Declared last, so it is destroyed (i.e. waited for) first. */
+            BackgroundJob job = {};
+
+            explicit Spill(Less l, RunSorter s, std::size_t const partitions)
+                : less(std::move(l)), sort_run(std::move(s)), buckets(partitions), files(partitions) {}
+
+            /** Like `ExternalSortBuilder::Impl::Spill::sortRun`. */
+            void sortRun(Bucket & bucket) {
+                auto & run = bucket.elements;
+                auto const begin = run.data();
+                auto const end = run.data() + run.size();
+                auto const sorted_prefix = bucket.sorted_prefix;
+                if (sorted_prefix == run.size()) {
+                    return;
+                } else if (sorted_prefix > 0u && run.size() - sorted_prefix <= run.size() / 8u) {
+                    sort_run(begin + sorted_prefix, end);
+                    std::inplace_merge(begin, begin + sorted_prefix, end, less);
+                } else {
+                    sort_run(begin, end);
+                }
+            }
+        };
+
+    private: /* Methods: */
+        void spillRun() {
+            auto & spill = *m_spill;
+            // Rethrows the exception if the previous spill failed.
+            spill.job.wait();
+            std::swap(m_buckets, spill.buckets);
+            auto const partitions = m_buckets.size();
+            for (std::size_t p = 0; p < partitions; ++p) {
+                m_buckets[p].sorted_prefix = 0;
+                m_buckets[p].reserve(m_run_size / partitions);
+                if (spill.buckets[p].elements.empty()) { continue; }
+                m_runs[p].emplace_back(m_temporary_path_prefix + std::to_string(p)
+                                       + "_" + std::to_string(m_runs[p].size()));
+                spill.files[p].reset(new SgxEncryptedFile{m_runs[p].back().openForWriting()});
+            }
+            m_size = 0;
+            m_spilled = true;
+
+            spill.job.start([&spill] {
+                IoAccount const account{PipelineProfile::ioAccount(PipelineProfile::Stage::HSpill)};
+                for (std::size_t p = 0; p < spill.buckets.size(); ++p) {
+                    auto & bucket = spill.buckets[p];
+                    if (bucket.elements.empty()) { continue; }
+                    spill.sortRun(bucket);
+                    spill.files[p]->write(bucket.elements.data(), bucket.elements.size() * ITEM_SIZE);
+                    spill.files[p].reset();
+                    bucket.elements.clear();
+                }
+            });
+        }
+
+    private: /* Fields: */
+        Less m_less;
+        std::size_t m_memory_bytes;
+        /** Number of elements per run, of all partitions together. */
+        std::size_t m_run_size;
+        std::string m_temporary_path_prefix;
+        PartitionOf m_partition_of;
+        std::vector<Bucket> m_buckets;
+        /** Number of elements in `m_buckets`. */
+        std::size_t m_size = 0;
+        bool m_spilled = false;
+        std::vector<std::vector<TemporaryEncryptedFile>> m_runs;
+        /** Declared after `m_runs`, so a running spill ends before the files
+         * are removed. */
+        std::unique_ptr<Spill> m_spill;
+    };
+
+    template <typename T>
+    Impl<T> build() && {
+        return Impl<T>{std::move(m_less),
+                       std::move(m_sort_run),
+                       m_memory_bytes,
+                       std::move(m_temporary_path_prefix),
+                       std::move(m_partition_of),
+                       m_partitions};
+    }
+
+private: /* Fields: */
+    Less m_less;
+    RunSorter m_sort_run;
+    std::size_t m_memory_bytes;
+    std::string m_temporary_path_prefix;
+    PartitionOf m_partition_of;
+    std::size_t m_partitions;
+};
+
+/**
+   Sorts the elements of each of `partitions` partitions, like `externalSort`
+   with the same arguments, and returns them as `SortedPartitions`. Each
+   element goes into the partition `partition_of` returns for it.
+
+   The partitions share the `memory_bytes` of a run. When the run is full,
+   each partition is sorted and spilled into its own run file
+   (`temporary_path_prefix` followed by the partition and the run number), so
+   the runs of a partition are later merged without reading the other
+   partitions. Nothing is spilled if everything fits into a single run.
+ */
+template <
+        /** bool(T const &, T const &), the order `sort_run` sorts in. */
+        typename Less,
+        /** void(T * begin, T * end), sorts the range in place. */
+        typename RunSorter,
+        /** std::size_t(T const &), less than `partitions`. */
+        typename PartitionOf>
+inline PartitionedSortBuilder<Less, RunSorter, PartitionOf>
+partitionedSort(Less less,
+                RunSorter sort_run,
+                std::size_t memory_bytes,
+                std::string temporary_path_prefix,
+                PartitionOf partition_of,
+                std::size_t partitions)
+{
+    return PartitionedSortBuilder<Less, RunSorter, PartitionOf>{std::move(less),
+                                                                std::move(sort_run),
+                                                                memory_bytes,
+                                                                std::move(temporary_path_prefix),
+                                                                std::move(partition_of),
+                                                                partitions};
+}
+
+} // namespace enclave
+} // namespace eurostat
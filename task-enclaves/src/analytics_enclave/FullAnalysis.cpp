@@ -16,17 +16,22 @@
 */ 
 
 #include "FullAnalysis.h"
+#include "AnalysisStages.h"
+#include "BackgroundJob.h"
 #include "Entities.h"
+#include "ExternalSort.h"
 #include "Indicators.h"
 #include "Parameters.h"
+#include "PipelineProfile.h"
 #include "Pseudonymisation.h"
-#include "Xoroshiro.h"
+#include "TileAggregation.h"
+#include <algorithm>
 #include <bitset>
 #include <cstdint>
-#include <iterator>
+#include <memory>
+#include <sharemind-hi/enclave/task/stream/TaskDataStream.h>
 #include <string>
-
-#define RANGE(...) std::begin(__VA_ARGS__), std::end(__VA_ARGS__)
+#include <vector>
 
 namespace eurostat {
 namespace enclave {
@@ -38,21 +43,40 @@ namespace {
 
 using namespace sharemind_hi::enclave::stream;
 
-// One char names, here we go ...
-using H = UserFootprintUpdates;
-using S = AccumulatedUserFootprint;
-using Y = QuantisedFootprint;
-
 /**
    This class encapsulates indicators / measurements / counts that will later be
    logged into the application log.
  */
 class Indicators {
 public: /* Methods: */
+    /** The indicators are logged into `application_log` in the dtor. */
     Indicators(Log & application_log) noexcept
-        : m_application_log(application_log)
+        : m_application_log(&application_log)
     {}
 
+    /** Only collects the indicators, to be `merge`d into another object. */
+    Indicators() noexcept = default;
+
+    /**
+       Adds the indicators of `other`, which must have seen other users than
+       this object, e.g. those of another S shard. `other` must not be used
+       afterwards.
+     */
+    void merge(Indicators && other) noexcept
+    {
+        m_number_of_duplicate_H_records += other.m_number_of_duplicate_H_records;
+        m_h_count.merge(std::move(other.m_h_count));
+        m_s_old_count.merge(std::move(other.m_s_old_count));
+        m_s_new_count.merge(std::move(other.m_s_new_count));
+        m_spatiotemporal_distribution.merge(std::move(other.m_spatiotemporal_distribution));
+        m_h_unique_tiles_per_user_with_presence.merge(
+                std::move(other.m_h_unique_tiles_per_user_with_presence));
+        m_h_weight_values.merge(std::move(other.m_h_weight_values));
+        m_s_old_weight_values.merge(std::move(other.m_s_old_weight_values));
+        m_average_distances.merge(std::move(other.m_average_distances));
+        m_bounding_box_measure.merge(std::move(other.m_bounding_box_measure));
+    }
+
     void report_additional_H_duplicates(std::uint64_t const additional_duplicates) noexcept {
         m_number_of_duplicate_H_records += additional_duplicates;
     }
@@ -83,11 +107,14 @@ public: /* Methods: */
 
     ~Indicators()
     {
+        if (!m_application_log) { return; }
+        Log & application_log = *m_application_log;
+
         auto const h_count = m_h_count.finish();
         auto const s_old_count = m_s_old_count.finish();
         auto const s_new_count = m_s_new_count.finish();
 
-        m_application_log.append("\n");
+        application_log.append("\n");
 
         if (std::min(h_count.num_unique_users, s_new_count.num_unique_users)
             < indicators_k_anonymity * 1000) {
@@ -95,22 +122,22 @@ public: /* Methods: */
             // masked NA values can be reconstructed from the rolling
             // percentage numbers. `1000`: The histogram rolling percentage
             // is printed with one digit after the decimal point (`100.0 %`).
-            m_application_log.append("The indicators are omitted because the user count is too small.\n");
+            application_log.append("The indicators are omitted because the user count is too small.\n");
             return;
         }
 
         auto formatHistogram = [&](char const * const prefix) {
             return indicators::Log2HistogramStandardFormatter{prefix,
-                                                              m_application_log};
+                                                              application_log};
         };
 
         {
-            m_application_log.append("Number of duplicate records in the H file: ");
-            m_application_log.append(std::to_string(m_number_of_duplicate_H_records));
-            m_application_log.append("\n");
+            application_log.append("Number of duplicate records in the H file: ");
+            application_log.append(std::to_string(m_number_of_duplicate_H_records));
+            application_log.append("\n");
         }
 
-        m_application_log.append("\n");
+        application_log.append("\n");
 
         {
             struct Data {
@@ -119,47 +146,47 @@ public: /* Methods: */
             };
             for (const auto data : {Data{"H", h_count}, Data{"Old S", s_old_count}, Data{"New S", s_new_count}}) {
                 auto const & r = data.count;
-                m_application_log.append(data.what);
-                m_application_log.append(":");
-                m_application_log.append("\n\tNumber of unique users in file: ");
-                m_application_log.append(std::to_string(r.num_unique_users));
-                m_application_log.append("\n\tNumber of records in file: ");
-                m_application_log.append(std::to_string(r.num_records));
-                m_application_log.append("\n\tHistogram of Number of records per user:\n");
+                application_log.append(data.what);
+                application_log.append(":");
+                application_log.append("\n\tNumber of unique users in file: ");
+                application_log.append(std::to_string(r.num_unique_users));
+                application_log.append("\n\tNumber of records in file: ");
+                application_log.append(std::to_string(r.num_records));
+                application_log.append("\n\tHistogram of Number of records per user:\n");
                 r.histogram_records_per_user.iterate(formatHistogram("\t\t"));
             }
         }
 
-        m_application_log.append("\n");
+        application_log.append("\n");
 
         {
             auto const r = m_spatiotemporal_distribution.result;
-            m_application_log.append("Histogram: count of H records with given subperiod pattern (subperiod order in pattern 0,1,2,3). 0 in pattern position i means given subperiod i had weight 0 in given record, 1 means weight >0. :\n");
+            application_log.append("Histogram: count of H records with given subperiod pattern (subperiod order in pattern 0,1,2,3). 0 in pattern position i means given subperiod i had weight 0 in given record, 1 means weight >0. :\n");
             for (std::size_t i = 0; i < r.size(); ++i) {
-                m_application_log.append("\t");
+                application_log.append("\t");
 
                 // writes for example "1101" or "0100"
-                m_application_log.append(std::bitset<4>{i}.to_string());
+                application_log.append(std::bitset<4>{i}.to_string());
 
-                m_application_log.append(": ");
-                indicators::k_anonymize(r[i], m_application_log);
-                m_application_log.append("\n");
+                application_log.append(": ");
+                indicators::k_anonymize(r[i], application_log);
+                application_log.append("\n");
             }
         }
 
-        m_application_log.append("\n");
+        application_log.append("\n");
 
         {
             auto const r = m_h_unique_tiles_per_user_with_presence.finish();
             for (std::size_t subperiod = 0; subperiod < num_subperiods; ++subperiod) {
-                m_application_log.append("H histogram of number of unique tiles per user (with presence > 0) for subperiod ");
-                m_application_log.append(std::to_string(subperiod));
-                m_application_log.append(":\n");
+                application_log.append("H histogram of number of unique tiles per user (with presence > 0) for subperiod ");
+                application_log.append(std::to_string(subperiod));
+                application_log.append(":\n");
                 r[subperiod].iterate(formatHistogram("\t"));
             }
         }
 
-        m_application_log.append("\n");
+        application_log.append("\n");
 
         {
             struct Data {
@@ -170,32 +197,32 @@ public: /* Methods: */
                 auto const r = data.hist.finish();
                 for (std::size_t subperiod = 0; subperiod < num_subperiods;
                      ++subperiod) {
-                    m_application_log.append(data.what);
-                    m_application_log.append(" histogram of weight values in subperiod ");
-                    m_application_log.append(std::to_string(subperiod));
-                    m_application_log.append(":\n");
+                    application_log.append(data.what);
+                    application_log.append(" histogram of weight values in subperiod ");
+                    application_log.append(std::to_string(subperiod));
+                    application_log.append(":\n");
                     r[subperiod].iterate(formatHistogram("\t"));
                 }
             }
         }
 
-        m_application_log.append("\n");
+        application_log.append("\n");
 
         {
             auto const r = m_average_distances.finish();
             for (std::size_t subperiod = 0; subperiod < num_subperiods;
                  ++subperiod) {
-                m_application_log.append(
+                application_log.append(
                         "Histogram of distance between user H and old S average position in subperiod ");
-                m_application_log.append(std::to_string(subperiod));
-                m_application_log.append(":\n");
+                application_log.append(std::to_string(subperiod));
+                application_log.append(":\n");
                 r[subperiod].iterate(formatHistogram("\t"));
             }
         }
 
         // This one is inside of the next section, but kept here commented out
         // for reference.
-        // m_application_log.append("\n");
+        // application_log.append("\n");
 
         {
             using Histogram = indicators::spatial_distribution::BoundingBoxMeasure::Histogram;
@@ -208,13 +235,13 @@ public: /* Methods: */
             for (auto const data : {Data{"Histogram of user tiles bounding box diagonal length in H", &Result::h_diagonal_length_histogram},
                                     Data{"Histogram of user tiles bounding box diagonal length in old S", &Result::old_s_diagonal_length_histogram},
                                     Data{"Histogram of user tiles bounding box diagonal length difference between old S and new S", &Result::old_s_vs_new_s_diagonal_length_histogram}}) {
-                m_application_log.append("\n");
+                application_log.append("\n");
                 for (std::size_t subperiod = 0; subperiod < num_subperiods;
                      ++subperiod) {
-                    m_application_log.append(data.what);
-                    m_application_log.append(" in subperiod ");
-                    m_application_log.append(std::to_string(subperiod));
-                    m_application_log.append(":\n");
+                    application_log.append(data.what);
+                    application_log.append(" in subperiod ");
+                    application_log.append(std::to_string(subperiod));
+                    application_log.append(":\n");
                     (r[subperiod].*(data.hist)).iterate(formatHistogram("\t"));
                 }
             }
@@ -240,7 +267,7 @@ private: /* Fields: */
     indicators::spatial_distribution::HistogramOfAverageDistances m_average_distances;
     indicators::spatial_distribution::BoundingBoxMeasure m_bounding_box_measure;
 
-    Log & m_application_log;
+    Log * m_application_log = nullptr;
 };
 
 /**
@@ -258,7 +285,17 @@ struct DebugRecordCounting {
     void s_new() noexcept { ++m_s_new; }
     void y() noexcept { ++m_y; }
 
+    /** Adds the counts of `other`, which does not report them anymore. */
+    void merge(DebugRecordCounting && other) noexcept {
+        m_h += other.m_h;
+        m_s_old += other.m_s_old;
+        m_s_new += other.m_s_new;
+        m_y += other.m_y;
+        other.m_merged = true;
+    }
+
     ~DebugRecordCounting() {
+        if (m_merged) { return; }
         enclave_printf_log("NUM_H_RECORDS %zu", m_h);
         enclave_printf_log("NUM_S_OLD_RECORDS %zu", m_s_old);
         enclave_printf_log("NUM_S_NEW_RECORDS %zu", m_s_new);
@@ -302,200 +339,64 @@ private:
     std::size_t m_s_old = 0;
     std::size_t m_s_new = 0;
     std::size_t m_y = 0;
+    bool m_merged = false;
 #else
     // Make sure that in Release builds these operations are no-ops.
     void h() noexcept {}
     void s_old() noexcept {}
     void s_new() noexcept {}
     void y() noexcept {}
+    void merge(DebugRecordCounting &&) noexcept {}
 #endif
 };
 
-namespace module_c {
-class SingleHumanAnalysis {
-public: /* Methods: */
-    SingleHumanAnalysis(Statistics & statistics) noexcept
-        : m_statistics(statistics)
-    {}
-
-    void operator()(std::vector<S> footprints, std::vector<QuantisedFootprint> & result)
-    {
-        footprints.erase(std::remove_if(RANGE(footprints),
-                                        [](S const & e) {
-                                            return e.i_column[0]
-                                                   < day_quantisation_threshold;
-                                        }),
-                         footprints.end());
-
-        if (footprints.empty()) {
-            m_statistics.highly_nomadic_users += 1;
-            return;
-        }
-
-        // Now, we want to use random data to sort, but we need to store it
-        // somewhere. The python implementation uses `random()` the lambda
-        // supplied to the `key` argument which is cached, but in C++ we don't
-        // have such a thing. So instead, we overwrite the user id data in the
-        // original S structs to contain random data, which is used as a tie
-        // braker and to introduce non-determinism.
-        auto const id_backup = footprints.front().key.id;
-        for (auto & footprint : footprints) {
-            std::array<uint64_t, 2> tmp_random{m_rng(), m_rng()};
-            static_assert(sizeof(tmp_random) >= sizeof(footprint.key.id), "");
-            memcpy(footprint.key.id.data(),
-                   tmp_random.data(),
-                   sizeof(footprint.key.id));
-        }
-
-        // Sort Y_m according to the L_m rules, so we get the ranks and store
-        // them inline in Y_m.
-        std::sort(RANGE(footprints),
-                  CMP_LAMBDA(>, S,
-                             e.i_column[0],
-                             // XXX Use nested std::max(.,.) to preserve the
-                             // lvalue references, instead of std::max({...})
-                             // which creates new values.
-                             std::max(std::max(e.i_column[1], e.i_column[2]),
-                                      e.i_column[3]),
-                             e.i_column[1],
-                             // XXX This was replaced with random bits, see note above.
-                             e.key.id));
-
-        result.reserve(footprints.size());
-        for (std::size_t i = 0; i < footprints.size(); ++i) {
-            result.emplace_back();
-            auto & q = result.back();
-            q.key.id = id_backup;
-            q.key.tile = footprints[i].key.tile;
-            q.rank = i + QuantisedFootprint::FirstRank;
-
-            auto const fvalues = footprints[i].i_column;
-            q.values[0] = true;
-            for (std::size_t j = 1; j < 4; ++j) {
-                q.values[j] = (fvalues[j] / fvalues[0])
-                              >= sub_period_quantisation_threshold;
-            }
-        }
-        return;
-    }
-
-private: /* Fields: */
-    Statistics & m_statistics;
-    /** A weak RNG just used for tie breaking */
-    Xoshiro256Plus m_rng;
-};
-} // namespace module_c
-
-namespace module_d {
-
-bool is_inside(TileIndex const & tile_index, ReferenceAreas::value_type const & reference_area) {
-    return reference_area.cend() != reference_area.find(tile_index);
+/** Merges a `duplicate` of the key of `result` into `result`. */
+void merge_duplicate(H & result, H const & duplicate, Indicators & indicators) noexcept {
+    indicators.report_additional_H_duplicates(1);
+    merge_duplicate_values(result, duplicate);
 }
 
-struct ConnectionStrengths {
-private: /* Types: */
-    struct ConnectionStrengthHasher {
-        std::size_t operator()(ConnectionStrengthKey const & key) const noexcept
-        {
-            uint64_t key_bytes = {};
-            static_assert(sizeof(key) < sizeof(key_bytes), "");
-            memcpy(&key_bytes, &key, sizeof(key));
-            return std::hash<decltype(key_bytes)>{}(key_bytes);
-        }
-    };
-
-    struct ConnectionOperand {
-        /**
-           The number of users that have both tile j and RA r in their usual
-           environment.
-         */
-        double numerator = {};
-        /**
-           The number of users that have tile j in their usual environment.
-         */
-        double denominator = {};
-    };
-
-    using ConnectionOperands = std::unordered_map<ConnectionStrengthKey,
-                                                  ConnectionOperand,
-                                                  ConnectionStrengthHasher>;
-
-public: /* Methods: */
-    void operator()(Y const & e)
-    {
-        for (ReferenceAreaIndex ra_index = 0; ra_index < m_reference_areas.size();
-             ++ra_index) {
-            // Skip this tile if it is in the reference areas (yes, only look
-            // at elements outside).
-            if (is_inside(e.key.tile, m_reference_areas[ra_index])) { continue; }
-
-            auto & connection_operand =
-                    connection_operands[{ra_index, e.key.tile}];
-            // e.calibration_weight is 1.0 if calibration is disabled.
-            connection_operand.numerator +=
-                    static_cast<double>(e.reference_area_indices.test(ra_index))
-                    * e.calibration_weight;
-            connection_operand.denominator += e.calibration_weight;
-        }
+/** The new S record of a key, out of its H and old S records (at most one is
+ * null). */
+S update_s(H const * h,
+           S const * s,
+           Indicators & indicators,
+           DebugRecordCounting & debug_record_counting) noexcept
+{
+    if (h) {
+        indicators.process_h_record(*h);
+        debug_record_counting.h();
     }
-
-    ConnectionStrengths(sharemind_hi::enclave::TaskOutputs & outputs,
-                        ReferenceAreas const & reference_areas) noexcept
-        : m_outputs(outputs), m_reference_areas(reference_areas)
-    {}
-
-    ConnectionStrengths(ConnectionStrengths &&) noexcept = default;
-
-    ~ConnectionStrengths()
-    {
-        if (connection_operands.empty()) {
-            // This is the moved-from instance. We can be rather sure that there
-            // is always input data, and hence there is always some data in
-            // this map.
-            return;
-        }
-
-        std::vector<FunctionalUrbanFingerprintReport> result;
-        result.reserve(connection_operands.size());
-
-        for (auto const & kv : connection_operands) {
-            auto const strength = kv.second.numerator / kv.second.denominator;
-            // Applying SDC. Don't add 0 connection strengths to the result.
-            if (kv.second.numerator >= sdc_threshold && strength > 1e-20) {
-                result.push_back({kv.first, strength});
-            }
-        }
-
-        m_outputs.put(output_names::functional_urban_fingerprint_report, result);
+    if (s) {
+        indicators.process_s_old_record(*s);
+        debug_record_counting.s_old();
     }
+    auto const result = accumulate_s(h, s);
+    indicators.process_s_new_record(result);
+    debug_record_counting.s_new();
+    return result;
+}
 
-public: /* Fields: */
-    sharemind_hi::enclave::TaskOutputs & m_outputs;
-    ReferenceAreas const & m_reference_areas;
+} // namespace
 
-private:
-    ConnectionOperands connection_operands;
-};
+namespace module_d {
+namespace {
 
-std::unordered_map<TileIndex, double, TileIndexHasher>
+TileGrid<double>
 build_calibration_weights_map(Statistics & statistics,
                               CensusResidents const & residents,
                               TopAnchorDistribution const & top_anchor_dist,
                               bool const with_calibration)
 {
-    std::unordered_map<TileIndex, double, TileIndexHasher> result;
+    TileGrid<double> result;
 
     if (!with_calibration) { return result; }
 
-    for (auto const & kv : top_anchor_dist) {
-        double const anchor_count = kv.second;
+    top_anchor_dist.forEach([&](TileIndex const tile, std::uint32_t const count) {
+        double const anchor_count = count;
         double const resident_count = [&] {
-            auto const it = residents.find(kv.first);
-            if (it == residents.cend()) {
-                return 0.0;
-            } else {
-                return it->second;
-            }
+            auto const residents_of_tile = residents.find(tile);
+            return residents_of_tile ? *residents_of_tile : 0.0;
         }();
         auto const max_count = std::max(resident_count, anchor_count);
         assert(anchor_count > 0);
@@ -511,29 +412,133 @@ build_calibration_weights_map(Statistics & statistics,
                 return ratio;
             }
         }();
-        result.insert(std::make_pair(kv.first, weight));
+        result.insert(tile, weight);
 
         // The python code has this calculation in a separate loop. I merged the
         // two loops into one.
         statistics.observed_total_users += anchor_count;
         statistics.adjusted_total_users += weight * anchor_count;
-    }
+    });
     return result;
 }
+
+/** Applies the SDC to the total footprints and puts them into `outputs`. */
+template <typename TotalFootprints>
+void report_total_footprints(TotalFootprints total_footprints,
+                             PipelineProfile & profile,
+                             sharemind_hi::enclave::TaskOutputs & outputs)
+{
+    using Stage = PipelineProfile::Stage;
+
+    std::move(total_footprints)
+            >>= stageEntry(profile, Stage::Outputs)
+            >>= smap([](TotalFootprint result) noexcept -> FingerprintReport {
+                    // Applying SDC
+                    for (auto & v : result.values) {
+                        if (v < sdc_threshold) { v = 0; }
+                    }
+
+                    return {result.tile_index, result.values};
+                })
+            //
+            >>= encryptedOutput(outputs, output_names::fingerprint_report);
+}
+
+/**
+   Computes the connection strengths and the total footprints from the Y
+   records with their calibration weights, and puts both reports into
+   `outputs`.
+ */
+template <typename WeightedY>
+void report_footprints(WeightedY weighted_y,
+                       ReferenceAreas const & reference_areas,
+                       std::string const & temporary_path_prefix,
+                       PipelineProfile & profile,
+                       sharemind_hi::enclave::TaskOutputs & outputs)
+{
+    using Stage = PipelineProfile::Stage;
+
+    report_total_footprints(
+            std::move(weighted_y)
+
+            /**********************
+             * Connection Strengths
+             **********************/
+
+            >>= stageEntry(profile, Stage::ModuleD)
+            >>= inspect(ConnectionStrengths{outputs, reference_areas})
+            >>= stageExit(profile, Stage::ModuleD)
+
+            /****************
+             * Sum footprints
+             ****************/
+
+            // The number of distinct tiles is bounded, so the sums usually
+            // fit into memory and Y does not need to be sorted by tile.
+            >>= stageEntry(profile, Stage::TileAggregation)
+            >>= aggregateByTile(
+                    [](Y const & e) noexcept { return e.key.tile; },
+                    [](Y const & e) {
+                        // Only initialize the data that needs to be
+                        // initialized once. The squash function is called
+                        // directly afterwards with the same `result` and `e`,
+                        // again to do the iterative logic.
+                        TotalFootprint result{};
+                        result.tile_index = e.key.tile;
+                        return result;
+                    },
+                    [](TotalFootprint & result, Y const & e) {
+                        for (std::size_t i = 0; i < result.values.size(); ++i) {
+                            result.values[i] +=
+                                    // e.calibration_weight is 1.0 if
+                                    // calibration is disabled.
+                                    e.calibration_weight
+                                    * static_cast<double>(e.values[i]);
+                        }
+                    },
+                    tile_aggregation_bytes,
+                    temporary_path_prefix + "y_aggregation_partition")
+            >>= stageExit(profile, Stage::TileAggregation),
+
+            /************************
+             * Total footprint report
+             ************************/
+            profile,
+            outputs);
+}
+} // namespace
+} // namespace module_d
+
+namespace {
+/** Logs the H files which are declared sorted, but were sorted after all. */
+void log_declared_order(std::vector<HInput> const & h_files,
+                        bool const * const h_sorted,
+                        Log & application_log)
+{
+    for (std::size_t i = 0; i < h_files.size(); ++i) {
+        if (h_files[i].is_sorted && !h_sorted[i]) {
+            application_log.append("The H file <" + h_files[i].path + "> is declared sorted, but is "
+                                   "not. It was sorted like an undeclared file.\n");
+        }
+    }
 }
 } // namespace
 
-void run(HFileSource h_file,
-         SFileSource s_file_in,
-         SFileSink s_file_out,
-         PseudonymisationKeyRef pseudonymisation_key,
+void run(std::vector<HInput> const & h_files,
+         std::string const & s_file_prefix,
+         SShards & s_segments,
+         std::string const & temporary_path_prefix,
          Perform const what_to_do,
          ReferenceAreas const & reference_areas,
          CensusResidents const & residents,
          bool const with_calibration,
+         IoProfile const & io_profile,
+         PipelineProfile & profile,
          sharemind_hi::enclave::TaskOutputs & outputs,
          Log & application_log)
 {
+    using Stage = PipelineProfile::Stage;
+
     // This function is awfully long, because the Stream API creates big, nested
     // types out of the combinators. This means, without C++14 auto function
     // return type deduction support this cannot really be split into nice
@@ -546,129 +551,215 @@ void run(HFileSource h_file,
 
     auto debug_record_counting = DebugRecordCounting{};
 
+    // The calling thread is one of the threads.
+    BackgroundJob::setMaxThreads(io_profile.threads - 1u);
+
     /************
      * Module B
      ************/
 
-    /** In an ideal situation, pseudonyms are sorted. This means, we only need
-     * to decrypt the first one and just can lookup the following records. */
-    struct LastSeen {
-        PseudonymisedUserIdentifier pseud_id;
-        UserIdentifier id;
+    assert(!h_files.empty());
 
-        LastSeen(HFileSource & h_file, PseudonymisationKeyRef pseudonymisation_key)
-        {
-            PseudonymisedUserFootprintUpdates first;
-            if (h_file.peek(first)) {
-                pseud_id = first.id;
-                id = decrypt_pseudonym(pseudonymisation_key, pseud_id);
-            } else {
-                // The H file is empty, so no records will be decrypted.
-                // The members can stay uninitialized.
-            }
+    // Each period has its own key, hence its own reversal, and they share the
+    // cache memory. They write to application_log in the dtor.
+    std::vector<std::unique_ptr<PseudonymReversal>> pseudonym_reversals;
+    for (auto const & h_file : h_files) {
+        pseudonym_reversals.emplace_back(
+                new PseudonymReversal{h_file.pseudonymisation_key,
+                                      io_profile.pseudonym_cache / h_files.size(),
+                                      application_log});
+    }
+
+    // Whether each H file is still expected to be sorted. Its sort clears
+    // this for a file declared sorted, if its first run is not in order.
+    std::unique_ptr<bool[]> h_sorted{new bool[h_files.size()]};
+    for (std::size_t i = 0; i < h_files.size(); ++i) { h_sorted[i] = h_files[i].is_sorted; }
+
+    // The H streams of all H files are open at the same time, so they share
+    // the buffer and sort memory.
+    auto const h_source_bytes = std::max<std::size_t>(io_profile.h_source / h_files.size(), 1u);
+    auto const sort_run_bytes = io_profile.sort_run / h_files.size();
+
+    auto const h_records = [&](std::size_t const i) {
+        return stagedSource(Stage::Decrypt,
+                            [&] { return HFileSource(h_files[i].path.c_str(), h_source_bytes); })
+                //
+                >>= stageEntry(profile, Stage::Decrypt)
+                >>= chunkedMap<H>(PseudonymReversal::chunk_size,
+                                  [&pseudonym_reversals, i](PseudonymisedUserFootprintUpdates const * in,
+                                                            std::size_t count,
+                                                            H * out) {
+                                      (*pseudonym_reversals[i])(in, count, out);
+                                  })
+                >>= stageExit(profile, Stage::Decrypt);
+    };
+
+    // The H records of the periods are summed up, like consecutive updates
+    // of S would do.
+    auto const h_key = [](H const & e) noexcept { return e.key; };
+    auto const add_periods = [](H & result, H const & other) noexcept {
+        add_period_values(result, other);
+    };
+
+    // At this point, H values are sorted by (ID, tile_index) after the sort,
+    // and each (ID, tile_index) is unique after merging the duplicates (and
+    // the periods). There is the invariant that the same holds for S, since
+    // the result of the following join is also sorted by (ID, tile_index)
+    // with (ID, tile_index) being unique.
+
+    // Only the records of the S shards [first_shard, end_shard) are kept.
+    auto const cleaned_deduped_sorted_h_file = [&](std::size_t const i,
+                                                   std::size_t const first_shard,
+                                                   std::size_t const end_shard) {
+        return h_records(i)
+                >>= filter([first_shard, end_shard](H const & e) noexcept {
+                        auto const shard = sShard(e.key.id);
+                        return first_shard <= shard && shard < end_shard;
+                    })
+                //
+                >>= stageEntry(profile, Stage::HSort)
+                >>= externalSort(CMP_LAMBDA(<, H, e.key),
+                                 FootprintKeyRadixSort{io_profile.threads},
+                                 sort_run_bytes,
+                                 temporary_path_prefix + "h_sort_run" + std::to_string(i) + "_",
+                                 &h_sorted[i])
+                >>= stageExit(profile, Stage::HSort)
+                //
+                >>= stageEntry(profile, Stage::FilterDedup)
+                >>= filter([](H const & e) noexcept { return is_valid(e); })
+
+                // In theory only one record per tile per user should be in the
+                // input data, so duplicates are merged in place instead of
+                // collecting each group into a vector.
+                >>= mergeDuplicates(CMP_LAMBDA(==, H, e.key),
+                                    [&indicators](H & result, H const & duplicate) noexcept {
+                                        merge_duplicate(result, duplicate, indicators);
+                                    })
+                >>= stageExit(profile, Stage::FilterDedup);
+    };
+    if (what_to_do == Perform::OnlyStateUpdate) {
+        // The S shards hold disjoint users, so each shard is updated on its
+        // own (in parallel, if enclave threads are available) with its part
+        // of H. The indicators and counts are merged in the end.
+        auto const shard_of = [](H const & e) noexcept { return sShard(e.key.id); };
+
+        // An unsorted H file is sorted by shard, before any shard is updated.
+        // If it does not fit into memory, each shard gets its own runs.
+        auto const sorted_h_shards = [&](std::size_t const i) {
+            return h_records(i)
+                    //
+                    >>= stageEntry(profile, Stage::HSort)
+                    >>= partitionedSort(CMP_LAMBDA(<, H, e.key),
+                                        FootprintKeyRadixSort{io_profile.threads},
+                                        sort_run_bytes,
+                                        temporary_path_prefix + "h_sort_run" + std::to_string(i) + "_",
+                                        shard_of,
+                                        s_shards);
+        };
+        std::vector<decltype(sorted_h_shards(0u))> unsorted_h_periods;
+        for (std::size_t i = 0; i < h_files.size(); ++i) {
+            if (!h_files[i].is_sorted) { unsorted_h_periods.push_back(sorted_h_shards(i)); }
         }
-    } last_seen = {h_file, pseudonymisation_key};
-    
-    auto sorted_h_file = std::move(h_file)
-            //
-            >>=
-            smap([&](PseudonymisedUserFootprintUpdates const & e) {
-                PseudonymisedUserIdentifier pseud_id = e.id;
-                if (pseud_id != last_seen.pseud_id) {
-                    last_seen.pseud_id = pseud_id;
-                    last_seen.id = decrypt_pseudonym(pseudonymisation_key, pseud_id);
+        // The sorted H files are read once per pass of the fan-out below.
+        auto const sorted_h = [&](std::size_t const first_shard, std::size_t const end_shard) {
+            std::vector<decltype(cleaned_deduped_sorted_h_file(0u, 0u, 0u))> periods;
+            for (std::size_t i = 0; i < h_files.size(); ++i) {
+                if (h_files[i].is_sorted) {
+                    periods.push_back(cleaned_deduped_sorted_h_file(i, first_shard, end_shard));
                 }
-                return H{{last_seen.id, e.tile}, e.i_column};
-            })
-            //
-            >>= sort(CMP_LAMBDA(<, H, e.key), detail::mebibytes(64));
+            }
+            return uniqueMerge(std::move(periods), h_key, add_periods);
+        };
 
-    auto cleaned_deduped_sorted_h_file = std::move(sorted_h_file)
-            //
-            >>= filter([](H const & e) noexcept {
-                    bool positive_found = false;
-                    for (auto const value : e.i_column) {
-                        if (!std::isfinite(value)) { return false; }
-                        if (value < 0) { return false; }
-                        if (value > 0) { positive_found = true; }
-                    }
-                    return positive_found;
-                })
+        std::unique_ptr<Indicators[]> shard_indicators{new Indicators[s_shards]};
+        std::unique_ptr<DebugRecordCounting[]> shard_record_counting{
+                new DebugRecordCounting[s_shards]};
+        std::unique_ptr<PipelineProfile[]> shard_profiles{new PipelineProfile[s_shards]};
+
+        // `sorted_h_shard` are the records of the sorted H files, which are
+        // already cleaned, deduplicated and merged.
+        auto const update_shard = [&](std::size_t const shard, FanOutSource<H> sorted_h_shard) {
+            auto & indicators = shard_indicators[shard];
+            auto & debug_record_counting = shard_record_counting[shard];
+            auto & profile = shard_profiles[shard];
+            auto const shard_prefix = sShardPrefix(s_file_prefix, shard);
+
+            auto const cleaned_deduped_h_shard = [&](std::size_t const k) {
+                return stagedSource(Stage::HSort, [&] { return unsorted_h_periods[k].source(shard); })
+                        >>= stageExit(profile, Stage::HSort)
+                        //
+                        >>= stageEntry(profile, Stage::FilterDedup)
+                        >>= filter([](H const & e) noexcept { return is_valid(e); })
+                        //
+                        >>= mergeDuplicates(CMP_LAMBDA(==, H, e.key),
+                                            [&indicators](H & result, H const & duplicate) noexcept {
+                                                merge_duplicate(result, duplicate, indicators);
+                                            })
+                        >>= stageExit(profile, Stage::FilterDedup);
+            };
+            std::vector<decltype(cleaned_deduped_h_shard(0u))> h_periods;
+            h_periods.reserve(unsorted_h_periods.size());
+            for (std::size_t k = 0; k < unsorted_h_periods.size(); ++k) {
+                h_periods.push_back(cleaned_deduped_h_shard(k));
+            }
+            // Like `add_periods`, the periods of the sorted and the unsorted
+            // files are summed up.
+            auto h_shard = uniqueOuterJoin(std::move(sorted_h_shard),
+                                           uniqueMerge(std::move(h_periods), h_key, add_periods),
+                                           h_key,
+                                           h_key,
+                                           [](H const * a, H const * b) noexcept {
+                                               if (!b) { return *a; }
+                                               if (!a) { return *b; }
+                                               auto result = *a;
+                                               add_period_values(result, *b);
+                                               return result;
+                                           });
+
+            profile.begin(Stage::OuterJoin);
+            uniqueOuterJoin(std::move(h_shard),
+                            stagedSource(Stage::OuterJoin,
+                                         [&] {
+                                             return SSegmentsSource{shard_prefix,
+                                                                    s_segments[shard],
+                                                                    io_profile.s_source};
+                                         }),
+                            [](H const & e) /* value */ { return e.key; },
+                            [](S const & e) /* value */ { return e.key; },
+                            [&](H const * h, S const * s) noexcept {
+                                profile.countIn(Stage::OuterJoin, (h ? 1u : 0u) + (s ? 1u : 0u));
+                                // Only the records with an H record changed,
+                                // so only these go into a delta segment.
+                                return SUpdate{update_s(h, s, indicators, debug_record_counting),
+                                               h != nullptr};
+                            })
+                    >>= stageExit(profile, Stage::OuterJoin)
+                    >>= stageEntry(profile, Stage::SWrite)
+                    >>= sSegmentsOutput(shard_prefix,
+                                       io_profile.s_sink,
+                                       s_segments[shard],
+                                       io_profile.compress_s);
+            profile.end(Stage::SWrite);
+            // The update wrote either a new base or a new delta segment.
+            auto const & segments = s_segments[shard];
+            profile.countOut(Stage::SWrite,
+                             segments.base.id == segments.last_id
+                                     ? segments.base.records
+                                     : segments.deltas[segments.num_deltas - 1u].records);
+        };
 
-            // Not using `squash` here, as in theory only one record per tile
-            // per user should be in the input data.
-            >>= groupBy(CMP_LAMBDA(==, H, e.key))
-            //
-            >>= flatMap(
-                    [&indicators](std::vector<H> const & v, std::vector<H> & result_vec) -> void {
-                        // Note: if the input H would be sanitized, `v` would
-                        // always only contain a single element.
-
-                        assert(!v.empty());
-                        result_vec.push_back(v.front());
-                        if (v.size() == 1) { return; }
-
-                        indicators.report_additional_H_duplicates(v.size() - 1);
-
-                        H & result = result_vec.front();
-                        for (auto const & e : v) {
-                            for (std::size_t i = 0;
-                                 i < result.i_column.size();
-                                 ++i) {
-                                auto const a = result.i_column[i];
-                                auto const b = e.i_column[i];
-                                result.i_column[i] = std::max(a, b);
-                            }
-                        }
-                        return;
-                    });
-
-    // At this point, H values are sorted by (ID, tile_index).
-    // Each (ID, tile_index) is unique.
-    // There is the invariant that the same holds for S, since the result of
-    // the following merge function is also sorted by (ID, tile_index) with
-    // (ID, tile_index) being unique.
-
-    auto updated_s = outerJoin(
-            std::move(cleaned_deduped_sorted_h_file),
-            std::move(s_file_in),
-            [](H const & e) /* value */ { return e.key; },
-            [](S const & e) /* value */ { return e.key; })
-            //
-            >>=
-            smap([&indicators, &debug_record_counting](
-                         std::pair<std::vector<H>, std::vector<S>> const & vv) noexcept
-                 -> S {
-                S result;
-                assert(vv.second.size() <= 1);
-                assert(vv.first.size() <= 1);
-                if (vv.first.empty()) {
-                    indicators.process_s_old_record(vv.second.front());
-                    debug_record_counting.s_old();
-                    result = vv.second.front();
-                } else if (vv.second.empty()) {
-                    indicators.process_h_record(vv.first.front());
-                    debug_record_counting.h();
-                    result = S{vv.first.front().key, vv.first.front().i_column};
-                } else {
-                    indicators.process_h_record(vv.first.front());
-                    indicators.process_s_old_record(vv.second.front());
-                    debug_record_counting.h();
-                    debug_record_counting.s_old();
-                    result = vv.second.front();
-                    for (std::size_t i = 0; i < result.i_column.size(); ++i) {
-                        result.i_column[i] += vv.first.front().i_column[i];
-                    }
-                }
-                indicators.process_s_new_record(result);
-                debug_record_counting.s_new();
-                return result;
-            });
+        // The sorted H files are streamed into the shards, which are updated
+        // while the files are read. A shard without its own thread is updated
+        // in the calling thread, which reads the sorted H files once more for
+        // each such shard after the first, instead of spilling H.
+        fanOut(sorted_h, shard_of, update_shard, s_shards, io_profile.h_source / s_shards);
 
-    if (what_to_do == Perform::OnlyStateUpdate) {
-        // The "update S" pipeline is built, just write it to the file ..
-        std::move(updated_s) >>= std::move(s_file_out);
-        // .. and call it a day.
+        for (std::size_t shard = 0; shard < s_shards; ++shard) {
+            indicators.merge(std::move(shard_indicators[shard]));
+            debug_record_counting.merge(std::move(shard_record_counting[shard]));
+            profile.merge(shard_profiles[shard]);
+        }
+        log_declared_order(h_files, h_sorted.get(), application_log);
         return;
     }
 
@@ -677,22 +768,40 @@ void run(HFileSource h_file,
     // If the full analysis can be done, we don't need to write S back - the NSI
     // request has been fulfilled and related state will be dismissed afterwards.
 
+    std::vector<decltype(cleaned_deduped_sorted_h_file(0u, 0u, 0u))> h_periods;
+    h_periods.reserve(h_files.size());
+    for (std::size_t i = 0; i < h_files.size(); ++i) {
+        h_periods.push_back(cleaned_deduped_sorted_h_file(i, 0u, s_shards));
+    }
+
     Statistics statistics = {};
     TopAnchorDistribution top_anchor_dist;
-    // Its somewhere in the range of 600K. To prevent an additional allocation
-    // if it is a bit above 600K, just add a buffer.
-    top_anchor_dist.reserve(700000);
 
     auto single_human_analysis = module_c::SingleHumanAnalysis{statistics};
 
-    auto materialized_y = std::move(updated_s)
+    // The shards are read in the order of the keys, as if S was not sharded.
+    profile.begin(Stage::OuterJoin);
+    auto updated_s = uniqueOuterJoin(
+            uniqueMerge(std::move(h_periods), h_key, add_periods),
+            stagedSource(Stage::OuterJoin,
+                         [&] { return SSegmentsSource{s_file_prefix, s_segments, io_profile.s_source}; }),
+            [](H const & e) /* value */ { return e.key; },
+            [](S const & e) /* value */ { return e.key; },
+            [&indicators, &debug_record_counting, &profile](H const * h, S const * s) noexcept {
+                profile.countIn(Stage::OuterJoin, (h ? 1u : 0u) + (s ? 1u : 0u));
+                return update_s(h, s, indicators, debug_record_counting);
+            })
+            >>= stageExit(profile, Stage::OuterJoin);
+
+    auto y = std::move(updated_s)
 
             // Group by the user id, i.e. put all tiles for the same user into
             // a single group.
-            >>= groupBy(CMP_LAMBDA(==, S, e.key.id))
-            //
-            >>= flatMap([&](std::vector<S> const & footprints,
-                           std::vector<QuantisedFootprint> & result) {
+            >>= stageEntry(profile, Stage::ModuleC)
+            >>= groupFlatMap<QuantisedFootprint>(
+                    CMP_LAMBDA(==, S, e.key.id),
+                    [&](std::vector<S> & footprints,
+                        std::vector<QuantisedFootprint> & result) {
             /************
              * Module C
              ************/
@@ -707,27 +816,9 @@ void run(HFileSource h_file,
              * Add Reference Areas
              *********************/
 
-                    // Intermediate storage for the reference area indices for
-                    // this user.
-                    decltype(Y::reference_area_indices) group_ra_indices{};
-                    for (std::size_t i = 0; i < reference_areas.size(); ++i) {
-                        for (auto const & q : result) {
-                            if (module_d::is_inside(q.key.tile, reference_areas[i])) {
-                                group_ra_indices.set(i);
-                                // Stop searching for more certificates for this RA,
-                                // go to the next RA and start iteration over all
-                                // quantised footprints.
-                                break;
-                            }
-                        }
-                    }
-
-                    // The result needs to be written to all elements in the group.
-                    for (auto & q : result) {
-                        q.reference_area_indices = group_ra_indices;
-                    }
-                    return;
+                    module_d::add_reference_areas(result, reference_areas);
                 })
+            >>= stageExit(profile, Stage::ModuleC)
 
             /***********************************
              * Calculate Top Anchor Distribution
@@ -740,108 +831,95 @@ void run(HFileSource h_file,
                     }
 
                     debug_record_counting.y();
-                })
-
-            // At this point we need to move fully through `Y` so the
-            // TopAnchorDistribution will be filled to build the calibration
-            // weights map.
-            >>= temporaryOutput();
-
-    auto const weights = module_d::build_calibration_weights_map(
-            statistics, residents, top_anchor_dist, with_calibration);
-
-    double group_calibration_weight = 0;
-
-    auto sorted_y = temporarySource<Y>(std::move(materialized_y))
-
-            /*************************
-             * Add calibration weights
-             *************************/
-
-            >>=
-            smap([group_calibration_weight, &weights, with_calibration](Y e) mutable {
-                if (! with_calibration) {
-                    // Make it the neutral element for multiplication `*`
-                    // where it will be used in future invocations.
+                });
+
+    if (!with_calibration) {
+        // All calibration weights are 1.0, the neutral element for the
+        // multiplications in the reports. As they do not depend on the top
+        // anchor distribution, the reports are computed in the same pass.
+        module_d::report_footprints(
+                std::move(y) >>= smap([](Y e) noexcept {
                     e.calibration_weight = 1.0;
                     return e;
-                }
-
-                // The first element in a group (of same user id)
-                // has the FirstRank, and no other elements in this
-                // group have this rank (all increasing). Hence,
-                // when we find this tile, we lookup the weight,
-                // cache it and reuse it for the rest of the group.
-                if (e.rank == Y::FirstRank) {
-                    group_calibration_weight = [&] {
-                        auto const it = weights.find(e.key.tile);
-                        if (it == weights.cend()) {
-                            return 0.0;
-                        } else {
-                            return it->second;
-                        }
-                    }();
-                }
-                e.calibration_weight = group_calibration_weight;
-                return e;
-            })
-
-            /**********************
-             * Connection Strengths
-             **********************/
-
-            >>= inspect(module_d::ConnectionStrengths{outputs, reference_areas})
-
-            /****************
-             * Sum footprints
-             ****************/
-
-            // First sort. Place the result in a temporary variable to highlight
-            // that this step materializes data on the disk. But conceptually
-            // the following `squash` is tightly coupled to this `sort`.
-            >>= sort(CMP_LAMBDA(<, Y, e.key.tile), mebibytes(64));
-
-    std::move(sorted_y)
-
-            // Sum footprints (continued)
+                }),
+                reference_areas,
+                temporary_path_prefix,
+                profile,
+                outputs);
+    } else {
+        // The calibration weight of a user only depends on the top anchor
+        // tile, but the weights need the complete top anchor distribution.
+        // So instead of writing Y and reading it again, the Y records are
+        // summed up per tile, top anchor tile and reference areas, and the
+        // weights are applied to these sums. They are only passed on once Y
+        // is exhausted, so the distribution is complete by then.
+        std::unique_ptr<TileGrid<double> const> weights;
+        auto weight_of = [&](TileIndex const anchor) {
+            if (!weights) {
+                weights.reset(new TileGrid<double>{module_d::build_calibration_weights_map(
+                        statistics, residents, top_anchor_dist, with_calibration)});
+            }
+            auto const weight = weights->find(anchor);
+            return weight ? *weight : 0.0;
+        };
 
-            // Optimized squash = groupBy + flatMap required here, because
-            // there might be a lot of records for the same tile id which
-            // exceeds the available memory.
-            >>= squash(
-                    CMP_LAMBDA(==, Y, e.key.tile),
-                    [](Y const & e) {
-                        // Only initialize the data that needs to be
-                        // initialized once. The squash function is called
-                        // directly afterwards with the same `result` and `e`,
-                        // again to do the iterative logic.
-                        TotalFootprint result{};
-                        result.tile_index = e.key.tile;
-                        return result;
-                    },
-                    [](TotalFootprint & result, Y const & e) {
-                        for (std::size_t i = 0; i < result.values.size(); ++i) {
-                            result.values[i] +=
-                                    // e.calibration_weight is 1.0 if
-                                    // calibration is disabled.
-                                    e.calibration_weight
-                                    * static_cast<double>(e.values[i]);
-                        }
+        using module_d::CalibratedSums;
+        using module_d::CalibrationSums;
+        module_d::report_total_footprints(
+                std::move(y)
+                >>= smap(module_d::AddAnchorTile{})
+                >>= stageEntry(profile, Stage::TileAggregation)
+                >>= aggregateByTile(
+                        [](module_d::AnchoredY const & e) noexcept { return e.key; },
+                        [](module_d::AnchoredY const & e) noexcept {
+                            CalibrationSums result{};
+                            result.key = e.key;
+                            return result;
+                        },
+                        module_d::add_calibration_sums,
+                        tile_aggregation_bytes,
+                        temporary_path_prefix + "calibration_aggregation_partition")
+                >>= stageExit(profile, Stage::TileAggregation)
+
+                /*************************
+                 * Add calibration weights
+                 *************************/
+
+                >>= stageEntry(profile, Stage::ModuleD)
+                >>= smap([&weight_of](CalibrationSums const & e) {
+                        return module_d::calibrate(e, weight_of(e.key.anchor));
                     })
 
-            /************************
-             * Total footprint report
-             ************************/
-            >>= smap([](TotalFootprint result) noexcept -> FingerprintReport {
-                    // Applying SDC
-                    for (auto & v : result.values) {
-                        if (v < sdc_threshold) { v = 0; }
-                    }
-
-                    return {result.tile_index, result.values};
-                })
-            //
-            >>= encryptedOutput(outputs, output_names::fingerprint_report);
+                /**********************
+                 * Connection Strengths
+                 **********************/
+
+                >>= inspect(module_d::ConnectionStrengths{outputs, reference_areas})
+
+                /****************
+                 * Sum footprints
+                 ****************/
+
+                // The sums are ordered by the tile.
+                >>= squash(CMP_LAMBDA(==, CalibratedSums, e.tile),
+                           [](CalibratedSums const & e) noexcept {
+                               TotalFootprint result{};
+                               result.tile_index = e.tile;
+                               return result;
+                           },
+                           [](TotalFootprint & result, CalibratedSums const & e) noexcept {
+                               for (std::size_t i = 0; i < result.values.size(); ++i) {
+                                   result.values[i] += e.values[i];
+                               }
+                           })
+                >>= stageExit(profile, Stage::ModuleD),
+
+                /************************
+                 * Total footprint report
+                 ************************/
+                profile,
+                outputs);
+    }
 
     /********************************
      * Top anchor distribution report
@@ -850,12 +928,13 @@ void run(HFileSource h_file,
     {
         std::vector<TopAnchorDistributionReport> result;
         result.reserve(top_anchor_dist.size());
-        for (auto const & p : top_anchor_dist) {
+        // The report is sorted by tile.
+        top_anchor_dist.forEach([&result](TileIndex const tile, std::uint32_t const count) {
             // Applying SDC
-            if (p.second >= sdc_threshold) {
-                result.push_back({p.first, p.second});
+            if (count >= sdc_threshold) {
+                result.push_back({tile, count});
             }
-        }
+        });
 
         outputs.put(output_names::top_anchor_distribution_report, result);
     }
@@ -865,6 +944,8 @@ void run(HFileSource h_file,
      *******************/
 
     outputs.put(output_names::statistics, &statistics, sizeof(statistics));
+    profile.end(Stage::Outputs);
+    log_declared_order(h_files, h_sorted.get(), application_log);
 }
 
 } // namespace full_analysis
@@ -18,27 +18,63 @@
 #pragma once
 
 #include "Entities.h"
+#include "IoProfile.h"
+#include "PipelineProfile.h"
+#include "ReferenceAreas.h"
+#include "SSegments.h"
+#include "TileGrid.h"
 #include "StreamAdditions.h"
+#include <cstdint>
 #include <sharemind-hi/enclave/common/File.h>
+#include <sharemind-hi/enclave/task/Task.h>
+#include <string>
+#include <vector>
 
 namespace eurostat {
 namespace enclave {
 namespace full_analysis {
 
 using HFileSource = PersistentDataSource<PseudonymisedUserFootprintUpdates, sharemind_hi::enclave::File>;
-using SFileSource = PersistentDataSource<AccumulatedUserFootprint, SgxEncryptedFile>;
-using SFileSink = PersistentDataSinkBuilder;
 
 enum class Perform { OnlyStateUpdate, FullAnalysis };
 
-void run(HFileSource h_file,
-         SFileSource s_file_in,
-         SFileSink s_file_out,
-         PseudonymisationKeyRef pseudonymisation_key,
+/** One of the H files of consecutive periods which are processed together. */
+struct HInput {
+    std::string path;
+    /** Whether the records of the file are declared sorted by their
+     * `FootprintKey` by the operator. Then their first sort run is checked
+     * while it is collected, and if it is in order, the rest is not sorted,
+     * but just checked to be in order, and an exception is thrown if it is
+     * not. A file whose first run is not in order is sorted like any other,
+     * which is logged. */
+    bool is_sorted;
+    /** The periodic key of the file's period. */
+    std::uint8_t pseudonymisation_key[PseudonymisationKeyLength];
+};
+
+/**
+   Runs the analysis for the H files of one or more consecutive periods (at
+   least one). Each H file is decrypted with its own key, sorted and cleaned
+   on its own, and the H records of the same key from several periods are
+   summed up, so S is read and written only once for all periods. The H
+   indicators describe these summed up records. `temporary_path_prefix` is
+   prepended to the names of temporary files, e.g. the runs of the external
+   sorts. `s_segments` are the S shards, whose files are named with
+   `s_file_prefix`. `Perform::OnlyStateUpdate` writes a new segment into each
+   shard and adds it to `s_segments`. The buffers of the H and S streams are
+   sized by `io_profile`, the H buffers and the sort memory are split among
+   the H files. The stages of the pipeline are measured in `profile`.
+ */
+void run(std::vector<HInput> const & h_files,
+         std::string const & s_file_prefix,
+         SShards & s_segments,
+         std::string const & temporary_path_prefix,
          Perform what_to_do,
          ReferenceAreas const & reference_areas,
          CensusResidents const & residents,
          bool with_calibration,
+         IoProfile const & io_profile,
+         PipelineProfile & profile,
          sharemind_hi::enclave::TaskOutputs & outputs,
          Log & application_log);
 
@@ -248,6 +248,11 @@ public: /* Methods: */
         }
     }
 
+    Log2Histogram & operator+=(Log2Histogram const & other) noexcept {
+        for (std::size_t bin = 0; bin < Bins; ++bin) { m_data[bin] += other.m_data[bin]; }
+        return *this;
+    }
+
 private: /* Fields: */
     std::array<std::uint64_t, Bins> m_data = {};
 };
@@ -303,6 +308,18 @@ public: /* Methods: */
         return m_data;
     }
 
+    /**
+       Adds the counts of `other`, which must have seen other users than this
+       object. `other` must not be used afterwards.
+     */
+    void merge(Count && other) noexcept
+    {
+        auto const data = other.finish();
+        m_data.num_records += data.num_records;
+        m_data.num_unique_users += data.num_unique_users;
+        m_data.histogram_records_per_user += data.histogram_records_per_user;
+    }
+
     void operator()(UserIdentifier const & id) noexcept
     {
         ++m_data.num_records;
@@ -360,6 +377,10 @@ struct SpatiotemporalDistribution {
         if (col[3] != 0) { index += 1; }
         ++result[index];
     }
+
+    void merge(SpatiotemporalDistribution && other) noexcept {
+        for (std::size_t i = 0; i < result.size(); ++i) { result[i] += other.result[i]; }
+    }
 };
 
 /** 6.4.5 */
@@ -399,6 +420,15 @@ public: /* Methods: */
         return map(m_datas, &Data::histogram);
     }
 
+    /** Like `Count::merge`. */
+    void merge(HHistogramCountOfUniqueTilesPerUserWithPresence && other) noexcept
+    {
+        auto const histograms = other.finish();
+        for (std::size_t i = 0; i < num_subperiods; ++i) {
+            m_datas[i].histogram += histograms[i];
+        }
+    }
+
 private: /* Methods: */
     void finish_user() noexcept {
         assert(!m_first_incovation);
@@ -446,6 +476,13 @@ public: /* Methods: */
         return m_histograms;
     }
 
+    void merge(HistogramOfWeightValues && other) noexcept
+    {
+        for (std::size_t i = 0; i < num_subperiods; ++i) {
+            m_histograms[i] += other.m_histograms[i];
+        }
+    }
+
 private: /* Fields: */
     std::array<Histogram, num_subperiods> m_histograms = {};
 };
@@ -485,6 +522,15 @@ public: /* Methods: */
         return map(m_datas, &Data::histogram);
     }
 
+    /** Like `Count::merge`. */
+    void merge(HistogramOfAverageDistances && other) noexcept
+    {
+        auto const histograms = other.finish();
+        for (std::size_t i = 0; i < num_subperiods; ++i) {
+            m_datas[i].histogram += histograms[i];
+        }
+    }
+
 private: /* Methods: */
     void process(FootprintKey const & key,
                  IColumn const & col,
@@ -608,6 +654,19 @@ public: /* Methods: */
         return map(m_datas, &Data::result);
     }
 
+    /** Like `Count::merge`. */
+    void merge(BoundingBoxMeasure && other) noexcept
+    {
+        auto const results = other.finish();
+        for (std::size_t i = 0; i < num_subperiods; ++i) {
+            auto & result = m_datas[i].result;
+            result.h_diagonal_length_histogram += results[i].h_diagonal_length_histogram;
+            result.old_s_diagonal_length_histogram += results[i].old_s_diagonal_length_histogram;
+            result.old_s_vs_new_s_diagonal_length_histogram +=
+                    results[i].old_s_vs_new_s_diagonal_length_histogram;
+        }
+    }
+
 private: /* Methods: */
     void process(FootprintKey const & key,
                  IColumn const & col,
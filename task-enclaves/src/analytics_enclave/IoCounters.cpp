@@ -0,0 +1,71 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#include "IoCounters.h"
+#include <cassert>
+
+namespace eurostat {
+namespace enclave {
+
+constexpr std::size_t IoCounters::ACCOUNTS;
+
+namespace {
+
+/** The size of the nodes of the protected FS. */
+constexpr std::uint64_t node_size = 4096u;
+
+thread_local IoCounters::Accounts thread_counts = {};
+thread_local std::size_t thread_account = 0u;
+
+void count(std::uint64_t const bytes_written, std::uint64_t const ocalls) noexcept {
+    auto & counters = thread_counts[thread_account];
+    counters.bytes_written += bytes_written;
+    counters.ocalls += ocalls;
+}
+
+} // anonymous namespace
+
+IoCounters::Accounts const & IoCounters::ofThread() noexcept { return thread_counts; }
+
+void IoCounters::addToThread(Accounts const & counts) noexcept {
+    for (std::size_t i = 0; i < ACCOUNTS; ++i) {
+        thread_counts[i].bytes_written += counts[i].bytes_written;
+        thread_counts[i].ocalls += counts[i].ocalls;
+    }
+}
+
+void IoCounters::countPlain(std::size_t const bytes, bool const write) noexcept {
+    count(write ? bytes : 0u, 1u);
+}
+
+void IoCounters::countEncrypted(std::size_t const bytes, bool const write) noexcept {
+    count(write ? bytes : 0u, (bytes + node_size - 1u) / node_size);
+}
+
+IoAccount::IoAccount(std::size_t const account) noexcept
+    : m_previous{thread_account}
+{
+    assert(account < IoCounters::ACCOUNTS);
+    thread_account = account;
+}
+
+IoAccount::~IoAccount() { thread_account = m_previous; }
+
+std::size_t IoAccount::current() noexcept { return thread_account; }
+
+} // namespace enclave
+} // namespace eurostat
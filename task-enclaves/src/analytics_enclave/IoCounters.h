@@ -0,0 +1,74 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace eurostat {
+namespace enclave {
+
+/**
+   Counters of the file I/O. The protected FS reads and writes its 4 KiB
+   nodes with one ocall each, so the ocalls are estimated from the number of
+   file operations and the bytes they transfer.
+
+   The I/O is counted by each thread on its own, into the account the thread
+   has set with `IoAccount`, e.g. the stage of the pipeline which runs. A
+   `BackgroundJob` counts into the account of the thread which started it,
+   and its counts are added to the thread which waits for it. So the counts
+   of a thread include the I/O of all jobs it has waited for.
+ */
+struct IoCounters {
+    /** The number of accounts. The account 0 is for the I/O outside of any
+     * other account. */
+    static constexpr std::size_t ACCOUNTS = 16u;
+    using Accounts = std::array<IoCounters, ACCOUNTS>;
+
+    std::uint64_t bytes_written = 0;
+    std::uint64_t ocalls = 0;
+
+    /** The counts of the calling thread. */
+    static Accounts const & ofThread() noexcept;
+    /** Adds `counts`, e.g. of a thread which ended, to the calling thread. */
+    static void addToThread(Accounts const & counts) noexcept;
+
+    /** Counts a read or write of `bytes` with an untrusted file. */
+    static void countPlain(std::size_t bytes, bool write) noexcept;
+    /** Counts a read or write of `bytes` with an `SgxEncryptedFile`. */
+    static void countEncrypted(std::size_t bytes, bool write) noexcept;
+};
+
+/** Counts the I/O of the calling thread into `account` while it exists. */
+class IoAccount {
+public: /* Methods: */
+    explicit IoAccount(std::size_t account) noexcept;
+    IoAccount(IoAccount const &) = delete;
+    IoAccount & operator=(IoAccount const &) = delete;
+    ~IoAccount();
+
+    /** The account the calling thread counts into. */
+    static std::size_t current() noexcept;
+
+private: /* Fields: */
+    std::size_t m_previous;
+};
+
+} // namespace enclave
+} // namespace eurostat
@@ -0,0 +1,246 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+#include "IoProfile.h"
+#include "HiInternalApiDuplication.h"
+#include "Parameters.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <sharemind-hi/enclave/common/EnclaveException.h>
+#include <sharemind-hi/enclave/common/File.h>
+#include <sharemind-hi/filesystem/FileOpenMode.h>
+#include <vector>
+
+namespace eurostat {
+namespace enclave {
+
+constexpr char const * IoProfile::FILE_NAME;
+constexpr char const * IoProfile::TUNED_FILE_NAME;
+constexpr std::size_t IoProfile::MIN_BUFFER_BYTES;
+constexpr std::size_t IoProfile::MAX_BUFFER_BYTES;
+constexpr std::size_t IoProfile::MIN_SORT_BYTES;
+constexpr std::size_t IoProfile::MAX_SORT_BYTES;
+constexpr std::size_t IoProfile::MAX_PSEUDONYM_CACHE_BYTES;
+
+namespace {
+
+using sharemind_hi::enclave::EnclaveException;
+using sharemind_hi::enclave::File;
+
+/** The profile is a handful of lines, anything larger is not a profile. */
+constexpr std::size_t max_file_bytes = 4096;
+
+std::size_t clamp(std::size_t const value, std::size_t const min, std::size_t const max) noexcept {
+    return std::min(std::max(value, min), max);
+}
+
+/** Parses a decimal number, saturating instead of overflowing. */
+std::size_t parseSize(std::string const & key, std::string const & value) {
+    if (value.empty()) {
+        throw EnclaveException("I/O profile: No value for <" + key + ">");
+    }
+    std::size_t result = 0;
+    for (auto const c : value) {
+        if (c < '0' || c > '9') {
+            throw EnclaveException("I/O profile: Invalid value <" + value + "> for <" + key + ">");
+        }
+        auto const digit = static_cast<std::size_t>(c - '0');
+        result = result > (static_cast<std::size_t>(-1) - digit) / 10u
+                         ? static_cast<std::size_t>(-1)
+                         : result * 10u + digit;
+    }
+    return result;
+}
+
+void logSize(char const * const name, std::size_t const bytes, Log & application_log) {
+    application_log.append("  ");
+    application_log.append(name);
+    application_log.append(": ");
+    application_log.append(std::to_string(bytes / 1024u));
+    application_log.append(" KiB\n");
+}
+
+/**
+   Reads the file at `path` into `content`. Like for the state file, we
+   assume that opening only fails if the file does not exist, then returns
+   false.
+ */
+bool readIfExists(std::string const & path, std::string & content) {
+    try {
+        (void) File(path, sharemind_hi::FileOpenMode::FILE_OPEN_READ_ONLY);
+    } catch (...) {
+        return false;
+    }
+    File file{path, sharemind_hi::FileOpenMode::FILE_OPEN_READ_ONLY};
+    auto const size = file.size();
+    if (size > max_file_bytes) {
+        throw EnclaveException("I/O profile: The file <" + path + "> is too large");
+    }
+    content.resize(size);
+    if (size != 0u) { file.read(&content[0], size); }
+    return true;
+}
+
+/** Sets the fields of `result` to the values of the lines in `content`. */
+void parseProfile(std::string const & content, IoProfile & result) {
+    std::size_t begin = 0;
+    while (begin < content.size()) {
+        auto end = content.find('\n', begin);
+        if (end == std::string::npos) { end = content.size(); }
+        auto const line = content.substr(begin, end - begin);
+        begin = end + 1u;
+
+        auto const separator = line.find(' ');
+        auto const key = line.substr(0, separator);
+        auto const value = separator == std::string::npos ? std::string{} : line.substr(separator + 1u);
+        if (key.empty() || key[0] == '#') { continue; }
+
+        if (key == "h_source") {
+            result.h_source = parseSize(key, value);
+        } else if (key == "s_source") {
+            result.s_source = parseSize(key, value);
+        } else if (key == "s_sink") {
+            result.s_sink = parseSize(key, value);
+        } else if (key == "sort_run") {
+            result.sort_run = parseSize(key, value);
+        } else if (key == "pseudonym_cache") {
+            result.pseudonym_cache = parseSize(key, value);
+        } else if (key == "threads") {
+            result.threads = parseSize(key, value);
+        } else if (key == "compress_s") {
+            result.compress_s = parseSize(key, value) != 0u;
+        } else if (key == "auto_tune") {
+            result.auto_tune = parseSize(key, value) != 0u;
+        } else {
+            throw EnclaveException("I/O profile: Unknown key <" + key + ">");
+        }
+    }
+}
+
+void clampProfile(IoProfile & result) noexcept {
+    result.h_source = clamp(result.h_source, IoProfile::MIN_BUFFER_BYTES, IoProfile::MAX_BUFFER_BYTES);
+    result.s_source = clamp(result.s_source, IoProfile::MIN_BUFFER_BYTES, IoProfile::MAX_BUFFER_BYTES);
+    result.s_sink = clamp(result.s_sink, IoProfile::MIN_BUFFER_BYTES, IoProfile::MAX_BUFFER_BYTES);
+    result.sort_run = clamp(result.sort_run, IoProfile::MIN_SORT_BYTES, IoProfile::MAX_SORT_BYTES);
+    result.pseudonym_cache = clamp(result.pseudonym_cache, 0u, IoProfile::MAX_PSEUDONYM_CACHE_BYTES);
+    result.threads = clamp(result.threads, 1u, enclave_tcs);
+}
+
+} // anonymous namespace
+
+IoProfile loadIoProfile(std::string const & path, Log & application_log) {
+    IoProfile result;
+    std::string content;
+    // The file is not trusted, see `IoProfile`.
+    if (readIfExists(path, content)) { parseProfile(content, result); }
+    clampProfile(result);
+
+    application_log.append("\nI/O profile:\n");
+    logSize("h_source", result.h_source, application_log);
+    logSize("s_source", result.s_source, application_log);
+    logSize("s_sink", result.s_sink, application_log);
+    logSize("sort_run", result.sort_run, application_log);
+    logSize("pseudonym_cache", result.pseudonym_cache, application_log);
+    application_log.append("  threads: " + std::to_string(result.threads) + "\n");
+    application_log.append(result.compress_s ? "  compress_s: true\n" : "  compress_s: false\n");
+    application_log.append(result.auto_tune ? "  auto_tune: true\n" : "  auto_tune: false\n");
+    return result;
+}
+
+void autoTune(IoProfile & profile,
+              std::string const & h_file,
+              std::string const & tuned_path,
+              Log & application_log)
+{
+    std::string content;
+    if (readIfExists(tuned_path, content)) {
+        IoProfile tuned = profile;
+        parseProfile(content, tuned);
+        clampProfile(tuned);
+        profile.h_source = tuned.h_source;
+        profile.s_source = tuned.s_source;
+        profile.s_sink = tuned.s_sink;
+        application_log.append("I/O auto-tuning: Using the sizes tuned before:\n");
+        logSize("h_source", profile.h_source, application_log);
+        logSize("s_source", profile.s_source, application_log);
+        logSize("s_sink", profile.s_sink, application_log);
+        return;
+    }
+
+    static constexpr std::array<std::size_t, 5u> candidates = {{
+            std::size_t{64} * 1024u,
+            std::size_t{256} * 1024u,
+            std::size_t{1} * 1024u * 1024u,
+            std::size_t{4} * 1024u * 1024u,
+            std::size_t{16} * 1024u * 1024u,
+    }};
+
+    File file{h_file, sharemind_hi::FileOpenMode::FILE_OPEN_READ_ONLY};
+    // Each candidate reads its own part of the file, so no candidate profits
+    // from the page cache warmed up by another one. The part is a multiple of
+    // all candidates.
+    auto const bytes_per_candidate =
+            std::min(AUTO_TUNE_BYTES, file.size() / candidates.size())
+            / candidates.back() * candidates.back();
+    if (bytes_per_candidate == 0u) {
+        application_log.append("I/O auto-tuning skipped, the H file is too small.\n");
+        return;
+    }
+
+    application_log.append("I/O auto-tuning (not trustworthy):\n");
+    std::vector<char> buffer;
+    std::size_t best = 0;
+    // Bytes per millisecond.
+    double best_throughput = 0;
+    for (auto const candidate : candidates) {
+        buffer.resize(candidate);
+        auto const start_time = enclave_untrusted_steady_clock_millis();
+        for (std::size_t read = 0; read < bytes_per_candidate; read += candidate) {
+            file.read(buffer.data(), candidate);
+        }
+        auto const end_time = enclave_untrusted_steady_clock_millis();
+        // The clock is not trusted, and has a coarse resolution.
+        auto const millis = std::max<std::uint64_t>(end_time > start_time ? end_time - start_time : 0u, 1u);
+        auto const throughput = static_cast<double>(bytes_per_candidate) / static_cast<double>(millis);
+
+        application_log.append("  ");
+        application_log.append(std::to_string(candidate / 1024u));
+        application_log.append(" KiB: ");
+        application_log.append(std::to_string(static_cast<std::uint64_t>(throughput * 1000.0 / (1024.0 * 1024.0))));
+        application_log.append(" MiB/s\n");
+
+        if (throughput > best_throughput) {
+            best_throughput = throughput;
+            best = candidate;
+        }
+    }
+
+    profile.h_source = best;
+    profile.s_source = best;
+    profile.s_sink = best;
+    logSize("chosen", best, application_log);
+
+    auto const best_text = std::to_string(best);
+    content = "h_source " + best_text + "\ns_source " + best_text + "\ns_sink " + best_text + "\n";
+    File tuned_file{tuned_path, sharemind_hi::FileOpenMode::FILE_OPEN_WRITE_ONLY};
+    tuned_file.write(content.data(), content.size());
+}
+
+} // namespace enclave
+} // namespace eurostat
@@ -0,0 +1,122 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+#pragma once
+
+#include "Entities.h"
+#include "Parameters.h"
+#include <cstddef>
+#include <string>
+
+namespace eurostat {
+namespace enclave {
+
+/**
+   The buffer sizes of the file streams of a state update or a full analysis,
+   the threads it uses, and whether S is compressed. They only influence the
+   performance, not the results, so the best values depend on the storage and
+   the CPU of a deployment.
+
+   The profile is read from the text file `IoProfile::FILE_NAME` in the
+   persistent path, next to the state file. Each line holds a key and a value
+   separated by a space, e.g. `h_source 262144`. The keys are the names of the
+   fields, with the value 1 or 0 for `compress_s` and `auto_tune`. Missing
+   keys keep their default, and without the file the defaults are used. Sizes
+   are clamped to `[MIN_BUFFER_BYTES, MAX_BUFFER_BYTES]`, and to
+   `[MIN_SORT_BYTES, MAX_SORT_BYTES]` for `sort_run`, and to
+   `[0, MAX_PSEUDONYM_CACHE_BYTES]` for `pseudonym_cache`, and to
+   `[1, enclave_tcs]` for `threads`.
+
+   Neither this file nor `TUNED_FILE_NAME` is encrypted or authenticated, so
+   the host can rewrite them between any two runs. This is accepted on
+   purpose: no value changes a result or the content of the state. The sizes
+   and `threads` only change the speed and, within the clamps above, the
+   memory used, so bad values can only slow down or fail the analysis, which
+   the host can do anyway by not scheduling the enclave. `compress_s` also
+   changes the size of the new S segments, which then depends on how well
+   their records compress; the host already sees the size of the raw
+   segments, and the blocks have a fixed size, so this adds only a coarse
+   measure of how similar the records of a segment are. A deployment which
+   must not reveal that has to drop the key from `parseProfile`.
+ */
+struct IoProfile {
+    static constexpr char const * FILE_NAME = "io_profile";
+    /** The sizes chosen by `autoTune`, next to `FILE_NAME`. */
+    static constexpr char const * TUNED_FILE_NAME = "io_profile_tuned";
+    static constexpr std::size_t MIN_BUFFER_BYTES = std::size_t{4} * 1024u;
+    static constexpr std::size_t MAX_BUFFER_BYTES = std::size_t{64} * 1024u * 1024u;
+    static constexpr std::size_t MIN_SORT_BYTES = std::size_t{1} * 1024u * 1024u;
+    static constexpr std::size_t MAX_SORT_BYTES = std::size_t{512} * 1024u * 1024u;
+    static constexpr std::size_t MAX_PSEUDONYM_CACHE_BYTES = std::size_t{256} * 1024u * 1024u;
+
+    /** Read buffer of the H file. */
+    std::size_t h_source = std::size_t{1} * 1024u * 1024u;
+    /** Read buffer of each S segment. */
+    std::size_t s_source = std::size_t{1} * 1024u * 1024u;
+    /** Write buffer of the new S segment. */
+    std::size_t s_sink = std::size_t{1} * 1024u * 1024u;
+    /** Memory of the H sort, i.e. the size of its runs, which also bounds the
+     * read buffers when the runs are merged. */
+    std::size_t sort_run = std::size_t{64} * 1024u * 1024u;
+    /** Memory of the cache for decrypted pseudonyms, see `PseudonymCache`,
+     * shared by the H files of a run. 0 disables the cache. */
+    std::size_t pseudonym_cache = std::size_t{16} * 1024u * 1024u;
+    /** Enclave threads, including the calling one, which sort the runs of the
+     * H sort, merge its runs and update the S shards in parallel, see
+     * `BackgroundJob::setMaxThreads`. If fewer TCS are free, e.g. as another
+     * task runs in the enclave, the remaining jobs run in the calling thread,
+     * so the analysis only takes longer. Without enclave threads, there is
+     * only the calling thread.
+     *
+     * By default all TCS of the enclave, whose number is part of the signed
+     * enclave (`ENCLAVE_TCS_NUM`), so the profile can only lower it. That
+     * the (untrusted) profile may do so is accepted: the host schedules the
+     * enclave threads anyway, and the value does not change any result. */
+    std::size_t threads = enclave_tcs;
+    /** Whether new S segments are written in compressed blocks, see `SBlock`.
+     * Segments of either format can be read, so it can be changed between
+     * updates. */
+    bool compress_s = false;
+    /** Whether `autoTune` replaces the buffer sizes. */
+    bool auto_tune = false;
+};
+
+/** Reads the profile from `path`, see `IoProfile`. Logs the profile. */
+IoProfile loadIoProfile(std::string const & path, Log & application_log);
+
+/**
+   Reads the start of the (unencrypted) `h_file` with a few candidate buffer
+   sizes and sets `h_source`, `s_source` and `s_sink` of `profile` to the size
+   with the best throughput. The measurement reads at most
+   `AUTO_TUNE_BYTES` bytes per candidate, so it takes a few seconds at most.
+   Keeps the profile if the file is too small to measure anything. Logs the
+   measurements.
+
+   The chosen size is stored in `tuned_path`, in the format of the profile.
+   If that file exists, its sizes are used instead of measuring again, so the
+   measurement runs once per deployment. Deleting the file tunes again.
+ */
+void autoTune(IoProfile & profile,
+              std::string const & h_file,
+              std::string const & tuned_path,
+              Log & application_log);
+
+constexpr std::size_t AUTO_TUNE_BYTES = std::size_t{32} * 1024u * 1024u;
+
+} // namespace enclave
+} // namespace eurostat
@@ -52,6 +52,28 @@ constexpr std::size_t hmac_bytes = 4;
 static_assert(hash_bytes + hmac_bytes == aes_block_size, "Needs to be as big as one AES block.");
 static_assert(PseudonymisationKeyLength == aes_block_size, "Needs to be as big as one AES block.");
 
+// Performance parameters
+/** Memory budget of the sums per tile (or per calibration key), see
+ * `aggregateByTile`. The sums of further keys are spilled to temporary files. */
+constexpr std::size_t tile_aggregation_bytes = std::size_t{64} * 1024u * 1024u;
+/** Number of enclave threads which can run at the same time, including the
+ * one which runs the task, i.e. the TCS count of the enclave. Set with the
+ * `ENCLAVE_TCS_NUM` CMake option. */
+#ifdef EUROSTAT_ENCLAVE_TCS
+constexpr std::size_t enclave_tcs = EUROSTAT_ENCLAVE_TCS;
+#else
+constexpr std::size_t enclave_tcs = 1;
+#endif
+static_assert(enclave_tcs > 0u, "The task runs on a TCS itself.");
+/** The S state is compacted into a new base segment as soon as its delta
+ * segments hold this fraction of the records of the base segment, see
+ * `SSegments`. */
+constexpr double s_compaction_ratio = 0.25;
+/** S is split into this many shards by the user id, which are updated in
+ * parallel, see `SShards`. The shards are part of the persistent state, so a
+ * change invalidates the existing states. */
+constexpr std::size_t s_shards = 4;
+
 
 using topic_name_t = char const *;
 using argument_name_t = char const *;
@@ -79,7 +101,8 @@ constexpr topic_name_t application_log = "application_log";
 namespace arguments {
 /** No matter the value, if it is present when we wait for
  * `UserFootprintUpdates` files, we reset the state instead and wait for a new
- * NSI request. */
+ * NSI request. Also resets a state which cannot be loaded, skipping all NSI
+ * requests which arrived so far. */
 constexpr argument_name_t cancel = "cancel";
 /** No matter the value, if it is present when we wait for
  * `UserFootprintUpdates` files, we finish the report. */
@@ -88,12 +111,21 @@ constexpr argument_name_t finish_report = "finish-report";
  * circumventing the usual topics for input data to sidestep the data
  * encryption and uploading cost for these huge files, which is both not
  * necessary: The files are created by the host, so no confidentiality is lost.
+ * May also be a comma separated list of the files of consecutive periods,
+ * which are processed together.
  * */
 constexpr argument_name_t file = "file";
 /** The task runner informs us which period we are working with, not. This is
  * more like a sanity check. If it matches the max period from the NSI request,
- * it will perform the report calculations. */
+ * it will perform the report calculations. With a list of files, this is the
+ * comma separated list of their (consecutive) periods. */
 constexpr argument_name_t period = "period";
+/** Optional with `file`: The comma separated list which tells for each file
+ * whether the operator sorted it by the user id and the tile after reversing
+ * the pseudonymisation, `1` if so, `0` if not. The order of a file declared
+ * sorted is checked before it is processed. If it holds, the file is not
+ * sorted again, otherwise it is sorted like an undeclared file. */
+constexpr argument_name_t sorted = "sorted";
 }
 
 } // namespace enclave
@@ -0,0 +1,155 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+#include "PipelineProfile.h"
+#include "HiInternalApiDuplication.h"
+#include <algorithm>
+#include <string>
+
+namespace eurostat {
+namespace enclave {
+
+constexpr std::size_t PipelineProfile::STAGES;
+constexpr std::size_t PipelineProfile::BLOCK_BYTES;
+
+namespace {
+
+constexpr std::array<char const *, PipelineProfile::STAGES> stage_names = {{
+        "Decrypt",
+        "H sort",
+        "H spill",
+        "Filter/dedup",
+        "Outer join",
+        "S write",
+        "Module C",
+        "Module D",
+        "Tile aggregation",
+        "Outputs",
+}};
+
+/** Appends `text`, right aligned in `width` characters. */
+void appendColumn(Log & application_log, std::string const & text, std::size_t const width) {
+    if (text.size() < width) { application_log.append(width - text.size(), ' '); }
+    application_log.append(text);
+}
+
+} // anonymous namespace
+
+PipelineProfile::PipelineProfile() noexcept
+    : m_jobs_begin(BackgroundJob::statistics())
+    , m_io_begin(IoCounters::ofThread())
+{}
+
+void PipelineProfile::begin(Stage const stage) noexcept {
+    auto & m = at(stage);
+    if (m.begun) { return; }
+    m.begun = true;
+    m.begin_millis = enclave_untrusted_steady_clock_millis();
+}
+
+void PipelineProfile::end(Stage const stage) noexcept {
+    begin(stage);
+    auto & m = at(stage);
+    m.ended = true;
+    m.end_millis = std::max(m.end_millis, enclave_untrusted_steady_clock_millis());
+}
+
+void PipelineProfile::merge(PipelineProfile const & other) noexcept {
+    for (std::size_t i = 0; i < STAGES; ++i) {
+        auto & m = m_stages[i];
+        auto const & o = other.m_stages[i];
+        m.records_in += o.records_in;
+        m.records_out += o.records_out;
+        if (o.begun) {
+            if (!m.begun || o.begin_millis < m.begin_millis) { m.begin_millis = o.begin_millis; }
+            m.begun = true;
+        }
+        if (o.ended) {
+            m.ended = true;
+            m.end_millis = std::max(m.end_millis, o.end_millis);
+        }
+    }
+}
+
+void PipelineProfile::appendTo(Log & application_log) const {
+    constexpr std::size_t name_width = 18u;
+    constexpr std::size_t width = 14u;
+
+    application_log.append("\nPipeline profile (times not trustworthy):\n");
+    application_log.append("stage");
+    application_log.append(name_width - 5u, ' ');
+    appendColumn(application_log, "wall ms", width);
+    appendColumn(application_log, "records in", width);
+    appendColumn(application_log, "records out", width);
+    appendColumn(application_log, "KiB written", width);
+    appendColumn(application_log, "ocalls (est.)", width);
+    application_log.append("\n");
+
+    auto const & io_end = IoCounters::ofThread();
+    auto const append_io = [&](std::size_t const account) {
+        auto const bytes_written = io_end[account].bytes_written - m_io_begin[account].bytes_written;
+        appendColumn(application_log, std::to_string(bytes_written / 1024u), width);
+        appendColumn(application_log,
+                     std::to_string(io_end[account].ocalls - m_io_begin[account].ocalls),
+                     width);
+        application_log.append("\n");
+    };
+    auto const has_io = [&](std::size_t const account) {
+        return io_end[account].ocalls != m_io_begin[account].ocalls;
+    };
+
+    for (std::size_t i = 0; i < STAGES; ++i) {
+        auto const & m = m_stages[i];
+        auto const measured = m.begun && m.ended;
+        auto const account = ioAccount(static_cast<Stage>(i));
+        // Stages which did not run in this invocation are left out.
+        if (!measured && !has_io(account)) { continue; }
+        application_log.append(stage_names[i]);
+        auto const name_length = std::string{stage_names[i]}.size();
+        application_log.append(name_width - std::min(name_length, name_width), ' ');
+        if (measured) {
+            // The untrusted clock could even go backwards.
+            auto const millis = m.end_millis > m.begin_millis ? m.end_millis - m.begin_millis : 0u;
+            appendColumn(application_log, std::to_string(millis), width);
+            appendColumn(application_log, std::to_string(m.records_in), width);
+            appendColumn(application_log, std::to_string(m.records_out), width);
+        } else {
+            // E.g. a spill is only measured by its I/O.
+            for (std::size_t column = 0; column < 3u; ++column) { appendColumn(application_log, "-", width); }
+        }
+        append_io(account);
+    }
+    if (has_io(0u)) {
+        application_log.append("(other)");
+        application_log.append(name_width - 7u, ' ');
+        for (std::size_t column = 0; column < 3u; ++column) { appendColumn(application_log, "-", width); }
+        append_io(0u);
+    }
+
+    auto const jobs = BackgroundJob::statistics();
+    application_log.append("Background jobs: ");
+    application_log.append(std::to_string(jobs.threaded - m_jobs_begin.threaded));
+    application_log.append(" on their own thread, ");
+    application_log.append(std::to_string(jobs.synchronous - m_jobs_begin.synchronous));
+    application_log.append(" synchronously (");
+    application_log.append(std::to_string(jobs.failed - m_jobs_begin.failed));
+    application_log.append(" as no thread could be created)\n");
+}
+
+} // namespace enclave
+} // namespace eurostat
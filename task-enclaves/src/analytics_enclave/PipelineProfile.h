@@ -0,0 +1,335 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+
+#pragma once
+
+#include "BackgroundJob.h"
+#include "Entities.h"
+#include "IoCounters.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <sharemind-hi/enclave/task/stream/Streams_detail.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace eurostat {
+namespace enclave {
+
+/**
+   Measures the stages of the analysis pipeline, also in Release builds, and
+   appends them as a table to the application log.
+
+   The stages are streamed, so they run interleaved. The wall time of a stage
+   is the time from its first input record until it emitted its last record,
+   hence the times of adjacent stages overlap. The times come from the
+   untrusted clock, and are only read at the borders of a stage.
+
+   The bytes written and ocalls are attributed to the stages by `IoAccount`s:
+   The stage probes pass the records on in blocks of `BLOCK_BYTES`, and set
+   the account of their stage once per block, `stagedSource` reads ahead a
+   block under its account, and the spills of the sorts use `Stage::HSpill`. The I/O of the calling thread is reported, which includes
+   the jobs it waited for, i.e. the other threads of the pipeline. The I/O
+   outside of any stage is reported as "(other)".
+
+   Not thread safe: Stages which run in parallel use their own profile, which
+   is `merge`d afterwards.
+
+   The table is followed by the number of `BackgroundJob`s started since the
+   profile was created, and how many of them ran synchronously.
+ */
+class PipelineProfile {
+public: /* Types: */
+    enum class Stage : std::size_t {
+        Decrypt,
+        HSort,
+        /** Only I/O, by the sorts which spill runs. */
+        HSpill,
+        FilterDedup,
+        OuterJoin,
+        SWrite,
+        ModuleC,
+        ModuleD,
+        TileAggregation,
+        Outputs,
+    };
+    static constexpr std::size_t STAGES = static_cast<std::size_t>(Stage::Outputs) + 1u;
+    static_assert(STAGES < IoCounters::ACCOUNTS, "Each stage has its own I/O account.");
+    /** The size of the blocks of records which the stage probes and
+     * `stagedSource` pass on, so the account is not switched per record. */
+    static constexpr std::size_t BLOCK_BYTES = std::size_t{16} * 1024u;
+
+    /** The records of type `T` in a block, at least one. */
+    template <typename T>
+    static constexpr std::size_t blockRecords() noexcept {
+        return sizeof(T) < BLOCK_BYTES ? BLOCK_BYTES / sizeof(T) : 1u;
+    }
+
+public: /* Methods: */
+    PipelineProfile() noexcept;
+
+    /** Starts `stage`, unless it was already started. */
+    void begin(Stage stage) noexcept;
+    /** Ends `stage`, later ends win. Starts it, if it was not started. */
+    void end(Stage stage) noexcept;
+
+    void countIn(Stage stage, std::uint64_t records = 1u) noexcept {
+        at(stage).records_in += records;
+    }
+    void countOut(Stage stage, std::uint64_t records = 1u) noexcept {
+        at(stage).records_out += records;
+    }
+
+    /** Adds the stages of `other`, with the union of their time spans. Its
+     * I/O is not added, it is counted by the threads. */
+    void merge(PipelineProfile const & other) noexcept;
+
+    /** The `IoAccount` of `stage`. */
+    static std::size_t ioAccount(Stage stage) noexcept {
+        return static_cast<std::size_t>(stage) + 1u;
+    }
+
+    void appendTo(Log & application_log) const;
+
+private: /* Types: */
+    struct Measurement {
+        bool begun = false;
+        bool ended = false;
+        std::uint64_t begin_millis = 0;
+        std::uint64_t end_millis = 0;
+        std::uint64_t records_in = 0;
+        std::uint64_t records_out = 0;
+    };
+
+private: /* Methods: */
+    Measurement & at(Stage stage) noexcept {
+        return m_stages[static_cast<std::size_t>(stage)];
+    }
+
+private: /* Fields: */
+    std::array<Measurement, STAGES> m_stages = {};
+    /** To report the background jobs which were started since then. */
+    BackgroundJob::Statistics m_jobs_begin;
+    /** To report the I/O of the calling thread since then. */
+    IoCounters::Accounts m_io_begin;
+};
+
+template <typename Builder>
+struct StageProbeBuilder {
+    using Category = sharemind_hi::enclave::stream::detail::SinkCategory;
+
+    StageProbeBuilder(StageProbeBuilder &&) noexcept = default;
+
+    explicit StageProbeBuilder(PipelineProfile & profile,
+                               PipelineProfile::Stage stage,
+                               bool exit,
+                               Builder sb2)
+        : m_profile{&profile}
+        , m_stage{stage}
+        , m_exit{exit}
+        , m_builder{std::move(sb2)}
+    { }
+
+    template <typename T>
+    struct Impl {
+        using In = T;
+        using Sink = typename Builder::template Impl<T>;
+        using Res = typename Sink::Res;
+
+        Impl(Impl &&) noexcept = default;
+
+        explicit Impl(PipelineProfile & profile,
+                      PipelineProfile::Stage stage,
+                      bool exit,
+                      Sink sink)
+            : m_profile{&profile}
+            , m_stage{stage}
+            , m_exit{exit}
+            , m_sink{std::move(sink)}
+        {
+            m_block.reserve(PipelineProfile::blockRecords<In>());
+        }
+
+        void sink(In const & argument) {
+            if (!m_exit && !m_any) { m_profile->begin(m_stage); }
+            m_any = true;
+            m_block.push_back(argument);
+            if (m_block.size() == m_block.capacity()) { flush(); }
+        }
+
+        Res finalize() && {
+            flush();
+            if (m_exit) {
+                m_profile->end(m_stage);
+            } else if (!m_any) {
+                m_profile->begin(m_stage);
+            }
+            IoAccount const account{ioAccount()};
+            return std::move(m_sink).finalize();
+        }
+
+    private: /* Methods: */
+        /** The downstream of an exit is outside of the stage. */
+        std::size_t ioAccount() const noexcept {
+            return m_exit ? 0u : PipelineProfile::ioAccount(m_stage);
+        }
+
+        void flush() {
+            if (m_block.empty()) { return; }
+            if (m_exit) {
+                m_profile->countOut(m_stage, m_block.size());
+            } else {
+                m_profile->countIn(m_stage, m_block.size());
+            }
+            IoAccount const account{ioAccount()};
+            for (auto const & element : m_block) { m_sink.sink(element); }
+            m_block.clear();
+        }
+
+    private: /* Fields: */
+        PipelineProfile * m_profile;
+        PipelineProfile::Stage m_stage;
+        bool m_exit;
+        bool m_any = false;
+        Sink m_sink;
+        /** The records which are not passed on yet. */
+        std::vector<In> m_block;
+    };
+
+    template <typename T>
+    Impl<T> build() && {
+        return Impl<T>{*m_profile, m_stage, m_exit, std::move(m_builder).template build<T>()};
+    }
+
+private: /* Fields: */
+    PipelineProfile * m_profile;
+    PipelineProfile::Stage m_stage;
+    bool m_exit;
+    Builder m_builder;
+};
+
+struct StageProbePipe {
+    using Category = sharemind_hi::enclave::stream::detail::PipeCategory;
+
+    template <typename In>
+    using Out = In;
+
+    StageProbePipe(StageProbePipe &&) noexcept = default;
+
+    explicit StageProbePipe(PipelineProfile & profile, PipelineProfile::Stage stage, bool exit)
+        : m_profile{&profile}
+        , m_stage{stage}
+        , m_exit{exit}
+    {}
+
+    template <typename Builder>
+    using InBuilder = StageProbeBuilder<Builder>;
+
+    template <typename Builder>
+    InBuilder<Builder> build(Builder down) && {
+        return InBuilder<Builder>{*m_profile, m_stage, m_exit, std::move(down)};
+    }
+
+private: /* Fields: */
+    PipelineProfile * m_profile;
+    PipelineProfile::Stage m_stage;
+    bool m_exit;
+};
+
+/**
+   Passes the elements on unchanged, in blocks, and counts them as the input
+   of `stage`. The first element (or the end of an empty stream) begins the
+   stage.
+ */
+inline StageProbePipe stageEntry(PipelineProfile & profile, PipelineProfile::Stage stage) {
+    return StageProbePipe{profile, stage, false};
+}
+
+/**
+   Passes the elements on unchanged, in blocks, and counts them as the output
+   of `stage`. The end of the stream ends the stage, before the downstream is
+   finalized.
+ */
+inline StageProbePipe stageExit(PipelineProfile & profile, PipelineProfile::Stage stage) {
+    return StageProbePipe{profile, stage, true};
+}
+
+template <typename Source>
+struct StagedSource {
+    using Category = sharemind_hi::enclave::stream::detail::SourceCategory;
+    using Out = typename Source::Out;
+
+    StagedSource(StagedSource &&) noexcept = default;
+
+    explicit StagedSource(std::size_t const io_account, Source source)
+        : m_io_account{io_account}
+        , m_source{std::move(source)}
+        , m_block(PipelineProfile::blockRecords<Out>())
+    {}
+
+    bool next(Out & result) {
+        if (m_next == m_size) {
+            if (m_end) { return false; }
+            readBlock();
+            if (m_size == 0u) { return false; }
+        }
+        result = std::move(m_block[m_next++]);
+        return true;
+    }
+
+private: /* Methods: */
+    void readBlock() {
+        IoAccount const account{m_io_account};
+        m_next = 0u;
+        m_size = 0u;
+        while (m_size < m_block.size() && m_source.next(m_block[m_size])) { ++m_size; }
+        m_end = m_size < m_block.size();
+    }
+
+private: /* Fields: */
+    std::size_t m_io_account;
+    Source m_source;
+    /** The records read ahead, `[m_next, m_size)` are not returned yet. */
+    std::vector<Out> m_block;
+    std::size_t m_next = 0u;
+    std::size_t m_size = 0u;
+    /** Whether `m_source` has ended. */
+    bool m_end = false;
+};
+
+/**
+   Creates the source returned by `make_source` and counts the I/O of its
+   creation and of its reads as the I/O of `stage`, e.g. as the source reads
+   a file before the stage probes see its records. The records are read
+   ahead in blocks.
+ */
+template <
+        /** Source() */
+        typename MakeSource>
+inline StagedSource<typename std::decay<typename std::result_of<MakeSource &()>::type>::type>
+stagedSource(PipelineProfile::Stage const stage, MakeSource make_source)
+{
+    using Source = typename std::decay<typename std::result_of<MakeSource &()>::type>::type;
+    auto const io_account = PipelineProfile::ioAccount(stage);
+    IoAccount const account{io_account};
+    return StagedSource<Source>{io_account, make_source()};
+}
+
+} // namespace enclave
+} // namespace eurostat
@@ -16,67 +16,247 @@
 */ 
 
 #include "Pseudonymisation.h"
+#include <algorithm>
 #include <array>
+#include <cstring>
 #include <sgx_tcrypto.h>
-#include <sharemind-hi/common/ArrayTraits.h>
 #include <sharemind-hi/enclave/common/EnclaveException.h>
 #include <sharemind-hi/enclave/common/Log.h>
 #include <sharemind-hi/enclave/common/SgxException.h>
 
 namespace eurostat {
 namespace enclave {
-UserIdentifier decrypt_pseudonym(PseudonymisationKeyRef pseudonymisation_key,
-                                 PseudonymisedUserIdentifier const & in)
+namespace {
+
+/**
+   Number of HMACs computed side by side. The SHA-256 state of all lanes is
+   stored lane-minor, so each step of the compression function is a loop over
+   the lanes which the compiler can vectorize.
+ */
+constexpr std::size_t hmac_lanes = 8;
+
+constexpr std::uint32_t sha256_round_constants[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+constexpr PseudonymDecryptor::Sha256State sha256_initial_state = {{
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+}};
+
+inline std::uint32_t rotr(std::uint32_t const x, unsigned const n) noexcept {
+    return (x >> n) | (x << (32u - n));
+}
+
+inline std::uint32_t load_big_endian(std::uint8_t const * const p) noexcept {
+    return (std::uint32_t{p[0]} << 24) | (std::uint32_t{p[1]} << 16)
+           | (std::uint32_t{p[2]} << 8) | std::uint32_t{p[3]};
+}
+
+/** SHA-256 state and message schedule of `Lanes` independent hashes. */
+template <std::size_t Lanes>
+struct Sha256Lanes {
+    std::uint32_t state[8][Lanes];
+    std::uint32_t w[16][Lanes];
+
+    void set_state(PseudonymDecryptor::Sha256State const & s) noexcept {
+        for (std::size_t i = 0; i < 8; ++i) {
+            for (std::size_t l = 0; l < Lanes; ++l) { state[i][l] = s[i]; }
+        }
+    }
+
+    /** Applies the compression function to the block in `w` of each lane. */
+    void compress() noexcept {
+        std::uint32_t v[8][Lanes];
+        std::memcpy(v, state, sizeof(v));
+
+        // Instead of shifting the working variables a..h after each round, the
+        // role of the rows of `v` rotates. Unrolling 16 rounds makes the row
+        // and message schedule indices compile time constants.
+        for (unsigned r = 0; r < 64; r += 16) {
+            round<0>(v, r);
+            round<1>(v, r + 1);
+            round<2>(v, r + 2);
+            round<3>(v, r + 3);
+            round<4>(v, r + 4);
+            round<5>(v, r + 5);
+            round<6>(v, r + 6);
+            round<7>(v, r + 7);
+            round<8>(v, r + 8);
+            round<9>(v, r + 9);
+            round<10>(v, r + 10);
+            round<11>(v, r + 11);
+            round<12>(v, r + 12);
+            round<13>(v, r + 13);
+            round<14>(v, r + 14);
+            round<15>(v, r + 15);
+        }
+
+        for (std::size_t i = 0; i < 8; ++i) {
+            for (std::size_t l = 0; l < Lanes; ++l) { state[i][l] += v[i][l]; }
+        }
+    }
+
+private:
+    template <unsigned J>
+    void round(std::uint32_t (&v)[8][Lanes], unsigned const r) noexcept {
+        auto & wr = w[J];
+        if (r >= 16) {
+            auto const & w2 = w[(J + 14) % 16];
+            auto const & w7 = w[(J + 9) % 16];
+            auto const & w15 = w[(J + 1) % 16];
+            for (std::size_t l = 0; l < Lanes; ++l) {
+                auto const s0 = rotr(w15[l], 7) ^ rotr(w15[l], 18) ^ (w15[l] >> 3);
+                auto const s1 = rotr(w2[l], 17) ^ rotr(w2[l], 19) ^ (w2[l] >> 10);
+                wr[l] += s0 + w7[l] + s1;
+            }
+        }
+
+        auto & a = v[(8 - J % 8) % 8];
+        auto & b = v[(9 - J % 8) % 8];
+        auto & c = v[(10 - J % 8) % 8];
+        auto & d = v[(11 - J % 8) % 8];
+        auto & e = v[(12 - J % 8) % 8];
+        auto & f = v[(13 - J % 8) % 8];
+        auto & g = v[(14 - J % 8) % 8];
+        auto & h = v[(15 - J % 8) % 8];
+        for (std::size_t l = 0; l < Lanes; ++l) {
+            auto const S1 = rotr(e[l], 6) ^ rotr(e[l], 11) ^ rotr(e[l], 25);
+            auto const ch = (e[l] & f[l]) ^ (~e[l] & g[l]);
+            auto const t1 = h[l] + S1 + ch + sha256_round_constants[r] + wr[l];
+            auto const S0 = rotr(a[l], 2) ^ rotr(a[l], 13) ^ rotr(a[l], 22);
+            auto const maj = (a[l] & b[l]) ^ (a[l] & c[l]) ^ (b[l] & c[l]);
+            d[l] += t1;
+            h[l] = t1 + S0 + maj;
+        }
+    }
+};
+
+/** The state after absorbing the HMAC key xored with the given pad byte. */
+PseudonymDecryptor::Sha256State hmac_key_pad_state(
+        PseudonymisationKeyRef key,
+        std::uint8_t const pad) noexcept
+{
+    static_assert(sizeof(key) <= 64u, "Longer HMAC keys would need to be hashed first.");
+    std::uint8_t block[64];
+    std::memset(block, pad, sizeof(block));
+    for (std::size_t i = 0; i < sizeof(key); ++i) { block[i] ^= key[i]; }
+
+    Sha256Lanes<1> sha;
+    sha.set_state(sha256_initial_state);
+    for (std::size_t i = 0; i < 16; ++i) { sha.w[i][0] = load_big_endian(block + 4 * i); }
+    sha.compress();
+
+    PseudonymDecryptor::Sha256State result;
+    for (std::size_t i = 0; i < 8; ++i) { result[i] = sha.state[i][0]; }
+    return result;
+}
+
+} // namespace
+
+PseudonymDecryptor::PseudonymDecryptor(PseudonymisationKeyRef pseudonymisation_key)
+    : m_hmac_inner(hmac_key_pad_state(pseudonymisation_key, 0x36))
+    , m_hmac_outer(hmac_key_pad_state(pseudonymisation_key, 0x5c))
 {
-    // With pseudonymisation - decrypt the pseudonym.
-
-    // `in` will be decrypted into the following struct, as the plaintext
-    // is composed of two parts. Makes it easier to use the two parts later
-    // on.
-    auto decrypted = [&] {
-        struct Decrypted {
-            UserIdentifier id;
-            std::array<std::uint8_t, hmac_bytes> hmac;
-        };
-        static_assert(sizeof(Decrypted) == sizeof(PseudonymisedUserIdentifier), "");
-
-        Decrypted decrypted;
-        uint8_t counter[16] = {};
-        sharemind_hi::enclave::SgxException::throwOnError(
-                sgx_aes_ctr_decrypt(&pseudonymisation_key,
-                                    in.data(),
-                                    in.size(),
-                                    counter,
-                                    static_cast<std::uint32_t>(12u),
-                                    reinterpret_cast<std::uint8_t *>(&decrypted)),
-                "Failed to decrypt pseudonymised user identifier");
-        return decrypted;
-    }();
-
-    auto calculated = [&] {
-        struct CalculatedHmac {
-            std::array<std::uint8_t, hmac_bytes> hmac;
-            std::array<std::uint8_t, sha256_size - hmac_bytes> ignored;
-        };
-
-        CalculatedHmac calculated;
-        sharemind_hi::enclave::SgxException::throwOnError(
-                sgx_hmac_sha256_msg(decrypted.id.data(),
-                                    decrypted.id.size(),
-                                    std::begin(pseudonymisation_key),
-                                    sharemind_hi::byteSize(pseudonymisation_key),
-                                    reinterpret_cast<std::uint8_t *>(&calculated),
-                                    sizeof(calculated)),
-                "Calculating the user id hmac after decrypting failed");
-        return calculated;
-    }();
-
-    if (decrypted.hmac != calculated.hmac) {
-        throw sharemind_hi::enclave::EnclaveException(
-                "HMAC check failed when reversing pseudonymisation");
+    // Encrypting zeros yields the keystream itself.
+    PseudonymisedUserIdentifier const zeros = {};
+    uint8_t counter[16] = {};
+    sharemind_hi::enclave::SgxException::throwOnError(
+            sgx_aes_ctr_encrypt(&pseudonymisation_key,
+                                zeros.data(),
+                                zeros.size(),
+                                counter,
+                                static_cast<std::uint32_t>(12u),
+                                m_keystream.data()),
+            "Failed to derive the pseudonym keystream");
+}
+
+UserIdentifier PseudonymDecryptor::decrypt(PseudonymisedUserIdentifier const & in) const {
+    UserIdentifier out;
+    decrypt(&in, 1u, &out);
+    return out;
+}
+
+void PseudonymDecryptor::decrypt(PseudonymisedUserIdentifier const * const in,
+                                 std::size_t const count,
+                                 UserIdentifier * const out) const
+{
+    static_assert(hash_bytes % 4u == 0u && hmac_bytes == 4u,
+                  "The message schedule setup assumes these sizes.");
+    constexpr std::size_t id_words = hash_bytes / 4u;
+
+    // Unused lanes of the last batch just hash zeros.
+    Sha256Lanes<hmac_lanes> sha = {};
+    std::uint32_t expected_hmac[hmac_lanes] = {};
+
+    for (std::size_t offset = 0; offset < count; offset += hmac_lanes) {
+        auto const batch = std::min(hmac_lanes, count - offset);
+
+        // Decrypt, and use the user id as the message of the inner hash.
+        for (std::size_t l = 0; l < batch; ++l) {
+            PseudonymisedUserIdentifier plain;
+            for (std::size_t i = 0; i < plain.size(); ++i) {
+                plain[i] = in[offset + l][i] ^ m_keystream[i];
+            }
+            std::memcpy(out[offset + l].data(), plain.data(), hash_bytes);
+            for (std::size_t i = 0; i < id_words; ++i) {
+                sha.w[i][l] = load_big_endian(plain.data() + 4 * i);
+            }
+            expected_hmac[l] = load_big_endian(plain.data() + hash_bytes);
+        }
+
+        // Inner hash: H((key ^ ipad) || id)
+        sha.set_state(m_hmac_inner);
+        for (std::size_t l = 0; l < hmac_lanes; ++l) {
+            sha.w[id_words][l] = 0x80000000u;
+            for (std::size_t i = id_words + 1; i < 15; ++i) { sha.w[i][l] = 0u; }
+            sha.w[15][l] = (64u + hash_bytes) * 8u;
+        }
+        sha.compress();
+
+        // Outer hash: H((key ^ opad) || inner hash). The big endian digest
+        // bytes are loaded big endian again, so the state words are the message
+        // words.
+        for (std::size_t l = 0; l < hmac_lanes; ++l) {
+            for (std::size_t i = 0; i < 8; ++i) { sha.w[i][l] = sha.state[i][l]; }
+            sha.w[8][l] = 0x80000000u;
+            for (std::size_t i = 9; i < 15; ++i) { sha.w[i][l] = 0u; }
+            sha.w[15][l] = (64u + sha256_size) * 8u;
+        }
+        sha.set_state(m_hmac_outer);
+        sha.compress();
+
+        // The truncated HMAC is the first `hmac_bytes` of the digest.
+        for (std::size_t l = 0; l < batch; ++l) {
+            if (sha.state[0][l] != expected_hmac[l]) {
+                throw sharemind_hi::enclave::EnclaveException(
+                        "HMAC check failed when reversing pseudonymisation");
+            }
+        }
     }
+}
 
-    return decrypted.id;
+PseudonymCache::PseudonymCache(std::size_t const max_bytes) {
+    std::size_t slots = max_bytes / sizeof(Slot);
+    if (slots > 0u) {
+        // Round down to a power of two, so the slot index is a bit mask.
+        std::size_t power = 1u;
+        while (power <= slots / 2u) { power *= 2u; }
+        slots = power;
+    }
+    m_slots.resize(slots, Slot{{}, {}, false});
+}
+
+UserIdentifier decrypt_pseudonym(PseudonymisationKeyRef pseudonymisation_key,
+                                 PseudonymisedUserIdentifier const & in)
+{
+    return PseudonymDecryptor{pseudonymisation_key}.decrypt(in);
 }
 } // namespace enclave
 } // namespace eurostat
@@ -18,9 +18,115 @@
 #pragma once
 
 #include "Entities.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
 
 namespace eurostat {
 namespace enclave {
+
+/**
+   Reverses the pseudonymisation for many pseudonyms with the same key.
+
+   A pseudonym is `AES-128-CTR(key, counter = 0, id || HMAC-SHA256(key, id)[0..4])`.
+   As it is exactly one AES block and every pseudonym starts with the same
+   counter, the keystream `AES(key, 0)` is identical for all of them and is
+   computed once in the constructor. Likewise, the HMAC key is fixed, so the
+   SHA-256 states after absorbing the inner and outer key pads are precomputed
+   and every HMAC check only needs two SHA-256 compressions.
+ */
+class PseudonymDecryptor {
+public: /* Types: */
+    using Sha256State = std::array<std::uint32_t, 8>;
+
+public: /* Methods: */
+    explicit PseudonymDecryptor(PseudonymisationKeyRef pseudonymisation_key);
+
+    UserIdentifier decrypt(PseudonymisedUserIdentifier const & in) const;
+
+    /**
+       Decrypts `count` pseudonyms from `in` into `out`. The HMAC checks are
+       computed for multiple pseudonyms side by side. Throws if any of the
+       checks fails.
+     */
+    void decrypt(PseudonymisedUserIdentifier const * in,
+                 std::size_t count,
+                 UserIdentifier * out) const;
+
+private: /* Fields: */
+    PseudonymisedUserIdentifier m_keystream;
+    Sha256State m_hmac_inner;
+    Sha256State m_hmac_outer;
+};
+
+/**
+   A bounded cache from pseudonyms to their decrypted user identifiers, for H
+   files which are not ordered by pseudonym.
+
+   The cache is direct mapped: A pseudonym is an AES ciphertext, so its first
+   bytes are uniformly distributed and directly select the slot. A new entry
+   replaces the one in its slot.
+ */
+class PseudonymCache {
+public: /* Methods: */
+    /** Uses at most `max_bytes` for the entries. */
+    explicit PseudonymCache(std::size_t max_bytes);
+
+    /** Returns nullptr if the pseudonym is not cached. Counts hits and misses. */
+    UserIdentifier const * find(PseudonymisedUserIdentifier const & pseudonym) noexcept {
+        if (m_slots.empty()) {
+            ++m_misses;
+            return nullptr;
+        }
+        auto const & slot = m_slots[slotIndex(pseudonym)];
+        if (slot.used && slot.pseudonym == pseudonym) {
+            ++m_hits;
+            return &slot.id;
+        }
+        ++m_misses;
+        return nullptr;
+    }
+
+    void insert(PseudonymisedUserIdentifier const & pseudonym,
+                UserIdentifier const & id) noexcept
+    {
+        if (m_slots.empty()) { return; }
+        auto & slot = m_slots[slotIndex(pseudonym)];
+        slot.pseudonym = pseudonym;
+        slot.id = id;
+        slot.used = true;
+    }
+
+    std::size_t capacity() const noexcept { return m_slots.size(); }
+    std::uint64_t hits() const noexcept { return m_hits; }
+    std::uint64_t misses() const noexcept { return m_misses; }
+
+private: /* Types: */
+    struct Slot {
+        PseudonymisedUserIdentifier pseudonym;
+        UserIdentifier id;
+        /** An all zero pseudonym is valid input, so emptiness is explicit. */
+        bool used;
+    };
+
+private: /* Methods: */
+    std::size_t slotIndex(PseudonymisedUserIdentifier const & pseudonym) const noexcept {
+        std::uint64_t bits;
+        static_assert(sizeof(bits) <= sizeof(pseudonym), "");
+        std::memcpy(&bits, pseudonym.data(), sizeof(bits));
+        return static_cast<std::size_t>(bits) & (m_slots.size() - 1u);
+    }
+
+private: /* Fields: */
+    /** The number of slots is zero or a power of two. */
+    std::vector<Slot> m_slots;
+    std::uint64_t m_hits = 0;
+    std::uint64_t m_misses = 0;
+};
+
+/** Convenience function for a single pseudonym, see `PseudonymDecryptor`. */
 UserIdentifier decrypt_pseudonym(PseudonymisationKeyRef pseudonymisation_key,
                                  PseudonymisedUserIdentifier const & in);
 } // namespace enclave
@@ -0,0 +1,210 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include "BackgroundJob.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace eurostat {
+namespace enclave {
+namespace radix_sort {
+
+/** Below this size, a bucket is sorted with insertion sort. */
+constexpr std::size_t insertion_threshold = 32;
+
+/** Below this size, a parallel sort is not worth starting jobs. */
+constexpr std::size_t parallel_threshold = 1u << 16;
+
+/** Compares the key bytes from `depth` on. */
+template <std::size_t KeyBytes, typename Key>
+inline bool keyLess(Key const & a, Key const & b, std::size_t depth) noexcept {
+    for (; depth < KeyBytes; ++depth) {
+        if (a[depth] != b[depth]) { return a[depth] < b[depth]; }
+    }
+    return false;
+}
+
+template <std::size_t KeyBytes, typename T, typename KeyOf>
+void insertionSortByKey(T * const begin,
+                        T * const end,
+                        std::size_t const depth,
+                        KeyOf const & key_of)
+{
+    for (T * i = begin + 1; i < end; ++i) {
+        T value = std::move(*i);
+        auto const key = key_of(value);
+        T * j = i;
+        for (; j != begin && keyLess<KeyBytes>(key, key_of(*(j - 1)), depth); --j) {
+            *j = std::move(*(j - 1));
+        }
+        *j = std::move(value);
+    }
+}
+
+/**
+   Partitions `[begin, end)` into 256 buckets by the key byte at `depth`. Key
+   bytes which are equal for all elements are skipped, `depth` is advanced
+   accordingly. Returns false if all keys are equal, i.e. nothing is left to
+   sort.
+ */
+template <std::size_t KeyBytes, typename T, typename KeyOf>
+bool partitionLevel(T * const begin,
+                    T * const end,
+                    std::size_t & depth,
+                    KeyOf const & key_of,
+                    std::size_t (&bucket_end)[256])
+{
+    std::size_t const size = static_cast<std::size_t>(end - begin);
+    for (;; ++depth) {
+        if (depth == KeyBytes) { return false; }
+
+        std::size_t counts[256] = {};
+        for (T const * i = begin; i != end; ++i) { ++counts[key_of(*i)[depth]]; }
+
+        if (counts[key_of(*begin)[depth]] != size) {
+            std::size_t sum = 0;
+            for (std::size_t b = 0; b < 256; ++b) {
+                sum += counts[b];
+                bucket_end[b] = sum;
+            }
+            break;
+        }
+    }
+
+    // American flag sort: Move each element into its bucket with swaps, the
+    // front of each bucket is already in place.
+    std::size_t heads[256];
+    heads[0] = 0;
+    for (std::size_t b = 1; b < 256; ++b) { heads[b] = bucket_end[b - 1]; }
+    for (std::size_t b = 0; b < 256; ++b) {
+        while (heads[b] < bucket_end[b]) {
+            T & slot = begin[heads[b]];
+            std::uint8_t digit = key_of(slot)[depth];
+            while (digit != b) {
+                std::swap(slot, begin[heads[digit]++]);
+                digit = key_of(slot)[depth];
+            }
+            ++heads[b];
+        }
+    }
+    return true;
+}
+
+template <std::size_t KeyBytes, typename T, typename KeyOf>
+void sortLevel(T * const begin, T * const end, std::size_t depth, KeyOf const & key_of);
+
+/** Sorts the buckets `[first_bucket, last_bucket)` from `depth` on. */
+template <std::size_t KeyBytes, typename T, typename KeyOf>
+void sortBuckets(T * const begin,
+                 std::size_t const (&bucket_end)[256],
+                 std::size_t const first_bucket,
+                 std::size_t const last_bucket,
+                 std::size_t const depth,
+                 KeyOf const & key_of)
+{
+    if (depth == KeyBytes) { return; }
+    std::size_t bucket_begin = first_bucket == 0u ? 0u : bucket_end[first_bucket - 1u];
+    for (std::size_t b = first_bucket; b < last_bucket; ++b) {
+        if (bucket_end[b] - bucket_begin > 1u) {
+            sortLevel<KeyBytes>(begin + bucket_begin, begin + bucket_end[b], depth, key_of);
+        }
+        bucket_begin = bucket_end[b];
+    }
+}
+
+template <std::size_t KeyBytes, typename T, typename KeyOf>
+void sortLevel(T * const begin, T * const end, std::size_t depth, KeyOf const & key_of) {
+    if (static_cast<std::size_t>(end - begin) <= insertion_threshold) {
+        insertionSortByKey<KeyBytes>(begin, end, depth, key_of);
+        return;
+    }
+
+    std::size_t bucket_end[256];
+    if (partitionLevel<KeyBytes>(begin, end, depth, key_of, bucket_end)) {
+        sortBuckets<KeyBytes>(begin, bucket_end, 0u, 256u, depth + 1u, key_of);
+    }
+}
+
+} // namespace radix_sort
+
+/**
+   Sorts `[begin, end)` in place by fixed width byte keys in lexicographic
+   (i.e. `memcmp`) order. `key_of(T const &)` returns the `KeyBytes` bytes of
+   the key of an element, either as a pointer or as a byte array.
+
+   This is an in-place most significant digit radix sort (American flag sort),
+   which takes one byte per level. It is well suited for keys with uniformly
+   distributed leading bytes, like the pseudonymised user identifiers, as the
+   first levels then split the data into evenly sized buckets. The sort is not
+   stable.
+ */
+template <std::size_t KeyBytes, typename T, typename KeyOf>
+void radixSortByKey(T * const begin, T * const end, KeyOf const & key_of) {
+    static_assert(KeyBytes > 0u, "");
+    if (end - begin > 1) {
+        radix_sort::sortLevel<KeyBytes>(begin, end, 0u, key_of);
+    }
+}
+
+/**
+   Like `radixSortByKey`, but after partitioning by the first distinguishing
+   key byte, the buckets are sorted by `parallelism` jobs. Each job gets a
+   contiguous range of buckets with about the same number of elements.
+ */
+template <std::size_t KeyBytes, typename T, typename KeyOf>
+void parallelRadixSortByKey(T * const begin,
+                            T * const end,
+                            KeyOf const & key_of,
+                            std::size_t const parallelism)
+{
+    static_assert(KeyBytes > 0u, "");
+    std::size_t const size = static_cast<std::size_t>(end - begin);
+    if (parallelism <= 1u || size <= radix_sort::parallel_threshold) {
+        radixSortByKey<KeyBytes>(begin, end, key_of);
+        return;
+    }
+
+    std::size_t depth = 0;
+    std::size_t bucket_end[256];
+    if (!radix_sort::partitionLevel<KeyBytes>(begin, end, depth, key_of, bucket_end)) {
+        return;
+    }
+
+    // Declared after `bucket_end`, so the jobs are done before it goes away.
+    std::unique_ptr<BackgroundJob[]> jobs{new BackgroundJob[parallelism - 1u]};
+    std::size_t first_bucket = 0;
+    for (std::size_t j = 0; j + 1u < parallelism; ++j) {
+        std::size_t const target = size / parallelism * (j + 1u);
+        std::size_t last_bucket = first_bucket;
+        while (last_bucket < 256u && bucket_end[last_bucket] < target) { ++last_bucket; }
+        if (last_bucket == first_bucket) { continue; }
+        jobs[j].start([=, &bucket_end, &key_of] {
+            radix_sort::sortBuckets<KeyBytes>(begin, bucket_end, first_bucket, last_bucket, depth + 1u, key_of);
+        });
+        first_bucket = last_bucket;
+    }
+    radix_sort::sortBuckets<KeyBytes>(begin, bucket_end, first_bucket, 256u, depth + 1u, key_of);
+
+    for (std::size_t j = 0; j + 1u < parallelism; ++j) { jobs[j].wait(); }
+}
+
+} // namespace enclave
+} // namespace eurostat
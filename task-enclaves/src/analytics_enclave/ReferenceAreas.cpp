@@ -0,0 +1,44 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#include "ReferenceAreas.h"
+#include <cassert>
+
+namespace eurostat {
+namespace enclave {
+namespace {
+
+ReferenceAreas::Set const no_reference_areas = {};
+
+} // anonymous namespace
+
+void ReferenceAreas::add(ReferenceAreaIndex const index, TileIndex const tile) {
+    assert(index < ReferenceArea::MAX_REFERENCE_AREAS);
+    if (index >= m_size) { m_size = index + 1u; }
+
+    auto const id = m_tile_ids.insert(tile);
+    if (id == m_sets.size()) { m_sets.emplace_back(); }
+    m_sets[id].set(index);
+}
+
+ReferenceAreas::Set const & ReferenceAreas::areasOf(TileIndex const tile) const noexcept {
+    auto const id = m_tile_ids.find(tile);
+    return id == DenseTileIds::none ? no_reference_areas : m_sets[id];
+}
+
+} // namespace enclave
+} // namespace eurostat
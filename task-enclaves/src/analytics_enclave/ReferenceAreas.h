@@ -0,0 +1,58 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include "DenseTileIds.h"
+#include "Entities.h"
+#include <bitset>
+#include <cstddef>
+#include <vector>
+
+namespace eurostat {
+namespace enclave {
+
+/**
+   The reference areas of an NSI report request, indexed by tile: For every
+   tile which is part of at least one reference area, the set of reference
+   areas containing it is stored as a bitset. Assigning a tile to all of its
+   reference areas is then a single lookup, instead of a set lookup per
+   reference area.
+ */
+class ReferenceAreas {
+public: /* Types: */
+    using Set = std::bitset<ReferenceArea::MAX_REFERENCE_AREAS>;
+
+public: /* Methods: */
+    /** Adds `tile` to the reference area `index`. */
+    void add(ReferenceAreaIndex index, TileIndex tile);
+
+    /** The number of reference areas, i.e. the highest index plus one. */
+    std::size_t size() const noexcept { return m_size; }
+
+    /** The reference areas which contain `tile`, empty if there are none. */
+    Set const & areasOf(TileIndex tile) const noexcept;
+
+private: /* Fields: */
+    std::size_t m_size = 0;
+    DenseTileIds m_tile_ids;
+    /** Indexed by the tile id. */
+    std::vector<Set> m_sets;
+};
+
+} // namespace enclave
+} // namespace eurostat
@@ -0,0 +1,156 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#include "SBlock.h"
+#include <algorithm>
+#include <cstring>
+#include <sharemind-hi/enclave/common/EnclaveException.h>
+
+namespace eurostat {
+namespace enclave {
+
+constexpr std::size_t SBlock::SIZE;
+
+namespace {
+
+constexpr std::uint8_t NEW_ID = 1u;
+constexpr unsigned VALUES_SHIFT = 4u;
+constexpr std::size_t COUNT_BYTES = sizeof(std::uint32_t);
+/** The flags, the id, two varints of at most 3 bytes, and the values. */
+constexpr std::size_t MAX_RECORD_BYTES =
+        1u + sizeof(UserIdentifier) + 2u * 3u + sizeof(IColumn);
+
+static_assert(std::tuple_size<IColumn>::value <= 8u - VALUES_SHIFT, "");
+
+std::uint32_t zigzag(std::int32_t const value) noexcept {
+    return (static_cast<std::uint32_t>(value) << 1u)
+           ^ static_cast<std::uint32_t>(-static_cast<std::int32_t>(value < 0));
+}
+
+std::int32_t unzigzag(std::uint32_t const value) noexcept {
+    return static_cast<std::int32_t>(value >> 1u) ^ -static_cast<std::int32_t>(value & 1u);
+}
+
+std::size_t putVarint(std::uint8_t * out, std::uint32_t value) noexcept {
+    std::size_t n = 0;
+    while (value >= 0x80u) {
+        out[n++] = static_cast<std::uint8_t>(value | 0x80u);
+        value >>= 7u;
+    }
+    out[n++] = static_cast<std::uint8_t>(value);
+    return n;
+}
+
+std::uint32_t getVarint(SBlock const & block, std::size_t & offset) {
+    std::uint32_t result = 0;
+    for (unsigned shift = 0;; shift += 7u) {
+        // The deltas of the uint16 coordinates take at most 3 bytes.
+        ENCLAVE_EXPECT(offset < SBlock::SIZE && shift < 21u, "Invalid compressed S block.");
+        auto const byte = block.bytes[offset++];
+        result |= static_cast<std::uint32_t>(byte & 0x7fu) << shift;
+        if (!(byte & 0x80u)) { return result; }
+    }
+}
+
+bool isZero(float const value) noexcept {
+    std::uint32_t bits;
+    static_assert(sizeof(bits) == sizeof(value), "");
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits == 0u;
+}
+
+} // anonymous namespace
+
+void SBlockEncoder::clear() noexcept {
+    m_bytes = COUNT_BYTES;
+    m_records = 0;
+    m_previous = {};
+}
+
+bool SBlockEncoder::full() const noexcept {
+    return m_bytes + MAX_RECORD_BYTES > SBlock::SIZE;
+}
+
+void SBlockEncoder::add(AccumulatedUserFootprint const & e) noexcept {
+    auto * const out = m_block.bytes.data();
+    auto & flags = out[m_bytes++];
+    flags = 0u;
+    if (e.key.id != m_previous.id) {
+        flags |= NEW_ID;
+        std::memcpy(out + m_bytes, e.key.id.data(), sizeof(UserIdentifier));
+        m_bytes += sizeof(UserIdentifier);
+    }
+    m_bytes += putVarint(out + m_bytes,
+                         zigzag(std::int32_t{e.key.tile.easting}
+                                - std::int32_t{m_previous.tile.easting}));
+    m_bytes += putVarint(out + m_bytes,
+                         zigzag(std::int32_t{e.key.tile.northing}
+                                - std::int32_t{m_previous.tile.northing}));
+    for (std::size_t i = 0; i < e.i_column.size(); ++i) {
+        if (isZero(e.i_column[i])) { continue; }
+        flags |= static_cast<std::uint8_t>(1u << (VALUES_SHIFT + i));
+        std::memcpy(out + m_bytes, &e.i_column[i], sizeof(float));
+        m_bytes += sizeof(float);
+    }
+    m_previous = e.key;
+    ++m_records;
+}
+
+SBlock const & SBlockEncoder::finish() noexcept {
+    std::memcpy(m_block.bytes.data(), &m_records, COUNT_BYTES);
+    std::fill(m_block.bytes.begin() + m_bytes, m_block.bytes.end(), 0u);
+    return m_block;
+}
+
+void SBlockDecoder::reset(SBlock const & block) noexcept {
+    m_block = &block;
+    std::memcpy(&m_records_left, block.bytes.data(), COUNT_BYTES);
+    m_offset = COUNT_BYTES;
+    m_previous = {};
+}
+
+bool SBlockDecoder::next(AccumulatedUserFootprint & result) {
+    if (m_records_left == 0u) { return false; }
+
+    auto const & in = *m_block;
+    ENCLAVE_EXPECT(m_offset < SBlock::SIZE, "Invalid compressed S block.");
+    auto const flags = in.bytes[m_offset++];
+    if (flags & NEW_ID) {
+        ENCLAVE_EXPECT(m_offset + sizeof(UserIdentifier) <= SBlock::SIZE,
+                       "Invalid compressed S block.");
+        std::memcpy(m_previous.id.data(), in.bytes.data() + m_offset, sizeof(UserIdentifier));
+        m_offset += sizeof(UserIdentifier);
+    }
+    m_previous.tile.easting = static_cast<std::uint16_t>(
+            std::int32_t{m_previous.tile.easting} + unzigzag(getVarint(in, m_offset)));
+    m_previous.tile.northing = static_cast<std::uint16_t>(
+            std::int32_t{m_previous.tile.northing} + unzigzag(getVarint(in, m_offset)));
+    result.key = m_previous;
+    for (std::size_t i = 0; i < result.i_column.size(); ++i) {
+        result.i_column[i] = 0.0f;
+        if (!(flags & (1u << (VALUES_SHIFT + i)))) { continue; }
+        ENCLAVE_EXPECT(m_offset + sizeof(float) <= SBlock::SIZE,
+                       "Invalid compressed S block.");
+        std::memcpy(&result.i_column[i], in.bytes.data() + m_offset, sizeof(float));
+        m_offset += sizeof(float);
+    }
+    --m_records_left;
+    return true;
+}
+
+} // namespace enclave
+} // namespace eurostat
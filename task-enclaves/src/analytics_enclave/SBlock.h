@@ -0,0 +1,94 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include "Entities.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace eurostat {
+namespace enclave {
+
+/**
+   A block of compressed S records. Consecutive records of the same user share
+   their id, their tiles are close to each other, and many of their values are
+   zero. So a record is encoded as:
+   - a flags byte: bit 0 is set if the user id differs from the previous
+     record, bits 4 to 7 are set for the values which are not zero,
+   - the user id, if it differs,
+   - the differences of the easting and the northing to the previous tile,
+     each as a zigzag encoded varint,
+   - the values which are not zero.
+   The block starts with the number of records in it (uint32), and the rest
+   of the block after the last record is zero. Each block is decoded on its
+   own, the first record is encoded relative to a zero key.
+
+   The blocks have a fixed size, so they are written and read like raw
+   records with `PersistentDataSinkBuilder` and `PersistentDataSource`.
+ */
+struct SBlock {
+    static constexpr std::size_t SIZE = 16u * 1024u;
+
+    std::array<std::uint8_t, SIZE> bytes;
+};
+
+/** Encodes records into an `SBlock`. */
+class SBlockEncoder {
+public: /* Methods: */
+    SBlockEncoder() noexcept { clear(); }
+
+    /** Starts a new, empty block. */
+    void clear() noexcept;
+
+    /** Whether the block might not have room for another record. */
+    bool full() const noexcept;
+
+    /** Appends `e` to the block, which must not be `full()`. */
+    void add(AccumulatedUserFootprint const & e) noexcept;
+
+    std::uint32_t records() const noexcept { return m_records; }
+
+    /** The block with the records added since `clear()`. */
+    SBlock const & finish() noexcept;
+
+private: /* Fields: */
+    SBlock m_block;
+    std::size_t m_bytes;
+    std::uint32_t m_records;
+    FootprintKey m_previous;
+};
+
+/** Decodes the records of an `SBlock`, throws if the block is invalid. */
+class SBlockDecoder {
+public: /* Methods: */
+    /** Starts to decode `block`, which must outlive the decoding. */
+    void reset(SBlock const & block) noexcept;
+
+    /** Returns false after the last record of the block. */
+    bool next(AccumulatedUserFootprint & result);
+
+private: /* Fields: */
+    SBlock const * m_block = nullptr;
+    std::size_t m_offset = 0;
+    std::uint32_t m_records_left = 0;
+    FootprintKey m_previous = {};
+};
+
+} // namespace enclave
+} // namespace eurostat
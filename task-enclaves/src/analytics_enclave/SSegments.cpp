@@ -0,0 +1,234 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#include "SSegments.h"
+#include <algorithm>
+#include <cstring>
+#include <sgx_trts.h>
+#include <sharemind-hi/enclave/common/EnclaveException.h>
+#include <sharemind-hi/enclave/common/SgxException.h>
+
+namespace eurostat {
+namespace enclave {
+
+constexpr std::size_t SSegments::MAX_DELTAS;
+
+std::string SSegments::path(std::string const & prefix, std::uint64_t const id) {
+    return prefix + std::to_string(id);
+}
+
+bool SSegments::empty() const noexcept {
+    return base.records == 0u && deltaRecords() == 0u;
+}
+
+std::uint64_t SSegments::deltaRecords() const noexcept {
+    std::uint64_t result = 0;
+    for (std::size_t i = 0; i < num_deltas; ++i) { result += deltas[i].records; }
+    return result;
+}
+
+bool SSegments::needsCompaction() const noexcept {
+    return base.id == 0u || num_deltas == MAX_DELTAS
+           || static_cast<double>(deltaRecords())
+                      >= s_compaction_ratio * static_cast<double>(base.records);
+}
+
+void SSegments::collectPaths(std::string const & prefix,
+                             std::vector<std::string> & paths) const
+{
+    if (base.id != 0u) { paths.push_back(path(prefix, base.id)); }
+    for (std::size_t i = 0; i < num_deltas; ++i) {
+        paths.push_back(path(prefix, deltas[i].id));
+    }
+}
+
+std::size_t sShard(UserIdentifier const & id) noexcept {
+    // The ids are hashes already, but do not rely on their distribution.
+    std::uint64_t bits;
+    static_assert(sizeof(bits) <= sizeof(id), "");
+    std::memcpy(&bits, id.data(), sizeof(bits));
+    return static_cast<std::size_t>((bits * 0x9e3779b97f4a7c15ull) >> 32u) % s_shards;
+}
+
+std::string sShardPrefix(std::string const & prefix, std::size_t const shard) {
+    return prefix + std::to_string(shard) + "_";
+}
+
+SSegmentWriter::SSegmentWriter(std::string const & path,
+                               std::size_t const buffer_size,
+                               SSegments::Segment const & segment)
+{
+    if (segment.compressed) {
+        // The sink buffers whole blocks, which are larger than the smallest
+        // buffer of the `IoProfile`.
+        m_blocks.reset(new PersistentDataSinkBuilder::Impl<SBlock>{
+                path, std::max(buffer_size, 2u * sizeof(SBlock)), segment.key});
+        m_encoder.reset(new SBlockEncoder);
+    } else {
+        m_raw.reset(new PersistentDataSinkBuilder::Impl<AccumulatedUserFootprint>{
+                path, buffer_size, segment.key});
+    }
+}
+
+void SSegmentWriter::write(AccumulatedUserFootprint const & e) {
+    if (m_raw) {
+        m_raw->sink(e);
+        return;
+    }
+    if (m_encoder->full()) { flushBlock(); }
+    m_encoder->add(e);
+}
+
+void SSegmentWriter::flushBlock() {
+    m_blocks->sink(m_encoder->finish());
+    m_encoder->clear();
+}
+
+void SSegmentWriter::finish() && {
+    if (m_raw) {
+        std::move(*m_raw).finalize();
+        return;
+    }
+    if (m_encoder->records() != 0u) { flushBlock(); }
+    std::move(*m_blocks).finalize();
+}
+
+SSegmentReader::SSegmentReader(std::string const & path,
+                               std::size_t const buffer_size,
+                               SSegments::Segment const & segment)
+{
+    if (segment.compressed) {
+        m_blocks.reset(new PersistentDataSource<SBlock, SgxEncryptedFile>{
+                path.c_str(), buffer_size, segment.key});
+        m_block.reset(new SBlock);
+    } else {
+        m_raw.reset(new PersistentDataSource<AccumulatedUserFootprint, SgxEncryptedFile>{
+                path.c_str(), buffer_size, segment.key});
+    }
+}
+
+bool SSegmentReader::next(AccumulatedUserFootprint & result) {
+    if (m_raw) { return m_raw->next(result); }
+
+    while (!m_decoder.next(result)) {
+        if (!m_blocks->next(*m_block)) { return false; }
+        m_decoder.reset(*m_block);
+    }
+    return true;
+}
+
+SSegmentsSource::SSegmentsSource(std::string const & prefix,
+                                 SSegments const & segments,
+                                 std::size_t const buffer_size)
+{
+    open(prefix, segments, buffer_size);
+}
+
+SSegmentsSource::SSegmentsSource(std::string const & prefix,
+                                 SShards const & shards,
+                                 std::size_t const buffer_size)
+{
+    // The shards hold disjoint keys, so they are merged like the segments.
+    for (std::size_t shard = 0; shard < shards.size(); ++shard) {
+        open(sShardPrefix(prefix, shard), shards[shard], buffer_size);
+    }
+}
+
+void SSegmentsSource::open(std::string const & prefix,
+                           SSegments const & segments,
+                           std::size_t const buffer_size)
+{
+    ENCLAVE_EXPECT(segments.num_deltas <= SSegments::MAX_DELTAS, "Invalid S segments.");
+    std::vector<SSegments::Segment> written;
+    if (segments.base.id != 0u) { written.push_back(segments.base); }
+    written.insert(written.end(),
+                   segments.deltas.begin(),
+                   segments.deltas.begin() + segments.num_deltas);
+
+    for (auto const & segment : written) {
+        m_sources.emplace_back(SSegments::path(prefix, segment.id), buffer_size, segment);
+        m_records_left.push_back(segment.records);
+        m_heads.emplace_back();
+        if (advance(m_sources.size() - 1u)) { pushActive(m_sources.size() - 1u); }
+    }
+}
+
+bool SSegmentsSource::next(Out & result) {
+    if (m_active.empty()) { return false; }
+
+    // The smallest key wins, and on equal keys the newest segment.
+    auto const newest = popActive();
+    result = m_heads[newest];
+    if (advance(newest)) { pushActive(newest); }
+
+    // Skip the replaced records of the older segments.
+    while (!m_active.empty() && m_heads[m_active.front()].key == result.key) {
+        auto const older = popActive();
+        if (advance(older)) { pushActive(older); }
+    }
+    return true;
+}
+
+bool SSegmentsSource::activeAfter(std::size_t const a, std::size_t const b) const noexcept {
+    // A min-heap by the key, and on equal keys the newest (i.e. largest)
+    // segment index first.
+    return m_heads[b].key < m_heads[a].key
+           || (m_heads[a].key == m_heads[b].key && a < b);
+}
+
+void SSegmentsSource::pushActive(std::size_t const segment) {
+    m_active.push_back(segment);
+    std::push_heap(m_active.begin(),
+                   m_active.end(),
+                   [this](std::size_t a, std::size_t b) { return activeAfter(a, b); });
+}
+
+std::size_t SSegmentsSource::popActive() {
+    std::pop_heap(m_active.begin(),
+                  m_active.end(),
+                  [this](std::size_t a, std::size_t b) { return activeAfter(a, b); });
+    auto const result = m_active.back();
+    m_active.pop_back();
+    return result;
+}
+
+bool SSegmentsSource::advance(std::size_t const segment) {
+    if (!m_sources[segment].next(m_heads[segment])) {
+        ENCLAVE_EXPECT(m_records_left[segment] == 0u,
+                       "An S segment holds less records than expected.");
+        return false;
+    }
+    ENCLAVE_EXPECT(m_records_left[segment] > 0u,
+                   "An S segment holds more records than expected.");
+    --m_records_left[segment];
+    return true;
+}
+
+SSegments::Segment SSegmentsOutputBuilder::newSegment(SSegments const & segments,
+                                                     bool const compress)
+{
+    SSegments::Segment result = {};
+    result.id = segments.last_id + 1u;
+    result.compressed = compress;
+    sharemind_hi::enclave::SgxException::throwOnError(
+            sgx_read_rand(result.key.key, sizeof(result.key.key)),
+            "Failed to create a new random S file key");
+    return result;
+}
+
+} // namespace enclave
+} // namespace eurostat
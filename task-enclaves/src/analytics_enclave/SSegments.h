@@ -0,0 +1,282 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include "Entities.h"
+#include "Parameters.h"
+#include "SBlock.h"
+#include "SgxEncryptedFile.h"
+#include "StreamAdditions.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sharemind-hi/enclave/task/stream/Streams_detail.h>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace eurostat {
+namespace enclave {
+
+/**
+   The S state is stored as a log of segments instead of a single file which
+   is rewritten on every update: A base segment, followed by up to
+   `MAX_DELTAS` delta segments. Each segment is sorted by the `FootprintKey`,
+   with unique keys, and is encrypted with its own key. A delta segment only
+   holds the records which were changed by its update, so it replaces the
+   records with the same key in the older segments.
+
+   An update writes a new delta segment, unless `needsCompaction()`. Then the
+   update writes all records into a new base segment instead, and the old
+   segments can be removed.
+
+   A segment is either stored as raw records, or compressed in `SBlock`s.
+
+   This descriptor is part of the persistent state, hence trivially copyable.
+   Zero initialized, it describes an empty S.
+ */
+struct SSegments {
+    static constexpr std::size_t MAX_DELTAS = 8;
+
+    struct Segment {
+        /** The file name suffix. 0 if the segment was never written. */
+        std::uint64_t id;
+        std::uint64_t records;
+        SgxFileKey key;
+        /** Whether the records are stored in `SBlock`s. */
+        bool compressed;
+    };
+
+    Segment base;
+    std::uint64_t num_deltas;
+    /** Ordered from the oldest to the newest. */
+    std::array<Segment, MAX_DELTAS> deltas;
+    /** The id of the segment which was written last. */
+    std::uint64_t last_id;
+
+    static std::string path(std::string const & prefix, std::uint64_t id);
+
+    /** Whether S holds no records at all. */
+    bool empty() const noexcept;
+    std::uint64_t deltaRecords() const noexcept;
+    bool needsCompaction() const noexcept;
+
+    /** Appends the paths of the files of all written segments. */
+    void collectPaths(std::string const & prefix, std::vector<std::string> & paths) const;
+};
+static_assert(std::is_trivially_copyable<SSegments>::value, "");
+
+/**
+   S is split into `s_shards` shards by the user id, each stored in its own
+   segments. All records of a user are in the shard `sShard(id)`, so the shards
+   can be updated independently of each other.
+ */
+using SShards = std::array<SSegments, s_shards>;
+
+std::size_t sShard(UserIdentifier const & id) noexcept;
+
+/** The path prefix of the segments of `shard`. */
+std::string sShardPrefix(std::string const & prefix, std::size_t shard);
+
+/** Writes the records of one segment, raw or compressed into `SBlock`s. */
+class SSegmentWriter {
+public: /* Methods: */
+    explicit SSegmentWriter(std::string const & path,
+                            std::size_t buffer_size,
+                            SSegments::Segment const & segment);
+
+    SSegmentWriter(SSegmentWriter &&) noexcept = default;
+
+    void write(AccumulatedUserFootprint const & e);
+
+    void finish() &&;
+
+private: /* Methods: */
+    void flushBlock();
+
+private: /* Fields: */
+    /** Exactly one of `m_raw` and `m_blocks` is set, and `m_encoder` with
+     * `m_blocks`. */
+    std::unique_ptr<PersistentDataSinkBuilder::Impl<AccumulatedUserFootprint>> m_raw;
+    std::unique_ptr<PersistentDataSinkBuilder::Impl<SBlock>> m_blocks;
+    std::unique_ptr<SBlockEncoder> m_encoder;
+};
+
+/** Reads the records of one segment written by `SSegmentWriter`. */
+class SSegmentReader {
+public: /* Methods: */
+    explicit SSegmentReader(std::string const & path,
+                            std::size_t buffer_size,
+                            SSegments::Segment const & segment);
+
+    SSegmentReader(SSegmentReader &&) noexcept = default;
+
+    bool next(AccumulatedUserFootprint & result);
+
+private: /* Fields: */
+    /** Exactly one of `m_raw` and `m_blocks` is set, and `m_block` with
+     * `m_blocks`. */
+    std::unique_ptr<PersistentDataSource<AccumulatedUserFootprint, SgxEncryptedFile>> m_raw;
+    std::unique_ptr<PersistentDataSource<SBlock, SgxEncryptedFile>> m_blocks;
+    std::unique_ptr<SBlock> m_block;
+    SBlockDecoder m_decoder;
+};
+
+/** Reads the records of all segments, ordered by their `FootprintKey`. */
+class SSegmentsSource {
+public: /* Types: */
+    using Category = sharemind_hi::enclave::stream::detail::SourceCategory;
+    using Out = AccumulatedUserFootprint;
+
+public: /* Methods: */
+    explicit SSegmentsSource(std::string const & prefix,
+                             SSegments const & segments,
+                             std::size_t buffer_size);
+
+    /** Reads the segments of all shards. */
+    explicit SSegmentsSource(std::string const & prefix,
+                             SShards const & shards,
+                             std::size_t buffer_size);
+
+    SSegmentsSource(SSegmentsSource &&) noexcept = default;
+
+    bool next(Out & result);
+
+private: /* Methods: */
+    void open(std::string const & prefix,
+              SSegments const & segments,
+              std::size_t buffer_size);
+    bool advance(std::size_t segment);
+    bool activeAfter(std::size_t a, std::size_t b) const noexcept;
+    void pushActive(std::size_t segment);
+    std::size_t popActive();
+
+private: /* Types: */
+    using Source = SSegmentReader;
+
+private: /* Fields: */
+    /** From the oldest to the newest segment (of each shard), for all fields. */
+    std::vector<Source> m_sources;
+    std::vector<std::uint64_t> m_records_left;
+    std::vector<Out> m_heads;
+    /**
+       The segments which are not exhausted, as a heap with the segment of
+       the next record at the front.
+     */
+    std::vector<std::size_t> m_active;
+};
+
+/** An S record after an update, and whether the update changed it. */
+struct SUpdate {
+    AccumulatedUserFootprint record;
+    bool changed;
+};
+
+struct SSegmentsOutputBuilder {
+    using Category = sharemind_hi::enclave::stream::detail::SinkCategory;
+
+    SSegmentsOutputBuilder(SSegmentsOutputBuilder &&) noexcept = default;
+
+    explicit SSegmentsOutputBuilder(std::string prefix,
+                                    std::size_t buffer_size,
+                                    SSegments & segments,
+                                    bool compress)
+        : m_prefix{std::move(prefix)}
+        , m_buffer_size{buffer_size}
+        , m_segments(segments)
+        , m_compress{compress}
+    {}
+
+    template <typename T>
+    struct Impl {
+        static_assert(std::is_same<T, SUpdate>::value, "Only S updates can be written.");
+
+        using In = T;
+        using Res = void;
+
+        Impl(Impl &&) noexcept = default;
+
+        explicit Impl(std::string const & prefix,
+                      std::size_t const buffer_size,
+                      SSegments & segments,
+                      bool const compress)
+            : m_segments(segments)
+            , m_compact{segments.needsCompaction()}
+            , m_segment(newSegment(segments, compress))
+            , m_writer{SSegments::path(prefix, m_segment.id), buffer_size, m_segment}
+        {}
+
+        void sink(In const & argument) {
+            if (m_compact || argument.changed) {
+                m_writer.write(argument.record);
+                ++m_segment.records;
+            }
+        }
+
+        void finalize() && {
+            std::move(m_writer).finish();
+            m_segments.last_id = m_segment.id;
+            if (m_compact) {
+                m_segments.base = m_segment;
+                m_segments.num_deltas = 0;
+                m_segments.deltas = {};
+            } else {
+                m_segments.deltas[m_segments.num_deltas++] = m_segment;
+            }
+        }
+
+    private: /* Fields: */
+        SSegments & m_segments;
+        bool m_compact;
+        SSegments::Segment m_segment;
+        SSegmentWriter m_writer;
+    };
+
+    template <typename T>
+    Impl<T> build() && { return Impl<T>{m_prefix, m_buffer_size, m_segments, m_compress}; }
+
+private: /* Methods: */
+    /** A segment with the next id and a fresh key. */
+    static SSegments::Segment newSegment(SSegments const & segments, bool compress);
+
+private: /* Fields: */
+    std::string m_prefix;
+    std::size_t m_buffer_size;
+    SSegments & m_segments;
+    bool m_compress;
+};
+
+/**
+   Writes the updated S as the next segment of `segments`, and adds the
+   segment to `segments` when the stream is finished. A delta segment only
+   receives the changed records, a new base segment (on compaction) all
+   records. The input must be ordered by the `FootprintKey`. With `compress`,
+   the segment is written in `SBlock`s.
+ */
+inline SSegmentsOutputBuilder sSegmentsOutput(std::string prefix,
+                                              std::size_t buffer_size,
+                                              SSegments & segments,
+                                              bool compress)
+{
+    return SSegmentsOutputBuilder{std::move(prefix), buffer_size, segments, compress};
+}
+
+} // namespace enclave
+} // namespace eurostat
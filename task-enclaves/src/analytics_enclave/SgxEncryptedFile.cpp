@@ -16,12 +16,17 @@
 */ 
 
 #include "SgxEncryptedFile.h"
+#include "IoCounters.h"
+#include <cassert>
 #include <cstring>
 #include <errno.h>
 #include <iterator>
 #include <sgx_error.h>
+#include <sgx_trts.h>
 #include <sharemind-hi/enclave/common/EnclaveException.h>
 #include <sharemind-hi/enclave/common/Log.h>
+#include <sharemind-hi/enclave/common/SgxException.h>
+#include <utility>
 
 namespace eurostat {
 namespace enclave {
@@ -135,6 +140,7 @@ void SgxEncryptedFile::read(void * const dest, std::size_t destSize) {
 
         auto const bytesToRead = std::min(BLOCK_SIZE, destSize);
         auto const bytesRead = sgx_fread(ptr, 1u, bytesToRead, m_stream.get());
+        IoCounters::countEncrypted(bytesRead, false);
         // Need to call sgx_ferror to detect an error with sgx_fread.
         EXPECT_FILE_OPERATION(true, "sgx_fread");
         // Clear the cache, so old data does not pile up (not sure if this is required, though).
@@ -156,6 +162,7 @@ void SgxEncryptedFile::write(void const * const data, std::size_t const size) {
         EXPECT_FILE_OPERATION(sgx_fwrite(ptr, 1u, bytesToWrite, m_stream.get())
                                       == bytesToWrite,
                               "File write failed.");
+        IoCounters::countEncrypted(bytesToWrite, true);
         // Clear the cache, so old data does not pile up (not sure if this is
         // required, though).
         EXPECT_FILE_OPERATION(sgx_fclear_cache(m_stream.get()) == 0u,
@@ -185,5 +192,41 @@ try {
     SgxEncryptedFile{path, sharemind_hi::FileOpenMode::FILE_OPEN_WRITE_ONLY, key};
 }
 
+TemporaryEncryptedFile::TemporaryEncryptedFile(std::string path)
+    : m_path{std::move(path)}
+    , m_key{}
+{
+    sharemind_hi::enclave::SgxException::throwOnError(
+            sgx_read_rand(m_key.key, sizeof(m_key.key)),
+            "Failed to create a random key for a temporary file");
+}
+
+TemporaryEncryptedFile::TemporaryEncryptedFile(TemporaryEncryptedFile && other) noexcept
+    : m_path{std::move(other.m_path)}
+    , m_key(other.m_key)
+    , m_created{other.m_created}
+{
+    other.m_created = false;
+}
+
+TemporaryEncryptedFile::~TemporaryEncryptedFile() {
+    if (!m_created) { return; }
+    try {
+        SgxEncryptedFile::remove(m_path);
+    } catch (std::exception const & e) {
+        // The content is still protected by the forgotten key.
+        enclave_printf_log("Failed to remove temporary file: %s", e.what());
+    }
+}
+
+SgxEncryptedFile TemporaryEncryptedFile::openForWriting() {
+    m_created = true;
+    return SgxEncryptedFile{m_path, sharemind_hi::FileOpenMode::FILE_OPEN_WRITE_ONLY, m_key};
+}
+
+SgxEncryptedFile TemporaryEncryptedFile::openForReading() const {
+    return SgxEncryptedFile{m_path, sharemind_hi::FileOpenMode::FILE_OPEN_READ_ONLY, m_key};
+}
+
 } // namespace enclave
 } // namespace sharemind_hi
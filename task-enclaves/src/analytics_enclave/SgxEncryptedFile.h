@@ -18,6 +18,7 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
 #include <sgx_key.h>
 #include <string>
 #include <sgx_tprotected_fs.h>
@@ -88,5 +89,36 @@ private: /* fields: */
     std::size_t m_bytes_written = 0;
 };
 
+/**
+   A file for intermediate data which only lives as long as this object. It is
+   encrypted with a fresh random key, so its content is not accessible after
+   this object is gone, even if removing the file fails.
+ */
+class TemporaryEncryptedFile {
+public: /* methods: */
+    /** Creates the key, but not the file itself. */
+    explicit TemporaryEncryptedFile(std::string path);
+    TemporaryEncryptedFile(TemporaryEncryptedFile && other) noexcept;
+    TemporaryEncryptedFile(TemporaryEncryptedFile const &) = delete;
+    TemporaryEncryptedFile & operator=(TemporaryEncryptedFile &&) = delete;
+    TemporaryEncryptedFile & operator=(TemporaryEncryptedFile const &) = delete;
+
+    /** Removes the file, if it was created. */
+    ~TemporaryEncryptedFile();
+
+    /** Creates the file, or truncates it if it was already written. */
+    SgxEncryptedFile openForWriting();
+    SgxEncryptedFile openForReading() const;
+
+    std::string const & path() const noexcept { return m_path; }
+    SgxFileKey const & key() const noexcept { return m_key; }
+
+private: /* fields: */
+    std::string m_path;
+    SgxFileKey m_key;
+    /** Whether this object is responsible for removing the file. */
+    bool m_created = false;
+};
+
 } // namespace enclave
 } // namespace eurostat
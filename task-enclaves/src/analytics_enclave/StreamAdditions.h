@@ -17,12 +17,25 @@
 
 #pragma once
 
+#include "BackgroundJob.h"
+#include "BlockQueue.h"
+#include "IoCounters.h"
 #include "SgxEncryptedFile.h"
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <sharemind-hi/enclave/common/EnclaveException.h>
 #include <sharemind-hi/enclave/common/File.h>
+#include <sharemind-hi/enclave/common/Log.h>
 #include <sharemind-hi/enclave/task/stream/Streams.h>
 #include <sharemind-hi/enclave/task/stream/Streams_detail.h>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace eurostat {
 namespace enclave {
@@ -33,6 +46,12 @@ namespace enclave {
   form.
 
   F may be sharemind_hi::enclave::File, or SgxEncryptedFile.
+
+  The file is read with a double buffer: While the pipeline drains the front
+  buffer, the next chunk of the file is read into the back buffer by a
+  `BackgroundJob`, so reading (and for SgxEncryptedFile also decrypting) the
+  file overlaps with the rest of the pipeline. The read-ahead state is kept on
+  the heap, so the source can be moved while a read is in progress.
  */
 template <typename T, typename F>
 struct PersistentDataSource {
@@ -46,21 +65,23 @@ struct PersistentDataSource {
             char const * filename,
             std::size_t bufferSizeInBytes,
             Args&& ... args)
-        : m_file(filename,
-                 // This is a source, so we intend to read it.
-                 sharemind_hi::FileOpenMode::FILE_OPEN_READ_ONLY,
-                 std::forward<Args>(args)...)
+        : m_read_ahead{new ReadAhead{
+                  F{filename,
+                    // This is a source, so we intend to read it.
+                    sharemind_hi::FileOpenMode::FILE_OPEN_READ_ONLY,
+                    std::forward<Args>(args)...}}}
     {
-        auto const file_byte_size = m_file.size();
+        auto const file_byte_size = m_read_ahead->file.size();
 
         // The file might be empty, as we also provide empty dummy files to the
         // analysis pipeline for some edge cases.
         ENCLAVE_EXPECT(file_byte_size % ITEM_SIZE == 0u, "Invalid file size. Validate your input data.");
         m_elements_left_in_file = file_byte_size / ITEM_SIZE;
-        m_buffer.resize(std::min((bufferSizeInBytes + ITEM_SIZE - 1) / ITEM_SIZE,
-                                 m_elements_left_in_file));
-        // Trigger a read on the first `next` call.
-        m_buffer_index = m_buffer.size();
+        m_read_ahead->elements_left_to_read = m_elements_left_in_file;
+        m_chunk_size = std::min((bufferSizeInBytes + ITEM_SIZE - 1) / ITEM_SIZE,
+                                m_elements_left_in_file);
+        m_buffer.reserve(m_chunk_size);
+        m_read_ahead->buffer.reserve(m_chunk_size);
 
 #ifndef NDEBUG
         enclave_printf_log(
@@ -68,6 +89,10 @@ struct PersistentDataSource {
                 m_elements_left_in_file,
                 filename);
 #endif
+
+        // Already read the first chunk while the rest of the pipeline is set
+        // up.
+        startReadAhead();
     }
 
     bool next(Out & result) {
@@ -93,6 +118,20 @@ struct PersistentDataSource {
 
     bool file_is_exhausted() const noexcept { return 0 == m_elements_left_in_file; }
 
+private: /* Types: */
+
+    struct ReadAhead {
+        F file;
+        /** The back buffer, filled by `job`. */
+        std::vector<Out> buffer = {};
+        /** Elements for which no read was started, yet. */
+        std::size_t elements_left_to_read = 0;
+        /** Declared last, so it is destroyed (i.e. waited for) first. */
+        BackgroundJob job = {};
+
+        explicit ReadAhead(F f) : file(std::move(f)) {}
+    };
+
 private: /* Methods: */
 
     bool fillBufferFromFile() {
@@ -100,20 +139,44 @@ private: /* Methods: */
             return false;
         }
 
-        auto const elementsToRead = std::min(m_buffer.size(), m_elements_left_in_file);
-        m_buffer.resize(elementsToRead);
-        m_elements_left_in_file -= elementsToRead;
-
-        m_file.read(m_buffer.data(), elementsToRead * ITEM_SIZE);
+        // Rethrows the exception if the read failed.
+        m_read_ahead->job.wait();
+        std::swap(m_buffer, m_read_ahead->buffer);
+        assert(!m_buffer.empty());
+        m_elements_left_in_file -= m_buffer.size();
         m_buffer_index = 0;
+
+        startReadAhead();
         return true;
     }
 
+    void startReadAhead() {
+        auto & read_ahead = *m_read_ahead;
+        auto const elementsToRead = std::min(m_chunk_size, read_ahead.elements_left_to_read);
+        if (elementsToRead == 0u) {
+            return;
+        }
+
+        read_ahead.elements_left_to_read -= elementsToRead;
+        read_ahead.buffer.resize(elementsToRead);
+        read_ahead.job.start([&read_ahead] {
+            read_ahead.file.read(read_ahead.buffer.data(),
+                                 read_ahead.buffer.size() * ITEM_SIZE);
+            // An SgxEncryptedFile counts its reads itself.
+            if (!std::is_same<F, SgxEncryptedFile>::value) {
+                IoCounters::countPlain(read_ahead.buffer.size() * ITEM_SIZE, false);
+            }
+        });
+    }
+
 private: /* Fields: */
+    /** The front buffer, drained by `next`. */
     std::vector<Out> m_buffer = {};
     std::size_t m_buffer_index = 0;
+    std::size_t m_chunk_size = 0;
+    /** Elements which have not been moved into the front buffer, yet. */
     std::size_t m_elements_left_in_file = 0;
-    F m_file;
+    std::unique_ptr<ReadAhead> m_read_ahead;
 };
 
 /** Allows to stream to a persistent file. The file is opened with
@@ -153,7 +216,7 @@ struct PersistentDataSinkBuilder {
             , m_buffer_size(buffer_size / ITEM_SIZE)
         {
             assert(buffer_size > ITEM_SIZE);
-            m_buffer.reserve(buffer_size);
+            m_buffer.reserve(m_buffer_size);
         }
 
         void sink(T const & item) {
@@ -339,5 +402,900 @@ inline SquashPipe<Eq, Init, Sq> squash(Eq eq, Init init, Sq squash)
             std::move(eq), std::move(init), std::move(squash)};
 }
 
+template <typename Eq, typename Merge, typename Builder>
+struct MergeDuplicatesBuilder {
+    using Category = sharemind_hi::enclave::stream::detail::SinkCategory;
+
+    MergeDuplicatesBuilder(MergeDuplicatesBuilder &&) noexcept = default;
+
+    explicit MergeDuplicatesBuilder(Eq eq, Merge merge, Builder sb2)
+        : m_eq{std::move(eq)}
+        , m_merge{std::move(merge)}
+        , m_builder{std::move(sb2)}
+    { }
+
+    template <typename T>
+    struct Impl {
+        using In = T;
+        using Sink = typename Builder::template Impl<T>;
+        using Res = typename Sink::Res;
+
+        Impl(Impl &&) noexcept = default;
+
+        explicit Impl(Eq eq, Merge merge, Sink sink)
+            : m_eq{std::move(eq)}
+            , m_merge{std::move(merge)}
+            , m_sink{std::move(sink)}
+        { }
+
+        void sink(In const & argument) {
+            if (m_first) {
+                m_first = false;
+            } else if (m_eq(m_current, argument)) {
+                m_merge(m_current, argument);
+                return;
+            } else {
+                m_sink.sink(m_current);
+            }
+            m_current = argument;
+        }
+
+        Res finalize() && {
+            if (!m_first) { m_sink.sink(m_current); }
+            return std::move(m_sink).finalize();
+        }
+
+    private: /* Fields: */
+        Eq m_eq;
+        Merge m_merge;
+        /** Make sure the first element does not trigger a group flush. */
+        bool m_first = true;
+        /** The first element of the current group, with all duplicates merged
+         * into it. */
+        In m_current;
+        Sink m_sink;
+    };
+
+    template <typename T>
+    Impl<T> build() && {
+        return Impl<T>{std::move(m_eq),
+                       std::move(m_merge),
+                       std::move(m_builder).template build<T>()};
+    }
+
+private: /* Fields: */
+    Eq m_eq;
+    Merge m_merge;
+    Builder m_builder;
+};
+
+template <typename Eq, typename Merge>
+struct MergeDuplicatesPipe {
+    using Category = sharemind_hi::enclave::stream::detail::PipeCategory;
+
+    template <typename In>
+    using Out = In;
+
+    MergeDuplicatesPipe(MergeDuplicatesPipe &&) noexcept = default;
+
+    explicit MergeDuplicatesPipe(Eq eq, Merge merge)
+        : m_eq{std::move(eq)}
+        , m_merge{std::move(merge)}
+    {}
+
+    template <typename Builder>
+    using InBuilder = MergeDuplicatesBuilder<Eq, Merge, Builder>;
+
+    template <typename Builder>
+    InBuilder<Builder> build(Builder down) && {
+        return InBuilder<Builder>{std::move(m_eq),
+                                  std::move(m_merge),
+                                  std::move(down)};
+    }
+
+private: /* Fields: */
+    Eq m_eq;
+    Merge m_merge;
+};
+
+/**
+   Merges consecutive equal elements into the first one of their group with
+   O(1) memory requirements. Unlike `squash`, the element type stays the same
+   and `Merge` is only called for the duplicates, so the common case of groups
+   with a single element costs just one comparison.
+ */
+template <
+        /** To determine what elements to merge. bool(T const &, T const &) */
+        typename Eq,
+        /** Merge a duplicate into the first group element. void(T &, T const &) */
+        typename Merge>
+inline MergeDuplicatesPipe<Eq, Merge> mergeDuplicates(Eq eq, Merge merge)
+{
+    return MergeDuplicatesPipe<Eq, Merge>{std::move(eq), std::move(merge)};
+}
+
+/**
+   An outer join of two sources which are sorted by their keys, where each key
+   is unique within each source. Instead of collecting the matching elements
+   into vectors, `f` is called with a pointer to the element of each side,
+   which is null if the side has no element with the key.
+ */
+template <typename A, typename B, typename KA, typename KB, typename F>
+struct UniqueOuterJoinSource {
+    using Category = sharemind_hi::enclave::stream::detail::SourceCategory;
+    using InA = typename A::Out;
+    using InB = typename B::Out;
+    using Out = typename std::decay<
+            typename std::result_of<F &(InA const *, InB const *)>::type>::type;
+
+    UniqueOuterJoinSource(UniqueOuterJoinSource &&) noexcept = default;
+
+    explicit UniqueOuterJoinSource(A a, B b, KA key_a, KB key_b, F f)
+        : m_a{std::move(a)}
+        , m_b{std::move(b)}
+        , m_key_a{std::move(key_a)}
+        , m_key_b{std::move(key_b)}
+        , m_f{std::move(f)}
+    {}
+
+    bool next(Out & result) {
+        if (!m_started) {
+            m_started = true;
+            m_has_a = m_a.next(m_element_a);
+            m_has_b = m_b.next(m_element_b);
+        }
+
+        if (m_has_a && (!m_has_b || m_key_a(m_element_a) < m_key_b(m_element_b))) {
+            result = m_f(&m_element_a, static_cast<InB const *>(nullptr));
+            advanceA();
+        } else if (m_has_b && (!m_has_a || m_key_b(m_element_b) < m_key_a(m_element_a))) {
+            result = m_f(static_cast<InA const *>(nullptr), &m_element_b);
+            advanceB();
+        } else if (m_has_a) {
+            result = m_f(&m_element_a, &m_element_b);
+            advanceA();
+            advanceB();
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+private: /* Methods: */
+    void advanceA() {
+#ifndef NDEBUG
+        auto const previous = m_key_a(m_element_a);
+        m_has_a = m_a.next(m_element_a);
+        assert(!m_has_a || previous < m_key_a(m_element_a));
+#else
+        m_has_a = m_a.next(m_element_a);
+#endif
+    }
+
+    void advanceB() {
+#ifndef NDEBUG
+        auto const previous = m_key_b(m_element_b);
+        m_has_b = m_b.next(m_element_b);
+        assert(!m_has_b || previous < m_key_b(m_element_b));
+#else
+        m_has_b = m_b.next(m_element_b);
+#endif
+    }
+
+private: /* Fields: */
+    A m_a;
+    B m_b;
+    KA m_key_a;
+    KB m_key_b;
+    F m_f;
+    bool m_started = false;
+    bool m_has_a = false;
+    bool m_has_b = false;
+    InA m_element_a = {};
+    InB m_element_b = {};
+};
+
+template <
+        /** Source sorted by unique keys. */
+        typename A,
+        /** Source sorted by unique keys. */
+        typename B,
+        /** K(A::Out const &) */
+        typename KA,
+        /** K(B::Out const &) */
+        typename KB,
+        /** O(A::Out const *, B::Out const *), at most one is null. */
+        typename F>
+inline UniqueOuterJoinSource<A, B, KA, KB, F>
+uniqueOuterJoin(A a, B b, KA key_a, KB key_b, F f)
+{
+    return UniqueOuterJoinSource<A, B, KA, KB, F>{
+            std::move(a), std::move(b), std::move(key_a), std::move(key_b), std::move(f)};
+}
+
+/**
+   Merges sources of the same type, each sorted by unique keys, into a single
+   source sorted by unique keys. The elements of several sources with the same
+   key are combined into one with `combine`, in the order of the sources. Only
+   a few sources are expected, so the smallest key is searched linearly.
+ */
+template <typename Source, typename K, typename Combine>
+struct UniqueMergeSource {
+    using Category = sharemind_hi::enclave::stream::detail::SourceCategory;
+    using Out = typename Source::Out;
+
+    UniqueMergeSource(UniqueMergeSource &&) noexcept = default;
+
+    explicit UniqueMergeSource(std::vector<Source> sources, K key, Combine combine)
+        : m_sources{std::move(sources)}
+        , m_key{std::move(key)}
+        , m_combine{std::move(combine)}
+        , m_heads(m_sources.size())
+        , m_has_head(m_sources.size(), false)
+    {}
+
+    bool next(Out & result) {
+        auto const count = m_sources.size();
+        if (!m_started) {
+            m_started = true;
+            for (std::size_t i = 0; i < count; ++i) {
+                m_has_head[i] = m_sources[i].next(m_heads[i]);
+            }
+        }
+
+        auto first = count;
+        for (std::size_t i = 0; i < count; ++i) {
+            if (m_has_head[i] && (first == count || m_key(m_heads[i]) < m_key(m_heads[first]))) {
+                first = i;
+            }
+        }
+        if (first == count) { return false; }
+
+        result = m_heads[first];
+        advance(first);
+        // The sources before `first` have larger keys, the ones after it at
+        // least the same key.
+        for (auto i = first + 1u; i < count; ++i) {
+            if (m_has_head[i] && !(m_key(result) < m_key(m_heads[i]))) {
+                m_combine(result, m_heads[i]);
+                advance(i);
+            }
+        }
+        return true;
+    }
+
+private: /* Methods: */
+    void advance(std::size_t const i) {
+#ifndef NDEBUG
+        auto const previous = m_key(m_heads[i]);
+        m_has_head[i] = m_sources[i].next(m_heads[i]);
+        assert(!m_has_head[i] || previous < m_key(m_heads[i]));
+#else
+        m_has_head[i] = m_sources[i].next(m_heads[i]);
+#endif
+    }
+
+private: /* Fields: */
+    std::vector<Source> m_sources;
+    K m_key;
+    Combine m_combine;
+    bool m_started = false;
+    std::vector<Out> m_heads;
+    std::vector<bool> m_has_head;
+};
+
+template <
+        /** Sources sorted by unique keys. */
+        typename Source,
+        /** K(Source::Out const &) */
+        typename K,
+        /** void(Source::Out & result, Source::Out const & other), `other`
+         * has the key of `result` and comes from a later source. */
+        typename Combine>
+inline UniqueMergeSource<Source, K, Combine>
+uniqueMerge(std::vector<Source> sources, K key, Combine combine)
+{
+    return UniqueMergeSource<Source, K, Combine>{
+            std::move(sources), std::move(key), std::move(combine)};
+}
+
+/**
+   Merges sources of the same type, each sorted by `less`, into a single
+   sorted source. Unlike `uniqueMerge`, many sources are expected, so they are
+   kept in a heap, and elements with equal keys are passed on one by one, in
+   no particular order.
+ */
+template <typename Source, typename Less>
+struct MergeSource {
+    using Category = sharemind_hi::enclave::stream::detail::SourceCategory;
+    using Out = typename Source::Out;
+
+    MergeSource(MergeSource &&) noexcept = default;
+
+    explicit MergeSource(std::vector<Source> sources, Less less)
+        : m_sources{std::move(sources)}
+        , m_less{std::move(less)}
+        , m_heads(m_sources.size())
+    {}
+
+    bool next(Out & result) {
+        if (!m_started) {
+            m_started = true;
+            m_heap.reserve(m_sources.size());
+            for (std::size_t i = 0; i < m_sources.size(); ++i) {
+                if (m_sources[i].next(m_heads[i])) { m_heap.push_back(i); }
+            }
+            std::make_heap(m_heap.begin(), m_heap.end(), HeapLess{*this});
+        }
+        if (m_heap.empty()) { return false; }
+
+        std::pop_heap(m_heap.begin(), m_heap.end(), HeapLess{*this});
+        auto const i = m_heap.back();
+        result = m_heads[i];
+        if (m_sources[i].next(m_heads[i])) {
+            std::push_heap(m_heap.begin(), m_heap.end(), HeapLess{*this});
+        } else {
+            m_heap.pop_back();
+        }
+        return true;
+    }
+
+private: /* Types: */
+    /** A min-heap of source indices, ordered by their current element. */
+    struct HeapLess {
+        MergeSource const & self;
+        bool operator()(std::size_t const a, std::size_t const b) const {
+            return self.m_less(self.m_heads[b], self.m_heads[a]);
+        }
+    };
+
+private: /* Fields: */
+    std::vector<Source> m_sources;
+    Less m_less;
+    bool m_started = false;
+    std::vector<Out> m_heads;
+    std::vector<std::size_t> m_heap = {};
+};
+
+template <
+        /** Sources sorted by `less`. */
+        typename Source,
+        /** bool(Source::Out const &, Source::Out const &) */
+        typename Less>
+inline MergeSource<Source, Less> mergeSorted(std::vector<Source> sources, Less less)
+{
+    return MergeSource<Source, Less>{std::move(sources), std::move(less)};
+}
+
+template <typename MakeSource>
+struct BackgroundSource {
+    using Category = sharemind_hi::enclave::stream::detail::SourceCategory;
+    using Source = typename std::decay<typename std::result_of<MakeSource &()>::type>::type;
+    using Out = typename Source::Out;
+
+    BackgroundSource(BackgroundSource &&) noexcept = default;
+
+    explicit BackgroundSource(MakeSource make_source, std::size_t const block_elements)
+        : m_state{new State{std::move(make_source), std::max<std::size_t>(block_elements, 1u)}}
+    {
+        auto & state = *m_state;
+        m_threaded = state.job.tryStart([&state] { state.produce(); });
+    }
+
+    bool next(Out & result) {
+        auto & state = *m_state;
+        if (!m_threaded) {
+            if (!state.source) { state.source.reset(new Source(state.make_source())); }
+            return state.source->next(result);
+        }
+
+        if (m_block_index >= m_block.size()) {
+            m_block_index = 0;
+            if (!state.queue.pop(m_block)) {
+                // Rethrows the exception if the source failed.
+                state.job.wait();
+                m_block.clear();
+                return false;
+            }
+        }
+        result = m_block[m_block_index++];
+        return true;
+    }
+
+private: /* Types: */
+    /** Kept on the heap, so the source stays movable while the job runs. */
+    struct State {
+        MakeSource make_source;
+        std::size_t block_elements;
+        std::unique_ptr<Source> source = {};
+        /** The consumer works on one block, and one is filled meanwhile. */
+        BlockQueue<Out> queue{2u};
+        /** Declared last, so it is destroyed (i.e. waited for) first. */
+        BackgroundJob job = {};
+
+        explicit State(MakeSource m, std::size_t const b)
+            : make_source(std::move(m)), block_elements(b) {}
+
+        /** Unblocks the job if the consumer gives up early. */
+        ~State() { queue.abort(); }
+
+        void produce() {
+            struct Closer {
+                BlockQueue<Out> & queue;
+                ~Closer() { queue.close(); }
+            } const closer{queue};
+
+            // Created here, so e.g. the read-ahead jobs of the source are
+            // started by this thread.
+            source.reset(new Source(make_source()));
+            std::vector<Out> block;
+            block.reserve(block_elements);
+            Out e;
+            while (source->next(e)) {
+                block.push_back(e);
+                if (block.size() >= block_elements) {
+                    if (!queue.push(block)) { return; }
+                    block.reserve(block_elements);
+                }
+            }
+            if (!block.empty()) { queue.push(block); }
+            source.reset();
+        }
+    };
+
+private: /* Fields: */
+    std::unique_ptr<State> m_state;
+    bool m_threaded = false;
+    std::vector<Out> m_block = {};
+    std::size_t m_block_index = 0;
+};
+
+/**
+   Creates the source returned by `make_source` and drains it on its own
+   `BackgroundJob`, so e.g. a merge runs in parallel to its consumer. The
+   elements are handed over in blocks of `block_elements`, and at most two
+   blocks are buffered.
+
+   The job is only started if it gets its own thread, as it waits for the
+   consumer when the buffer is full. Otherwise `next` creates and drains the
+   source itself, so the elements are the same either way.
+ */
+template <
+        /** Source(), called once by the thread which drains the source. */
+        typename MakeSource>
+inline BackgroundSource<MakeSource> inBackground(MakeSource make_source,
+                                                 std::size_t block_elements)
+{
+    return BackgroundSource<MakeSource>{std::move(make_source), block_elements};
+}
+
+template <typename O, typename F, typename Builder>
+struct ChunkedMapBuilder {
+    using Category = sharemind_hi::enclave::stream::detail::SinkCategory;
+
+    ChunkedMapBuilder(ChunkedMapBuilder &&) noexcept = default;
+
+    explicit ChunkedMapBuilder(std::size_t chunk_size, F f, Builder sb2)
+        : m_chunk_size{chunk_size}
+        , m_f{std::move(f)}
+        , m_builder{std::move(sb2)}
+    { }
+
+    template <typename T>
+    struct Impl {
+        using In = T;
+        using Sink = typename Builder::template Impl<O>;
+        using Res = typename Sink::Res;
+
+        Impl(Impl &&) noexcept = default;
+
+        explicit Impl(std::size_t chunk_size, F f, Sink sink)
+            : m_chunk_size{chunk_size}
+            , m_f{std::move(f)}
+            , m_sink{std::move(sink)}
+        {
+            assert(m_chunk_size > 0u);
+            m_in.reserve(m_chunk_size);
+            m_out.reserve(m_chunk_size);
+        }
+
+        void sink(In const & argument) {
+            m_in.push_back(argument);
+            if (m_in.size() >= m_chunk_size) { flushChunk(); }
+        }
+
+        Res finalize() && {
+            if (!m_in.empty()) { flushChunk(); }
+            return std::move(m_sink).finalize();
+        }
+
+    private: /* Methods: */
+        void flushChunk() {
+            m_out.resize(m_in.size());
+            m_f(static_cast<In const *>(m_in.data()), m_in.size(), m_out.data());
+            for (auto const & e : m_out) { m_sink.sink(e); }
+            m_in.clear();
+        }
+
+    private: /* Fields: */
+        std::size_t m_chunk_size;
+        F m_f;
+        /** Both buffers are reused for all chunks. */
+        std::vector<In> m_in = {};
+        std::vector<O> m_out = {};
+        Sink m_sink;
+    };
+
+    template <typename T>
+    Impl<T> build() && {
+        return Impl<T>{m_chunk_size,
+                       std::move(m_f),
+                       std::move(m_builder).template build<O>()};
+    }
+
+private: /* Fields: */
+    std::size_t m_chunk_size;
+    F m_f;
+    Builder m_builder;
+};
+
+template <typename O, typename F>
+struct ChunkedMapPipe {
+    using Category = sharemind_hi::enclave::stream::detail::PipeCategory;
+
+    template <typename In>
+    using Out = O;
+
+    ChunkedMapPipe(ChunkedMapPipe &&) noexcept = default;
+
+    explicit ChunkedMapPipe(std::size_t chunk_size, F f)
+        : m_chunk_size{chunk_size}
+        , m_f{std::move(f)}
+    {}
+
+    template <typename Builder>
+    using InBuilder = ChunkedMapBuilder<O, F, Builder>;
+
+    template <typename Builder>
+    InBuilder<Builder> build(Builder down) && {
+        return InBuilder<Builder>{m_chunk_size, std::move(m_f), std::move(down)};
+    }
+
+private: /* Fields: */
+    std::size_t m_chunk_size;
+    F m_f;
+};
+
+/**
+   Like `smap`, but hands up to `chunk_size` consecutive elements at once to
+   `f`, so that it can process them in a batch. The order of the elements is
+   retained.
+ */
+template <
+        /** The output element type. */
+        typename O,
+        /** void(I const * in, std::size_t count, O * out) */
+        typename F>
+inline ChunkedMapPipe<O, F> chunkedMap(std::size_t chunk_size, F f)
+{
+    return ChunkedMapPipe<O, F>{chunk_size, std::move(f)};
+}
+
+template <typename O, typename Eq, typename F, typename Builder>
+struct GroupFlatMapBuilder {
+    using Category = sharemind_hi::enclave::stream::detail::SinkCategory;
+
+    GroupFlatMapBuilder(GroupFlatMapBuilder &&) noexcept = default;
+
+    explicit GroupFlatMapBuilder(Eq eq, F f, Builder sb2)
+        : m_eq{std::move(eq)}
+        , m_f{std::move(f)}
+        , m_builder{std::move(sb2)}
+    { }
+
+    template <typename T>
+    struct Impl {
+        using In = T;
+        using Sink = typename Builder::template Impl<O>;
+        using Res = typename Sink::Res;
+
+        Impl(Impl &&) noexcept = default;
+
+        explicit Impl(Eq eq, F f, Sink sink)
+            : m_eq{std::move(eq)}
+            , m_f{std::move(f)}
+            , m_sink{std::move(sink)}
+        { }
+
+        void sink(In const & argument) {
+            if (!m_group.empty() && !m_eq(m_group.front(), argument)) {
+                flushGroup();
+            }
+            m_group.push_back(argument);
+        }
+
+        Res finalize() && {
+            if (!m_group.empty()) { flushGroup(); }
+            return std::move(m_sink).finalize();
+        }
+
+    private: /* Methods: */
+        void flushGroup() {
+            m_f(m_group, m_out);
+            for (auto const & e : m_out) { m_sink.sink(e); }
+            m_group.clear();
+            m_out.clear();
+        }
+
+    private: /* Fields: */
+        Eq m_eq;
+        F m_f;
+        /** Both buffers are reused for all groups, they only grow to the size
+         * of the largest group. */
+        std::vector<In> m_group = {};
+        std::vector<O> m_out = {};
+        Sink m_sink;
+    };
+
+    template <typename T>
+    Impl<T> build() && {
+        return Impl<T>{std::move(m_eq),
+                       std::move(m_f),
+                       std::move(m_builder).template build<O>()};
+    }
+
+private: /* Fields: */
+    Eq m_eq;
+    F m_f;
+    Builder m_builder;
+};
+
+template <typename O, typename Eq, typename F>
+struct GroupFlatMapPipe {
+    using Category = sharemind_hi::enclave::stream::detail::PipeCategory;
+
+    template <typename In>
+    using Out = O;
+
+    GroupFlatMapPipe(GroupFlatMapPipe &&) noexcept = default;
+
+    explicit GroupFlatMapPipe(Eq eq, F f)
+        : m_eq{std::move(eq)}
+        , m_f{std::move(f)}
+    {}
+
+    template <typename Builder>
+    using InBuilder = GroupFlatMapBuilder<O, Eq, F, Builder>;
+
+    template <typename Builder>
+    InBuilder<Builder> build(Builder down) && {
+        return InBuilder<Builder>{std::move(m_eq), std::move(m_f), std::move(down)};
+    }
+
+private: /* Fields: */
+    Eq m_eq;
+    F m_f;
+};
+
+/**
+   The `groupBy + flatMap` pattern, but the group and the result vectors are
+   reused for all groups instead of being allocated anew for each group. The
+   group is handed out as a mutable reference, so `f` may work on it in place.
+   `f` gets an empty result vector for each group.
+ */
+template <
+        /** The output element type. */
+        typename O,
+        /** To determine what elements form a group. bool(I const &, I const &) */
+        typename Eq,
+        /** void(std::vector<I> & group, std::vector<O> & result) */
+        typename F>
+inline GroupFlatMapPipe<O, Eq, F> groupFlatMap(Eq eq, F f)
+{
+    return GroupFlatMapPipe<O, Eq, F>{std::move(eq), std::move(f)};
+}
+
+/**
+   The elements of one partition of `fanOut`, in the order of the source of
+   the fan-out. They are either handed over by a `BlockQueue` from the thread
+   which reads the source, or read from the source by the consumer itself.
+ */
+template <typename T>
+class FanOutSource {
+public: /* Types: */
+    using Category = sharemind_hi::enclave::stream::detail::SourceCategory;
+    using Out = T;
+
+public: /* Methods: */
+    FanOutSource(FanOutSource &&) = default;
+
+    explicit FanOutSource(BlockQueue<T> & queue) noexcept
+        : m_queue{&queue}
+    {}
+
+    /** `read` returns the next element of the partition from the source. */
+    explicit FanOutSource(std::function<bool(T &)> read)
+        : m_read{std::move(read)}
+    {}
+
+    bool next(Out & result) {
+        if (m_read) { return m_read(result); }
+        if (m_block_index >= m_block.size()) {
+            m_block_index = 0;
+            if (!m_queue->pop(m_block)) {
+                m_block.clear();
+                return false;
+            }
+        }
+        result = m_block[m_block_index++];
+        return true;
+    }
+
+private: /* Fields: */
+    BlockQueue<T> * m_queue = nullptr;
+    std::function<bool(T &)> m_read = {};
+    std::vector<T> m_block = {};
+    std::size_t m_block_index = 0;
+};
+
+template <typename MakeSource, typename PartitionOf, typename Consume>
+class FanOut {
+public: /* Types: */
+    using Source = typename std::decay<
+            typename std::result_of<MakeSource &(std::size_t, std::size_t)>::type>::type;
+    using T = typename Source::Out;
+
+public: /* Methods: */
+    explicit FanOut(MakeSource make_source,
+                    PartitionOf partition_of,
+                    Consume consume,
+                    std::size_t const partitions,
+                    std::size_t const block_bytes)
+        : m_make_source{std::move(make_source)}
+        , m_partition_of{std::move(partition_of)}
+        , m_consume{std::move(consume)}
+        , m_partitions{partitions}
+        , m_block_size{std::max<std::size_t>(block_bytes / sizeof(T), 1u)}
+    {
+        assert(partitions > 0u);
+    }
+
+    void run() {
+        // The partitions which get a thread are the first ones, so the
+        // others form a range, too.
+        for (std::size_t p = 0; p < m_partitions; ++p) {
+            std::unique_ptr<Partition> partition{new Partition{}};
+            auto & queue = partition->queue;
+            auto & consume = m_consume;
+            auto const threaded = partition->job.tryStart([&consume, &queue, p] {
+                // Unblocks the fan-out, also if the consumer failed.
+                struct Aborter {
+                    BlockQueue<T> & queue;
+                    ~Aborter() { queue.abort(); }
+                } const aborter{queue};
+                consume(p, FanOutSource<T>{queue});
+            });
+            if (!threaded) { break; }
+            partition->block.reserve(m_block_size);
+            m_threaded.push_back(std::move(partition));
+        }
+
+        // Each pass reads the source once, and one partition without a thread
+        // is consumed in the calling thread meanwhile. The first pass also
+        // feeds the partitions with a thread.
+        for (std::size_t first = 0u, p = m_threaded.size(); first < m_partitions; ++p) {
+            auto const end = std::min(p + 1u, m_partitions);
+            pass(first, end, p);
+            if (first == 0u) {
+                for (auto & partition : m_threaded) {
+                    if (!partition->block.empty()) { flush(*partition); }
+                    partition->queue.close();
+                }
+            }
+            first = end;
+        }
+
+        // Rethrows the exception of a failed consumer.
+        for (auto & partition : m_threaded) { partition->job.wait(); }
+    }
+
+private: /* Types: */
+    struct Partition {
+        std::vector<T> block = {};
+        /** The consumer works on one block, and one is filled meanwhile. */
+        BlockQueue<T> queue{2u};
+        /** Declared last, so it is destroyed (i.e. waited for) first. */
+        BackgroundJob job = {};
+
+        /** Fails the consumer if the fan-out failed. */
+        ~Partition() { queue.abort(); }
+    };
+
+private: /* Methods: */
+    /** Reads the source for the partitions [first, end), of which `own` (if
+     * any) is consumed by the calling thread. */
+    void pass(std::size_t const first, std::size_t const end, std::size_t const own) {
+        auto source = m_make_source(first, end);
+        auto const read = [&](T & result) -> bool {
+            while (source.next(result)) {
+                auto const p = m_partition_of(result);
+                assert(p < m_partitions);
+                if (p == own) { return true; }
+                if (first == 0u && p < m_threaded.size()) {
+                    auto & partition = *m_threaded[p];
+                    partition.block.push_back(result);
+                    if (partition.block.size() >= m_block_size) { flush(partition); }
+                }
+                // Otherwise, the element is consumed by another pass.
+            }
+            return false;
+        };
+        if (own < m_partitions) { m_consume(own, FanOutSource<T>{read}); }
+        // The rest is for the partitions with a thread, e.g. all of the source
+        // if each partition has one.
+        T e;
+        while (read(e)) {}
+    }
+
+    void flush(Partition & partition) {
+        if (!partition.queue.push(partition.block)) {
+            // The consumer ended early, most likely as it failed.
+            partition.job.wait();
+            throw sharemind_hi::enclave::EnclaveException(
+                    "fanOut: A consumer ended before its input.");
+        }
+        partition.block.reserve(m_block_size);
+    }
+
+private: /* Fields: */
+    MakeSource m_make_source;
+    PartitionOf m_partition_of;
+    Consume m_consume;
+    std::size_t m_partitions;
+    /** Number of elements per block. */
+    std::size_t m_block_size;
+    /** Declared last, as the consumers refer to the other fields. */
+    std::vector<std::unique_ptr<Partition>> m_threaded = {};
+};
+
+/**
+   Splits the elements of a source into `partitions` partitions, each element
+   into the partition `partition_of` returns for it, and passes each partition
+   as a `FanOutSource` to `consume`, which is called once per partition. The
+   order of the elements is retained within each partition. Nothing is
+   written to disk.
+
+   Each partition which gets a thread is consumed on its own `BackgroundJob`,
+   while the calling thread reads the source and hands the elements over in
+   blocks of about `block_bytes`. At most two blocks per partition are
+   buffered, so the reading waits for a slow consumer. Each other partition
+   is consumed in the calling thread, which reads the source once more for
+   each of them after the first. The source is created for each read with
+   `make_source(first, end)`, where the partitions [first, end) are the ones
+   the read is for, so it may leave out the elements of the other partitions.
+ */
+template <
+        /** Source(std::size_t first, std::size_t end), see above. */
+        typename MakeSource,
+        /** std::size_t(Source::Out const &), less than `partitions`. */
+        typename PartitionOf,
+        /** void(std::size_t partition, FanOutSource<Source::Out> source), may
+         * be called by several threads at the same time. */
+        typename Consume>
+inline void fanOut(MakeSource make_source,
+                   PartitionOf partition_of,
+                   Consume consume,
+                   std::size_t partitions,
+                   std::size_t block_bytes)
+{
+    FanOut<MakeSource, PartitionOf, Consume>{std::move(make_source),
+                                             std::move(partition_of),
+                                             std::move(consume),
+                                             partitions,
+                                             block_bytes}
+            .run();
+}
+
+
 } // namespace enclave
 } // namespace eurostat
@@ -0,0 +1,432 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include "DenseTileIds.h"
+#include "Entities.h"
+#include "SgxEncryptedFile.h"
+#include "StreamAdditions.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sharemind-hi/enclave/common/Log.h>
+#include <sharemind-hi/enclave/task/stream/Streams_detail.h>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace eurostat {
+namespace enclave {
+
+/** The tile by which the keys of `aggregateByTile` are partitioned. */
+inline TileIndex aggregationTile(TileIndex const tile) noexcept { return tile; }
+
+template <typename KeyOf, typename Init, typename Sq, typename Builder>
+struct TileAggregationBuilder {
+    using Category = sharemind_hi::enclave::stream::detail::SinkCategory;
+
+    TileAggregationBuilder(TileAggregationBuilder &&) noexcept = default;
+
+    explicit TileAggregationBuilder(KeyOf key_of,
+                                    Init init,
+                                    Sq squash,
+                                    std::size_t memory_bytes,
+                                    std::string temporary_path_prefix,
+                                    Builder sb2)
+        : m_key_of{std::move(key_of)}
+        , m_init{std::move(init)}
+        , m_squash{std::move(squash)}
+        , m_memory_bytes{memory_bytes}
+        , m_temporary_path_prefix{std::move(temporary_path_prefix)}
+        , m_builder{std::move(sb2)}
+    { }
+
+    template <typename T>
+    struct Impl {
+        using In = T;
+        using Key = typename std::decay<typename std::result_of<KeyOf(T const &)>::type>::type;
+        using Mid = typename std::decay<typename std::result_of<Init(T const &)>::type>::type;
+        using Sink = typename Builder::template Impl<Mid>;
+        using Res = typename Sink::Res;
+
+        /** Partitions per spilling level, selected by 4 bits of the tile. */
+        static constexpr std::size_t PARTITIONS = 16;
+        /** Each level selects the partition by the next lower 4 bits of the
+         * 32 bit tile, so after this many levels a partition holds a single
+         * tile. */
+        static constexpr std::size_t TILE_DEPTH = 32 / 4;
+        /** The levels after `TILE_DEPTH` select the partition by the next 4
+         * bits of the 32 bit key hash, from the lowest ones on, as `DenseIds`
+         * uses the upper ones. Only after this many levels, the keys are all
+         * aggregated in memory, which then have the same tile and hash. */
+        static constexpr std::size_t MAX_DEPTH = TILE_DEPTH + 32 / 4;
+        static constexpr std::size_t SPILL_BUFFER_BYTES = 64 * 1024;
+
+        Impl(Impl &&) noexcept = default;
+
+        explicit Impl(KeyOf key_of,
+                      Init init,
+                      Sq squash,
+                      std::size_t memory_bytes,
+                      std::string temporary_path_prefix,
+                      Sink sink)
+            : m_key_of{std::move(key_of)}
+            , m_init{std::move(init)}
+            , m_squash{std::move(squash)}
+            // The aggregate, the key and up to four hash table slots.
+            , m_max_keys{std::max<std::size_t>(
+                      memory_bytes / (sizeof(Mid) + sizeof(Key)
+                                      + 4u * sizeof(typename DenseIds<Key>::Id)),
+                      1u)}
+            , m_temporary_path_prefix{std::move(temporary_path_prefix)}
+            , m_sink{std::move(sink)}
+            , m_top{new Level{0u}}
+        { }
+
+        void sink(In const & argument) { add(*m_top, argument); }
+
+        Res finalize() && {
+            SinkWriter writer{m_sink};
+            finish(*m_top, writer);
+            m_top.reset();
+            return std::move(m_sink).finalize();
+        }
+
+    private: /* Types: */
+        struct Partition {
+            TemporaryEncryptedFile file;
+            std::unique_ptr<SgxEncryptedFile> writer;
+            std::vector<In> buffer;
+        };
+
+        /** An aggregate of a spilling level, handed to the next level. */
+        struct Seed {
+            Key key;
+            Mid aggregate;
+        };
+
+        /** Writes aggregates as `Seed`s into a temporary file. */
+        struct SeedWriter {
+            SgxEncryptedFile file;
+            std::vector<Seed> buffer = {};
+
+            explicit SeedWriter(SgxEncryptedFile f) : file{std::move(f)} {
+                buffer.reserve(std::max<std::size_t>(SPILL_BUFFER_BYTES / sizeof(Seed), 1u));
+            }
+
+            void operator()(Key const & key, Mid const & aggregate) {
+                buffer.push_back(Seed{key, aggregate});
+                if (buffer.size() >= buffer.capacity()) { flush(); }
+            }
+
+            void flush() {
+                if (buffer.empty()) { return; }
+                file.write(buffer.data(), buffer.size() * sizeof(Seed));
+                buffer.clear();
+            }
+        };
+
+        /** Passes the aggregates of the top level on. */
+        struct SinkWriter {
+            Sink & sink;
+
+            void operator()(Key const &, Mid const & aggregate) { sink.sink(aggregate); }
+        };
+
+        /**
+           The aggregates which fit into memory, and the partitions the records
+           of the other keys are spilled to. Each partition is aggregated on
+           the next level once this level is done, together with the
+           aggregates of this level which belong to it.
+         */
+        struct Level {
+            explicit Level(std::size_t d) : depth{d} {}
+
+            std::size_t depth;
+            DenseIds<Key> key_ids = {};
+            /** Indexed by the key id. */
+            std::vector<Mid> aggregates = {};
+            std::vector<Partition> partitions = {};
+        };
+
+    private: /* Methods: */
+        /** The partitions of a level up to `TILE_DEPTH` are ranges of tiles
+         * in tile order, the ones of the further levels are not ordered. */
+        static std::size_t partitionOf(Key const & key, std::size_t const depth) noexcept {
+            if (depth >= TILE_DEPTH) {
+                return (denseIdHash(key) >> (4u * (depth - TILE_DEPTH))) & (PARTITIONS - 1u);
+            }
+            auto const tile = aggregationTile(key);
+            auto const bits = (std::uint32_t{tile.easting} << 16u) | tile.northing;
+            return (bits >> (28u - 4u * depth)) & (PARTITIONS - 1u);
+        }
+
+        void add(Level & level, In const & argument) {
+            auto const key = m_key_of(argument);
+            auto id = level.key_ids.find(key);
+            if (id == DenseIds<Key>::none) {
+                if (level.aggregates.size() >= m_max_keys && level.depth < MAX_DEPTH) {
+                    spill(level, key, argument);
+                    return;
+                }
+                id = level.key_ids.insert(key);
+                level.aggregates.push_back(m_init(argument));
+            }
+            m_squash(level.aggregates[id], argument);
+        }
+
+        void spill(Level & level, Key const & key, In const & argument) {
+            auto const buffer_size = std::max<std::size_t>(SPILL_BUFFER_BYTES / sizeof(In), 1u);
+            if (level.partitions.empty()) {
+#ifndef NDEBUG
+                enclave_printf_log("TileAggregation: Spilling at level %zu after %zu keys",
+                                   level.depth,
+                                   level.aggregates.size());
+#endif
+                level.partitions.reserve(PARTITIONS);
+                for (std::size_t p = 0; p < PARTITIONS; ++p) {
+                    level.partitions.push_back(Partition{
+                            TemporaryEncryptedFile{m_temporary_path_prefix
+                                                   + std::to_string(level.depth) + "_"
+                                                   + std::to_string(p)},
+                            nullptr,
+                            {}});
+                    auto & partition = level.partitions.back();
+                    partition.writer.reset(new SgxEncryptedFile{partition.file.openForWriting()});
+                    partition.buffer.reserve(buffer_size);
+                }
+            }
+
+            auto & partition = level.partitions[partitionOf(key, level.depth)];
+            partition.buffer.push_back(argument);
+            if (partition.buffer.size() >= buffer_size) { flush(partition); }
+        }
+
+        static void flush(Partition & partition) {
+            partition.writer->write(partition.buffer.data(), partition.buffer.size() * sizeof(In));
+            partition.buffer.clear();
+        }
+
+        /** Passes the aggregates of `level` on in key order, to
+         * `write(key, aggregate)`. */
+        template <typename Writer>
+        void finish(Level & level, Writer & write) {
+            using Id = typename DenseIds<Key>::Id;
+            std::vector<Id> order(level.aggregates.size());
+            for (std::size_t i = 0; i < order.size(); ++i) { order[i] = static_cast<Id>(i); }
+            auto const & key_ids = level.key_ids;
+            std::sort(order.begin(), order.end(), [&key_ids](Id a, Id b) {
+                return key_ids.key(a) < key_ids.key(b);
+            });
+            if (level.partitions.empty()) {
+                for (auto const id : order) { write(key_ids.key(id), level.aggregates[id]); }
+                return;
+            }
+
+            // Otherwise, the aggregates are spilled along with the records
+            // of their partition, in key order.
+            std::vector<TemporaryEncryptedFile> seed_files;
+            seed_files.reserve(PARTITIONS);
+            for (std::size_t p = 0; p < PARTITIONS; ++p) {
+                seed_files.emplace_back(m_temporary_path_prefix + std::to_string(level.depth) + "_"
+                                        + std::to_string(p) + "_seeds");
+                SeedWriter seeds{seed_files.back().openForWriting()};
+                for (auto const id : order) {
+                    if (partitionOf(key_ids.key(id), level.depth) == p) {
+                        seeds(key_ids.key(id), level.aggregates[id]);
+                    }
+                }
+                seeds.flush();
+            }
+            std::vector<Id>().swap(order);
+            std::vector<Mid>().swap(level.aggregates);
+            level.key_ids = DenseIds<Key>{};
+
+            for (auto & partition : level.partitions) {
+                if (!partition.buffer.empty()) { flush(partition); }
+                partition.writer.reset();
+                std::vector<In>().swap(partition.buffer);
+            }
+            // The partitions of the tile levels are passed on one after
+            // another, so all of them are in key order. The ones of the hash
+            // levels are written into a file each, which are merged.
+            std::vector<TemporaryEncryptedFile> result_files;
+            for (std::size_t p = 0; p < PARTITIONS; ++p) {
+                Level next{level.depth + 1u};
+                {
+                    // There are at most as many seeds as keys fit into memory.
+                    PersistentDataSource<Seed, SgxEncryptedFile> source{
+                            seed_files[p].path().c_str(), SPILL_BUFFER_BYTES, seed_files[p].key()};
+                    Seed seed;
+                    while (source.next(seed)) {
+                        next.key_ids.insert(seed.key);
+                        next.aggregates.push_back(seed.aggregate);
+                    }
+                }
+                auto const & partition = level.partitions[p];
+                {
+                    PersistentDataSource<In, SgxEncryptedFile> source{
+                            partition.file.path().c_str(), SPILL_BUFFER_BYTES, partition.file.key()};
+                    In e;
+                    while (source.next(e)) { add(next, e); }
+                }
+                if (level.depth < TILE_DEPTH) {
+                    finish(next, write);
+                    continue;
+                }
+                result_files.emplace_back(m_temporary_path_prefix + std::to_string(level.depth) + "_"
+                                          + std::to_string(p) + "_result");
+                SeedWriter result{result_files.back().openForWriting()};
+                finish(next, result);
+                result.flush();
+            }
+            level.partitions.clear();
+            if (result_files.empty()) { return; }
+
+            std::vector<PersistentDataSource<Seed, SgxEncryptedFile>> results;
+            results.reserve(result_files.size());
+            for (auto const & file : result_files) {
+                results.push_back(PersistentDataSource<Seed, SgxEncryptedFile>{
+                        file.path().c_str(), SPILL_BUFFER_BYTES, file.key()});
+            }
+            // The partitions hold distinct keys.
+            auto merged = mergeSorted(std::move(results), [](Seed const & a, Seed const & b) {
+                return a.key < b.key;
+            });
+            Seed seed;
+            while (merged.next(seed)) { write(seed.key, seed.aggregate); }
+        }
+
+    private: /* Fields: */
+        KeyOf m_key_of;
+        Init m_init;
+        Sq m_squash;
+        /** Number of distinct keys aggregated in memory per level. */
+        std::size_t m_max_keys;
+        std::string m_temporary_path_prefix;
+        Sink m_sink;
+        /** On the heap, so `Impl` stays movable. */
+        std::unique_ptr<Level> m_top;
+    };
+
+    template <typename T>
+    Impl<T> build() && {
+        using Mid = typename Impl<T>::Mid;
+        return Impl<T>{std::move(m_key_of),
+                       std::move(m_init),
+                       std::move(m_squash),
+                       m_memory_bytes,
+                       std::move(m_temporary_path_prefix),
+                       std::move(m_builder).template build<Mid>()};
+    }
+
+private: /* Fields: */
+    KeyOf m_key_of;
+    Init m_init;
+    Sq m_squash;
+    std::size_t m_memory_bytes;
+    std::string m_temporary_path_prefix;
+    Builder m_builder;
+};
+
+template <typename KeyOf, typename Init, typename Sq>
+struct TileAggregationPipe {
+    using Category = sharemind_hi::enclave::stream::detail::PipeCategory;
+
+    template <typename In>
+    using Out = typename std::decay<typename std::result_of<Init(In const &)>::type>::type;
+
+    TileAggregationPipe(TileAggregationPipe &&) noexcept = default;
+
+    explicit TileAggregationPipe(KeyOf key_of,
+                                 Init init,
+                                 Sq squash,
+                                 std::size_t memory_bytes,
+                                 std::string temporary_path_prefix)
+        : m_key_of{std::move(key_of)}
+        , m_init{std::move(init)}
+        , m_squash{std::move(squash)}
+        , m_memory_bytes{memory_bytes}
+        , m_temporary_path_prefix{std::move(temporary_path_prefix)}
+    {}
+
+    template <typename Builder>
+    using InBuilder = TileAggregationBuilder<KeyOf, Init, Sq, Builder>;
+
+    template <typename Builder>
+    InBuilder<Builder> build(Builder down) && {
+        return InBuilder<Builder>{std::move(m_key_of),
+                                  std::move(m_init),
+                                  std::move(m_squash),
+                                  m_memory_bytes,
+                                  std::move(m_temporary_path_prefix),
+                                  std::move(down)};
+    }
+
+private: /* Fields: */
+    KeyOf m_key_of;
+    Init m_init;
+    Sq m_squash;
+    std::size_t m_memory_bytes;
+    std::string m_temporary_path_prefix;
+};
+
+/**
+   Squashes all elements with the same key, usually a tile, into one element,
+   like `sort` followed by `squash`, but with a hash aggregation instead of
+   sorting. The input does not need to be in any order.
+
+   The aggregates of up to `memory_bytes` worth of distinct keys are kept in
+   memory. The elements of further keys are spilled into temporary files
+   (`temporary_path_prefix` followed by the level and the partition number),
+   which are partitioned by ranges of tiles and aggregated one after another
+   in the end, each together with the aggregates in memory of its range. The
+   keys of a single tile which do not fit are partitioned by their hash
+   instead, and the aggregates of these partitions are merged from temporary
+   files, so memory stays bounded also for a tile with many keys. The
+   aggregates are passed on in key order.
+
+   A key other than a `TileIndex` needs the overloads `aggregationTile(key)`,
+   the tile it is partitioned by, and `denseIdHash(key)`, see `DenseIds`. Its
+   `operator<` orders by that tile first.
+ */
+template <
+        /** Key(I const &) */
+        typename KeyOf,
+        /** Initialize the accumulator with the first element to `O`. O(I const &) */
+        typename Init,
+        /** Squash elements together, also the first element. void(O &, I const &) */
+        typename Sq>
+inline TileAggregationPipe<KeyOf, Init, Sq> aggregateByTile(KeyOf key_of,
+                                                            Init init,
+                                                            Sq squash,
+                                                            std::size_t memory_bytes,
+                                                            std::string temporary_path_prefix)
+{
+    return TileAggregationPipe<KeyOf, Init, Sq>{std::move(key_of),
+                                                std::move(init),
+                                                std::move(squash),
+                                                memory_bytes,
+                                                std::move(temporary_path_prefix)};
+}
+
+} // namespace enclave
+} // namespace eurostat
@@ -0,0 +1,275 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+#pragma once
+
+#include "DenseTileIds.h"
+#include "Entities.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace eurostat {
+namespace enclave {
+
+/**
+   A map from tiles to values without hashing, for tiles which cover a bounded
+   area like a national grid.
+
+   The grid is divided into blocks of 16 x 16 tiles, which are allocated when
+   the first of their tiles is inserted. A directory of the blocks covers the
+   bounding box of the inserted tiles and grows with it. Looking up a tile is
+   then a directory and a block access.
+
+   If the tiles are too scattered for this, i.e. the directory would get very
+   large or the blocks are mostly empty, the map falls back to a hash table
+   (`DenseTileIds`).
+
+   `forEach` visits the tiles in the order of `TileIndex`'s operator<. Pointers
+   and references to the values stay valid until the map falls back to the
+   hash table.
+ */
+template <typename V>
+class TileGrid {
+public: /* Methods: */
+    V const * find(TileIndex const tile) const noexcept {
+        if (m_sparse) {
+            auto const id = m_tile_ids.find(tile);
+            return id == DenseTileIds::none ? nullptr : &m_values[id];
+        }
+        auto const block = findBlock(tile);
+        if (!block) { return nullptr; }
+        auto const local = localIndex(tile);
+        return block->isPresent(local) ? &block->values[local] : nullptr;
+    }
+
+    V * find(TileIndex const tile) noexcept {
+        return const_cast<V *>(static_cast<TileGrid const &>(*this).find(tile));
+    }
+
+    /** Returns the value of `tile`, which is value initialized if it is new. */
+    V & operator[](TileIndex const tile) {
+        if (auto const value = find(tile)) { return *value; }
+        return add(tile, V{});
+    }
+
+    /** Adds `tile` with `value`, if `tile` is new. Returns whether it was. */
+    bool insert(TileIndex const tile, V value) {
+        if (find(tile)) { return false; }
+        add(tile, std::move(value));
+        return true;
+    }
+
+    std::size_t size() const noexcept { return m_size; }
+
+    bool empty() const noexcept { return m_size == 0u; }
+
+    /** Calls `f(TileIndex, V const &)` for each tile, in tile order. */
+    template <typename F>
+    void forEach(F && f) const {
+        if (m_sparse) {
+            std::vector<DenseTileIds::Id> order(m_values.size());
+            for (std::size_t i = 0; i < order.size(); ++i) {
+                order[i] = static_cast<DenseTileIds::Id>(i);
+            }
+            auto const & tile_ids = m_tile_ids;
+            std::sort(order.begin(), order.end(), [&tile_ids](DenseTileIds::Id a, DenseTileIds::Id b) {
+                return tile_ids.key(a) < tile_ids.key(b);
+            });
+            for (auto const id : order) { f(m_tile_ids.key(id), m_values[id]); }
+            return;
+        }
+
+        for (std::size_t bx = 0; bx < m_width; ++bx) {
+            for (std::size_t ex = 0; ex < BLOCK_SIDE; ++ex) {
+                for (std::size_t by = 0; by < m_height; ++by) {
+                    auto const entry = m_directory[bx * m_height + by];
+                    if (entry == 0u) { continue; }
+                    auto const & block = *m_blocks[entry - 1u];
+                    for (std::size_t ny = 0; ny < BLOCK_SIDE; ++ny) {
+                        auto const local = ex * BLOCK_SIDE + ny;
+                        if (!block.isPresent(local)) { continue; }
+                        f(TileIndex{static_cast<std::uint16_t>((m_x0 + bx) * BLOCK_SIDE + ex),
+                                    static_cast<std::uint16_t>((m_y0 + by) * BLOCK_SIDE + ny)},
+                          block.values[local]);
+                    }
+                }
+            }
+        }
+    }
+
+private: /* Types: */
+    static constexpr std::size_t BLOCK_BITS = 4;
+    static constexpr std::size_t BLOCK_SIDE = std::size_t{1} << BLOCK_BITS;
+    static constexpr std::size_t BLOCK_TILES = BLOCK_SIDE * BLOCK_SIDE;
+    /** Number of blocks along each axis of the whole grid. */
+    static constexpr std::size_t GRID_BLOCKS = (std::size_t{1} << 16u) / BLOCK_SIDE;
+    /** Above this, the directory alone would take more than 4 MiB. */
+    static constexpr std::size_t MAX_DIRECTORY_SIZE = std::size_t{1} << 20u;
+    /** Below this fill rate of the blocks (in tiles per block), the hash
+     * table is used instead. */
+    static constexpr std::size_t MIN_TILES_PER_BLOCK = BLOCK_TILES / 16u;
+    static constexpr std::size_t MIN_BLOCKS_FOR_FALLBACK = 64;
+
+    struct Block {
+        std::array<V, BLOCK_TILES> values = {};
+        std::array<std::uint64_t, BLOCK_TILES / 64u> present = {};
+
+        bool isPresent(std::size_t const local) const noexcept {
+            return (present[local / 64u] >> (local % 64u)) & 1u;
+        }
+    };
+
+private: /* Methods: */
+    static std::size_t localIndex(TileIndex const tile) noexcept {
+        return (tile.easting % BLOCK_SIDE) * BLOCK_SIDE + tile.northing % BLOCK_SIDE;
+    }
+
+    bool inBox(std::size_t const bx, std::size_t const by) const noexcept {
+        return bx >= m_x0 && bx - m_x0 < m_width && by >= m_y0 && by - m_y0 < m_height;
+    }
+
+    Block const * findBlock(TileIndex const tile) const noexcept {
+        std::size_t const bx = tile.easting / BLOCK_SIDE;
+        std::size_t const by = tile.northing / BLOCK_SIDE;
+        if (!inBox(bx, by)) { return nullptr; }
+        auto const entry = m_directory[(bx - m_x0) * m_height + (by - m_y0)];
+        return entry == 0u ? nullptr : m_blocks[entry - 1u].get();
+    }
+
+    /** Precondition: `tile` is not in the map. */
+    V & add(TileIndex const tile, V value) {
+        if (!m_sparse) {
+            std::size_t const bx = tile.easting / BLOCK_SIDE;
+            std::size_t const by = tile.northing / BLOCK_SIDE;
+            if (!inBox(bx, by)) { growBox(bx, by); }
+        }
+        if (!m_sparse && !findBlock(tile)
+            && m_blocks.size() >= MIN_BLOCKS_FOR_FALLBACK
+            && m_size < (m_blocks.size() + 1u) * MIN_TILES_PER_BLOCK)
+        {
+            switchToHashTable();
+        }
+        ++m_size;
+
+        if (m_sparse) {
+            auto const id = m_tile_ids.insert(tile);
+            m_values.push_back(std::move(value));
+            return m_values[id];
+        }
+
+        auto & entry = m_directory[(tile.easting / BLOCK_SIDE - m_x0) * m_height
+                                   + (tile.northing / BLOCK_SIDE - m_y0)];
+        if (entry == 0u) {
+            m_blocks.emplace_back(new Block{});
+            entry = static_cast<std::uint32_t>(m_blocks.size());
+        }
+        auto & block = *m_blocks[entry - 1u];
+        auto const local = localIndex(tile);
+        block.present[local / 64u] |= std::uint64_t{1} << (local % 64u);
+        block.values[local] = std::move(value);
+        return block.values[local];
+    }
+
+    /** Grows the directory to also cover block (`bx`, `by`), with some
+     * slack to not grow again for every new block. */
+    void growBox(std::size_t const bx, std::size_t const by) {
+        auto const slack = [](std::size_t extent) { return std::max<std::size_t>(extent / 4u, 4u); };
+        std::size_t x0 = bx, x1 = bx + 1u, y0 = by, y1 = by + 1u;
+        if (m_width > 0u) {
+            x0 = std::min(x0, m_x0);
+            x1 = std::max(x1, m_x0 + m_width);
+            y0 = std::min(y0, m_y0);
+            y1 = std::max(y1, m_y0 + m_height);
+            if (x0 < m_x0) { x0 = x0 > slack(x1 - x0) ? x0 - slack(x1 - x0) : 0u; }
+            if (x1 > m_x0 + m_width) { x1 = std::min(x1 + slack(x1 - x0), GRID_BLOCKS); }
+            if (y0 < m_y0) { y0 = y0 > slack(y1 - y0) ? y0 - slack(y1 - y0) : 0u; }
+            if (y1 > m_y0 + m_height) { y1 = std::min(y1 + slack(y1 - y0), GRID_BLOCKS); }
+        }
+        if ((x1 - x0) * (y1 - y0) > MAX_DIRECTORY_SIZE) {
+            switchToHashTable();
+            return;
+        }
+
+        std::vector<std::uint32_t> directory((x1 - x0) * (y1 - y0), 0u);
+        for (std::size_t x = 0; x < m_width; ++x) {
+            for (std::size_t y = 0; y < m_height; ++y) {
+                directory[(m_x0 + x - x0) * (y1 - y0) + (m_y0 + y - y0)] =
+                        m_directory[x * m_height + y];
+            }
+        }
+        m_directory = std::move(directory);
+        m_x0 = x0;
+        m_y0 = y0;
+        m_width = x1 - x0;
+        m_height = y1 - y0;
+    }
+
+    void switchToHashTable() {
+        std::vector<V> values;
+        values.reserve(m_size);
+        DenseTileIds tile_ids;
+        forEach([&](TileIndex const tile, V const & value) {
+            tile_ids.insert(tile);
+            values.push_back(value);
+        });
+        m_tile_ids = std::move(tile_ids);
+        m_values = std::move(values);
+        std::vector<std::uint32_t>().swap(m_directory);
+        std::vector<std::unique_ptr<Block>>().swap(m_blocks);
+        m_width = m_height = 0u;
+        m_sparse = true;
+    }
+
+private: /* Fields: */
+    std::size_t m_size = 0;
+
+    /** The box covered by the directory, in blocks. */
+    std::size_t m_x0 = 0;
+    std::size_t m_y0 = 0;
+    std::size_t m_width = 0;
+    std::size_t m_height = 0;
+    /** Block index plus one for each block in the box, column-major, zero if
+     * the block was not allocated. */
+    std::vector<std::uint32_t> m_directory;
+    std::vector<std::unique_ptr<Block>> m_blocks;
+
+    /** The fallback, used if `m_sparse`. */
+    bool m_sparse = false;
+    DenseTileIds m_tile_ids;
+    std::vector<V> m_values;
+};
+
+template <typename V> constexpr std::size_t TileGrid<V>::BLOCK_SIDE;
+template <typename V> constexpr std::size_t TileGrid<V>::BLOCK_TILES;
+template <typename V> constexpr std::size_t TileGrid<V>::GRID_BLOCKS;
+template <typename V> constexpr std::size_t TileGrid<V>::MAX_DIRECTORY_SIZE;
+template <typename V> constexpr std::size_t TileGrid<V>::MIN_TILES_PER_BLOCK;
+template <typename V> constexpr std::size_t TileGrid<V>::MIN_BLOCKS_FOR_FALLBACK;
+
+/** Not SDC filtered. */
+using TopAnchorDistribution = TileGrid<std::uint32_t>;
+
+// Needs to be built up from the `CensusResident` input.
+using CensusResidents = TileGrid<double>;
+
+} // namespace enclave
+} // namespace eurostat
@@ -20,7 +20,8 @@ set -euo pipefail
 
 # This test fully processes a single report request. The NSI and VAD scripts
 # are used for the interaction with the enclaves, but for performance reasons
-# the pseudonymisation is done with `generate_pseudonyms.c`. The amount of
+# the pseudonymisation is done with `generate_pseudonyms.c`. Optionally, the
+# whole H files are generated with `generate_h_file.cpp`. The amount of
 # generated data is configurable through the variables in the beginning of
 # the test.
 #
@@ -57,6 +58,12 @@ tiles_per_subperiod=5 # generator
 duplicate_count=10 # generator
 # simple_generator, circle_generator, generator
 python_generator=generator
+# Generate the footprint updates with `generate_h_file.cpp` instead of the
+# python generator, which is a lot faster. The python generator is still used
+# for the reference areas and residents files, and the native generator picks
+# its tiles from the residents file. Uses user_count, duplicate_count,
+# tiles_per_subperiod and the fill_subperiod_* probabilities.
+native_generator=false
 
 with_calibration=true
 
@@ -90,13 +97,18 @@ nd="client1.yaml"
 vad="client2.yaml"
 nsi="client3.yaml"
 
-if [ "$python_generator" = generator ]; then
+if [ "$python_generator" = generator ] || $native_generator; then
     total_user_count="$(( user_count * (duplicate_count + 1) ))"
 else
     total_user_count=$user_count
 fi
 
-if [ $(( num_days * total_user_count )) -gt 100000 ]; then
+if $native_generator; then
+    # The python comparison maps the pseudonyms back to IDs by their order in
+    # the H file, but the native generator sorts the records by the IDs.
+    compare_against_python=false
+    warn "Skipping the output verification (the native generator is used)."
+elif [ $(( num_days * total_user_count )) -gt 100000 ]; then
     # If there is too much data, then the analysis.py script will take a lot
     # of time. This much data is only relevant for the benchmark, not for
     # validating the correctness of the application logic.
@@ -250,6 +262,13 @@ generate_pseudonyms_bin=generate-pseudonyms
 # require OpenSSL, so it is rather safe to assume that it is available.
 gcc -O2 "$dir/generate_pseudonyms.c" -lcrypto -o "$generate_pseudonyms_bin"
 
+# Same for the native H file generator, the workers share the cores.
+generate_h_file_bin=generate-h-file
+generate_h_file_threads="$(( ($(nproc) + data_generator_parallelism - 1) / data_generator_parallelism ))"
+if $native_generator; then
+    g++ -O2 -std=c++11 -pthread "$dir/generate_h_file.cpp" -lcrypto -o "$generate_h_file_bin"
+fi
+
 generate_h_file() {
     # $1 period
     # $2 worker index [0, data_generator_parallelism)
@@ -274,23 +293,39 @@ generate_h_file() {
             --datafile "periodic_key$2"
 
     say "[Period $period] Generating the footprint updates (background worker)"
+    local key_hex
+    key_hex="$(<"periodic_key$2" tail -c 16 | od -A x -t x1 -v | head -n1 | sed 's/ //g' | tail -c 33)"
     time_gen_start="$(current_time)"
-    "./$generate_pseudonyms_bin" \
-        "$(<"periodic_key$2" tail -c 16 | od -A x -t x1 -v | head -n1 | sed 's/ //g' | tail -c 33)" \
-        "$total_user_count" \
-    | "$dir/../data-generator.py" \
-        --period "$period" \
-        --prototype-dir "$prototype_path" \
-        --data-generator-dir "$data_generator_path" \
-        --user-count "$user_count" \
-        --days "$num_days" \
-        --tiles-per-user "$tiles_per_user" \
-        --tiles-per-subperiod "$tiles_per_subperiod" \
-        --night-prob "$fill_subperiod_from_night_tile_probability" \
-        --day-prob "$fill_subperiod_from_day_tile_probability" \
-        --area-width "$area_width" \
-        --duplicate-count "$duplicate_count" \
-        --generator "$python_generator"
+    if $native_generator; then
+        "./$generate_h_file_bin" \
+            --period "$period" \
+            --users "$user_count" \
+            --duplicates "$duplicate_count" \
+            --tiles-per-subperiod "$tiles_per_subperiod" \
+            --night-prob "$fill_subperiod_from_night_tile_probability" \
+            --day-prob "$fill_subperiod_from_day_tile_probability" \
+            --residents "$census_residents" \
+            --threads "$generate_h_file_threads" \
+            "$key_hex" \
+            "$test_data_dir/day-$(period_to_date "$period")-updates.hdata"
+    else
+        "./$generate_pseudonyms_bin" \
+            "$key_hex" \
+            "$total_user_count" \
+        | "$dir/../data-generator.py" \
+            --period "$period" \
+            --prototype-dir "$prototype_path" \
+            --data-generator-dir "$data_generator_path" \
+            --user-count "$user_count" \
+            --days "$num_days" \
+            --tiles-per-user "$tiles_per_user" \
+            --tiles-per-subperiod "$tiles_per_subperiod" \
+            --night-prob "$fill_subperiod_from_night_tile_probability" \
+            --day-prob "$fill_subperiod_from_day_tile_probability" \
+            --area-width "$area_width" \
+            --duplicate-count "$duplicate_count" \
+            --generator "$python_generator"
+    fi
     time_gen_end="$(current_time)"
     time_gen="$(timediff "$time_gen_start" "$time_gen_end")"
     say "[Period $period] Finished the footprint updates (background worker) (${time_gen}s)"
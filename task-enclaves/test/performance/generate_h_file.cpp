@@ -0,0 +1,765 @@
+/*
+* Copyright 2021 European Union
+*
+* Licensed under the EUPL, Version 1.2 or – as soon they will be approved by 
+* the European Commission - subsequent versions of the EUPL (the "Licence");
+* You may not use this work except in compliance with the Licence.
+* You may obtain a copy of the Licence at:
+*
+* https://joinup.ec.europa.eu/software/page/eupl
+*
+* Unless required by applicable law or agreed to in writing, software 
+* distributed under the Licence is distributed on an "AS IS" basis,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the Licence for the specific language governing permissions and 
+* limitations under the Licence.
+*/ 
+
+// This file is compiled just-in-time by the performance test and not integrated
+// within the CMake infrastructure, same as `generate_pseudonyms.c`.
+//
+// It writes a binary H file (`PseudonymisedUserFootprintUpdates` records)
+// directly, so the performance test does not need to pipe the pseudonyms
+// through the python data generator. The footprints follow the model of
+// `data-generator/generator.py` (anchors per subperiod, normal or Pareto
+// distributed tile offsets, filling of subperiods), without the vacations.
+// The user identifiers are the ones of `generate_pseudonyms.c`, i.e. the
+// user n has the identifier SHA256(n)[0..12), where the duplicates of the
+// users 1..U are the users U+1..2U and so on.
+//
+// The output is deterministic for a given seed and period, regardless of the
+// number of threads. Unless requested otherwise, it is sorted the same way as
+// the enclave sorts the H records, so the enclave can skip sorting it.
+
+#include <openssl/evp.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <initializer_list>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t id_bytes = 12;
+constexpr std::size_t hmac_bytes = 4;
+constexpr std::size_t pseudonym_bytes = id_bytes + hmac_bytes;
+constexpr double pareto_shape = 1.1;
+constexpr double pareto_scale = 2;
+constexpr double fill_max = 1;
+/** The offsets of the day and evening anchors from the night anchor, in
+ * multiples of the `rtile` parameter. */
+constexpr double anchor_spread = 4;
+/** Give up on finding a tile inside the area after this many attempts and
+ * use the anchor tile instead. */
+constexpr int max_attempts = 100;
+
+using UserIdentifier = std::array<std::uint8_t, id_bytes>;
+using Pseudonym = std::array<std::uint8_t, pseudonym_bytes>;
+
+/** Matches `TileIndex`, the enclave compares its raw bytes. */
+struct Tile {
+    std::uint16_t easting;
+    std::uint16_t northing;
+};
+
+bool operator<(Tile const & a, Tile const & b) noexcept {
+    return std::memcmp(&a, &b, sizeof(Tile)) < 0;
+}
+
+bool operator==(Tile const & a, Tile const & b) noexcept {
+    return a.easting == b.easting && a.northing == b.northing;
+}
+
+/** Matches `PseudonymisedUserFootprintUpdates` on a little endian host. */
+struct Record {
+    Pseudonym pseudonym;
+    Tile tile;
+    std::array<float, 4> values;
+};
+static_assert(sizeof(Record) == 36, "Padding in struct.");
+
+struct Options {
+    std::string key_hex;
+    std::string output;
+    std::string residents;
+    std::uint64_t users = 100;
+    std::uint64_t duplicates = 0;
+    std::uint64_t tiles_per_subperiod = 4;
+    std::uint64_t area_width = 20;
+    double silent_probability = 0;
+    double normal_probability = 0.7;
+    double night_probability = 0.4;
+    double day_probability = 0.2;
+    double pec1 = 0.5;
+    double pec2 = 2;
+    double rtile = 2;
+    double duplicate_record_probability = 0;
+    double unsorted_fraction = 0;
+    std::uint64_t period = 0;
+    std::uint64_t seed = 1;
+    std::uint64_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::uint64_t block_users = 4096;
+};
+
+std::uint64_t splitmix64(std::uint64_t & state) noexcept {
+    std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/** Derives independent seeds out of the user given seed and some indices. */
+std::uint64_t derive_seed(std::initializer_list<std::uint64_t> const values) noexcept {
+    std::uint64_t state = 0;
+    for (auto const value : values) {
+        state ^= value;
+        state = splitmix64(state);
+    }
+    return state;
+}
+
+/** xoshiro256+, seeded through splitmix64. */
+class Rng {
+public: /* Methods: */
+    explicit Rng(std::uint64_t seed) noexcept {
+        for (auto & s : m_state) { s = splitmix64(seed); }
+    }
+
+    std::uint64_t next() noexcept {
+        auto const result = m_state[0] + m_state[3];
+        auto const t = m_state[1] << 17;
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = (m_state[3] << 45) | (m_state[3] >> 19);
+        return result;
+    }
+
+    /** In [0, 1). */
+    double uniform() noexcept {
+        return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    double uniform(double const low, double const high) noexcept {
+        return low + uniform() * (high - low);
+    }
+
+    bool bernoulli(double const p) noexcept { return uniform() < p; }
+
+    std::size_t below(std::size_t const n) noexcept {
+        return static_cast<std::size_t>(uniform() * static_cast<double>(n));
+    }
+
+    /** Box-Muller, only one of the two values is used. */
+    double normal(double const scale) noexcept {
+        auto const u1 = 1.0 - uniform();
+        auto const u2 = uniform();
+        return scale * std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+    }
+
+    /** Pareto II (Lomax) like `numpy.random.pareto`. */
+    double pareto(double const shape) noexcept {
+        return std::pow(1.0 - uniform(), -1.0 / shape) - 1.0;
+    }
+
+private: /* Fields: */
+    std::array<std::uint64_t, 4> m_state;
+};
+
+/**
+   The tiles where users may be. Either a square of `area_width` tiles, or the
+   populated tiles of a residents file (as written by `generator.py`), in which
+   case the night anchors are chosen proportionally to the population.
+ */
+class Area {
+public: /* Methods: */
+    explicit Area(Options const & options) : m_width{options.area_width} {
+        if (options.residents.empty()) {
+            if (m_width == 0u || m_width > 65536u) {
+                throw std::runtime_error("Invalid area width.");
+            }
+            return;
+        }
+
+        std::ifstream in(options.residents);
+        if (!in) { throw std::runtime_error("Failed to open " + options.residents); }
+        std::string line;
+        std::getline(in, line); // header
+        double total = 0;
+        while (std::getline(in, line)) {
+            if (line.empty()) { continue; }
+            char * end = nullptr;
+            auto const e = std::strtol(line.c_str(), &end, 10);
+            auto const n = std::strtol(end + 1, &end, 10);
+            auto const population = std::strtod(end + 1, &end);
+            if (e < 0 || e > 65535 || n < 0 || n > 65535) {
+                throw std::runtime_error("Tile out of range in " + options.residents);
+            }
+            Tile const tile{static_cast<std::uint16_t>(e), static_cast<std::uint16_t>(n)};
+            m_tiles.insert(key(tile));
+            if (population > 0) {
+                total += population;
+                m_populated.push_back(tile);
+                m_cumulative.push_back(total);
+            }
+        }
+        if (m_populated.empty()) {
+            throw std::runtime_error("No populated tiles in " + options.residents);
+        }
+    }
+
+    /** A random position, which is rounded to its tile. */
+    std::array<double, 2> sample(Rng & rng) const noexcept {
+        if (m_populated.empty()) {
+            return {{rng.uniform() * m_width - 0.5, rng.uniform() * m_width - 0.5}};
+        }
+        auto const index = std::upper_bound(m_cumulative.begin(),
+                                            m_cumulative.end(),
+                                            rng.uniform() * m_cumulative.back())
+                           - m_cumulative.begin();
+        auto const & tile = m_populated[std::min<std::size_t>(index, m_populated.size() - 1u)];
+        return {{tile.easting + rng.uniform() - 0.5, tile.northing + rng.uniform() - 0.5}};
+    }
+
+    bool tile_of(double const easting, double const northing, Tile & tile) const {
+        auto const e = std::llround(easting);
+        auto const n = std::llround(northing);
+        if (e < 0 || n < 0) { return false; }
+        if (m_populated.empty()) {
+            if (static_cast<std::uint64_t>(e) >= m_width
+                || static_cast<std::uint64_t>(n) >= m_width)
+            {
+                return false;
+            }
+        } else if (e > 65535 || n > 65535) {
+            return false;
+        }
+        tile = Tile{static_cast<std::uint16_t>(e), static_cast<std::uint16_t>(n)};
+        return m_populated.empty() || m_tiles.count(key(tile)) != 0u;
+    }
+
+private: /* Methods: */
+    static std::uint32_t key(Tile const tile) noexcept {
+        return (std::uint32_t{tile.easting} << 16) | tile.northing;
+    }
+
+private: /* Fields: */
+    std::uint64_t m_width;
+    std::unordered_set<std::uint32_t> m_tiles;
+    std::vector<Tile> m_populated;
+    std::vector<double> m_cumulative;
+};
+
+struct EvpMdCtxDeleter {
+    void operator()(EVP_MD_CTX * const ctx) const noexcept { EVP_MD_CTX_free(ctx); }
+};
+using EvpMdCtx = std::unique_ptr<EVP_MD_CTX, EvpMdCtxDeleter>;
+
+EvpMdCtx new_md_ctx() {
+    EvpMdCtx ctx{EVP_MD_CTX_new()};
+    if (!ctx) { throw std::runtime_error("EVP_MD_CTX_new failed"); }
+    return ctx;
+}
+
+void check(int const result, char const * const what) {
+    if (result != 1) { throw std::runtime_error(std::string(what) + " failed"); }
+}
+
+/**
+   The pseudonymisation of `decrypt_pseudonym` in reverse: The identifier and
+   the first bytes of its HMAC-SHA256 are encrypted with AES-128-CTR and a
+   zero IV. The pseudonym is just a single block, so the AES keystream is
+   computed once, and the HMAC states after the key blocks are reused.
+ */
+class Pseudonymiser {
+public: /* Methods: */
+    explicit Pseudonymiser(std::array<std::uint8_t, 16> const & key) {
+        std::unique_ptr<EVP_CIPHER_CTX, void (*)(EVP_CIPHER_CTX *)> cipher{
+                EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free};
+        if (!cipher) { throw std::runtime_error("EVP_CIPHER_CTX_new failed"); }
+        std::array<std::uint8_t, 16> const iv{};
+        std::array<std::uint8_t, 16> const zeros{};
+        int len = 0;
+        check(EVP_EncryptInit_ex(cipher.get(), EVP_aes_128_ctr(), nullptr, key.data(), iv.data()),
+              "EVP_EncryptInit_ex");
+        check(EVP_EncryptUpdate(cipher.get(), m_keystream.data(), &len, zeros.data(), 16),
+              "EVP_EncryptUpdate");
+
+        std::array<std::uint8_t, 64> ipad;
+        std::array<std::uint8_t, 64> opad;
+        ipad.fill(0x36);
+        opad.fill(0x5c);
+        for (std::size_t i = 0; i < key.size(); ++i) {
+            ipad[i] ^= key[i];
+            opad[i] ^= key[i];
+        }
+        check(EVP_DigestInit_ex(m_inner.get(), EVP_sha256(), nullptr), "EVP_DigestInit_ex");
+        check(EVP_DigestUpdate(m_inner.get(), ipad.data(), ipad.size()), "EVP_DigestUpdate");
+        check(EVP_DigestInit_ex(m_outer.get(), EVP_sha256(), nullptr), "EVP_DigestInit_ex");
+        check(EVP_DigestUpdate(m_outer.get(), opad.data(), opad.size()), "EVP_DigestUpdate");
+    }
+
+    /** Thread safe, `scratch` is per thread. */
+    Pseudonym operator()(UserIdentifier const & id, EVP_MD_CTX * const scratch) const {
+        std::array<std::uint8_t, EVP_MAX_MD_SIZE> digest;
+        unsigned digest_size = 0;
+        check(EVP_MD_CTX_copy_ex(scratch, m_inner.get()), "EVP_MD_CTX_copy_ex");
+        check(EVP_DigestUpdate(scratch, id.data(), id.size()), "EVP_DigestUpdate");
+        check(EVP_DigestFinal_ex(scratch, digest.data(), &digest_size), "EVP_DigestFinal_ex");
+        check(EVP_MD_CTX_copy_ex(scratch, m_outer.get()), "EVP_MD_CTX_copy_ex");
+        check(EVP_DigestUpdate(scratch, digest.data(), digest_size), "EVP_DigestUpdate");
+        check(EVP_DigestFinal_ex(scratch, digest.data(), &digest_size), "EVP_DigestFinal_ex");
+
+        Pseudonym result;
+        std::copy(id.begin(), id.end(), result.begin());
+        std::copy_n(digest.begin(), hmac_bytes, result.begin() + id_bytes);
+        for (std::size_t i = 0; i < result.size(); ++i) { result[i] ^= m_keystream[i]; }
+        return result;
+    }
+
+private: /* Fields: */
+    std::array<std::uint8_t, 16> m_keystream;
+    EvpMdCtx m_inner = new_md_ctx();
+    EvpMdCtx m_outer = new_md_ctx();
+};
+
+/** The identifier of the user `number` (starting from 1) of `generate_pseudonyms.c`. */
+UserIdentifier user_identifier(std::uint64_t const number, EVP_MD_CTX * const scratch) {
+    std::array<std::uint8_t, EVP_MAX_MD_SIZE> digest;
+    unsigned digest_size = 0;
+    check(EVP_DigestInit_ex(scratch, EVP_sha256(), nullptr), "EVP_DigestInit_ex");
+    // Host byte order, same as `generate_pseudonyms.c`.
+    check(EVP_DigestUpdate(scratch, &number, sizeof(number)), "EVP_DigestUpdate");
+    check(EVP_DigestFinal_ex(scratch, digest.data(), &digest_size), "EVP_DigestFinal_ex");
+    UserIdentifier result;
+    std::copy_n(digest.begin(), id_bytes, result.begin());
+    return result;
+}
+
+struct User {
+    UserIdentifier id;
+    /** Zero based, the base user is `index % users`. */
+    std::uint32_t index;
+};
+
+struct Anchor {
+    double easting;
+    double northing;
+    /** The scale of the normally distributed tile offsets. */
+    double error;
+};
+
+struct Footprint {
+    Tile tile;
+    std::array<float, 4> values;
+};
+
+/** Generates the footprints of one (base) user for the period. */
+class FootprintGenerator {
+public: /* Methods: */
+    FootprintGenerator(Options const & options, Area const & area) noexcept
+        : m_options(options), m_area(area)
+    {}
+
+    void operator()(std::uint64_t const base_user, std::vector<Footprint> & result) {
+        result.clear();
+        auto const anchors = this->anchors(base_user);
+        Rng rng{derive_seed({m_options.seed, 1u, base_user, m_options.period})};
+
+        m_visits.clear();
+        for (std::size_t subperiod = 1; subperiod <= 3; ++subperiod) {
+            if (rng.bernoulli(m_options.silent_probability)) { continue; }
+            auto const & anchor = anchors[subperiod - 1u];
+            for (std::uint64_t i = 0; i < m_options.tiles_per_subperiod; ++i) {
+                Footprint visit{tile_near(anchor, rng), {}};
+                visit.values[subperiod] = static_cast<float>(rng.uniform());
+                m_visits.push_back(visit);
+            }
+        }
+
+        // Aggregate the visits per tile, subperiod 0 is the sum.
+        std::sort(m_visits.begin(),
+                  m_visits.end(),
+                  [](Footprint const & a, Footprint const & b) { return a.tile < b.tile; });
+        for (auto const & visit : m_visits) {
+            if (result.empty() || !(result.back().tile == visit.tile)) {
+                result.push_back(Footprint{visit.tile, {}});
+            }
+            for (std::size_t i = 1; i < 4; ++i) {
+                result.back().values[i] += visit.values[i];
+                result.back().values[0] += visit.values[i];
+            }
+        }
+
+        // Maybe "visit" the tile in more than one subperiod.
+        for (auto & footprint : result) {
+            auto const p = footprint.values[1] > 1e-15f ? m_options.night_probability
+                                                        : m_options.day_probability;
+            for (std::size_t i = 1; i < 4; ++i) {
+                if (footprint.values[i] < 1e-15f && rng.bernoulli(p)) {
+                    auto const value = static_cast<float>(rng.uniform() * fill_max);
+                    footprint.values[i] = value;
+                    footprint.values[0] += value;
+                }
+            }
+        }
+    }
+
+private: /* Methods: */
+    /** Only depend on the user, not on the period. */
+    std::array<Anchor, 3> anchors(std::uint64_t const base_user) const {
+        Rng rng{derive_seed({m_options.seed, 0u, base_user})};
+        auto const night = m_area.sample(rng);
+        std::array<Anchor, 3> result;
+        result[0] = Anchor{night[0], night[1], error(rng)};
+        for (std::size_t i = 1; i < 3; ++i) {
+            Tile tile;
+            auto easting = night[0];
+            auto northing = night[1];
+            for (int attempt = 0; attempt < max_attempts; ++attempt) {
+                auto const e = night[0] + rng.normal(anchor_spread * m_options.rtile);
+                auto const n = night[1] + rng.normal(anchor_spread * m_options.rtile);
+                if (m_area.tile_of(e, n, tile)) {
+                    easting = e;
+                    northing = n;
+                    break;
+                }
+            }
+            result[i] = Anchor{easting, northing, error(rng)};
+        }
+        return result;
+    }
+
+    double error(Rng & rng) const noexcept {
+        return m_options.rtile * rng.uniform(m_options.pec1, m_options.pec2);
+    }
+
+    Tile tile_near(Anchor const & anchor, Rng & rng) const {
+        Tile tile;
+        for (int attempt = 0; attempt < max_attempts; ++attempt) {
+            auto const r = rng.bernoulli(m_options.normal_probability)
+                                   ? rng.normal(anchor.error)
+                                   : rng.pareto(pareto_shape) * pareto_scale;
+            auto const phi = rng.uniform() * 2.0 * M_PI;
+            if (m_area.tile_of(anchor.easting + r * std::cos(phi),
+                               anchor.northing + r * std::sin(phi),
+                               tile))
+            {
+                return tile;
+            }
+        }
+        if (!m_area.tile_of(anchor.easting, anchor.northing, tile)) {
+            throw std::runtime_error("Anchor outside of the area.");
+        }
+        return tile;
+    }
+
+private: /* Fields: */
+    Options const & m_options;
+    Area const & m_area;
+    std::vector<Footprint> m_visits;
+};
+
+/**
+   Writes the blocks of records in their order, while they are generated out
+   of order. At most `window` blocks are buffered.
+ */
+class OrderedWriter {
+public: /* Methods: */
+    OrderedWriter(std::FILE * const file, std::size_t const window) noexcept
+        : m_file(file), m_window(window)
+    {}
+
+    /** Returns false if the generation was aborted. */
+    bool wait_for_turn(std::size_t const block) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_failed || block < m_next + m_window; });
+        return !m_failed;
+    }
+
+    void put(std::size_t const block, std::vector<Record> && records) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_ready.emplace(block, std::move(records));
+        while (!m_ready.empty() && m_ready.begin()->first == m_next) {
+            auto const & next = m_ready.begin()->second;
+            if (std::fwrite(next.data(), sizeof(Record), next.size(), m_file) != next.size()) {
+                throw std::runtime_error("Failed to write the output file.");
+            }
+            m_records += next.size();
+            m_ready.erase(m_ready.begin());
+            ++m_next;
+        }
+        m_cv.notify_all();
+    }
+
+    void abort() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_failed = true;
+        m_cv.notify_all();
+    }
+
+    std::uint64_t records() const noexcept { return m_records; }
+
+private: /* Fields: */
+    std::FILE * const m_file;
+    std::size_t const m_window;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::map<std::size_t, std::vector<Record>> m_ready;
+    std::size_t m_next = 0;
+    std::uint64_t m_records = 0;
+    bool m_failed = false;
+};
+
+/** Runs `f(i)` for all i in [0, count) on `threads` threads. */
+template <typename F>
+void parallel_for(std::size_t const count, std::size_t const threads, F f) {
+    std::atomic<std::size_t> next{0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            try {
+                for (std::size_t i; (i = next.fetch_add(1u)) < count;) { f(i); }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) { error = std::current_exception(); }
+                next = count;
+            }
+        });
+    }
+    for (auto & worker : workers) { worker.join(); }
+    if (error) { std::rethrow_exception(error); }
+}
+
+/** All users (including the duplicates), sorted by their identifier. */
+std::vector<User> sorted_users(Options const & options) {
+    auto const count = options.users * (options.duplicates + 1u);
+    if (count > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error("Too many users.");
+    }
+    std::vector<User> users(count);
+    auto const chunk = std::size_t{1u} << 16;
+    parallel_for((count + chunk - 1u) / chunk, options.threads, [&](std::size_t const c) {
+        auto const scratch = new_md_ctx();
+        auto const end = std::min<std::uint64_t>(count, (c + 1u) * chunk);
+        for (auto i = c * chunk; i < end; ++i) {
+            users[i] = User{user_identifier(i + 1u, scratch.get()), static_cast<std::uint32_t>(i)};
+        }
+    });
+    std::sort(users.begin(), users.end(), [](User const & a, User const & b) {
+        return a.id < b.id;
+    });
+    return users;
+}
+
+void generate(Options const & options) {
+    std::array<std::uint8_t, 16> key;
+    if (options.key_hex.size() != 2u * key.size()) {
+        throw std::runtime_error("The key must be 32 hex characters.");
+    }
+    for (std::size_t i = 0; i < key.size(); ++i) {
+        char * end = nullptr;
+        auto const byte = options.key_hex.substr(2u * i, 2u);
+        key[i] = static_cast<std::uint8_t>(std::strtoul(byte.c_str(), &end, 16));
+        if (*end != '\0') { throw std::runtime_error("The key must be 32 hex characters."); }
+    }
+
+    Pseudonymiser const pseudonymiser{key};
+    Area const area{options};
+    auto const start = std::chrono::steady_clock::now();
+    auto const users = sorted_users(options);
+
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)> file{
+            std::fopen(options.output.c_str(), "wb"), &std::fclose};
+    if (!file) { throw std::runtime_error("Failed to open " + options.output); }
+
+    auto const blocks = (users.size() + options.block_users - 1u) / options.block_users;
+    OrderedWriter writer{file.get(), 4u * options.threads};
+    try {
+        parallel_for(blocks, options.threads, [&](std::size_t const block) {
+            if (!writer.wait_for_turn(block)) { return; }
+            auto const scratch = new_md_ctx();
+            FootprintGenerator generate_footprints{options, area};
+            std::vector<Footprint> footprints;
+            std::vector<Record> records;
+            auto const begin = block * options.block_users;
+            auto const end = std::min<std::size_t>(users.size(), begin + options.block_users);
+            for (auto u = begin; u < end; ++u) {
+                auto const & user = users[u];
+                auto const base_user = user.index % options.users;
+                generate_footprints(base_user, footprints);
+                auto const pseudonym = pseudonymiser(user.id, scratch.get());
+                Rng rng{derive_seed({options.seed, 2u, user.index, options.period})};
+                for (auto const & footprint : footprints) {
+                    records.push_back(Record{pseudonym, footprint.tile, footprint.values});
+                    if (rng.bernoulli(options.duplicate_record_probability)) {
+                        // Duplicate keys are merged by the enclave.
+                        auto duplicate = records.back();
+                        for (auto & value : duplicate.values) {
+                            value *= static_cast<float>(rng.uniform());
+                        }
+                        records.push_back(duplicate);
+                    }
+                }
+            }
+
+            if (options.unsorted_fraction > 0) {
+                Rng rng{derive_seed({options.seed, 3u, block, options.period})};
+                for (std::size_t i = 0; i < records.size(); ++i) {
+                    if (rng.bernoulli(options.unsorted_fraction)) {
+                        std::swap(records[i], records[rng.below(records.size())]);
+                    }
+                }
+            }
+
+            writer.put(block, std::move(records));
+        });
+    } catch (...) {
+        writer.abort();
+        throw;
+    }
+
+    if (std::fflush(file.get()) != 0) {
+        throw std::runtime_error("Failed to write the output file.");
+    }
+    auto const seconds = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start).count();
+    std::fprintf(stderr,
+                 "Wrote %llu records of %llu users in %.2fs (%.0f records/s).\n",
+                 static_cast<unsigned long long>(writer.records()),
+                 static_cast<unsigned long long>(users.size()),
+                 seconds,
+                 static_cast<double>(writer.records()) / seconds);
+}
+
+void usage(char const * const program) {
+    std::fprintf(
+            stderr,
+            "Usage: %s [options] <periodic key hex> <output file>\n"
+            "\n"
+            "Options (defaults of generator.py where applicable):\n"
+            "  --users N                  Users (default 100)\n"
+            "  --duplicates N             Copies of each user with another pseudonym (default 0)\n"
+            "  --tiles-per-subperiod N    Visits per user and subperiod (default 4)\n"
+            "  --area-width N             Width of the square area (default 20)\n"
+            "  --residents FILE           Use the tiles and population of a residents csv\n"
+            "                             instead of the square area\n"
+            "  --silent-prob P            Probability to skip a subperiod (default 0)\n"
+            "  --normal-prob P            Probability of normal instead of Pareto tile\n"
+            "                             offsets (default 0.7)\n"
+            "  --night-prob P             Fill probability if the night value is set (default 0.4)\n"
+            "  --day-prob P               Fill probability otherwise (default 0.2)\n"
+            "  --pec1 X, --pec2 X         Range of the positioning error factor (default 0.5, 2)\n"
+            "  --rtile X                  Positioning error radius in tiles (default 2)\n"
+            "  --duplicate-record-prob P  Probability to repeat a record with smaller\n"
+            "                             values (default 0)\n"
+            "  --unsorted-fraction P      Fraction of records swapped with a random record\n"
+            "                             of the same block (default 0, i.e. sorted)\n"
+            "  --period N                 Period of the file (default 0)\n"
+            "  --seed N                   Seed (default 1)\n"
+            "  --threads N                Threads (default: all cores)\n"
+            "  --block-users N            Users per unit of work (default 4096)\n",
+            program);
+}
+
+Options parse_options(int const argc, char ** const argv) {
+    Options options;
+    std::vector<std::string> positional;
+    auto const parse_u64 = [](char const * const s) {
+        char * end = nullptr;
+        auto const value = std::strtoull(s, &end, 10);
+        if (*s == '\0' || *end != '\0') { throw std::runtime_error(std::string("Invalid number ") + s); }
+        return static_cast<std::uint64_t>(value);
+    };
+    auto const parse_double = [](char const * const s) {
+        char * end = nullptr;
+        auto const value = std::strtod(s, &end);
+        if (*s == '\0' || *end != '\0') { throw std::runtime_error(std::string("Invalid number ") + s); }
+        return value;
+    };
+    std::map<std::string, std::uint64_t *> const u64_options{
+            {"--users", &options.users},
+            {"--duplicates", &options.duplicates},
+            {"--tiles-per-subperiod", &options.tiles_per_subperiod},
+            {"--area-width", &options.area_width},
+            {"--period", &options.period},
+            {"--seed", &options.seed},
+            {"--threads", &options.threads},
+            {"--block-users", &options.block_users}};
+    std::map<std::string, double *> const double_options{
+            {"--silent-prob", &options.silent_probability},
+            {"--normal-prob", &options.normal_probability},
+            {"--night-prob", &options.night_probability},
+            {"--day-prob", &options.day_probability},
+            {"--pec1", &options.pec1},
+            {"--pec2", &options.pec2},
+            {"--rtile", &options.rtile},
+            {"--duplicate-record-prob", &options.duplicate_record_probability},
+            {"--unsorted-fraction", &options.unsorted_fraction}};
+
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            std::exit(0);
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc) { throw std::runtime_error("Missing value of " + arg); }
+        char const * const value = argv[++i];
+        auto const u64_option = u64_options.find(arg);
+        auto const double_option = double_options.find(arg);
+        if (u64_option != u64_options.end()) {
+            *u64_option->second = parse_u64(value);
+        } else if (double_option != double_options.end()) {
+            *double_option->second = parse_double(value);
+        } else if (arg == "--residents") {
+            options.residents = value;
+        } else {
+            throw std::runtime_error("Unknown option " + arg);
+        }
+    }
+
+    if (positional.size() != 2u) { throw std::runtime_error("Expected the key and the output file."); }
+    options.key_hex = positional[0];
+    options.output = positional[1];
+    if (options.users == 0u || options.threads == 0u || options.block_users == 0u) {
+        throw std::runtime_error("--users, --threads and --block-users must be positive.");
+    }
+    return options;
+}
+
+} // anonymous namespace
+
+int main(int argc, char ** argv) {
+    try {
+        generate(parse_options(argc, argv));
+    } catch (std::exception const & e) {
+        std::fprintf(stderr, "Error: %s\n", e.what());
+        usage(argv[0]);
+        return 1;
+    }
+}
@@ -15,18 +15,33 @@
 * limitations under the Licence.
 */ 
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <exception>
 #include <functional>
 #include <limits>
+#include <sharemind-hi/enclave/common/EnclaveException.h>
 #include <sharemind-hi/enclave/common/Log.h>
 #include <sharemind-hi/test/Prelude.h>
 #include <string>
 #include <utility>
 #include <vector>
+#include "../src/analytics_enclave/AnalysisStages.h"
+#include "../src/analytics_enclave/ConnectionStrengthSums.h"
+#include "../src/analytics_enclave/DenseTileIds.h"
+#include "../src/analytics_enclave/ExternalSort.h"
 #include "../src/analytics_enclave/Indicators.h"
 #include "../src/analytics_enclave/Pseudonymisation.h"
+#include "../src/analytics_enclave/RadixSort.h"
+#include "../src/analytics_enclave/ReferenceAreas.h"
+#include "../src/analytics_enclave/SBlock.h"
+#include "../src/analytics_enclave/SSegments.h"
+#include "../src/analytics_enclave/TileAggregation.h"
+#include "../src/analytics_enclave/TileGrid.h"
 
 namespace test {
 namespace enclave {
@@ -137,6 +152,204 @@ bool decrypt_pseudonym2() {
     return true;
 }
 
+bool decrypt_pseudonym_batch() {
+    using namespace eurostat::enclave;
+    const uint8_t key[PseudonymisationKeyLength] = {
+        0x60, 0x8b, 0x23, 0xb7, 0x23, 0x63, 0x0c, 0x30, 0x43, 0x85, 0xb4, 0xeb, 0xd0, 0x05, 0x37, 0x01,
+    };
+    PseudonymisedUserIdentifier const pseudonyms[] = {
+        {0x13, 0xbf, 0xfe, 0x75, 0x26, 0x1b, 0x0f, 0xa7, 0x84, 0x42, 0x30, 0x94, 0x93, 0x6b, 0xa6, 0xd7},
+        {0x97, 0x78, 0xdf, 0x7e, 0xd1, 0x2e, 0x73, 0x44, 0xf1, 0xe9, 0x74, 0x38, 0x84, 0x17, 0x4c, 0xf0},
+        {0xed, 0x26, 0x61, 0xa4, 0x2b, 0x88, 0xd5, 0x2e, 0x9b, 0x47, 0xda, 0xd2, 0xac, 0xa3, 0xdc, 0x85},
+    };
+    UserIdentifier const ids[] = {
+        {0x95, 0xe5, 0x12, 0x4f, 0xa2, 0x53, 0x0b, 0x6b, 0xec, 0x01, 0xff, 0x60},
+        {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc},
+        {0x6b, 0x7c, 0x8d, 0x9e, 0xaf, 0xc0, 0xd1, 0xe2, 0xf3, 0x04, 0x15, 0x26},
+    };
+
+    // More than fit into one batch of side by side HMAC computations.
+    constexpr std::size_t count = 19;
+    std::vector<PseudonymisedUserIdentifier> in;
+    std::vector<UserIdentifier> expected;
+    for (std::size_t i = 0; i < count; ++i) {
+        in.push_back(pseudonyms[(i * i) % 3]);
+        expected.push_back(ids[(i * i) % 3]);
+    }
+
+    PseudonymDecryptor const decryptor{key};
+    std::vector<UserIdentifier> result(count);
+    decryptor.decrypt(in.data(), count, result.data());
+    for (std::size_t i = 0; i < count; ++i) {
+        if (result[i] != expected[i]) {
+            enclave_printf_log("Failed test %s at index %zu", __func__, i);
+            enclave_printf_log("expected: <%s>", hexBinToString(expected[i]).c_str());
+            enclave_printf_log("result:   <%s>", hexBinToString(result[i]).c_str());
+            return false;
+        }
+    }
+
+    // A single manipulated pseudonym fails the whole batch.
+    in[count - 2][0] ^= 0x01;
+    try {
+        decryptor.decrypt(in.data(), count, result.data());
+    } catch (sharemind_hi::enclave::EnclaveException const &) {
+        return true;
+    }
+    enclave_printf_log("Failed test %s: manipulated pseudonym was accepted", __func__);
+    return false;
+}
+
+bool pseudonym_cache() {
+    using namespace eurostat::enclave;
+    PseudonymisedUserIdentifier const pseudonym = {0x13, 0xbf, 0xfe, 0x75, 0x26, 0x1b, 0x0f, 0xa7,
+                                                   0x84, 0x42, 0x30, 0x94, 0x93, 0x6b, 0xa6, 0xd7};
+    UserIdentifier const id = {0x95, 0xe5, 0x12, 0x4f, 0xa2, 0x53, 0x0b, 0x6b, 0xec, 0x01, 0xff, 0x60};
+
+    PseudonymCache cache{1000};
+    // Each slot holds at least a pseudonym and an identifier.
+    bool ok = cache.capacity() > 0u && cache.capacity() * 28u <= 1000u
+              && (cache.capacity() & (cache.capacity() - 1u)) == 0u;
+    // An empty slot must not match the all zero pseudonym.
+    ok = ok && cache.find(PseudonymisedUserIdentifier{}) == nullptr;
+    ok = ok && cache.find(pseudonym) == nullptr;
+    cache.insert(pseudonym, id);
+    auto const found = cache.find(pseudonym);
+    ok = ok && found && *found == id;
+    ok = ok && cache.hits() == 1u && cache.misses() == 2u;
+
+    PseudonymCache disabled{0};
+    disabled.insert(pseudonym, id);
+    ok = ok && disabled.capacity() == 0u && disabled.find(pseudonym) == nullptr;
+
+    if (!ok) { enclave_printf_log("Failed test %s", __func__); }
+    return ok;
+}
+
+bool radix_sort() {
+    using namespace eurostat::enclave;
+    struct Element {
+        std::uint8_t key[5];
+        std::uint32_t original_index;
+    };
+    auto const key_of = [](Element const & e) noexcept {
+        return static_cast<std::uint8_t const *>(e.key);
+    };
+    auto const less = [](Element const & a, Element const & b) noexcept {
+        return std::memcmp(a.key, b.key, sizeof(a.key)) < 0;
+    };
+
+    // Few distinct bytes, so there are many equal keys and common prefixes.
+    // Large enough for the parallel sort to actually split the work.
+    std::vector<Element> elements(100000);
+    std::uint32_t state = 42;
+    for (std::uint32_t i = 0; i < elements.size(); ++i) {
+        for (auto & byte : elements[i].key) {
+            state = state * 1664525u + 1013904223u;
+            byte = static_cast<std::uint8_t>((state >> 24) % 5u);
+        }
+        elements[i].original_index = i;
+    }
+    auto expected = elements;
+    std::stable_sort(expected.begin(), expected.end(), less);
+
+    auto check = [&](std::vector<Element> const & result, char const * variant) {
+        std::vector<bool> seen(result.size(), false);
+        for (std::size_t i = 0; i < result.size(); ++i) {
+            if (std::memcmp(result[i].key, expected[i].key, sizeof(Element::key)) != 0
+                || seen[result[i].original_index])
+            {
+                enclave_printf_log("Failed test %s (%s) at index %zu", __func__, variant, i);
+                return false;
+            }
+            seen[result[i].original_index] = true;
+        }
+        return true;
+    };
+
+    auto sequential = elements;
+    radixSortByKey<sizeof(Element::key)>(sequential.data(), sequential.data() + sequential.size(), key_of);
+    auto parallel = elements;
+    parallelRadixSortByKey<sizeof(Element::key)>(parallel.data(), parallel.data() + parallel.size(), key_of, 3u);
+    return check(sequential, "sequential") && check(parallel, "parallel");
+}
+
+bool reference_areas() {
+    using namespace eurostat::enclave;
+    ReferenceAreas areas;
+    bool ok = areas.size() == 0u && areas.areasOf(TileIndex{1, 2}).none();
+
+    // Enough tiles to grow the table a few times.
+    for (std::uint16_t e = 0; e < 100; ++e) {
+        for (std::uint16_t n = 0; n < 100; ++n) {
+            areas.add(0, TileIndex{e, n});
+            if ((e + n) % 3 == 0) { areas.add(5, TileIndex{e, n}); }
+        }
+    }
+    areas.add(127, TileIndex{0xffff, 0xffff});
+    ok = ok && areas.size() == 128u;
+
+    for (std::uint16_t e = 0; e < 100; ++e) {
+        for (std::uint16_t n = 0; n < 100; ++n) {
+            auto const & set = areas.areasOf(TileIndex{e, n});
+            ok = ok && set.test(0) && set.test(5) == ((e + n) % 3 == 0)
+                 && set.count() == (set.test(5) ? 2u : 1u);
+        }
+    }
+    ok = ok && areas.areasOf(TileIndex{0xffff, 0xffff}).count() == 1u
+         && areas.areasOf(TileIndex{0xffff, 0xffff}).test(127);
+    ok = ok && areas.areasOf(TileIndex{100, 0}).none();
+
+    if (!ok) { enclave_printf_log("Failed test %s", __func__); }
+    return ok;
+}
+
+bool tile_grid() {
+    using namespace eurostat::enclave;
+    auto check = [](std::vector<TileIndex> const & tiles, char const * variant) {
+        TileGrid<std::uint32_t> grid;
+        for (std::size_t i = 0; i < tiles.size(); ++i) {
+            grid[tiles[i]] += static_cast<std::uint32_t>(i + 1u);
+        }
+        bool ok = !grid.insert(tiles.front(), 0u) && grid.find(TileIndex{1, 1}) == nullptr;
+        ok = ok && grid.insert(TileIndex{1, 1}, 7u) && *grid.find(TileIndex{1, 1}) == 7u;
+
+        auto expected = tiles;
+        expected.push_back(TileIndex{1, 1});
+        std::sort(expected.begin(), expected.end());
+        expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+        ok = ok && grid.size() == expected.size();
+
+        std::size_t i = 0;
+        grid.forEach([&](TileIndex const tile, std::uint32_t const value) {
+            ok = ok && i < expected.size() && tile == expected[i] && grid.find(tile)
+                 && *grid.find(tile) == value;
+            ++i;
+        });
+        ok = ok && i == expected.size();
+        if (!ok) { enclave_printf_log("Failed test %s (%s)", __func__, variant); }
+        return ok;
+    };
+
+    // A compact area with duplicates, which is kept in blocks.
+    std::vector<TileIndex> compact;
+    for (std::uint16_t e = 100; e < 300; ++e) {
+        for (std::uint16_t n = 500; n < 520; n += 2) {
+            compact.push_back(TileIndex{static_cast<std::uint16_t>(400u - e), n});
+            compact.push_back(TileIndex{e, n});
+        }
+    }
+    // Scattered over the whole grid, which falls back to the hash table.
+    std::vector<TileIndex> scattered;
+    std::uint32_t state = 42;
+    for (std::size_t i = 0; i < 5000; ++i) {
+        state = state * 1664525u + 1013904223u;
+        scattered.push_back(TileIndex{static_cast<std::uint16_t>(state >> 16),
+                                      static_cast<std::uint16_t>(state)});
+    }
+    return check(compact, "compact") && check(scattered, "scattered");
+}
+
 bool log2histogram() {
     using namespace eurostat::enclave::indicators;
     std::string format_buffer;
@@ -250,6 +463,876 @@ bool log2histogram() {
     return true;
 }
 
+bool s_block() {
+    using namespace eurostat::enclave;
+    auto record = [](std::uint8_t const user,
+                     std::uint16_t const easting,
+                     std::uint16_t const northing,
+                     float const value)
+    {
+        AccumulatedUserFootprint result = {};
+        result.key.id.fill(user);
+        result.key.tile = TileIndex{easting, northing};
+        result.i_column.fill(value);
+        return result;
+    };
+
+    std::vector<AccumulatedUserFootprint> records;
+    // Equal to the key a block starts with, so without an id.
+    records.push_back(record(0, 0, 0, 0.0f));
+    // The largest deltas in both directions take the longest varints.
+    records.push_back(record(0, 0xffff, 0xffff, 1.0f));
+    records.push_back(record(0, 0, 0xffff, -0.0f));
+    records.push_back(record(0xff, 0xffff, 0, std::numeric_limits<float>::quiet_NaN()));
+    records.push_back(record(0xff, 0xffff, 0, std::numeric_limits<float>::denorm_min()));
+    // Enough records to fill several blocks, so users span the blocks.
+    std::uint32_t state = 42;
+    for (std::uint32_t i = 0; i < 5000; ++i) {
+        state = state * 1664525u + 1013904223u;
+        auto e = record(static_cast<std::uint8_t>(i / 7u),
+                        static_cast<std::uint16_t>(state >> 16),
+                        static_cast<std::uint16_t>(1000u + i % 7u),
+                        0.0f);
+        for (std::size_t j = 0; j < e.i_column.size(); ++j) {
+            if ((state >> j) & 1u) { e.i_column[j] = static_cast<float>(i) / 3.0f; }
+        }
+        records.push_back(e);
+    }
+
+    std::vector<SBlock> blocks;
+    SBlockEncoder encoder;
+    for (auto const & e : records) {
+        if (encoder.full()) {
+            blocks.push_back(encoder.finish());
+            encoder.clear();
+        }
+        encoder.add(e);
+    }
+    blocks.push_back(encoder.finish());
+    bool ok = blocks.size() > 2u;
+
+    std::size_t i = 0;
+    SBlockDecoder decoder;
+    AccumulatedUserFootprint decoded;
+    ok = ok && !decoder.next(decoded);
+    for (auto const & block : blocks) {
+        decoder.reset(block);
+        while (ok && decoder.next(decoded)) {
+            // Bitwise, so NaN and the sign of zero count as well.
+            ok = i < records.size() && std::memcmp(&decoded, &records[i], sizeof(decoded)) == 0;
+            ++i;
+        }
+    }
+    ok = ok && i == records.size();
+
+    encoder.clear();
+    decoder.reset(encoder.finish());
+    ok = ok && !decoder.next(decoded);
+
+    // A block which claims more records than it holds is rejected once the
+    // decoder runs past its end.
+    auto invalid = blocks.front();
+    std::memset(invalid.bytes.data(), 0xff, sizeof(std::uint32_t));
+    decoder.reset(invalid);
+    bool thrown = false;
+    try {
+        for (std::size_t n = 0; n <= SBlock::SIZE && decoder.next(decoded); ++n) {}
+    } catch (sharemind_hi::enclave::EnclaveException const &) {
+        thrown = true;
+    }
+    ok = ok && thrown;
+
+    if (!ok) { enclave_printf_log("Failed test %s", __func__); }
+    return ok;
+}
+
+/** A stream sink which appends the elements to a vector. */
+template <typename T>
+struct VectorSinkBuilder {
+    using Category = sharemind_hi::enclave::stream::detail::SinkCategory;
+
+    template <typename U>
+    struct Impl {
+        using In = U;
+        using Res = void;
+
+        void sink(In const & e) { result->push_back(e); }
+        void finalize() && {}
+
+        std::vector<T> * result;
+    };
+
+    template <typename U>
+    Impl<U> build() && { return Impl<U>{result}; }
+
+    std::vector<T> * result;
+};
+
+/** A stream source which yields the elements of a vector. */
+template <typename T>
+struct VectorSource {
+    using Category = sharemind_hi::enclave::stream::detail::SourceCategory;
+    using Out = T;
+
+    explicit VectorSource(std::vector<T> e) : elements(std::move(e)) {}
+
+    bool next(Out & result) {
+        if (next_index == elements.size()) { return false; }
+        result = elements[next_index++];
+        return true;
+    }
+
+    std::vector<T> elements;
+    std::size_t next_index = 0;
+};
+
+bool tile_aggregation() {
+    using namespace eurostat::enclave;
+    struct Element {
+        TileIndex tile;
+        std::uint32_t value;
+    };
+    struct Sum {
+        TileIndex tile;
+        std::uint64_t sum;
+        std::uint32_t elements;
+    };
+
+    auto check = [](TileIndex (*tile_of)(std::uint32_t), std::size_t const budget, char const * variant) {
+        // Every tile three times, in a random order.
+        std::size_t const tiles = 300;
+        std::vector<Element> elements;
+        for (std::uint32_t repeat = 0; repeat < 3; ++repeat) {
+            for (std::uint32_t i = 0; i < tiles; ++i) {
+                elements.push_back(Element{tile_of(i), i + repeat});
+            }
+        }
+        std::uint32_t state = 42;
+        for (std::size_t i = elements.size() - 1u; i > 0; --i) {
+            state = state * 1664525u + 1013904223u;
+            std::swap(elements[i], elements[(state >> 8) % (i + 1u)]);
+        }
+
+        std::vector<Sum> sums;
+        auto aggregation = aggregateByTile(
+                                   [](Element const & e) noexcept { return e.tile; },
+                                   [](Element const & e) { return Sum{e.tile, 0u, 0u}; },
+                                   [](Sum & result, Element const & e) {
+                                       result.sum += e.value;
+                                       ++result.elements;
+                                   },
+                                   budget * (sizeof(Sum) + sizeof(TileIndex) + 4u * sizeof(DenseTileIds::Id)),
+                                   "unit_test_tile_aggregation_")
+                                   .build(VectorSinkBuilder<Sum>{&sums})
+                                   .template build<Element>();
+        for (auto const & e : elements) { aggregation.sink(e); }
+        std::move(aggregation).finalize();
+
+        // The sums are passed on in tile order, also if they were spilled.
+        std::vector<Sum> expected;
+        for (std::uint32_t i = 0; i < tiles; ++i) {
+            expected.push_back(Sum{tile_of(i), 3u * i + 3u, 3u});
+        }
+        std::sort(expected.begin(), expected.end(), [](Sum const & a, Sum const & b) { return a.tile < b.tile; });
+        bool ok = sums.size() == expected.size();
+        for (std::size_t i = 0; ok && i < sums.size(); ++i) {
+            ok = sums[i].tile == expected[i].tile && sums[i].sum == expected[i].sum
+                 && sums[i].elements == expected[i].elements;
+        }
+        if (!ok) { enclave_printf_log("Failed test %s (%s, %zu)", __func__, variant, budget); }
+        return ok;
+    };
+
+    // Spread over the whole grid, so the ~19 tiles of each partition of the
+    // first level are spilled again with a budget of a single tile.
+    auto const spread = [](std::uint32_t const i) {
+        return TileIndex{static_cast<std::uint16_t>(i * 7919u), static_cast<std::uint16_t>(i)};
+    };
+    // A compact area, whose tiles share the partition of the first levels.
+    auto const compact = [](std::uint32_t const i) {
+        return TileIndex{static_cast<std::uint16_t>(1000u + i / 20u),
+                         static_cast<std::uint16_t>(2000u + i % 20u)};
+    };
+    bool ok = true;
+    for (std::size_t const budget : {std::size_t{1}, std::size_t{50}, std::size_t{1000}}) {
+        ok = check(spread, budget, "spread") && ok;
+        ok = check(compact, budget, "compact") && ok;
+    }
+
+    // The calibration keys of a busy tile, with users of many anchor tiles.
+    // They do not fit into memory after the levels of the tile either, so
+    // they are partitioned by their hash, and still passed on in key order.
+    {
+        using namespace eurostat::enclave::full_analysis::module_d;
+        std::size_t const anchors = 3000;
+        std::size_t const budget = 50;
+        std::vector<AnchoredY> elements;
+        for (std::uint32_t repeat = 0; repeat < 3; ++repeat) {
+            for (std::uint32_t i = 0; i < anchors; ++i) {
+                AnchoredY e{};
+                e.key.tile = TileIndex{1000, 2000};
+                e.key.anchor = TileIndex{static_cast<std::uint16_t>(i * 7919u), static_cast<std::uint16_t>(i)};
+                e.values[0] = repeat == 0u;
+                elements.push_back(e);
+            }
+        }
+        std::uint32_t state = 42;
+        for (std::size_t i = elements.size() - 1u; i > 0; --i) {
+            state = state * 1664525u + 1013904223u;
+            std::swap(elements[i], elements[(state >> 8) % (i + 1u)]);
+        }
+
+        std::vector<CalibrationSums> sums;
+        auto aggregation = aggregateByTile(
+                                   [](AnchoredY const & e) noexcept { return e.key; },
+                                   [](AnchoredY const & e) noexcept {
+                                       CalibrationSums result{};
+                                       result.key = e.key;
+                                       return result;
+                                   },
+                                   add_calibration_sums,
+                                   budget * (sizeof(CalibrationSums) + sizeof(CalibrationKey)
+                                             + 4u * sizeof(DenseTileIds::Id)),
+                                   "unit_test_tile_aggregation_busy_")
+                                   .build(VectorSinkBuilder<CalibrationSums>{&sums})
+                                   .template build<AnchoredY>();
+        for (auto const & e : elements) { aggregation.sink(e); }
+        std::move(aggregation).finalize();
+
+        bool busy_ok = sums.size() == anchors;
+        for (std::size_t i = 0; busy_ok && i < sums.size(); ++i) {
+            busy_ok = sums[i].records == 3u && sums[i].values[0] == 1u
+                      && (i == 0u || sums[i - 1u].key < sums[i].key);
+        }
+        if (!busy_ok) { enclave_printf_log("Failed test %s (busy tile)", __func__); }
+        ok = busy_ok && ok;
+    }
+    return ok;
+}
+
+bool external_sort() {
+    using namespace eurostat::enclave;
+    struct Element {
+        std::uint32_t key;
+        std::uint32_t original_index;
+    };
+    auto const less = [](Element const & a, Element const & b) noexcept { return a.key < b.key; };
+    // Records the size of each range it is asked to sort, i.e. how much of a
+    // run is sorted.
+    std::vector<std::size_t> sorted_sizes;
+    auto const sort_run = [&sorted_sizes, less](Element * begin, Element * end) {
+        sorted_sizes.push_back(static_cast<std::size_t>(end - begin));
+        std::stable_sort(begin, end, less);
+    };
+    std::uint32_t state = 42;
+    auto random_key = [&state] {
+        state = state * 1664525u + 1013904223u;
+        return state >> 20;
+    };
+    auto sorted_keys = [&](std::vector<Element> & elements, std::size_t const count) {
+        std::uint32_t key = 1000u + random_key();
+        for (std::size_t i = 0; i < count; ++i) {
+            key += random_key() % 3u;
+            elements.push_back(Element{key, static_cast<std::uint32_t>(elements.size())});
+        }
+    };
+    auto random_keys = [&](std::vector<Element> & elements, std::size_t const count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            elements.push_back(Element{random_key(), static_cast<std::uint32_t>(elements.size())});
+        }
+    };
+    // Each key is smaller than the one before, so the sorted prefix ends.
+    auto descending_keys = [&](std::vector<Element> & elements, std::size_t const count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            elements.push_back(Element{elements.back().key - 1u - random_key() % 3u,
+                                       static_cast<std::uint32_t>(elements.size())});
+        }
+    };
+
+    // The output must be the input, in order.
+    auto sort = [&](std::vector<Element> const & elements,
+                    std::size_t const run_size,
+                    bool * const input_is_sorted) {
+        std::vector<Element> result;
+        sorted_sizes.clear();
+        auto sorter = externalSort(less,
+                                   sort_run,
+                                   run_size * sizeof(Element),
+                                   "unit_test_external_sort_",
+                                   input_is_sorted)
+                              .build(VectorSinkBuilder<Element>{&result})
+                              .template build<Element>();
+        for (auto const & e : elements) { sorter.sink(e); }
+        std::move(sorter).finalize();
+
+        std::vector<bool> seen(elements.size(), false);
+        bool ok = result.size() == elements.size();
+        for (std::size_t i = 0; ok && i < result.size(); ++i) {
+            ok = result[i].original_index < elements.size() && !seen[result[i].original_index]
+                 && result[i].key == elements[result[i].original_index].key
+                 && (i == 0u || !less(result[i], result[i - 1u]));
+            seen[result[i].original_index] = true;
+        }
+        return ok;
+    };
+    bool ok = true;
+
+    // In memory: A sorted run is not sorted, a run with a short unsorted tail
+    // gets only the tail sorted, and anything else is sorted as a whole.
+    std::vector<Element> sorted;
+    sorted_keys(sorted, 1000u);
+    ok = ok && sort(sorted, 1000u, nullptr) && sorted_sizes.empty();
+    auto tail = sorted;
+    tail.resize(900u);
+    descending_keys(tail, 100u);
+    ok = ok && sort(tail, 1000u, nullptr) && sorted_sizes == std::vector<std::size_t>{100u};
+    auto long_tail = sorted;
+    long_tail.resize(500u);
+    random_keys(long_tail, 500u);
+    ok = ok && sort(long_tail, 1000u, nullptr) && sorted_sizes == std::vector<std::size_t>{1000u};
+
+    // Spilled into runs of 256 elements: A sorted run, a run with a tail of
+    // 32 (1/8 of the run), a random run, and a partial run with a tail.
+    std::vector<Element> runs;
+    sorted_keys(runs, 256u);
+    sorted_keys(runs, 224u);
+    descending_keys(runs, 32u);
+    random_keys(runs, 256u);
+    sorted_keys(runs, 90u);
+    descending_keys(runs, 10u);
+    ok = ok && sort(runs, 256u, nullptr)
+         && sorted_sizes == std::vector<std::size_t>{32u, 256u, 10u};
+
+    // An input expected to be sorted is passed through once its first run
+    // turned out to be in order, and the order of the rest is verified.
+    bool input_is_sorted = true;
+    ok = ok && sort(sorted, 256u, &input_is_sorted) && sorted_sizes.empty() && input_is_sorted;
+    bool thrown = false;
+    try {
+        sort(tail, 256u, &input_is_sorted);
+    } catch (sharemind_hi::enclave::EnclaveException const &) {
+        thrown = true;
+    }
+    ok = ok && thrown;
+    // If the first run is not in order, the input is sorted after all, in
+    // memory or in runs.
+    input_is_sorted = true;
+    ok = ok && sort(long_tail, 1000u, &input_is_sorted) && !input_is_sorted;
+    std::vector<Element> unsorted_start;
+    random_keys(unsorted_start, 100u);
+    sorted_keys(unsorted_start, 500u);
+    input_is_sorted = true;
+    ok = ok && sort(unsorted_start, 256u, &input_is_sorted) && !input_is_sorted
+         && sorted_sizes == std::vector<std::size_t>{256u};
+
+    if (!ok) { enclave_printf_log("Failed test %s", __func__); }
+    return ok;
+}
+
+/** A key and a value, for the tests of the stream combinators. */
+struct KeyValue {
+    std::uint32_t key;
+    std::uint32_t value;
+};
+
+bool unique_outer_join() {
+    using namespace eurostat::enclave;
+    struct Joined {
+        std::uint32_t key;
+        /** 0 if the side has no element with the key. */
+        std::uint32_t a;
+        std::uint32_t b;
+    };
+    auto join = [](std::vector<KeyValue> a, std::vector<KeyValue> b) {
+        auto const key = [](KeyValue const & e) noexcept { return e.key; };
+        auto source = uniqueOuterJoin(VectorSource<KeyValue>{std::move(a)},
+                                      VectorSource<KeyValue>{std::move(b)},
+                                      key,
+                                      key,
+                                      [](KeyValue const * a, KeyValue const * b) noexcept {
+                                          return Joined{a ? a->key : b->key,
+                                                        a ? a->value : 0u,
+                                                        b ? b->value : 0u};
+                                      });
+        std::vector<Joined> result;
+        Joined e;
+        while (source.next(e)) { result.push_back(e); }
+        return result;
+    };
+    auto equal = [](std::vector<Joined> const & result, std::vector<Joined> const & expected) {
+        if (result.size() != expected.size()) { return false; }
+        for (std::size_t i = 0; i < result.size(); ++i) {
+            if (result[i].key != expected[i].key || result[i].a != expected[i].a
+                || result[i].b != expected[i].b)
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Keys only on the left (1, 5), only on the right (2, 7), and on both
+    // sides (3, 6), starting and ending with either side.
+    std::vector<KeyValue> const a = {{1, 10}, {3, 30}, {5, 50}, {6, 60}};
+    std::vector<KeyValue> const b = {{2, 200}, {3, 300}, {6, 600}, {7, 700}};
+    bool ok = equal(join(a, b), {{1, 10, 0}, {2, 0, 200}, {3, 30, 300}, {5, 50, 0},
+                                 {6, 60, 600}, {7, 0, 700}});
+    ok = ok && equal(join(b, a), {{1, 0, 10}, {2, 200, 0}, {3, 300, 30}, {5, 0, 50},
+                                  {6, 600, 60}, {7, 700, 0}});
+    // Empty sides.
+    ok = ok && equal(join(a, {}), {{1, 10, 0}, {3, 30, 0}, {5, 50, 0}, {6, 60, 0}});
+    ok = ok && equal(join({}, b), {{2, 0, 200}, {3, 0, 300}, {6, 0, 600}, {7, 0, 700}});
+    ok = ok && equal(join({}, {}), {});
+
+    if (!ok) { enclave_printf_log("Failed test %s", __func__); }
+    return ok;
+}
+
+bool unique_merge() {
+    using namespace eurostat::enclave;
+    auto merge = [](std::vector<std::vector<KeyValue>> const & inputs) {
+        std::vector<VectorSource<KeyValue>> sources;
+        for (auto const & input : inputs) { sources.push_back(VectorSource<KeyValue>{input}); }
+        // Records the order in which the elements are combined.
+        auto source = uniqueMerge(std::move(sources),
+                                  [](KeyValue const & e) noexcept { return e.key; },
+                                  [](KeyValue & result, KeyValue const & other) noexcept {
+                                      result.value = result.value * 10u + other.value;
+                                  });
+        std::vector<KeyValue> result;
+        KeyValue e;
+        while (source.next(e)) { result.push_back(e); }
+        return result;
+    };
+    auto equal = [](std::vector<KeyValue> const & result, std::vector<KeyValue> const & expected) {
+        if (result.size() != expected.size()) { return false; }
+        for (std::size_t i = 0; i < result.size(); ++i) {
+            if (result[i].key != expected[i].key || result[i].value != expected[i].value) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // The keys 1 and 4 are in several sources, 2 and 3 in one each, and one
+    // source is empty.
+    bool ok = equal(merge({{{1, 1}, {4, 1}}, {{1, 2}, {2, 2}, {4, 2}}, {}, {{3, 4}, {4, 4}}}),
+                    {{1, 12}, {2, 2}, {3, 4}, {4, 124}});
+    ok = ok && equal(merge({{}, {{5, 1}}}), {{5, 1}});
+    ok = ok && equal(merge({{}, {}}), {});
+    ok = ok && equal(merge({}), {});
+
+    if (!ok) { enclave_printf_log("Failed test %s", __func__); }
+    return ok;
+}
+
+bool merge_duplicates() {
+    using namespace eurostat::enclave;
+    auto merge = [](std::vector<KeyValue> const & input, std::size_t & merges) {
+        std::vector<KeyValue> result;
+        merges = 0u;
+        auto pipe = mergeDuplicates([](KeyValue const & a, KeyValue const & b) noexcept {
+                                        return a.key == b.key;
+                                    },
+                                    [&merges](KeyValue & result, KeyValue const & duplicate) noexcept {
+                                        result.value += duplicate.value;
+                                        ++merges;
+                                    })
+                            .build(VectorSinkBuilder<KeyValue>{&result})
+                            .template build<KeyValue>();
+        for (auto const & e : input) { pipe.sink(e); }
+        std::move(pipe).finalize();
+        return result;
+    };
+    auto equal = [](std::vector<KeyValue> const & result, std::vector<KeyValue> const & expected) {
+        if (result.size() != expected.size()) { return false; }
+        for (std::size_t i = 0; i < result.size(); ++i) {
+            if (result[i].key != expected[i].key || result[i].value != expected[i].value) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Runs of duplicates at the start, in the middle and at the end. The
+    // merge is called once per duplicate beyond the first element of a run.
+    std::size_t merges = 0u;
+    bool ok = equal(merge({{1, 1}, {1, 2}, {1, 4}, {2, 1}, {3, 1}, {3, 2}, {4, 1}, {4, 2}, {4, 4}, {4, 8}},
+                          merges),
+                    {{1, 7}, {2, 1}, {3, 3}, {4, 15}});
+    ok = ok && merges == 6u;
+    ok = ok && equal(merge({{1, 1}, {2, 2}, {3, 3}}, merges), {{1, 1}, {2, 2}, {3, 3}}) && merges == 0u;
+    ok = ok && equal(merge({{1, 1}, {1, 1}}, merges), {{1, 2}}) && merges == 1u;
+    ok = ok && equal(merge({{1, 1}}, merges), {{1, 1}}) && merges == 0u;
+    ok = ok && equal(merge({}, merges), {}) && merges == 0u;
+
+    if (!ok) { enclave_printf_log("Failed test %s", __func__); }
+    return ok;
+}
+
+bool fan_out() {
+    using namespace eurostat::enclave;
+    std::size_t const partitions = 4;
+    std::vector<KeyValue> input;
+    std::uint32_t state = 42;
+    for (std::uint32_t i = 0; i < 10000; ++i) {
+        state = state * 1664525u + 1013904223u;
+        // The value gives the position, to check the order in each partition.
+        input.push_back(KeyValue{state >> 8, i});
+    }
+    auto partition_of = [partitions](KeyValue const & e) noexcept { return e.key % partitions; };
+
+    auto run = [&](std::size_t const max_threads) {
+        auto const previous_threads = BackgroundJob::maxThreads();
+        auto const threaded_before = BackgroundJob::statistics().threaded;
+        BackgroundJob::setMaxThreads(max_threads);
+        // Each consumer only touches its own partition.
+        std::vector<std::vector<KeyValue>> result(partitions);
+        std::vector<std::size_t> calls(partitions);
+        // Each read of the input covers at least one partition, and together
+        // they cover each partition once.
+        std::vector<std::size_t> reads(partitions);
+        // Small blocks, so the fan-out waits for the consumers.
+        fanOut([&input, &reads, &partition_of](std::size_t const first, std::size_t const end) {
+                   for (auto p = first; p < end; ++p) { ++reads[p]; }
+                   // Leaves out the other partitions, like the sorted H files.
+                   std::vector<KeyValue> elements;
+                   for (auto const & e : input) {
+                       if (first <= partition_of(e) && partition_of(e) < end) { elements.push_back(e); }
+                   }
+                   return VectorSource<KeyValue>{std::move(elements)};
+               },
+               partition_of,
+               [&result, &calls](std::size_t const p, FanOutSource<KeyValue> source) {
+                   ++calls[p];
+                   KeyValue e;
+                   while (source.next(e)) { result[p].push_back(e); }
+               },
+               partitions,
+               16u * sizeof(KeyValue));
+        auto const threaded = BackgroundJob::statistics().threaded - threaded_before;
+        BackgroundJob::setMaxThreads(previous_threads);
+
+        bool ok = threaded <= std::min(max_threads, partitions);
+        for (std::size_t p = 0; ok && p < partitions; ++p) { ok = reads[p] == 1u; }
+        for (std::size_t p = 0; ok && p < partitions; ++p) {
+            std::vector<KeyValue> expected;
+            for (auto const & e : input) {
+                if (partition_of(e) == p) { expected.push_back(e); }
+            }
+            ok = calls[p] == 1u && result[p].size() == expected.size();
+            for (std::size_t i = 0; ok && i < expected.size(); ++i) {
+                ok = result[p][i].key == expected[i].key
+                     && result[p][i].value == expected[i].value;
+            }
+        }
+        return ok;
+    };
+
+    // Without threads the input is read once per partition, with fewer
+    // threads than partitions once per partition without a thread.
+    bool ok = run(0u);
+    ok = ok && run(2u);
+    ok = ok && run(partitions);
+
+    if (!ok) { enclave_printf_log("Failed test %s", __func__); }
+    return ok;
+}
+
+bool calibration_sums() {
+    using namespace eurostat::enclave;
+    using namespace eurostat::enclave::full_analysis::module_d;
+    TileIndex const a{10, 10}, b{20, 20}, c{30, 30}, d{40, 40}, e{50, 50};
+    ReferenceAreas areas;
+    areas.add(0, a);
+    areas.add(1, b);
+    areas.add(70, c);
+    auto const weight_of = [&](TileIndex const anchor) {
+        return anchor == a ? 0.2 : anchor == b ? 10.0 : anchor == d ? 1.5 : 1.0;
+    };
+
+    // The users in the order of Y, each with its tiles by rank, so the first
+    // tile is the top anchor tile.
+    std::vector<std::vector<TileIndex>> const users = {
+            {a, d}, {b, d, e}, {c, d}, {a, c, e}, {d}, {d, a}, {a, d}, {e, b, c}, {b, d, e}};
+    std::vector<QuantisedFootprint> y;
+    for (std::size_t user = 0; user < users.size(); ++user) {
+        QuantisedFootprint record;
+        record.key.id.fill(static_cast<std::uint8_t>(user));
+        record.calibration_weight = weight_of(users[user].front());
+        record.reference_area_indices.reset();
+        for (auto const tile : users[user]) { record.reference_area_indices |= areas.areasOf(tile); }
+        record.rank = QuantisedFootprint::FirstRank;
+        for (auto const tile : users[user]) {
+            record.key.tile = tile;
+            for (std::size_t i = 0; i < record.values.size(); ++i) {
+                record.values[i] = ((user + record.rank + i) % 3u) != 0u;
+            }
+            y.push_back(record);
+            ++record.rank;
+        }
+    }
+
+    // The weights applied to each Y record.
+    ConnectionStrengthSums expected_strengths{areas};
+    TileGrid<std::array<double, num_subperiods>> expected_totals;
+    for (auto const & record : y) {
+        expected_strengths.add(record);
+        auto & total = expected_totals[record.key.tile];
+        for (std::size_t i = 0; i < total.size(); ++i) {
+            total[i] += record.calibration_weight * record.values[i];
+        }
+    }
+
+    auto check = [&](std::size_t const budget) {
+        std::vector<CalibrationSums> sums;
+        auto aggregation = aggregateByTile(
+                                   [](AnchoredY const & e) noexcept { return e.key; },
+                                   [](AnchoredY const & e) noexcept {
+                                       CalibrationSums result{};
+                                       result.key = e.key;
+                                       return result;
+                                   },
+                                   add_calibration_sums,
+                                   budget * (sizeof(CalibrationSums) + sizeof(CalibrationKey)
+                                             + 4u * sizeof(DenseIds<CalibrationKey>::Id)),
+                                   "unit_test_calibration_sums_")
+                                   .build(VectorSinkBuilder<CalibrationSums>{&sums})
+                                   .template build<AnchoredY>();
+        AddAnchorTile add_anchor_tile;
+        for (auto const & record : y) { aggregation.sink(add_anchor_tile(record)); }
+        std::move(aggregation).finalize();
+
+        // The weights applied to the sums give the same totals and connection
+        // strengths, the sums are in tile order.
+        ConnectionStrengthSums strengths{areas};
+        TileGrid<std::array<double, num_subperiods>> totals;
+        bool ok = !sums.empty();
+        for (std::size_t i = 0; ok && i < sums.size(); ++i) {
+            ok = i == 0u || !(sums[i].key.tile < sums[i - 1u].key.tile);
+            auto const calibrated = calibrate(sums[i], weight_of(sums[i].key.anchor));
+            strengths.add(calibrated.tile, calibrated.areas, calibrated.users);
+            auto & total = totals[calibrated.tile];
+            for (std::size_t j = 0; j < total.size(); ++j) { total[j] += calibrated.values[j]; }
+        }
+        auto close = [](double const value, double const expected) {
+            return std::abs(value - expected) <= 1e-9 * std::abs(expected);
+        };
+        ok = ok && totals.size() == expected_totals.size();
+        expected_totals.forEach([&](TileIndex const tile, std::array<double, num_subperiods> const & expected) {
+            auto const total = totals.find(tile);
+            ok = ok && total;
+            for (std::size_t i = 0; ok && i < expected.size(); ++i) { ok = close((*total)[i], expected[i]); }
+        });
+
+        // The reports differ in the order of the tiles within an area.
+        auto by_key = [](FunctionalUrbanFingerprintReport const & l, FunctionalUrbanFingerprintReport const & r) {
+            return l.key.reference_area_index != r.key.reference_area_index
+                           ? l.key.reference_area_index < r.key.reference_area_index
+                           : l.key.tile_index < r.key.tile_index;
+        };
+        auto report = strengths.report();
+        auto expected_report = expected_strengths.report();
+        std::sort(report.begin(), report.end(), by_key);
+        std::sort(expected_report.begin(), expected_report.end(), by_key);
+        ok = ok && !expected_report.empty() && report.size() == expected_report.size();
+        for (std::size_t i = 0; ok && i < report.size(); ++i) {
+            ok = report[i].key.reference_area_index == expected_report[i].key.reference_area_index
+                 && report[i].key.tile_index == expected_report[i].key.tile_index
+                 && close(report[i].strength, expected_report[i].strength);
+        }
+        if (!ok) { enclave_printf_log("Failed test calibration_sums (%zu)", budget); }
+        return ok;
+    };
+
+    // A budget of a single key spills all keys.
+    bool ok = check(1u);
+    ok = check(1000u) && ok;
+    return ok;
+}
+
+bool s_segments() {
+    using namespace eurostat::enclave;
+    std::string const prefix = "unit_test_s_";
+    std::size_t const buffer_size = 1u << 12u;
+    auto record = [](std::uint8_t const user, float const value) {
+        AccumulatedUserFootprint result = {};
+        result.key.id.fill(user);
+        result.key.tile = TileIndex{user, 7};
+        result.i_column.fill(value);
+        return result;
+    };
+    auto equal = [](std::vector<AccumulatedUserFootprint> const & a,
+                    std::vector<AccumulatedUserFootprint> const & b)
+    {
+        return a.size() == b.size()
+               && std::memcmp(a.data(), b.data(), a.size() * sizeof(a[0])) == 0;
+    };
+
+    // The model of S, ordered by the user. An update changes the values of
+    // `changed_users`, adds the missing ones, and passes all records of S to
+    // the output, like the state update does.
+    std::vector<AccumulatedUserFootprint> s;
+    auto update = [&](SSegments & segments,
+                      std::vector<std::uint8_t> const & changed_users,
+                      float const value,
+                      bool const compress)
+    {
+        for (auto const user : changed_users) {
+            auto const it = std::lower_bound(
+                    s.begin(), s.end(), record(user, 0.0f),
+                    [](AccumulatedUserFootprint const & a, AccumulatedUserFootprint const & b) {
+                        return a.key < b.key;
+                    });
+            if (it == s.end() || !(it->key == record(user, 0.0f).key)) {
+                s.insert(it, record(user, value));
+            } else {
+                *it = record(user, value);
+            }
+        }
+        auto output = sSegmentsOutput(prefix, buffer_size, segments, compress)
+                              .template build<SUpdate>();
+        for (auto const & e : s) {
+            SUpdate u;
+            u.record = e;
+            u.changed = std::find(changed_users.begin(),
+                                  changed_users.end(),
+                                  e.key.id[0]) != changed_users.end();
+            output.sink(u);
+        }
+        std::move(output).finalize();
+    };
+    auto read = [&](SSegments const & segments) {
+        std::vector<AccumulatedUserFootprint> result;
+        SSegmentsSource source{prefix, segments, buffer_size};
+        AccumulatedUserFootprint e;
+        while (source.next(e)) { result.push_back(e); }
+        return result;
+    };
+    auto paths = [&](SSegments const & segments) {
+        std::vector<std::string> result;
+        segments.collectPaths(prefix, result);
+        return result;
+    };
+
+    // An empty S is written as a base segment first.
+    SSegments segments = {};
+    bool ok = segments.empty() && segments.needsCompaction() && read(segments).empty()
+              && paths(segments).empty();
+    std::vector<std::uint8_t> users;
+    for (std::uint8_t user = 0; user < 200; user += 2) { users.push_back(user); }
+    update(segments, users, 0.0f, false);
+    ok = ok && segments.base.id == 1u && segments.base.records == 100u
+         && segments.num_deltas == 0u && !segments.needsCompaction()
+         && equal(read(segments), s);
+
+    // Deltas hold only the changed records, the newest segment wins on equal
+    // keys, and raw and compressed segments can be mixed.
+    update(segments, {10, 20, 21}, 1.0f, true);
+    update(segments, {10, 199}, 2.0f, false);
+    update(segments, {0, 21}, 3.0f, true);
+    ok = ok && segments.num_deltas == 3u && segments.deltas[0].records == 3u
+         && segments.deltas[0].compressed && segments.deltas[1].records == 2u
+         && !segments.deltas[1].compressed && segments.deltas[2].records == 2u
+         && segments.last_id == 4u && !segments.needsCompaction();
+    auto const merged = read(segments);
+    ok = ok && merged.size() == 102u && equal(merged, s);
+
+    // The delta records reach `s_compaction_ratio` of the base.
+    std::vector<std::uint8_t> many;
+    for (std::uint8_t user = 100; many.size() + 7u < s_compaction_ratio * 100u; user += 2) {
+        many.push_back(user);
+    }
+    update(segments, many, 4.0f, false);
+    ok = ok && segments.needsCompaction();
+    auto const replaced = paths(segments);
+    std::vector<std::string> expected = {prefix + "1", prefix + "2", prefix + "3",
+                                         prefix + "4", prefix + "5"};
+    ok = ok && replaced == expected;
+
+    // The compaction writes all records into one base segment.
+    update(segments, {1}, 5.0f, true);
+    ok = ok && segments.base.id == 6u && segments.base.records == 103u
+         && segments.base.compressed && segments.num_deltas == 0u
+         && !segments.needsCompaction() && equal(read(segments), s)
+         && paths(segments) == std::vector<std::string>{prefix + "6"};
+
+    // At most `MAX_DELTAS` deltas, even if they are small.
+    for (std::size_t i = 0; ok && i < SSegments::MAX_DELTAS; ++i) {
+        ok = !segments.needsCompaction();
+        update(segments, {static_cast<std::uint8_t>(2u * i)}, 6.0f + i, i % 2u == 0u);
+    }
+    ok = ok && segments.num_deltas == SSegments::MAX_DELTAS && segments.needsCompaction()
+         && equal(read(segments), s) && paths(segments).size() == SSegments::MAX_DELTAS + 1u;
+    update(segments, {}, 0.0f, false);
+    ok = ok && segments.num_deltas == 0u && segments.base.records == 103u
+         && !segments.base.compressed && equal(read(segments), s)
+         && paths(segments) == std::vector<std::string>{prefix + "15"};
+
+    if (!ok) { enclave_printf_log("Failed test %s", __func__); }
+    return ok;
+}
+
+bool connection_strength_sums() {
+    using namespace eurostat::enclave;
+    TileIndex const a{10, 10}, b{20, 20}, c{30, 30}, d{40, 40}, e{50, 50}, f{60, 60};
+    // The area 70 is in the second word of the bits, and the numerators of
+    // each tile span all 71 areas.
+    ReferenceAreas areas;
+    areas.add(0, a);
+    areas.add(1, b);
+    areas.add(70, c);
+
+    ConnectionStrengthSums sums{areas};
+    bool ok = sums.empty();
+    auto add_user = [&](std::vector<TileIndex> const & tiles, double const weight) {
+        QuantisedFootprint y;
+        y.calibration_weight = weight;
+        for (auto const tile : tiles) { y.reference_area_indices |= areas.areasOf(tile); }
+        for (auto const tile : tiles) {
+            y.key.tile = tile;
+            sums.add(y);
+        }
+    };
+    add_user({a, d}, 1.0);
+    add_user({b, d, e}, 2.0);
+    add_user({c, d}, 1.5);
+    add_user({a, c, e}, 1.0);
+    add_user({d}, 1.0);
+    // Below the SDC threshold.
+    add_user({f, b}, 0.5);
+    ok = ok && !sums.empty();
+
+    // By area, then by the tile in the order of the first record, without
+    // the tiles inside the area. The denominators are a: 2, b: 2.5, c: 2.5,
+    // d: 5.5, e: 3 and f: 0.5.
+    struct Expected {
+        ReferenceAreaIndex area;
+        TileIndex tile;
+        double strength;
+    };
+    std::vector<Expected> const expected = {
+            {0, d, 1.0 / 5.5},
+            {0, e, 1.0 / 3.0},
+            {0, c, 1.0 / 2.5},
+            {1, d, 2.0 / 5.5},
+            {1, e, 2.0 / 3.0},
+            {70, a, 1.0 / 2.0},
+            {70, d, 1.5 / 5.5},
+            {70, e, 1.0 / 3.0},
+    };
+    auto const report = sums.report();
+    ok = ok && report.size() == expected.size();
+    for (std::size_t i = 0; ok && i < report.size(); ++i) {
+        FunctionalUrbanFingerprintReport const r = report[i];
+        ok = r.key.reference_area_index == expected[i].area
+             && r.key.tile_index == expected[i].tile && r.strength == expected[i].strength;
+    }
+
+    if (!ok) { enclave_printf_log("Failed test %s", __func__); }
+    return ok;
+}
+
 void main(bool & ok) {
     std::size_t total = 0u;
     std::size_t success = 0u;
@@ -264,7 +1347,22 @@ void main(bool & ok) {
     try {
         count(decrypt_pseudonym1());
         count(decrypt_pseudonym2());
+        count(decrypt_pseudonym_batch());
+        count(pseudonym_cache());
+        count(radix_sort());
+        count(reference_areas());
+        count(tile_grid());
         count(log2histogram());
+        count(s_block());
+        count(tile_aggregation());
+        count(external_sort());
+        count(unique_outer_join());
+        count(unique_merge());
+        count(merge_duplicates());
+        count(fan_out());
+        count(calibration_sums());
+        count(s_segments());
+        count(connection_strength_sums());
 
         enclave_printf("Success rate: %u / %u\n", success, total);
         ok = total == success;